@@ -0,0 +1,303 @@
+// allocator stress: random allocate / free sequences through TlsfAllocator
+// and GpuAllocator, validate() after every step. live ranges are also kept
+// on the side, a new one must be aligned and overlap none of them, and host
+// visible ones keep a tag written at both ends until freed.
+// the gpu part needs a vulkan device, a software one is enough, e.g.
+// lavapipe with VK_DRIVER_FILES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json.
+// exits 77 (skipped) without a device.
+// usage: gpu_allocator_stress [steps] [seed]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "render/gpu_allocator.hpp"
+#include "util/tlsf_allocator.hpp"
+
+using namespace LLShader;
+
+namespace {
+
+constexpr int skipped = 77;
+
+// offset -> end of the live ranges of one memory / allocator.
+typedef std::map<u_int64_t, u_int64_t> RangeMap;
+
+// false if [offset, offset + size) overlaps a live range.
+bool insertRange(RangeMap& ranges, u_int64_t offset, u_int64_t size) {
+  auto next = ranges.lower_bound(offset);
+  if (next != ranges.end() && next->first < offset + size) return false;
+  if (next != ranges.begin() && std::prev(next)->second > offset) return false;
+  ranges[offset] = offset + size;
+  return true;
+}
+
+// mostly small requests, few large ones, like buffers & textures.
+u_int64_t randomSize(std::mt19937_64& random, u_int64_t large) {
+  switch (random() % 8) {
+    case 0:
+      return 1 + random() % large;
+    case 1:
+    case 2:
+      return 1 + random() % 65536;
+    default:
+      return 1 + random() % 1024;
+  }
+}
+
+u_int64_t randomAlignment(std::mt19937_64& random) {
+  return 1ull << (random() % 17);
+}
+
+bool stressTlsf(u_int64_t steps, u_int64_t seed) {
+  typedef struct {
+    u_int64_t offset;
+    u_int32_t node;
+  } Live;
+
+  std::mt19937_64 random(seed);
+  TlsfAllocator tlsf(64ull << 20);
+  std::vector<Live> live;
+  RangeMap ranges;
+  u_int64_t failed = 0;
+
+  for (u_int64_t step = 0; step < steps; ++step) {
+    // grow until half full, then hold around it.
+    bool grow = live.empty() || random() % 100 < (live.size() < 2000 ? 60 : 45);
+    if (grow) {
+      u_int64_t size = randomSize(random, 4ull << 20);
+      u_int64_t alignment = randomAlignment(random);
+      Live allocation;
+      if (!tlsf.allocate(size, alignment, allocation.offset,
+                         allocation.node)) {
+        ++failed;
+        continue;
+      }
+      if (allocation.offset % alignment != 0 ||
+          allocation.offset + size > tlsf.getSize() ||
+          !insertRange(ranges, allocation.offset, size)) {
+        printf("tlsf step %llu: bad range %llu + %llu\n",
+               static_cast<unsigned long long>(step),
+               static_cast<unsigned long long>(allocation.offset),
+               static_cast<unsigned long long>(size));
+        return false;
+      }
+      live.push_back(allocation);
+    } else {
+      size_t i = random() % live.size();
+      tlsf.free(live[i].node);
+      ranges.erase(live[i].offset);
+      live[i] = live.back();
+      live.pop_back();
+    }
+    if (!tlsf.validate() || tlsf.getAllocationCount() != live.size()) {
+      printf("tlsf step %llu: validate failed\n",
+             static_cast<unsigned long long>(step));
+      return false;
+    }
+  }
+
+  for (const auto& allocation : live) tlsf.free(allocation.node);
+  bool ok = tlsf.validate() && tlsf.isEmpty() && tlsf.getUsedBytes() == 0;
+  printf("tlsf: %llu steps, %llu full, empty after free all: %s\n",
+         static_cast<unsigned long long>(steps),
+         static_cast<unsigned long long>(failed), ok ? "yes" : "no");
+  return ok;
+}
+
+typedef struct {
+  VkInstance instance;
+  VkPhysicalDevice physical_device;
+  VkDevice device;
+} Device;
+
+bool createDevice(Device& out) {
+  VkApplicationInfo app_info{
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = "gpu_allocator_stress",
+      .apiVersion = VK_API_VERSION_1_1,
+  };
+  VkInstanceCreateInfo instance_info{
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &app_info,
+  };
+  if (vkCreateInstance(&instance_info, nullptr, &out.instance) != VK_SUCCESS)
+    return false;
+
+  u_int32_t count = 1;
+  VkResult result =
+      vkEnumeratePhysicalDevices(out.instance, &count, &out.physical_device);
+  if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || count == 0) {
+    vkDestroyInstance(out.instance, nullptr);
+    return false;
+  }
+
+  float priority = 1.0f;
+  VkDeviceQueueCreateInfo queue_info{
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+      .pQueuePriorities = &priority,
+  };
+  VkDeviceCreateInfo device_info{
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .queueCreateInfoCount = 1,
+      .pQueueCreateInfos = &queue_info,
+  };
+  if (vkCreateDevice(out.physical_device, &device_info, nullptr,
+                     &out.device) != VK_SUCCESS) {
+    vkDestroyInstance(out.instance, nullptr);
+    return false;
+  }
+  return true;
+}
+
+bool stressGpuAllocator(const Device& device, u_int64_t steps,
+                        u_int64_t seed) {
+  typedef struct {
+    GpuAllocation allocation;
+    u_int64_t tag;
+  } Live;
+
+  // small blocks, so blocks are created, filled and released often, and
+  // requests over half a block go dedicated.
+  constexpr VkDeviceSize block_size = 1 << 20;
+  GpuAllocator allocator;
+  allocator.init(device.physical_device, device.device, block_size);
+
+  const auto& memory = allocator.getMemoryProperties();
+  const VkMemoryPropertyFlags properties[] = {
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+  };
+  u_int32_t all_types = (1u << memory.memoryTypeCount) - 1;
+
+  std::mt19937_64 random(seed);
+  std::vector<Live> live;
+  std::map<VkDeviceMemory, RangeMap> ranges;
+
+  // tag at both ends, once if they would overlap.
+  auto tagOffsets = [](const GpuAllocation& allocation, size_t& bytes,
+                       size_t& tail) {
+    bytes = std::min<size_t>(sizeof(u_int64_t), allocation.size);
+    tail = allocation.size >= 2 * bytes ? allocation.size - bytes : 0;
+  };
+  auto writeTag = [&](const GpuAllocation& allocation, u_int64_t tag) {
+    size_t bytes, tail;
+    tagOffsets(allocation, bytes, tail);
+    auto* p = static_cast<unsigned char*>(allocation.mapped);
+    memcpy(p, &tag, bytes);
+    memcpy(p + tail, &tag, bytes);
+  };
+  auto checkTag = [&](const GpuAllocation& allocation, u_int64_t tag) {
+    size_t bytes, tail;
+    tagOffsets(allocation, bytes, tail);
+    auto* p = static_cast<const unsigned char*>(allocation.mapped);
+    return memcmp(p, &tag, bytes) == 0 && memcmp(p + tail, &tag, bytes) == 0;
+  };
+
+  for (u_int64_t step = 0; step < steps; ++step) {
+    bool grow = live.empty() || random() % 100 < (live.size() < 500 ? 60 : 45);
+    if (grow) {
+      VkMemoryRequirements requirements{
+          .size = randomSize(random, block_size),
+          .alignment = randomAlignment(random),
+          .memoryTypeBits = all_types,
+      };
+      auto property = properties[random() % 3];
+      auto kind = random() % 2 ? GpuResourceKind::kLinear
+                               : GpuResourceKind::kOptimal;
+      Live entry;
+      entry.tag = step + 1;
+      try {
+        entry.allocation = allocator.allocate(requirements, property, kind);
+      } catch (const std::runtime_error& error) {
+        printf("gpu step %llu: %s\n", static_cast<unsigned long long>(step),
+               error.what());
+        return false;
+      }
+
+      const auto& allocation = entry.allocation;
+      if (allocation.offset % requirements.alignment != 0 ||
+          allocation.size < requirements.size ||
+          !insertRange(ranges[allocation.memory], allocation.offset,
+                       allocation.size)) {
+        printf("gpu step %llu: bad range %llu + %llu\n",
+               static_cast<unsigned long long>(step),
+               static_cast<unsigned long long>(allocation.offset),
+               static_cast<unsigned long long>(allocation.size));
+        return false;
+      }
+      if (allocation.mapped) writeTag(allocation, entry.tag);
+      live.push_back(entry);
+    } else {
+      size_t i = random() % live.size();
+      auto& allocation = live[i].allocation;
+      if (allocation.mapped && !checkTag(allocation, live[i].tag)) {
+        printf("gpu step %llu: tag of allocation %llu overwritten\n",
+               static_cast<unsigned long long>(step),
+               static_cast<unsigned long long>(live[i].tag));
+        return false;
+      }
+      auto& memory_ranges = ranges[allocation.memory];
+      memory_ranges.erase(allocation.offset);
+      // a released block may come back with the same handle.
+      if (memory_ranges.empty()) ranges.erase(allocation.memory);
+      allocator.free(allocation);
+      live[i] = live.back();
+      live.pop_back();
+    }
+
+    if (!allocator.validate() ||
+        allocator.getStats().allocation_count != live.size()) {
+      printf("gpu step %llu: validate failed\n",
+             static_cast<unsigned long long>(step));
+      return false;
+    }
+  }
+
+  auto stats = allocator.getStats();
+  printf("gpu: %llu steps, %zu live, %u blocks, %u dedicated, peak %.2f MiB\n",
+         static_cast<unsigned long long>(steps), live.size(),
+         stats.block_count, stats.dedicated_count,
+         stats.peak_used_bytes / 1048576.0);
+
+  for (auto& entry : live) allocator.free(entry.allocation);
+  stats = allocator.getStats();
+  bool ok = allocator.validate() && stats.allocation_count == 0 &&
+            stats.used_bytes == 0 && stats.dedicated_count == 0;
+  allocator.dispose();
+  printf("gpu: empty after free all: %s\n", ok ? "yes" : "no");
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  u_int64_t steps = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+  u_int64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  bool ok = stressTlsf(steps * 10, seed);
+
+  Device device;
+  if (!createDevice(device)) {
+    printf("no vulkan device, gpu allocator skipped\n");
+    return ok ? skipped : EXIT_FAILURE;
+  }
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device.physical_device, &properties);
+  printf("device: %s\n", properties.deviceName);
+
+  ok = stressGpuAllocator(device, steps, seed) && ok;
+
+  vkDestroyDevice(device.device, nullptr);
+  vkDestroyInstance(device.instance, nullptr);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
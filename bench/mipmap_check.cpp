@@ -0,0 +1,145 @@
+// mipmap check: generateMipChain() against generateMipChainScalar(), every
+// level and channel may differ by at most 1. synthetic images cover odd and
+// tiny sizes, the image file is also timed, best of runs for each path.
+// usage: mipmap_check [image] [runs]
+
+#define STB_IMAGE_IMPLEMENTATION
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "3rd/stb/stb_image.h"
+#include "util/mipmap_generator.hpp"
+#include "util/thread_pool.hpp"
+
+using namespace LLShader;
+
+namespace {
+
+constexpr int max_channel_diff = 1;
+
+std::vector<unsigned char> makeNoise(u_int32_t width, u_int32_t height,
+                                     u_int32_t seed) {
+  std::mt19937 random(seed);
+  std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+  for (auto& c : rgba) c = static_cast<unsigned char>(random() & 0xff);
+  return rgba;
+}
+
+// smooth ramps, rounding differences show up here rather than on noise.
+std::vector<unsigned char> makeGradient(u_int32_t width, u_int32_t height) {
+  std::vector<unsigned char> rgba(static_cast<size_t>(width) * height * 4);
+  for (u_int32_t y = 0; y < height; ++y) {
+    for (u_int32_t x = 0; x < width; ++x) {
+      unsigned char* p = rgba.data() + (static_cast<size_t>(y) * width + x) * 4;
+      p[0] = static_cast<unsigned char>(x * 255 / std::max(width - 1, 1u));
+      p[1] = static_cast<unsigned char>(y * 255 / std::max(height - 1, 1u));
+      p[2] = static_cast<unsigned char>((x + y) & 0xff);
+      p[3] = static_cast<unsigned char>(255 - p[0]);
+    }
+  }
+  return rgba;
+}
+
+// largest channel difference over all levels, -1 if the layouts differ.
+int maxChainDiff(const MipChain& a, const MipChain& b) {
+  if (a.levels.size() != b.levels.size() ||
+      a.pixels.size() != b.pixels.size()) {
+    return -1;
+  }
+  for (size_t i = 0; i < a.levels.size(); ++i) {
+    if (a.levels[i].width != b.levels[i].width ||
+        a.levels[i].height != b.levels[i].height ||
+        a.levels[i].offset != b.levels[i].offset) {
+      return -1;
+    }
+  }
+  int diff = 0;
+  for (size_t i = 0; i < a.pixels.size(); ++i) {
+    diff = std::max(diff, std::abs(a.pixels[i] - b.pixels[i]));
+  }
+  return diff;
+}
+
+bool checkImage(const char* name, const unsigned char* rgba, u_int32_t width,
+                u_int32_t height) {
+  bool ok = true;
+  for (bool srgb : {true, false}) {
+    MipChain fast, scalar;
+    generateMipChain(rgba, width, height, fast, srgb);
+    generateMipChainScalar(rgba, width, height, scalar, srgb);
+    int diff = maxChainDiff(fast, scalar);
+    bool passed = diff >= 0 && diff <= max_channel_diff;
+    printf("  %-10s %5ux%-5u %-5s levels %2zu max diff %d%s\n", name, width,
+           height, srgb ? "srgb" : "unorm", fast.levels.size(), diff,
+           passed ? "" : "  FAILED");
+    ok = passed && ok;
+  }
+  return ok;
+}
+
+template <typename F>
+double bestMs(int runs, F&& run) {
+  double best = 1e30;
+  for (int i = 0; i < runs; ++i) {
+    auto begin = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::milli>(end - begin).count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string file =
+      argc > 1 ? argv[1]
+               : std::string(BENCH_ASSET_DIR) +
+                     "/obj2mesh/assets/mary/MC003_Kozakura_Mari.png";
+  int runs = argc > 2 ? std::max(atoi(argv[2]), 1) : 5;
+
+  bool ok = true;
+  printf("synthetic\n");
+  const u_int32_t sizes[][2] = {{1, 1},  {2, 2},   {3, 1},     {1, 5},
+                                {7, 5},  {64, 64}, {257, 129}, {1000, 3},
+                                {512, 512}};
+  for (const auto& size : sizes) {
+    auto noise = makeNoise(size[0], size[1], size[0] * 31 + size[1]);
+    ok = checkImage("noise", noise.data(), size[0], size[1]) && ok;
+    auto gradient = makeGradient(size[0], size[1]);
+    ok = checkImage("gradient", gradient.data(), size[0], size[1]) && ok;
+  }
+
+  int width, height, channels;
+  unsigned char* rgba =
+      stbi_load(file.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (!rgba) {
+    printf("failed to load %s\n", file.c_str());
+    return EXIT_FAILURE;
+  }
+  printf("%s\n", file.c_str());
+  ok = checkImage("image", rgba, width, height) && ok;
+
+  MipChain chain;
+  double fast_ms = bestMs(runs, [&] {
+    generateMipChain(rgba, width, height, chain);
+  });
+  double scalar_ms = bestMs(runs, [&] {
+    generateMipChainScalar(rgba, width, height, chain);
+  });
+  printf("  srgb chain, best of %d: fast %.2f ms (%zu threads), scalar "
+         "%.2f ms, %.1fx\n",
+         runs, fast_ms, getGlobalThreadPool().getWorkerCount() + 1, scalar_ms,
+         scalar_ms / fast_ms);
+  stbi_image_free(rgba);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
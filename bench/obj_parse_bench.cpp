@@ -0,0 +1,194 @@
+// parseObjFile() against tinyobj on the same file: both must read the same
+// attribute values and the same triangles per shape, then the best of runs
+// is printed for each.
+// a synthetic file with quads, negative indices and several groups, spread
+// over many parse chunks, is checked first. the bundled meshes are all
+// triangles with positive indices.
+// usage: obj_parse_bench [file.obj] [runs]
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#define TINYOBJLOADER_USE_MAPBOX_EARCUT
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "3rd/tinyobjloader/tiny_obj_loader.h"
+#include "util/obj_parser.hpp"
+#include "util/thread_pool.hpp"
+
+using namespace LLShader;
+
+namespace {
+
+// best of runs, in ms.
+double bestMs(int runs, const std::function<void()>& func) {
+  double best = 1e30;
+  for (int i = 0; i < runs; ++i) {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::milli>(end - begin).count());
+  }
+  return best;
+}
+
+// height field of size x size vertices, one group per 16 rows. faces use
+// negative indices into the rows emitted so far, heights are random so both
+// quad diagonals get picked.
+void writeSyntheticObj(const std::string& file, u_int32_t size) {
+  std::mt19937 random(7);
+  std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+  std::ofstream out(file, std::ios::trunc);
+  out << "# obj_parse_bench synthetic\nmtllib none.mtl\n";
+  for (u_int32_t row = 0; row < size; ++row) {
+    if (row % 16 == 1) out << "g rows " << row << '\n';
+    // a group without faces, dropped by both.
+    if (row % 64 == 33) out << "o empty " << row << "\ng rows " << row << '\n';
+    for (u_int32_t col = 0; col < size; ++col) {
+      out << "v " << col * 0.25f << ' ' << height(random) << ' '
+          << row * 0.25f << '\n';
+      out << "vt " << col / float(size) << ' ' << row / float(size) << '\n';
+      out << "vn 0 1 " << height(random) * 0.1f << '\n';
+    }
+    if (row == 0) continue;
+    // vertex (r, c) is index r * size + c, negative index counts back from
+    // the end of what is emitted.
+    const int64_t count = int64_t(row + 1) * size;
+    auto ref = [&](u_int32_t r, u_int32_t c, bool texcoord) {
+      int64_t i = int64_t(r) * size + c - count;
+      return texcoord ? std::to_string(i) + '/' + std::to_string(i) + '/' +
+                            std::to_string(i)
+                      : std::to_string(i) + "//" + std::to_string(i);
+    };
+    for (u_int32_t col = 0; col + 1 < size; ++col) {
+      bool texcoord = col % 2 == 0;
+      if (col % 7 == 3) {
+        // split by hand, positive indices.
+        auto a = (row - 1) * size + col + 1, b = a + 1;
+        auto c = row * size + col + 1, d = c + 1;
+        out << "f " << a << ' ' << b << ' ' << d << '\n';
+        out << "f " << a << ' ' << d << ' ' << c << '\n';
+        continue;
+      }
+      out << "f " << ref(row - 1, col, texcoord) << ' '
+          << ref(row - 1, col + 1, texcoord) << ' '
+          << ref(row, col + 1, texcoord) << ' ' << ref(row, col, texcoord)
+          << '\n';
+    }
+  }
+}
+
+// the two decimal parsers may round the last bit differently.
+bool sameFloats(const char* name, const std::vector<float>& a,
+                const std::vector<float>& b) {
+  if (a.size() != b.size()) {
+    printf("  %s: %zu values, tinyobj %zu\n", name, a.size(), b.size());
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::abs(a[i] - b[i]) > 1e-6f * std::max(1.0f, std::abs(b[i]))) {
+      printf("  %s[%zu]: %.9g, tinyobj %.9g\n", name, i, a[i], b[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// values, shape count and every triangle of every shape, first difference
+// is printed.
+bool sameAsTinyobj(const ObjData& data, const tinyobj::ObjReader& reader) {
+  const auto& attrib = reader.GetAttrib();
+  if (!sameFloats("vertices", data.vertices, attrib.vertices) ||
+      !sameFloats("normals", data.normals, attrib.normals) ||
+      !sameFloats("texcoords", data.texcoords, attrib.texcoords)) {
+    return false;
+  }
+
+  const auto& shapes = reader.GetShapes();
+  if (data.shapes.size() != shapes.size()) {
+    printf("  %zu shapes, tinyobj %zu\n", data.shapes.size(), shapes.size());
+    return false;
+  }
+  for (size_t s = 0; s < shapes.size(); ++s) {
+    const auto& indices = data.shapes[s].indices;
+    const auto& expected = shapes[s].mesh.indices;
+    if (indices.size() != expected.size()) {
+      printf("  shape %zu: %zu indices, tinyobj %zu\n", s, indices.size(),
+             expected.size());
+      return false;
+    }
+    for (size_t i = 0; i < indices.size(); ++i) {
+      if (indices[i].vertex_index != expected[i].vertex_index ||
+          indices[i].texcoord_index != expected[i].texcoord_index ||
+          indices[i].normal_index != expected[i].normal_index) {
+        printf("  shape %zu triangle %zu: v/vt/vn %d/%d/%d, tinyobj "
+               "%d/%d/%d\n",
+               s, i / 3, indices[i].vertex_index, indices[i].texcoord_index,
+               indices[i].normal_index, expected[i].vertex_index,
+               expected[i].texcoord_index, expected[i].normal_index);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool checkFile(const std::string& file, int runs) {
+  ObjData data;
+  double native_ms = bestMs(runs, [&] { parseObjFile(file, data); });
+
+  tinyobj::ObjReader reader;
+  tinyobj::ObjReaderConfig config;
+  config.triangulate = true;
+  double tinyobj_ms = bestMs(runs, [&] {
+    reader = tinyobj::ObjReader();
+    reader.ParseFromFile(file, config);
+  });
+  if (!reader.Valid()) {
+    printf("tinyobj failed on %s: %s\n", file.c_str(),
+           reader.Error().c_str());
+    return false;
+  }
+
+  size_t triangles = 0;
+  for (const auto& shape : data.shapes) triangles += shape.indices.size() / 3;
+  printf("%s\n", file.c_str());
+  printf("  %zu vertices, %zu triangles, %zu shapes\n",
+         data.vertices.size() / 3, triangles, data.shapes.size());
+  bool same = sameAsTinyobj(data, reader);
+  printf("  parseObjFile %8.2f ms, %zu threads\n", native_ms,
+         getGlobalThreadPool().getWorkerCount() + 1);
+  printf("  tinyobj      %8.2f ms, %.2fx\n", tinyobj_ms,
+         tinyobj_ms / native_ms);
+  if (!same) printf("  differs from tinyobj\n");
+  return same;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string file = argc > 1 ? argv[1]
+                              : std::string(BENCH_ASSET_DIR) +
+                                    "/obj2mesh/assets/mary/Marry.obj";
+  int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+  // named after the input, ctest may run the entries in parallel.
+  auto synthetic = (std::filesystem::temp_directory_path() /
+                    ("obj_parse_bench_" +
+                     std::filesystem::path(file).stem().string() + ".obj"))
+                       .string();
+  writeSyntheticObj(synthetic, 256);
+  bool ok = checkFile(synthetic, 1);
+  std::filesystem::remove(synthetic);
+
+  ok = checkFile(file, runs) && ok;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
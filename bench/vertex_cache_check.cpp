@@ -0,0 +1,197 @@
+// vertex cache check: optimizeMesh() and buildMeshlets() after it must not
+// raise ACMR on real meshes.
+// ACMR is measured by an independent FIFO post transform cache simulation,
+// cross checked against analyzeVertexCache().
+// overdraw is estimated by a cpu depth raster from fixed views, the order of
+// optimizeMesh() must draw fewer fragments than the plain cache order.
+// usage: vertex_cache_check [file.obj ...]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "util/assets_helper.hpp"
+#include "util/mesh_optimizer.hpp"
+#include "util/meshlet_builder.hpp"
+
+using namespace LLShader;
+
+namespace {
+
+// misses per triangle of a FIFO cache holding cache_size vertices.
+double simulateFifoAcmr(const std::vector<u_int32_t>& indices,
+                        size_t vertex_count, u_int32_t cache_size) {
+  std::deque<u_int32_t> fifo;
+  std::vector<bool> cached(vertex_count, false);
+  size_t misses = 0;
+  for (auto index : indices) {
+    if (cached[index]) continue;
+    ++misses;
+    fifo.push_back(index);
+    cached[index] = true;
+    if (fifo.size() > cache_size) {
+      cached[fifo.front()] = false;
+      fifo.pop_front();
+    }
+  }
+  return static_cast<double>(misses) / (indices.size() / 3);
+}
+
+// acmr must match analyzeVertexCache() and not exceed the input one.
+bool checkAcmr(const char* pass, const std::vector<u_int32_t>& input,
+               size_t input_vertices, const std::vector<u_int32_t>& output,
+               size_t output_vertices, u_int32_t cache_size) {
+  double before = simulateFifoAcmr(input, input_vertices, cache_size);
+  double after = simulateFifoAcmr(output, output_vertices, cache_size);
+  double reported =
+      analyzeVertexCache(output, output_vertices, cache_size).acmr;
+  bool passed = output.size() == input.size() && after <= before &&
+                std::fabs(after - reported) < 1e-4;
+  printf("  %-12s cache %2u: ACMR %.3f -> %.3f%s\n", pass, cache_size,
+         before, after, passed ? "" : "  FAILED");
+  return passed;
+}
+
+// shaded fragments per covered pixel, no culling like the demo pipelines.
+// orthographic views from the 26 directions of a cube around the mesh, each
+// triangle is drawn in index order with a less depth test.
+double estimateOverdraw(const std::vector<VertexData>& vertices,
+                        const std::vector<u_int32_t>& indices,
+                        int resolution = 256) {
+  glm::vec3 lo{1e30f}, hi{-1e30f};
+  for (const auto& vertex : vertices) {
+    lo = glm::min(lo, vertex.position);
+    hi = glm::max(hi, vertex.position);
+  }
+  glm::vec3 center = (lo + hi) * 0.5f;
+  float scale = resolution / std::max(glm::length(hi - lo), 1e-6f);
+
+  constexpr float far = 1e30f;
+  std::vector<float> depth(static_cast<size_t>(resolution) * resolution);
+  std::vector<glm::vec3> projected(vertices.size());
+  size_t shaded = 0, covered = 0;
+  for (int x = -1; x <= 1; ++x) {
+    for (int y = -1; y <= 1; ++y) {
+      for (int z = -1; z <= 1; ++z) {
+        if (x == 0 && y == 0 && z == 0) continue;
+        glm::vec3 view = glm::normalize(glm::vec3(x, y, z));
+        glm::vec3 up = std::fabs(view.y) > 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                                : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::vec3 right = glm::normalize(glm::cross(up, view));
+        up = glm::cross(view, right);
+        for (size_t i = 0; i < vertices.size(); ++i) {
+          glm::vec3 p = vertices[i].position - center;
+          projected[i] = {glm::dot(p, right) * scale + resolution * 0.5f,
+                          glm::dot(p, up) * scale + resolution * 0.5f,
+                          glm::dot(p, view)};
+        }
+
+        std::fill(depth.begin(), depth.end(), far);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+          glm::vec3 a = projected[indices[t]];
+          glm::vec3 b = projected[indices[t + 1]];
+          glm::vec3 c = projected[indices[t + 2]];
+          float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+          if (area == 0.0f) continue;
+          if (area < 0.0f) {
+            std::swap(b, c);
+            area = -area;
+          }
+          int x0 = std::max(0, static_cast<int>(std::min({a.x, b.x, c.x})));
+          int y0 = std::max(0, static_cast<int>(std::min({a.y, b.y, c.y})));
+          int x1 = std::min(resolution - 1,
+                            static_cast<int>(std::max({a.x, b.x, c.x})));
+          int y1 = std::min(resolution - 1,
+                            static_cast<int>(std::max({a.y, b.y, c.y})));
+          for (int py = y0; py <= y1; ++py) {
+            for (int px = x0; px <= x1; ++px) {
+              float sx = px + 0.5f, sy = py + 0.5f;
+              float w0 = (c.x - b.x) * (sy - b.y) - (c.y - b.y) * (sx - b.x);
+              float w1 = (a.x - c.x) * (sy - c.y) - (a.y - c.y) * (sx - c.x);
+              float w2 = (b.x - a.x) * (sy - a.y) - (b.y - a.y) * (sx - a.x);
+              if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+              float d = (w0 * a.z + w1 * b.z + w2 * c.z) / area;
+              float& stored = depth[static_cast<size_t>(py) * resolution + px];
+              if (d < stored) {
+                covered += stored == far;
+                stored = d;
+                ++shaded;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return covered ? static_cast<double>(shaded) / covered : 0.0;
+}
+
+bool checkMesh(const std::string& file) {
+  Mesh mesh;
+  loadObjToMesh(file, mesh);
+  const auto input = mesh.indices;
+  const size_t vertex_count = mesh.vertices.size();
+
+  bool ok = true;
+  for (u_int32_t cache_size : {8u, 16u, 32u}) {
+    auto indices = input;
+    optimizeVertexCache(indices, vertex_count, nullptr, cache_size);
+    ok = checkAcmr("tipsify", input, vertex_count, indices, vertex_count,
+                   cache_size) &&
+         ok;
+  }
+
+  // views come in opposite pairs, a convex mesh draws the same fragments in
+  // any order then, it only has to not get worse.
+  auto cache_order = input;
+  optimizeVertexCache(cache_order, vertex_count);
+  double cache_overdraw = estimateOverdraw(mesh.vertices, cache_order);
+  auto reversed = input;
+  std::reverse(reversed.begin(), reversed.end());
+  bool order_matters = estimateOverdraw(mesh.vertices, input) !=
+                       estimateOverdraw(mesh.vertices, reversed);
+
+  optimizeMesh(mesh);
+  ok = checkAcmr("optimizeMesh", input, vertex_count, mesh.indices,
+                 mesh.vertices.size(), vertex_cache_size) &&
+       ok;
+
+  double overdraw = estimateOverdraw(mesh.vertices, mesh.indices);
+  bool passed = order_matters ? overdraw < cache_overdraw
+                              : overdraw <= cache_overdraw;
+  printf("  %-12s overdraw %.4f -> %.4f%s%s\n", "optimizeMesh",
+         cache_overdraw, overdraw, order_matters ? "" : ", order independent",
+         passed ? "" : "  FAILED");
+  ok = passed && ok;
+
+  // meshlets cut the cache order at every boundary, each one is Tipsify
+  // ordered again, the result must stay below the input.
+  buildMeshlets(mesh);
+  ok = checkAcmr("meshlets", input, vertex_count, mesh.indices,
+                 mesh.vertices.size(), vertex_cache_size) &&
+       ok;
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) files.push_back(argv[i]);
+  if (files.empty()) {
+    files = {std::string(BENCH_ASSET_DIR) + "/obj2mesh/assets/mary/Marry.obj",
+             std::string(BENCH_ASSET_DIR) + "/pbr/assets/bunny/bunny.obj",
+             std::string(BENCH_ASSET_DIR) + "/pbr/assets/sphere/sphere.obj"};
+  }
+
+  bool ok = true;
+  for (const auto& file : files) {
+    printf("%s\n", file.c_str());
+    ok = checkMesh(file) && ok;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
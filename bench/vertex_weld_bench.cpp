@@ -0,0 +1,150 @@
+// vertex weld bench: VertexWeldTable, exact and with an epsilon, against the
+// unordered_map with the old XOR / shift hash it replaced, on the corners of
+// an obj file. the exact table must give the same unique vertices and
+// indices as the map, welded vertices must stay within epsilon of their
+// corners. best of runs is printed for each.
+// usage: vertex_weld_bench [file.obj] [runs] [epsilon]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "util/obj_parser.hpp"
+#include "util/vertex_weld.hpp"
+
+using namespace LLShader;
+
+namespace {
+
+// std::hash<VertexData> before hashVertex(), collides on symmetric data.
+struct OldVertexHash {
+  std::size_t operator()(const VertexData& v) const noexcept {
+    return (std::hash<glm::vec3>()(v.position) ^
+            (std::hash<glm::vec3>()(v.normal) << 1) >> 1) ^
+           (std::hash<glm::vec2>()(v.texcoords) << 1);
+  }
+};
+
+typedef struct {
+  std::vector<VertexData> vertices;
+  std::vector<u_int32_t> indices;
+} Welded;
+
+// one vertex per face corner of all shapes, built like loadObjToMesh().
+std::vector<VertexData> readCorners(const std::string& file) {
+  ObjData data;
+  parseObjFile(file, data);
+  std::vector<VertexData> corners;
+  for (const auto& shape : data.shapes) {
+    for (const auto& index : shape.indices) {
+      VertexData vertex{};
+      const float* v = &data.vertices[index.vertex_index * 3];
+      vertex.position = {v[0], v[1], v[2]};
+      if (index.normal_index >= 0) {
+        const float* n = &data.normals[index.normal_index * 3];
+        vertex.normal = {n[0], n[1], n[2]};
+      }
+      if (index.texcoord_index >= 0) {
+        const float* t = &data.texcoords[index.texcoord_index * 2];
+        vertex.texcoords = {t[0], 1.0f - t[1]};
+      }
+      corners.push_back(vertex);
+    }
+  }
+  return corners;
+}
+
+void weldWithMap(const std::vector<VertexData>& corners, Welded& out) {
+  out.vertices.clear();
+  out.indices.clear();
+  out.indices.reserve(corners.size());
+  std::unordered_map<VertexData, u_int32_t, OldVertexHash> unique_vertices;
+  unique_vertices.reserve(corners.size());
+  for (const auto& vertex : corners) {
+    auto result = unique_vertices.emplace(
+        vertex, static_cast<u_int32_t>(out.vertices.size()));
+    if (result.second) out.vertices.push_back(vertex);
+    out.indices.push_back(result.first->second);
+  }
+}
+
+void weldWithTable(const std::vector<VertexData>& corners, float epsilon,
+                   Welded& out) {
+  out.vertices.clear();
+  out.indices.clear();
+  out.indices.reserve(corners.size());
+  VertexWeldTable table(out.vertices, corners.size(), epsilon);
+  for (const auto& vertex : corners) {
+    out.indices.push_back(table.insertOrGet(vertex));
+  }
+}
+
+// best of runs, in ms.
+double bestMs(int runs, const std::function<void()>& func) {
+  double best = 1e30;
+  for (int i = 0; i < runs; ++i) {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    auto end = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::milli>(end - begin).count());
+  }
+  return best;
+}
+
+bool isWithin(const VertexData& a, const VertexData& b, float epsilon) {
+  for (int k = 0; k < 3; ++k) {
+    if (std::fabs(a.position[k] - b.position[k]) > epsilon ||
+        std::fabs(a.normal[k] - b.normal[k]) > epsilon) {
+      return false;
+    }
+  }
+  return std::fabs(a.texcoords.x - b.texcoords.x) <= epsilon &&
+         std::fabs(a.texcoords.y - b.texcoords.y) <= epsilon;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string file = argc > 1 ? argv[1]
+                              : std::string(BENCH_ASSET_DIR) +
+                                    "/obj2mesh/assets/mary/Marry.obj";
+  int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+  float epsilon = argc > 3 ? std::strtof(argv[3], nullptr) : 1e-4f;
+
+  auto corners = readCorners(file);
+  Welded map, exact, near;
+  double map_ms = bestMs(runs, [&] { weldWithMap(corners, map); });
+  double exact_ms = bestMs(runs, [&] { weldWithTable(corners, 0.0f, exact); });
+  double near_ms = bestMs(runs, [&] { weldWithTable(corners, epsilon, near); });
+
+  printf("%s, %zu indices, best of %d\n", file.c_str(), corners.size(), runs);
+  printf("  unordered_map + old hash %8.3f ms, %zu vertices\n", map_ms,
+         map.vertices.size());
+  printf("  VertexWeldTable exact    %8.3f ms, %zu vertices, %.2fx\n",
+         exact_ms, exact.vertices.size(), map_ms / exact_ms);
+  printf("  VertexWeldTable epsilon  %8.3f ms, %zu vertices, %.2fx (%g)\n",
+         near_ms, near.vertices.size(), map_ms / near_ms, epsilon);
+
+  bool ok = true;
+  if (exact.vertices != map.vertices || exact.indices != map.indices) {
+    printf("  exact table differs from unordered_map\n");
+    ok = false;
+  }
+  bool near_ok = near.indices.size() == corners.size() &&
+                 near.vertices.size() <= exact.vertices.size();
+  for (size_t i = 0; near_ok && i < corners.size(); ++i) {
+    near_ok = near.indices[i] < near.vertices.size() &&
+              isWithin(near.vertices[near.indices[i]], corners[i], epsilon);
+  }
+  if (!near_ok) {
+    printf("  epsilon table welded a corner farther than epsilon\n");
+    ok = false;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,28 @@
+#include "lod_selector.hpp"
+
+namespace LLShader {
+
+float getProjectionScale(const FPSCamera& camera, float viewport_height) {
+  // fov is vertical, see getPerspectiveProjectionMatrix().
+  return viewport_height / (2.0f * glm::tan(glm::radians(camera.fov) * 0.5f));
+}
+
+u_int32_t selectLod(const std::vector<LodRange>& lods,
+                    const FPSCamera& camera, float viewport_height,
+                    glm::vec3 center, float radius, float pixel_threshold) {
+  if (lods.empty()) return 0;
+
+  float distance = glm::length(center - camera.getPosition()) - radius;
+  distance = glm::max(distance, camera.znear);
+  float scale = getProjectionScale(camera, viewport_height) / distance;
+
+  // errors grow with lod index.
+  u_int32_t result = 0;
+  for (u_int32_t i = 1; i < lods.size(); ++i) {
+    if (lods[i].error * scale > pixel_threshold) break;
+    result = i;
+  }
+  return result;
+}
+
+}  // namespace LLShader
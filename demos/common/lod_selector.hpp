@@ -0,0 +1,25 @@
+#ifndef LOD_SELECTOR_HPP
+#define LOD_SELECTOR_HPP
+
+#include <vector>
+
+#include "demos/common/camera.hpp"
+#include "demos/common/model_prototype.hpp"
+
+namespace LLShader {
+
+/// pixels covered by one world unit at distance 1 in front of camera.
+float getProjectionScale(const FPSCamera& camera, float viewport_height);
+
+/// pick the coarsest lod whose error projected on screen is no more than
+/// pixel_threshold pixels. distance is taken from camera to the nearest
+/// point of the world space bounding sphere (center, radius), lod errors
+/// are assumed in world units (instances are not scaled).
+u_int32_t selectLod(const std::vector<LodRange>& lods,
+                    const FPSCamera& camera, float viewport_height,
+                    glm::vec3 center, float radius,
+                    float pixel_threshold = 1.0f);
+
+}  // namespace LLShader
+
+#endif
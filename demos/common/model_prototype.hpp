@@ -3,97 +3,96 @@
 
 #include <vulkan/vulkan.h>
 
+#include <map>
 #include <memory>
-#include <unordered_map>
 
 #include "3rd/tinyobjloader/tiny_obj_loader.h"
 #include "demos/common/shader_type.hpp"
+#include "demos/common/vertex_format.hpp"
 #include "engine/matrix.hpp"
 #include "log/log.hpp"
 #include "render/render_manager.hpp"
+#include "util/assets_helper.hpp"
+#include "util/mesh_cache.hpp"
+#include "util/mesh_optimizer.hpp"
+#include "util/mesh_simplifier.hpp"
+#include "util/meshlet_builder.hpp"
 
 namespace LLShader {
 
+/// range of one lod in the index buffer.
+typedef struct {
+  u_int32_t first_index;
+  u_int32_t index_count;
+  // object space error, see selectLod().
+  float error;
+} LodRange;
+
 typedef struct {
   VkBuffer vert_buffer;
-  VkDeviceMemory vert_memory;
+  GpuAllocation vert_memory;
   VkBuffer idx_buffer;
-  VkDeviceMemory idx_memory;
+  GpuAllocation idx_memory;
+  // layout of vert_buffer, push dequant as vertex push constant when packed.
+  VertexFormat vertex_format;
+  VertexDequantParams dequant;
+  // uint16 when the mesh has no more than 65536 vertices.
+  VkIndexType index_type;
+  // index count of lod 0.
+  u_int32_t index_count;
+  // lods[0] is the full mesh, all lods are packed in idx_buffer.
+  std::vector<LodRange> lods;
+  // object space bounding sphere.
+  glm::vec3 bounds_center;
+  float bounds_radius;
 } ProtoTypeGPUData;
 
+/// options which change the loaded meshes, part of the mesh cache key.
+struct ModelLoadOptions {
+  // 0 for exact welding, otherwise vertices closer than this are merged.
+  float weld_epsilon = 0.0f;
+  // reorder triangles and vertices for vertex cache, overdraw and fetch.
+  bool optimize = false;
+  // number of simplified lods generated after lod 0, each has about half
+  // triangles of the previous one.
+  u_int32_t lod_count = 0;
+  // split lod 0 into meshlets for cluster culling, reorders indices.
+  bool build_meshlets = false;
+  // gpu vertex layout, only applied in generateGPUData so not part of the
+  // cache key.
+  VertexFormat vertex_format = VertexFormat::kFloat32;
+};
+
+inline u_int64_t hashModelLoadOptions(const ModelLoadOptions& options) {
+  u_int64_t hash = 0;
+  hash = hashCombine(
+      hash, hashBytes(&options.weld_epsilon, sizeof(options.weld_epsilon)));
+  hash = hashCombine(hash, options.optimize);
+  hash = hashCombine(hash, options.lod_count);
+  hash = hashCombine(hash, options.build_meshlets);
+  return hash;
+}
+
 /// TODO: using a big material lib, mesh lib, using flight weight or prototype
 /// pattern to implement this class.
 /// Load Obj file only
 class ModelProtoType {
  public:
   // mtl file auto load in same dictionary.
-  ModelProtoType(const std::string& obj_file) {
-    using namespace tinyobj;
-    ObjReader reader;
-    ObjReaderConfig reader_config;
-    reader_config.triangulate = true;
-
-    if (!reader.ParseFromFile(obj_file, reader_config)) {
-      if (!reader.Error().empty()) {
-        throw std::runtime_error(reader.Error());
-      }
-    }
-    if (!reader.Warning().empty()) {
-      LogUtil::LogW(reader.Warning());
+  // parsed meshes are cached in a binary file next to obj_file, later runs
+  // load the cache directly while obj_file is unchanged.
+  ModelProtoType(const std::string& obj_file,
+                 const ModelLoadOptions& options = {})
+      : options(options) {
+    auto options_hash = hashModelLoadOptions(options);
+    if (loadMeshCache(obj_file, sub_meshes, options_hash)) {
+      LogUtil::LogI(obj_file + " loaded from mesh cache.\n");
+    } else {
+      parseObj(obj_file);
+      writeMeshCache(obj_file, sub_meshes, options_hash);
+      LogUtil::LogI(obj_file + " loded.\n");
     }
 
-    // load material
-    materials = reader.GetMaterials();
-    // load vertex data
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-
-    std::unordered_map<VertexData, u_int32_t> unique_vertices;
-
-    sub_meshes.resize(shapes.size());
-    for (size_t i = 0; i < sub_meshes.size(); ++i) {
-      auto& shape = shapes[i];
-      auto& mesh = sub_meshes[i];
-      mesh.name = shape.name;
-      // TODO: performance may be optimized here
-      for (size_t j = 0; j < shape.mesh.indices.size(); ++j) {
-        auto& index = shape.mesh.indices[j];
-        VertexData vertex;
-        // 提取 position
-        size_t v_start = index.vertex_index * 3;
-        auto vx = attrib.vertices[v_start];
-        auto vy = attrib.vertices[v_start + 1];
-        auto vz = attrib.vertices[v_start + 2];
-        vertex.position = {vx, vy, vz};
-
-        // 提取 normal
-        if (index.normal_index >= 0) {
-          size_t n_start = index.normal_index * 3;
-          auto nx = attrib.normals[n_start];
-          auto ny = attrib.normals[n_start + 1];
-          auto nz = attrib.normals[n_start + 2];
-          vertex.normal = {nx, ny, nz};
-        }
-
-        // 提取 texcoords
-        // reverse y for vulkan
-        if (index.texcoord_index >= 0) {
-          size_t t_start = 2 * index.texcoord_index;
-          auto s = attrib.texcoords[t_start];
-          auto t = 1.0 - attrib.texcoords[t_start + 1];
-          vertex.texcoords = {s, t};
-        }
-        // not exitst
-        if (!unique_vertices.count(vertex)) {
-          unique_vertices[vertex] = mesh.vertices.size();
-          mesh.vertices.push_back(vertex);
-        }
-        mesh.indices.push_back(unique_vertices[vertex]);
-      }
-    }
-
-    LogUtil::LogI(obj_file + " loded.\n");
-
     for (auto& mesh : sub_meshes) {
       LogUtil::LogI("mesh " + mesh.name +
                     "\n vertices:" + std::to_string(mesh.vertices.size()) +
@@ -106,28 +105,99 @@ class ModelProtoType {
 
   inline const std::vector<Mesh>& getMeshes() const { return sub_meshes; }
 
+  inline VertexFormat getVertexFormat() const { return options.vertex_format; }
+
   inline std::vector<ProtoTypeGPUData> generateGPUData() const {
     assert(global_matrix_engine.render_manager.use_count());
     auto& manager = global_matrix_engine.render_manager;
     std::vector<ProtoTypeGPUData> data(sub_meshes.size());
 
+    std::vector<unsigned char> vertices;
+    std::vector<unsigned char> indices;
+    std::vector<u_int32_t> all_lods;
+    // buffers of every sub mesh go out with one submit.
+    manager->beginUploadBatch();
     for (size_t i = 0; i < data.size(); ++i) {
+      const auto& mesh = sub_meshes[i];
+      data[i].vertex_format = options.vertex_format;
+      data[i].dequant =
+          encodeVertices(options.vertex_format, mesh.vertices, vertices);
+
+      // lod 0 first, then every lod after another, drawn by first_index.
+      all_lods = mesh.indices;
+      data[i].lods.clear();
+      data[i].lods.push_back(
+          {0, static_cast<u_int32_t>(mesh.indices.size()), 0.0f});
+      for (const auto& lod : mesh.lods) {
+        data[i].lods.push_back({static_cast<u_int32_t>(all_lods.size()),
+                                static_cast<u_int32_t>(lod.indices.size()),
+                                lod.error});
+        all_lods.insert(all_lods.end(), lod.indices.begin(),
+                        lod.indices.end());
+      }
+      data[i].index_type =
+          encodeIndices(all_lods, mesh.vertices.size(), indices);
+      data[i].index_count = static_cast<u_int32_t>(mesh.indices.size());
+
+      glm::vec3 lo{0.0f}, hi{0.0f};
+      if (!mesh.vertices.empty()) lo = hi = mesh.vertices[0].position;
+      for (const auto& v : mesh.vertices) {
+        lo = glm::min(lo, v.position);
+        hi = glm::max(hi, v.position);
+      }
+      data[i].bounds_center = (lo + hi) * 0.5f;
+      data[i].bounds_radius = glm::length(hi - lo) * 0.5f;
       manager->createDeviceOnlyBuffer(data[i].idx_buffer, data[i].idx_memory,
-                                      sub_meshes[i].getIndicesByteSize(),
-                                      (void*)sub_meshes[i].indices.data(),
+                                      indices.size(), indices.data(),
                                       VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
       manager->createDeviceOnlyBuffer(data[i].vert_buffer, data[i].vert_memory,
-                                      sub_meshes[i].getVerticesByteSize(),
-                                      (void*)sub_meshes[i].vertices.data(),
-                                      VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                      vertices.size(), vertices.data(),
+                                      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     }
+    manager->submitUploadBatch();
 
     return data;
   }
 
  private:
+  // materials are only loaded when obj is parsed, mesh cache do not store
+  // them.
+  void parseObj(const std::string& obj_file) {
+    std::vector<std::string> material_libs;
+    loadObjToMeshes(obj_file, sub_meshes, &material_libs,
+                    options.weld_epsilon);
+    if (options.optimize) {
+      for (auto& mesh : sub_meshes) optimizeMesh(mesh);
+    }
+    if (options.lod_count > 0) {
+      for (auto& mesh : sub_meshes) {
+        generateMeshLods(mesh, options.lod_count, options.optimize);
+      }
+    }
+    if (options.build_meshlets) {
+      for (auto& mesh : sub_meshes) buildMeshlets(mesh);
+    }
+
+    // load material, mtl file is searched in the obj dictionary.
+    auto slash = obj_file.find_last_of("/\\");
+    std::string base_dir =
+        slash == std::string::npos ? "" : obj_file.substr(0, slash + 1);
+    tinyobj::MaterialFileReader reader(base_dir);
+    std::map<std::string, int> material_map;
+    for (const auto& lib : material_libs) {
+      std::string warn, err;
+      if (!reader(lib, &materials, &material_map, &warn, &err)) {
+        LogUtil::LogW("failed to load material " + lib + ": " + err + '\n');
+      } else if (!warn.empty()) {
+        LogUtil::LogW(warn);
+      }
+    }
+  }
+
+  ModelLoadOptions options;
+
   // if have multi mode, there is duplication data, also vertex number may
   // overflow.
   std::vector<Mesh> sub_meshes;
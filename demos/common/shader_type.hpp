@@ -2,6 +2,7 @@
 #define SHADER_TYPE_HPP
 
 #include <functional>
+#include <string>
 #include <vector>
 
 #ifndef GLM_ENABLE_EXPERIMENTAL
@@ -10,6 +11,7 @@
 
 #include "3rd/glm/glm/gtc/matrix_transform.hpp"
 #include "3rd/glm/glm/gtx/hash.hpp"
+#include "util/hash.hpp"
 
 namespace LLShader {
 
@@ -36,10 +38,42 @@ struct VertexData {
   }
 };
 
+/// cluster of at most meshlet_max_vertices vertices and
+/// meshlet_max_triangles triangles, laid out for std430 storage buffers.
+typedef struct {
+  // bounding sphere, xyz center, w radius.
+  glm::vec4 sphere;
+  // normal cone, xyz apex. the cluster is backfacing when
+  // dot(normalize(cone_apex - eye), cone_axis.xyz) >= cone_axis.w.
+  glm::vec4 cone_apex;
+  glm::vec4 cone_axis;
+  // into Mesh::meshlet_vertices.
+  u_int32_t vertex_offset;
+  u_int32_t vertex_count;
+  // in triangles, into Mesh::meshlet_triangles and Mesh::indices.
+  u_int32_t triangle_offset;
+  u_int32_t triangle_count;
+} Meshlet;
+
+/// simplified index buffer of a mesh, refer to the same vertices.
+struct MeshLod {
+  // object space distance to the full resolution surface.
+  float error;
+  std::vector<u_int32_t> indices;
+};
+
 struct Mesh {
   std::string name;
   std::vector<VertexData> vertices;
   std::vector<u_int32_t> indices;
+  // coarser and coarser lods, indices above is lod 0.
+  std::vector<MeshLod> lods;
+  // clusters of lod 0, indices are ordered by meshlet when not empty.
+  std::vector<Meshlet> meshlets;
+  // vertex index of each meshlet local vertex.
+  std::vector<u_int32_t> meshlet_vertices;
+  // 3 local vertex indices per triangle.
+  std::vector<u_int8_t> meshlet_triangles;
 
   // return vert data size in byte.
   u_int64_t getVerticesByteSize() const {
@@ -54,15 +88,24 @@ struct Mesh {
 typedef struct {
 } Material;
 
+/// 64 bit hash of the vertex bytes.
+/// -0.0 is turned into 0.0 first, they are equal under operator==.
+inline u_int64_t hashVertex(const VertexData& v) {
+  static_assert(sizeof(VertexData) == 8 * sizeof(float),
+                "VertexData must be tightly packed floats");
+  float data[8];
+  memcpy(data, &v, sizeof(data));
+  for (auto& f : data) f += 0.0f;
+  return hashBytes(data, sizeof(data));
+}
+
 };  // namespace LLShader
 
 // custom hash for remove duplicated vertex
 template <>
 struct std::hash<LLShader::VertexData> {
   std::size_t operator()(LLShader::VertexData const& v) const noexcept {
-    return (std::hash<glm::vec3>()(v.position) ^
-            (std::hash<glm::vec3>()(v.normal) << 1) >> 1) ^
-           (std::hash<glm::vec2>()(v.texcoords) << 1);
+    return static_cast<std::size_t>(LLShader::hashVertex(v));
   }
 };
 
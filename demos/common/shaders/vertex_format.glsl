@@ -0,0 +1,62 @@
+// vertex input decoding, layout is selected by VERTEX_FORMAT_* macro.
+// must match demos/common/vertex_format.hpp.
+// usage: vec3 position = decodePosition(); ...
+
+#if defined(VERTEX_FORMAT_PACKED16) || defined(VERTEX_FORMAT_PACKED12)
+layout(push_constant) uniform VertexDequant {
+  vec4 offset;
+  vec4 scale;
+}
+vertex_dequant;
+
+vec3 octDecode(vec2 e) {
+  vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+#endif
+
+#if defined(VERTEX_FORMAT_PACKED16)
+layout(location = 0) in vec4 in_position;  // unorm16
+layout(location = 1) in vec2 in_normal;    // snorm16 octahedral
+layout(location = 2) in vec2 in_texcoords;  // half
+
+vec3 decodePosition() {
+  return vertex_dequant.offset.xyz + in_position.xyz * vertex_dequant.scale.xyz;
+}
+
+vec3 decodeNormal() { return octDecode(in_normal); }
+
+vec2 decodeTexcoords() { return in_texcoords; }
+
+#elif defined(VERTEX_FORMAT_PACKED12)
+layout(location = 0) in uvec4 in_position;  // uint16, w is snorm8 x2 normal
+layout(location = 2) in vec2 in_texcoords;  // half
+
+vec3 decodePosition() {
+  return vertex_dequant.offset.xyz +
+         vec3(in_position.xyz) / 65535.0 * vertex_dequant.scale.xyz;
+}
+
+vec3 decodeNormal() {
+  // sign extend the two bytes.
+  ivec2 e = ivec2(in_position.w & 0xffu, in_position.w >> 8u);
+  e = (e ^ 0x80) - 0x80;
+  return octDecode(max(vec2(e) / 127.0, -1.0));
+}
+
+vec2 decodeTexcoords() { return in_texcoords; }
+
+#else
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_texcoords;
+
+vec3 decodePosition() { return in_position; }
+
+vec3 decodeNormal() { return in_normal; }
+
+vec2 decodeTexcoords() { return in_texcoords; }
+#endif
@@ -0,0 +1,218 @@
+#include "vertex_format.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace LLShader {
+
+namespace {
+
+u_int16_t floatToHalf(float value) {
+  u_int32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  u_int32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  u_int32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) {
+    // inf / nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  if (exponent >= 31) return sign | 0x7c00;
+  if (exponent <= 0) {
+    // subnormal or zero
+    if (exponent < -10) return sign;
+    mantissa |= 0x800000;
+    u_int32_t shift = 14 - exponent;
+    u_int32_t half = mantissa >> shift;
+    // round to nearest even
+    u_int32_t rest = mantissa & ((1u << shift) - 1);
+    u_int32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) ++half;
+    return sign | half;
+  }
+
+  u_int32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  u_int32_t rest = mantissa & 0x1fff;
+  // carry into exponent is the correct result.
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) ++half;
+  return static_cast<u_int16_t>(half);
+}
+
+// octahedral mapping, result in [-1, 1].
+glm::vec2 octEncode(glm::vec3 n) {
+  float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  if (l1 == 0.0f) return glm::vec2(0.0f);
+  n /= l1;
+  glm::vec2 e(n.x, n.y);
+  if (n.z < 0.0f) {
+    e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+    e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return e;
+}
+
+inline int32_t quantizeSnorm(float v, int32_t max) {
+  v = std::fmax(-1.0f, std::fmin(v, 1.0f));
+  return static_cast<int32_t>(std::round(v * max));
+}
+
+inline u_int16_t quantizeUnorm16(float v) {
+  v = std::fmax(0.0f, std::fmin(v, 1.0f));
+  return static_cast<u_int16_t>(std::round(v * 65535.0f));
+}
+
+}  // namespace
+
+u_int32_t getVertexStride(VertexFormat format) {
+  switch (format) {
+    case VertexFormat::kPacked16:
+      return sizeof(PackedVertex16);
+    case VertexFormat::kPacked12:
+      return sizeof(PackedVertex12);
+    default:
+      return sizeof(VertexData);
+  }
+}
+
+VkVertexInputBindingDescription getVertexBindingDescription(
+    VertexFormat format, u_int32_t binding) {
+  return VkVertexInputBindingDescription{
+      .binding = binding,
+      .stride = getVertexStride(format),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+  };
+}
+
+std::vector<VkVertexInputAttributeDescription> getVertexAttributeDescriptions(
+    VertexFormat format, u_int32_t binding) {
+  switch (format) {
+    case VertexFormat::kPacked16:
+      return {
+          {0, binding, VK_FORMAT_R16G16B16A16_UNORM,
+           offsetof(PackedVertex16, position)},
+          {1, binding, VK_FORMAT_R16G16_SNORM,
+           offsetof(PackedVertex16, normal)},
+          {2, binding, VK_FORMAT_R16G16_SFLOAT,
+           offsetof(PackedVertex16, texcoords)},
+      };
+    case VertexFormat::kPacked12:
+      return {
+          {0, binding, VK_FORMAT_R16G16B16A16_UINT,
+           offsetof(PackedVertex12, position)},
+          {2, binding, VK_FORMAT_R16G16_SFLOAT,
+           offsetof(PackedVertex12, texcoords)},
+      };
+    default:
+      return {
+          {0, binding, VK_FORMAT_R32G32B32_SFLOAT,
+           offsetof(VertexData, position)},
+          {1, binding, VK_FORMAT_R32G32B32_SFLOAT,
+           offsetof(VertexData, normal)},
+          {2, binding, VK_FORMAT_R32G32_SFLOAT,
+           offsetof(VertexData, texcoords)},
+      };
+  }
+}
+
+std::vector<std::string> getVertexFormatMacros(VertexFormat format) {
+  switch (format) {
+    case VertexFormat::kPacked16:
+      return {"VERTEX_FORMAT_PACKED16"};
+    case VertexFormat::kPacked12:
+      return {"VERTEX_FORMAT_PACKED12"};
+    default:
+      return {};
+  }
+}
+
+VkPushConstantRange getVertexDequantPushConstantRange() {
+  return VkPushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = sizeof(VertexDequantParams),
+  };
+}
+
+VertexDequantParams encodeVertices(VertexFormat format,
+                                   const std::vector<VertexData>& vertices,
+                                   std::vector<unsigned char>& out) {
+  VertexDequantParams params{glm::vec4(0.0f), glm::vec4(1.0f)};
+  out.resize(vertices.size() * getVertexStride(format));
+
+  if (format == VertexFormat::kFloat32) {
+    memcpy(out.data(), vertices.data(), out.size());
+    return params;
+  }
+
+  glm::vec3 lo(0.0f), hi(0.0f);
+  if (!vertices.empty()) lo = hi = vertices[0].position;
+  for (const auto& v : vertices) {
+    lo = glm::min(lo, v.position);
+    hi = glm::max(hi, v.position);
+  }
+  glm::vec3 extent = hi - lo;
+  glm::vec3 inv_extent;
+  for (int k = 0; k < 3; ++k) {
+    // flat axis, any value decodes to lo.
+    if (extent[k] <= 0.0f) extent[k] = 1.0f;
+    inv_extent[k] = 1.0f / extent[k];
+  }
+  params.offset = glm::vec4(lo, 0.0f);
+  params.scale = glm::vec4(extent, 0.0f);
+
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const auto& v = vertices[i];
+    glm::vec3 p = (v.position - lo) * inv_extent;
+    glm::vec2 n = octEncode(v.normal);
+    u_int16_t uv[2] = {floatToHalf(v.texcoords.x),
+                       floatToHalf(v.texcoords.y)};
+
+    if (format == VertexFormat::kPacked16) {
+      PackedVertex16 packed{};
+      for (int k = 0; k < 3; ++k) packed.position[k] = quantizeUnorm16(p[k]);
+      packed.normal[0] = static_cast<int16_t>(quantizeSnorm(n.x, 32767));
+      packed.normal[1] = static_cast<int16_t>(quantizeSnorm(n.y, 32767));
+      memcpy(packed.texcoords, uv, sizeof(uv));
+      memcpy(out.data() + i * sizeof(packed), &packed, sizeof(packed));
+    } else {
+      PackedVertex12 packed{};
+      for (int k = 0; k < 3; ++k) packed.position[k] = quantizeUnorm16(p[k]);
+      auto nx = static_cast<u_int8_t>(quantizeSnorm(n.x, 127));
+      auto ny = static_cast<u_int8_t>(quantizeSnorm(n.y, 127));
+      packed.position[3] = static_cast<u_int16_t>(nx | (ny << 8));
+      memcpy(packed.texcoords, uv, sizeof(uv));
+      memcpy(out.data() + i * sizeof(packed), &packed, sizeof(packed));
+    }
+  }
+  return params;
+}
+
+VkIndexType chooseIndexType(size_t vertex_count) {
+  // primitive restart is not used, so 0xffff is a valid index.
+  return vertex_count <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+u_int32_t getIndexSize(VkIndexType index_type) {
+  return index_type == VK_INDEX_TYPE_UINT16 ? sizeof(u_int16_t)
+                                            : sizeof(u_int32_t);
+}
+
+VkIndexType encodeIndices(const std::vector<u_int32_t>& indices,
+                          size_t vertex_count,
+                          std::vector<unsigned char>& out) {
+  auto index_type = chooseIndexType(vertex_count);
+  out.resize(indices.size() * getIndexSize(index_type));
+  if (index_type == VK_INDEX_TYPE_UINT32) {
+    memcpy(out.data(), indices.data(), out.size());
+  } else {
+    auto* dst = reinterpret_cast<u_int16_t*>(out.data());
+    for (size_t i = 0; i < indices.size(); ++i) {
+      dst[i] = static_cast<u_int16_t>(indices[i]);
+    }
+  }
+  return index_type;
+}
+
+}  // namespace LLShader
@@ -0,0 +1,85 @@
+#ifndef VERTEX_FORMAT_HPP
+#define VERTEX_FORMAT_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+
+namespace LLShader {
+
+/// GPU side vertex layouts, VertexData is always used on CPU side and
+/// encoded when uploading. shaders include
+/// demos/common/shaders/vertex_format.glsl and select the decoder by the
+/// macro from getVertexFormatMacros().
+enum class VertexFormat : u_int32_t {
+  // VertexData as is, 32 bytes.
+  kFloat32 = 0,
+  // 16 bytes, see PackedVertex16.
+  kPacked16,
+  // 12 bytes, see PackedVertex12.
+  kPacked12,
+};
+
+/// position: unorm16 x3 relative to mesh bounds, w unused.
+/// normal: octahedral snorm16 x2.
+/// texcoords: half x2.
+typedef struct {
+  u_int16_t position[4];
+  int16_t normal[2];
+  u_int16_t texcoords[2];
+} PackedVertex16;
+
+/// position: uint16 x3 relative to mesh bounds, w is octahedral normal as
+/// snorm8 x2 (x in low byte), fetched as R16G16B16A16_UINT.
+/// texcoords: half x2.
+typedef struct {
+  u_int16_t position[4];
+  u_int16_t texcoords[2];
+} PackedVertex12;
+
+static_assert(sizeof(PackedVertex16) == 16, "PackedVertex16 is 16 bytes");
+static_assert(sizeof(PackedVertex12) == 12, "PackedVertex12 is 12 bytes");
+
+/// push constant of vertex stage, position = offset + normalized * scale.
+/// identity for kFloat32.
+typedef struct {
+  glm::vec4 offset;
+  glm::vec4 scale;
+} VertexDequantParams;
+
+u_int32_t getVertexStride(VertexFormat format);
+
+VkVertexInputBindingDescription getVertexBindingDescription(
+    VertexFormat format, u_int32_t binding = 0);
+
+/// location 0 position, 1 normal, 2 texcoords. kPacked12 has no location 1,
+/// normal is packed into position.w.
+std::vector<VkVertexInputAttributeDescription> getVertexAttributeDescriptions(
+    VertexFormat format, u_int32_t binding = 0);
+
+/// macros passed to shader compiler, empty for kFloat32.
+std::vector<std::string> getVertexFormatMacros(VertexFormat format);
+
+/// push constant range matching VertexDequantParams.
+VkPushConstantRange getVertexDequantPushConstantRange();
+
+/// encode vertices into format, return params to decode position.
+VertexDequantParams encodeVertices(VertexFormat format,
+                                   const std::vector<VertexData>& vertices,
+                                   std::vector<unsigned char>& out);
+
+/// uint16 when every index of vertex_count vertices fits, otherwise uint32.
+VkIndexType chooseIndexType(size_t vertex_count);
+
+u_int32_t getIndexSize(VkIndexType index_type);
+
+/// encode indices with chooseIndexType(vertex_count), return the type.
+VkIndexType encodeIndices(const std::vector<u_int32_t>& indices,
+                          size_t vertex_count, std::vector<unsigned char>& out);
+
+}  // namespace LLShader
+
+#endif
@@ -1,12 +1,13 @@
 #include "mesh_demo.hpp"
-
+#include "demos/common/vertex_format.hpp"
 #include "engine/matrix.hpp"
 #include "util/assets_helper.hpp"
 namespace LLShader {
 void MeshDemo::init() {
   context = global_matrix_engine.render_manager->getRenderBaseContext();
-  loadModels();
+  // texture decodes on workers while meshes parse.
   loadTextures();
+  loadModels();
   createBuffers();
   setupLayoutAndSets();
   createRenderPass();
@@ -17,28 +18,27 @@ void MeshDemo::init() {
 
 void MeshDemo::dispose() {
   VkDevice device = context.device;
-  // release texture
-  {
+  auto& allocator = global_matrix_engine.render_manager->getAllocator();
+  // release texture, placeholder is owned by asset loader.
+  if (!mary_texture_future.valid()) {
     vkDestroyImage(device, mary.texture.texture_image, nullptr);
     vkDestroyImageView(device, mary.texture.texture_image_view, nullptr);
-    vkFreeMemory(device, mary.texture.texture_memory, nullptr);
+    allocator.free(mary.texture.texture_memory);
   }
   // release model vert and index
 
   {
     vkDestroyBuffer(device, mary.model_index_buf, nullptr);
-    vkFreeMemory(device, mary.model_index_memory, nullptr);
+    allocator.free(mary.model_index_memory);
     vkDestroyBuffer(device, mary.model_vert_buf, nullptr);
-    vkFreeMemory(device, mary.model_vert_memory, nullptr);
+    allocator.free(mary.model_vert_memory);
   }
 
-  // relase depth resources
+  // relase depth resource
   {
-    for (auto item : depth_resources) {
-      vkDestroyImage(device, item.depth_image, nullptr);
-      vkDestroyImageView(device, item.depth_image_view, nullptr);
-      vkFreeMemory(device, item.depth_memory, nullptr);
-    }
+    vkDestroyImageView(device, depth_resource.depth_image_view, nullptr);
+    vkDestroyImage(device, depth_resource.depth_image, nullptr);
+    allocator.free(depth_resource.depth_memory);
   }
 }
 
@@ -75,15 +75,23 @@ void MeshDemo::onNotification() {
   auto p = fps_camera.getPerspectiveProjectionMatrix();
   p[1][1] *= -1;
 
-  void* data;
-  vkMapMemory(context.device, camera_uniform[current_frame_idx].obj_mem, 0,
-              sizeof(CameraUniformObject), 0, &data);
-
-  memcpy(data, &camera_uniform[current_frame_idx].obj, sizeof(CameraUniform));
-  vkUnmapMemory(context.device, camera_uniform[current_frame_idx].obj_mem);
+  // host visible memory stays mapped.
+  memcpy(camera_uniform[current_frame_idx].obj_mem.mapped,
+         &camera_uniform[current_frame_idx].obj, sizeof(CameraUniform));
 }
 
-void MeshDemo::update(double dt) {}
+void MeshDemo::update(double dt) {
+  // swap placeholder once the texture uploaded.
+  if (mary_texture_future.valid() &&
+      mary_texture_future.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    mary.texture = mary_texture_future.get();
+    mary_texture_future = {};
+    // sets of frames in flight still name the placeholder, each frame
+    // rewrites its own when it records next.
+    stale_texture_sets = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
+  }
+}
 
 void MeshDemo::drawScene(VkCommandBuffer command_buffer,
                          u_int32_t framebuffer_index) {
@@ -109,14 +117,22 @@ void MeshDemo::drawScene(VkCommandBuffer command_buffer,
   VkDeviceSize offset[] = {0};
   vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     scene_pipeline);
+  RenderManager::cmdSetViewport(command_buffer, context.extent);
 
   vkCmdBindVertexBuffers(command_buffer, 0, 1, &mary.model_vert_buf, offset);
 
   vkCmdBindIndexBuffer(command_buffer, mary.model_index_buf, 0,
-                       VK_INDEX_TYPE_UINT32);
-
-  VkDescriptorSet sets[] = {set_infos[framebuffer_index].global_data_set,
-                            set_infos[framebuffer_index].texture_set};
+                       mary.model_index_type);
+
+  // sets are per frame in flight, framebuffer_index is the swapchain image.
+  // beginFrame() waited for the last frame recorded in this slot.
+  auto frame = global_matrix_engine.render_manager->getCurrenFrame();
+  if (stale_texture_sets & (1u << frame)) {
+    writeTextureSet(frame);
+    stale_texture_sets &= ~(1u << frame);
+  }
+  VkDescriptorSet sets[] = {set_infos[frame].global_data_set,
+                            set_infos[frame].texture_set};
 
   // multi set bind once is ok.
   vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -127,6 +143,29 @@ void MeshDemo::drawScene(VkCommandBuffer command_buffer,
   vkCmdEndRenderPass(command_buffer);
 }
 
+void MeshDemo::onSwapchainRecreated() {
+  auto& render_manager = global_matrix_engine.render_manager;
+  context = render_manager->getRenderBaseContext();
+  // frames in flight still render with the old ones.
+  auto device = context.device;
+  auto old_framebuffers = framebuffers;
+  auto old_depth = depth_resource;
+  render_manager->deferDestroy([device, old_framebuffers,
+                                old_depth]() mutable {
+    for (auto framebuffer : old_framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    vkDestroyImageView(device, old_depth.depth_image_view, nullptr);
+    vkDestroyImage(device, old_depth.depth_image, nullptr);
+    global_matrix_engine.render_manager->getAllocator().free(
+        old_depth.depth_memory);
+  });
+
+  render_manager->createTransientDepthResource(
+      context.extent, depth_resource.depth_image,
+      depth_resource.depth_image_view, depth_resource.depth_memory);
+  createFramebuffers();
+}
+
 void MeshDemo::drawUI() {
   // draw camera position
   {
@@ -150,40 +189,43 @@ void MeshDemo::drawUI() {
 }
 
 void MeshDemo::loadModels() {
-  loadObjToMesh("./demos/obj2mesh/assets/mary/Marry.obj", mary.mesh);
+  auto& asset_loader = global_matrix_engine.asset_loader;
+  mary.mesh = asset_loader->wait(
+      asset_loader->loadMesh("./demos/obj2mesh/assets/mary/Marry.obj"));
 }
 
 void MeshDemo::loadTextures() {
-  mary.texture = global_matrix_engine.render_manager->loadTexture2D(
+  auto& asset_loader = global_matrix_engine.asset_loader;
+  mary_texture_future = asset_loader->loadTexture(
       "./demos/obj2mesh/assets/mary/MC003_Kozakura_Mari.png");
+  mary.texture = asset_loader->getPlaceholderTexture();
 }
 
 void MeshDemo::createBuffers() {
   auto& render_manager = global_matrix_engine.render_manager;
-  // model buffer
+  // model buffer, one submit for both.
   {
+    render_manager->beginUploadBatch();
     render_manager->createDeviceOnlyBuffer(
         mary.model_vert_buf, mary.model_vert_memory,
         mary.mesh.vertices.size() * sizeof(VertexData),
         mary.mesh.vertices.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
+    std::vector<unsigned char> indices;
+    mary.model_index_type = encodeIndices(mary.mesh.indices,
+                                          mary.mesh.vertices.size(), indices);
     render_manager->createDeviceOnlyBuffer(
-        mary.model_index_buf, mary.model_index_memory,
-        mary.mesh.indices.size() * sizeof(u_int32_t), mary.mesh.indices.data(),
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        mary.model_index_buf, mary.model_index_memory, indices.size(),
+        indices.data(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    render_manager->submitUploadBatch();
   }
 
-  // depth image
-  {
-    size_t img_cnt = render_manager->getSwapchainImageViews().size();
-    depth_resources.resize(img_cnt);
-    for (auto& item : depth_resources) {
-      render_manager->defaultCreateDepthResource(
-          context.extent, item.depth_image, item.depth_image_view,
-          item.depth_memory);
-    }
-  }
+  // depth image, shared by every framebuffer.
+  render_manager->createTransientDepthResource(
+      context.extent, depth_resource.depth_image,
+      depth_resource.depth_image_view, depth_resource.depth_memory);
 
   // Set 0 : camera data
   {
@@ -230,6 +272,8 @@ void MeshDemo::createBuffers() {
       samplerInfo.compareEnable = VK_FALSE;
       samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
       samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+      samplerInfo.minLod = 0.0f;
+      samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
       if (vkCreateSampler(context.device, &samplerInfo, nullptr, &sampler) !=
           VK_SUCCESS) {
@@ -321,26 +365,29 @@ void MeshDemo::setupLayoutAndSets() {
       ubo_writer.dstSet = set_infos[i].global_data_set;
       ubo_writer.pBufferInfo = &ubo_buf_info;
 
-      VkDescriptorImageInfo marry_image_info{};
-      marry_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      marry_image_info.imageView = mary.texture.texture_image_view;
-      marry_image_info.sampler = sampler;
-      VkWriteDescriptorSet marry_texture_sampler_writer{
-          VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-      marry_texture_sampler_writer.dstSet = set_infos[i].texture_set;
-      marry_texture_sampler_writer.dstBinding = 0;
-      marry_texture_sampler_writer.dstArrayElement = 0;
-      marry_texture_sampler_writer.descriptorType =
-          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      marry_texture_sampler_writer.descriptorCount = 1;
-      marry_texture_sampler_writer.pImageInfo = &marry_image_info;
-
-      VkWriteDescriptorSet writers[] = {ubo_writer,
-                                        marry_texture_sampler_writer};
-
-      vkUpdateDescriptorSets(context.device, 2, writers, 0, nullptr);
+      vkUpdateDescriptorSets(context.device, 1, &ubo_writer, 0, nullptr);
     }
   }
+  for (u_int32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) writeTextureSet(i);
+}
+
+void MeshDemo::writeTextureSet(u_int32_t frame) {
+  VkDescriptorImageInfo marry_image_info{};
+  marry_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  marry_image_info.imageView = mary.texture.texture_image_view;
+  marry_image_info.sampler = sampler;
+  VkWriteDescriptorSet marry_texture_sampler_writer{
+      VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  marry_texture_sampler_writer.dstSet = set_infos[frame].texture_set;
+  marry_texture_sampler_writer.dstBinding = 0;
+  marry_texture_sampler_writer.dstArrayElement = 0;
+  marry_texture_sampler_writer.descriptorType =
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  marry_texture_sampler_writer.descriptorCount = 1;
+  marry_texture_sampler_writer.pImageInfo = &marry_image_info;
+
+  vkUpdateDescriptorSets(context.device, 1, &marry_texture_sampler_writer, 0,
+                         nullptr);
 }
 
 void MeshDemo::createRenderPass() {
@@ -365,11 +412,12 @@ void MeshDemo::createRenderPass() {
       .format = VK_FORMAT_D32_SFLOAT,
       .samples = VK_SAMPLE_COUNT_1_BIT,
       .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      // transient, never leaves the pass.
+      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
   };
 
   VkAttachmentReference depthAttachmentRef{
@@ -386,13 +434,18 @@ void MeshDemo::createRenderPass() {
 
   std::array<VkSubpassDependency, 1> dependencies;
 
+  // one depth for every frame in flight, the previous frame must be done
+  // with it. also waits the swapchain image.
   dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
   dependencies[0].dstSubpass = 0;
-  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dependencyFlags = 0;
 
   std::array<VkAttachmentDescription, 2> attachments = {colorAttachment,
                                                         depthAttachment};
@@ -481,26 +534,19 @@ void MeshDemo::createPipelines() {
       .primitiveRestartEnable = VK_FALSE,
   };
 
-  VkViewport viewPort{
-      .x = 0.f,
-      .y = 0.f,
-      .width = static_cast<float>(context.extent.width),
-      .height = static_cast<float>(context.extent.height),
-      .minDepth = 0.f,
-      .maxDepth = 1.f,
-  };
-
-  VkRect2D scissor{
-      .offset = {0, 0},
-      .extent = context.extent,
-  };
-
+  // viewport & scissor follow the swapchain, set when recording.
   VkPipelineViewportStateCreateInfo viewport_state{
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
       .viewportCount = 1,
-      .pViewports = &viewPort,
       .scissorCount = 1,
-      .pScissors = &scissor,
+  };
+
+  std::array<VkDynamicState, 2> dynamic_states{VK_DYNAMIC_STATE_VIEWPORT,
+                                               VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamic_state{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = static_cast<u_int32_t>(dynamic_states.size()),
+      .pDynamicStates = dynamic_states.data(),
   };
 
   // Rasterizer
@@ -559,7 +605,7 @@ void MeshDemo::createPipelines() {
       .pMultisampleState = nullptr,
       .pDepthStencilState = &depthStencil,
       .pColorBlendState = &colorBlending,
-      .pDynamicState = nullptr,
+      .pDynamicState = &dynamic_state,
       .layout = scene_pipeline_layout,
       .renderPass = scene_pass,
   };
@@ -582,7 +628,7 @@ void MeshDemo::createFramebuffers() {
   for (size_t i = 0; i < framebuffers.size(); ++i) {
     VkImageView attachments[] = {
         swapchain_image_views[i],
-        depth_resources[i].depth_image_view,
+        depth_resource.depth_image_view,
     };
 
     VkFramebufferCreateInfo framebufferInfo{
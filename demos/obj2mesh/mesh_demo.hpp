@@ -3,6 +3,7 @@
 
 #include "demos/common/camera.hpp"
 #include "demos/common/shader_type.hpp"
+#include "render/asset_loader.hpp"
 #include "render/render_base.hpp"
 #include "render/render_manager.hpp"
 
@@ -17,16 +18,17 @@ class MeshDemo : public RenderBase, public Listener {
     Texture2D texture;
 
     VkBuffer model_vert_buf;
-    VkDeviceMemory model_vert_memory;
+    GpuAllocation model_vert_memory;
     VkBuffer model_index_buf;
-    VkDeviceMemory model_index_memory;
+    GpuAllocation model_index_memory;
+    VkIndexType model_index_type;
   } TypicalModel;
 
   /// depth resource
   typedef struct {
     VkImage depth_image;
     VkImageView depth_image_view;
-    VkDeviceMemory depth_memory;
+    GpuAllocation depth_memory;
   } DepthResource;
 
   typedef struct {
@@ -48,7 +50,7 @@ class MeshDemo : public RenderBase, public Listener {
   typedef struct {
     CameraUniformObject obj;
     VkBuffer obj_buf;
-    VkDeviceMemory obj_mem;
+    GpuAllocation obj_mem;
   } CameraUniform;
 
   void init() override;
@@ -62,15 +64,19 @@ class MeshDemo : public RenderBase, public Listener {
 
   void drawUI() override;
 
+  void onSwapchainRecreated() override;
+
  private:
   void loadModels();
   void loadTextures();
   void createBuffers();
   void setupLayoutAndSets();
+  // mary texture of set_infos[frame].
+  void writeTextureSet(u_int32_t frame);
   void createRenderPass();
   void createPipelines();
   void createFramebuffers();
-  std::vector<DepthResource> depth_resources;
+  DepthResource depth_resource;
   std::vector<CameraUniform> camera_uniform;
   std::vector<VkFramebuffer> framebuffers;
 
@@ -89,6 +95,10 @@ class MeshDemo : public RenderBase, public Listener {
   std::vector<ResourceSetInfo> set_infos;
 
   TypicalModel mary;
+  // valid until mary.texture is swapped from placeholder.
+  TextureFuture mary_texture_future;
+  // bit i set: set_infos[i].texture_set names the placeholder.
+  u_int32_t stale_texture_sets{0};
   TypicalModel floor;
   VkSampler sampler;
 };
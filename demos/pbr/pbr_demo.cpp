@@ -1,7 +1,10 @@
 #include "pbr_demo.hpp"
 
+#include <chrono>
+
+#include "demos/common/lod_selector.hpp"
 #include "engine/matrix.hpp"
-#include "util/memory_ext.hpp"
+#include "render/asset_loader.hpp"
 
 namespace LLShader {
 
@@ -24,27 +27,9 @@ void PBRDemo::onNotification() {
   auto cursor_delta =
       global_matrix_engine.input_manager->getCursorPositionDelta();
 
-  auto frame_idx = global_matrix_engine.render_manager->getCurrenFrame();
-
   auto move_delta = camera.processKeyCommand(key_command);
   camera.move(move_delta);
   camera.rotate(glm::vec3(-cursor_delta.y, cursor_delta.x, 0.f));
-  auto p = camera.getPerspectiveProjectionMatrix();
-  auto v = camera.getViewMatrix();
-  p[1][1] *= -1;
-  auto pv = p * v;
-
-  // auto test = glm::mat4(7.7f);
-
-  struct CameraShaderType cam_shader_type {};
-  cam_shader_type.ViewProjMatrix = pv;
-  cam_shader_type.position = camera.position;
-  // cam_shader_type.ViewProjMatrix = test;
-  // cam_shader_type.position = glm::vec3(6.6f);
-
-  memcpy((void*)((u_int64_t)camera_uniform.mapped_memory +
-                 frame_idx * camera_uniform.dynamic_aligned_size),
-         &cam_shader_type, camera_uniform.dynamic_aligned_size);
 
   // upload each frame
   memcpy(material_uniform.mapped_memory, &material_uniform.material,
@@ -53,6 +38,27 @@ void PBRDemo::onNotification() {
 
 void PBRDemo::update(double dt) {}
 
+void PBRDemo::onSwapchainRecreated() {
+  auto& render_manager = global_matrix_engine.render_manager;
+  context = render_manager->getRenderBaseContext();
+  // frames in flight still render with the old ones.
+  auto device = context.device;
+  auto old_framebuffers = scene_resource.framebuffers;
+  auto old_depth = scene_resource.depth_resource;
+  render_manager->deferDestroy([device, old_framebuffers,
+                                old_depth]() mutable {
+    for (auto framebuffer : old_framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    vkDestroyImageView(device, old_depth.depth_image_view, nullptr);
+    vkDestroyImage(device, old_depth.depth_image, nullptr);
+    global_matrix_engine.render_manager->getAllocator().free(
+        old_depth.depth_memory);
+  });
+
+  // new depth & framebuffers, pipelines have a dynamic viewport.
+  createFramebuffers();
+}
+
 void PBRDemo::drawScene(VkCommandBuffer command_buffer,
                         u_int32_t framebuffer_index) {
   VkRenderPassBeginInfo renderPassInfo{
@@ -72,32 +78,95 @@ void PBRDemo::drawScene(VkCommandBuffer command_buffer,
   renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
   renderPassInfo.pClearValues = clearValues.data();
 
-  VkDeviceSize zero_offset[] = {0};
-  u_int32_t dynamic_offset[] = {camera_uniform.dynamic_aligned_size *
-                                framebuffer_index};
+  auto p = camera.getPerspectiveProjectionMatrix();
+  auto v = camera.getViewMatrix();
+  p[1][1] *= -1;
+  struct CameraShaderType cam_shader_type {};
+  cam_shader_type.ViewProjMatrix = p * v;
+  cam_shader_type.position = camera.position;
+
+  u_int32_t camera_offset =
+      global_matrix_engine.render_manager->getFrameUniforms().push(
+          cam_shader_type);
+
+  const auto& mesh = sphere_data.mesh;
+  glm::vec3 center = glm::vec3(sphere_instance->getModelMatrix() *
+                               glm::vec4(mesh.bounds_center, 1.0f));
+  // shown in the ui, of the sphere at the origin.
+  sphere_lod = selectLod(mesh.lods, camera,
+                         static_cast<float>(context.extent.height), center,
+                         mesh.bounds_radius);
+
+  size_t count = stress_grid > 0 ? static_cast<size_t>(stress_grid) *
+                                       static_cast<size_t>(stress_grid)
+                                 : 1;
+  bool parallel = parallel_record && stress_grid > 0;
 
   vkCmdBeginRenderPass(command_buffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
+                       parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                : VK_SUBPASS_CONTENTS_INLINE);
+
+  auto begin = std::chrono::steady_clock::now();
+  auto record = [this, camera_offset, center](VkCommandBuffer cmd,
+                                              size_t first, size_t last) {
+    recordSpheres(cmd, camera_offset, center, first, last);
+  };
+  if (parallel) {
+    global_matrix_engine.render_manager->cmdRecordParallel(
+        command_buffer, scene_resource.pass, 0,
+        scene_resource.framebuffers[framebuffer_index], count, record);
+  } else {
+    record(command_buffer, 0, count);
+  }
+  record_ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - begin)
+                  .count();
+
+  vkCmdEndRenderPass(command_buffer);
+}
 
+void PBRDemo::recordSpheres(VkCommandBuffer command_buffer,
+                            u_int32_t camera_offset, glm::vec3 center,
+                            size_t begin, size_t end) const {
   vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                     demo_pipeline.pbr_pipeline);
+  RenderManager::cmdSetViewport(command_buffer, context.extent);
 
   vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                           demo_pipeline.pbr_pipeline_layout, 0, 1,
-                          &sets_info.global_data_set, 1, dynamic_offset);
-
-  vkCmdBindVertexBuffers(command_buffer, 0, 1, &sphere_data.vert_buffer,
-                         zero_offset);
+                          &sets_info.global_data_set, 1, &camera_offset);
 
-  vkCmdBindIndexBuffer(command_buffer, sphere_data.idx_buffer, 0,
-                       VK_INDEX_TYPE_UINT32);
-
-  // bad code
-  vkCmdDrawIndexed(command_buffer,
-                   sphere_proto_type->getMeshes().front().indices.size(), 1, 0,
-                   0, 0);
+  const auto& mesh = sphere_data.mesh;
+  VkDeviceSize zero_offset[] = {0};
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &mesh.vert_buffer, zero_offset);
+
+  vkCmdBindIndexBuffer(command_buffer, mesh.idx_buffer, 0, mesh.index_type);
+
+  for (size_t i = begin; i < end; ++i) {
+    InstanceShaderType instance{getStressOffset(i)};
+    vkCmdPushConstants(command_buffer, demo_pipeline.pbr_pipeline_layout,
+                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(instance),
+                       &instance);
+
+    // coarser lod when sphere is far, error below one pixel.
+    auto lod_index = selectLod(mesh.lods, camera,
+                               static_cast<float>(context.extent.height),
+                               center + glm::vec3(instance.offset),
+                               mesh.bounds_radius);
+    const auto& lod = mesh.lods[lod_index];
+    vkCmdDrawIndexed(command_buffer, lod.index_count, 1, lod.first_index, 0,
+                     0);
+  }
+}
 
-  vkCmdEndRenderPass(command_buffer);
+glm::vec4 PBRDemo::getStressOffset(size_t index) const {
+  if (stress_grid <= 0) return glm::vec4(0.0f);
+  // grid on the xz plane around the origin.
+  size_t n = static_cast<size_t>(stress_grid);
+  float spacing = 2.5f * sphere_data.mesh.bounds_radius;
+  float half = (n - 1) * 0.5f;
+  return glm::vec4((index % n - half) * spacing, 0.0f,
+                   (index / n - half) * spacing, 0.0f);
 }
 
 void PBRDemo::drawUI() {
@@ -127,96 +196,44 @@ void PBRDemo::drawUI() {
                      1.f, "%.2f ");
     ImGui::DragFloat("roughness", &material_uniform.material.roughness, 0.01f,
                      0.f, 1.f, "%.2f ");
+    const auto& lod = sphere_data.mesh.lods[sphere_lod];
+    ImGui::Text("lod: %u, triangles: %u", sphere_lod, lod.index_count / 3);
+  }
+  // parallel recording stress test
+  {
+    ImGui::SliderInt("stress grid", &stress_grid, 0, 100);
+    ImGui::Checkbox("parallel record", &parallel_record);
+    ImGui::Text("%d draws, record %.3f ms on %zu threads",
+                stress_grid > 0 ? stress_grid * stress_grid : 1, record_ms,
+                parallel_record ? global_matrix_engine.render_manager
+                                      ->getRecordThreadCount()
+                                : size_t{1});
   }
   ImGui::End();
 }
 
 void PBRDemo::loadModels() {
-  sphere_proto_type =
-      std::make_shared<ModelProtoType>("./demos/pbr/assets/sphere/sphere.obj");
+  ModelLoadOptions options;
+  options.optimize = true;
+  options.lod_count = 4;
+  // parse & lod generation run on a worker, keeps uploads going meanwhile.
+  auto& asset_loader = global_matrix_engine.asset_loader;
+  sphere_proto_type = asset_loader->wait(asset_loader->async([options] {
+    return std::make_shared<ModelProtoType>(
+        "./demos/pbr/assets/sphere/sphere.obj", options);
+  }));
   sphere_instance = std::make_shared<ModelInstance>(sphere_proto_type);
 }
 
 void PBRDemo::uploadGPUData() {
   auto& render_manager = global_matrix_engine.render_manager;
-  const auto& meshes = sphere_proto_type->getMeshes();
 
-  // vert & idx buffer
-  {
-    // note: actually, my model only have one mesh, for loop is useless.
-    for (auto& mesh : meshes) {
-      render_manager->createDeviceOnlyBuffer(
-          sphere_data.vert_buffer, sphere_data.vert_memory,
-          mesh.getVerticesByteSize(), (void*)(mesh.vertices.data()),
-          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-      render_manager->createDeviceOnlyBuffer(
-          sphere_data.idx_buffer, sphere_data.idx_memory,
-          mesh.getIndicesByteSize(), (void*)(mesh.indices.data()),
-          VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    }
-  }
+  // vert & idx buffer, all lods in one index buffer.
+  // note: actually, my model only have one mesh.
+  sphere_data.mesh = sphere_proto_type->generateGPUData().front();
 
   // uniform buffer
   {
-    // camera uniform (dynamic)
-    {
-      render_manager->createBufferAndBindMemory(
-          camera_uniform.buffer, camera_uniform.memory,
-          getDynamicAlignedSize2(sizeof(CameraShaderType)) *
-              MAX_FRAMES_IN_FLIGHT,
-          nullptr, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
-              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-      // alloc aligned memory
-      auto sz = getDynamicAlignedSize2(sizeof(CameraShaderType));
-      camera_uniform.dynamic_aligned_size = sz;
-      camera_uniform.shader_type =
-          (CameraShaderType*)aligned_malloc(MAX_FRAMES_IN_FLIGHT * sz, sz);
-
-      // auto r1 = getDynamicAlignedSize2(0);    // 1
-      // auto r2 = getDynamicAlignedSize2(1);    // 1
-      // auto r3 = getDynamicAlignedSize2(2);    // 2
-      // auto r4 = getDynamicAlignedSize2(3);    // 4
-      // auto r5 = getDynamicAlignedSize2(16);   // 16
-      // auto r6 = getDynamicAlignedSize2(80);   // 128
-      // auto r7 = getDynamicAlignedSize2(96);   // 128
-      // auto r8 = getDynamicAlignedSize2(129);  // 256
-
-      // auto x = 96;
-      // void* test = (void*)aligned_malloc(MAX_FRAMES_IN_FLIGHT * x, x);
-      // assert(test);
-
-      vkMapMemory(context.device, camera_uniform.memory, 0,
-                  MAX_FRAMES_IN_FLIGHT * sz, 0, &camera_uniform.mapped_memory);
-
-      for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-        CameraShaderType* data =
-            (CameraShaderType*)((u_int64_t)(camera_uniform.shader_type) +
-                                sz * i);
-
-        // (*data).ViewProjMatrix =
-        //     camera.getPerspectiveProjectionMatrix() * camera.getViewMatrix();
-        // (*data).ViewProjMatrix[1][1] *= -1;
-        // (*data).position = camera.position;
-
-        (*data).ViewProjMatrix = glm::mat4(7.7f);
-        (*data).position = glm::vec3(6.6f);
-
-        VkMappedMemoryRange range{VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
-        range.memory = camera_uniform.memory;
-        range.size = camera_uniform.dynamic_aligned_size;
-        range.offset = (VkDeviceSize)(i * sz);
-        range.pNext = nullptr;
-        memcpy((void*)((u_int64_t)camera_uniform.mapped_memory + range.offset),
-               data, range.size);
-        vkFlushMappedMemoryRanges(context.device, 1, &range);
-      }
-    }
-
     // point light uniform(non-dynamic)
     {
       point_light_uniform.shader_type.color = glm::vec3(1.f, 1.f, 1.f);
@@ -242,9 +259,7 @@ void PBRDemo::uploadGPUData() {
               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-      vkMapMemory(context.device, material_uniform.memory, 0,
-                  sizeof(MaterialShaderType), 0,
-                  &material_uniform.mapped_memory);
+      material_uniform.mapped_memory = material_uniform.memory.mapped;
     }
   }
 }
@@ -326,9 +341,11 @@ void PBRDemo::setupSets() {
     // global data
     // camera uniform
     VkDescriptorBufferInfo camera_uniform_buf_info{};
-    camera_uniform_buf_info.buffer = camera_uniform.buffer;
+    // camera is pushed per frame, the offset is dynamic.
+    camera_uniform_buf_info.buffer =
+        global_matrix_engine.render_manager->getFrameUniforms().getBuffer();
     camera_uniform_buf_info.offset = 0;
-    camera_uniform_buf_info.range = camera_uniform.dynamic_aligned_size;
+    camera_uniform_buf_info.range = sizeof(CameraShaderType);
 
     VkWriteDescriptorSet camera_uniform_writer{
         VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
@@ -404,11 +421,12 @@ void PBRDemo::createRenderPass() {
       .format = VK_FORMAT_D32_SFLOAT,
       .samples = VK_SAMPLE_COUNT_1_BIT,
       .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      // transient, never leaves the pass.
+      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
   };
 
   VkAttachmentReference depthAttachmentRef{
@@ -425,13 +443,18 @@ void PBRDemo::createRenderPass() {
 
   std::array<VkSubpassDependency, 1> dependencies;
 
+  // one depth for every frame in flight, the previous frame must be done
+  // with it. also waits the swapchain image.
   dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
   dependencies[0].dstSubpass = 0;
-  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-  dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-  dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dependencyFlags = 0;
 
   std::array<VkAttachmentDescription, 2> attachments = {colorAttachment,
                                                         depthAttachment};
@@ -518,26 +541,19 @@ void PBRDemo::createPipelines() {
         .primitiveRestartEnable = VK_FALSE,
     };
 
-    VkViewport viewPort{
-        .x = 0.f,
-        .y = 0.f,
-        .width = static_cast<float>(context.extent.width),
-        .height = static_cast<float>(context.extent.height),
-        .minDepth = 0.f,
-        .maxDepth = 1.f,
-    };
-
-    VkRect2D scissor{
-        .offset = {0, 0},
-        .extent = context.extent,
-    };
-
+    // viewport & scissor follow the swapchain, set when recording.
     VkPipelineViewportStateCreateInfo viewport_state{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .viewportCount = 1,
-        .pViewports = &viewPort,
         .scissorCount = 1,
-        .pScissors = &scissor,
+    };
+
+    std::array<VkDynamicState, 2> dynamic_states{VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = static_cast<u_int32_t>(dynamic_states.size()),
+        .pDynamicStates = dynamic_states.data(),
     };
 
     // Rasterizer
@@ -581,6 +597,14 @@ void PBRDemo::createPipelines() {
     };
 
     pipeline_layout_c_info.pSetLayouts = set_layouts;
+
+    VkPushConstantRange instance_range{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(InstanceShaderType),
+    };
+    pipeline_layout_c_info.pushConstantRangeCount = 1;
+    pipeline_layout_c_info.pPushConstantRanges = &instance_range;
     if (vkCreatePipelineLayout(context.device, &pipeline_layout_c_info, nullptr,
                                &demo_pipeline.pbr_pipeline_layout) !=
         VK_SUCCESS) {
@@ -598,7 +622,7 @@ void PBRDemo::createPipelines() {
         .pMultisampleState = nullptr,
         .pDepthStencilState = &depthStencil,
         .pColorBlendState = &colorBlending,
-        .pDynamicState = nullptr,
+        .pDynamicState = &dynamic_state,
         .layout = demo_pipeline.pbr_pipeline_layout,
         .renderPass = scene_resource.pass,
     };
@@ -622,22 +646,16 @@ void PBRDemo::createFramebuffers() {
   auto extent = context.extent;
   auto device = context.device;
   scene_resource.framebuffers.resize(swapchain_image_views.size());
-  scene_resource.depth_resources.resize(swapchain_image_views.size());
-  // depth resources
-  {
-    for (size_t i = 0; i < scene_resource.depth_resources.size(); ++i) {
-      render_manager->createDepthResource(
-          scene_resource.depth_resources[i].depth_image, context.extent,
-          VK_FORMAT_D32_SFLOAT,
-          scene_resource.depth_resources[i].depth_image_view,
-          scene_resource.depth_resources[i].depth_memory);
-    }
-  }
+  // depth resource, shared by every framebuffer.
+  render_manager->createTransientDepthResource(
+      context.extent, scene_resource.depth_resource.depth_image,
+      scene_resource.depth_resource.depth_image_view,
+      scene_resource.depth_resource.depth_memory);
 
   for (size_t i = 0; i < scene_resource.framebuffers.size(); ++i) {
     VkImageView attachments[] = {
         swapchain_image_views[i],
-        scene_resource.depth_resources[i].depth_image_view,
+        scene_resource.depth_resource.depth_image_view,
     };
 
     VkFramebufferCreateInfo framebufferInfo{
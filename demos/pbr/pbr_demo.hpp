@@ -10,13 +10,11 @@
 namespace LLShader {
 class PBRDemo : public RenderBase, public Listener {
   struct SphereGPUData {
-    VkBuffer vert_buffer;
-    VkDeviceMemory vert_memory;
-    VkBuffer idx_buffer;
-    VkDeviceMemory idx_memory;
+    // vertex, index buffer and lod ranges.
+    ProtoTypeGPUData mesh;
     // dynamic uniform below, contain model data
     VkBuffer instance_buffer;
-    VkDeviceMemory instance_memory;
+    GpuAllocation instance_memory;
   };
 
   // gpu uniform
@@ -26,14 +24,6 @@ class PBRDemo : public RenderBase, public Listener {
     glm::vec3 position;
   };
 
-  struct CameraUniform {
-    CameraShaderType* shader_type;  // dynamic uniform
-    u_int32_t dynamic_aligned_size;
-    void* mapped_memory;
-    VkBuffer buffer;
-    VkDeviceMemory memory;
-  } camera_uniform;
-
   struct PointLightShaderType {
     glm::vec3 position;
     alignas(16) glm::vec3 color;
@@ -42,9 +32,14 @@ class PBRDemo : public RenderBase, public Listener {
   struct PointLightUniform {
     PointLightShaderType shader_type;
     VkBuffer buffer;
-    VkDeviceMemory memory;
+    GpuAllocation memory;
   } point_light_uniform;
 
+  // push constant.
+  struct InstanceShaderType {
+    glm::vec4 offset;
+  };
+
   struct MaterialShaderType {
     float roughness;
     float metalic;
@@ -53,20 +48,20 @@ class PBRDemo : public RenderBase, public Listener {
   struct MaterialUniform {
     MaterialShaderType material;
     VkBuffer buffer;
-    VkDeviceMemory memory;
+    GpuAllocation memory;
     void* mapped_memory;
   } material_uniform;
 
   struct DepthResource {
     VkImage depth_image;
     VkImageView depth_image_view;
-    VkDeviceMemory depth_memory;
+    GpuAllocation depth_memory;
   };
 
   struct ScenceResource {
     VkRenderPass pass;
     std::vector<VkFramebuffer> framebuffers;
-    std::vector<DepthResource> depth_resources;
+    DepthResource depth_resource;
   } scene_resource;
 
   struct DemoSet {
@@ -93,6 +88,8 @@ class PBRDemo : public RenderBase, public Listener {
 
   void onNotification() override;
 
+  void onSwapchainRecreated() override;
+
  private:
   RenderBaseContext context;
 
@@ -103,10 +100,23 @@ class PBRDemo : public RenderBase, public Listener {
   void createPipelines();
   void createFramebuffers();
 
+  // draws spheres [begin, end) of the stress grid, binds everything itself.
+  void recordSpheres(VkCommandBuffer command_buffer, u_int32_t camera_offset,
+                     glm::vec3 center, size_t begin, size_t end) const;
+  glm::vec4 getStressOffset(size_t index) const;
+
   std::shared_ptr<ModelProtoType> sphere_proto_type;
   std::shared_ptr<ModelInstance> sphere_instance;
 
   SphereGPUData sphere_data;
+  // lod drawn in the last frame, picked from projected error.
+  u_int32_t sphere_lod{0};
+
+  // stress scene of stress_grid^2 spheres, 0 draws the single one.
+  int stress_grid{0};
+  // secondary command buffers recorded on the render manager workers.
+  bool parallel_record{true};
+  double record_ms{0.0};
 
   FPSCamera camera;
 
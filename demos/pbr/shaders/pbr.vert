@@ -3,6 +3,10 @@
 layout(set = 0, binding = 0) uniform CameraData { mat4 ViewProjMatrix; }
 camera;
 
+// stress grid placement, zero for the single sphere.
+layout(push_constant) uniform Instance { vec4 offset; }
+instance;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texcoords;
@@ -11,8 +15,9 @@ layout(location = 0) out vec3 frag_world_position;
 layout(location = 1) out vec3 frag_normal;
 
 void main() {
-  // model is identity.
-  gl_Position = camera.ViewProjMatrix * vec4(position, 1.0);
-  frag_world_position = position;
+  // model is a translation.
+  vec3 world_position = position + instance.offset.xyz;
+  gl_Position = camera.ViewProjMatrix * vec4(world_position, 1.0);
+  frag_world_position = world_position;
   frag_normal = normal;
 }
\ No newline at end of file
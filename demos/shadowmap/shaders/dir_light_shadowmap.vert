@@ -1,12 +1,13 @@
 #version 460
 
+#include "../../common/shaders/vertex_format.glsl"
+
 layout(std140, set = 0, binding = 1) uniform DirectionLight {
   mat4 view_projectio_matrix;
 }
 dirlight;
 
-layout(location = 0) in vec3 position;
-
 void main() {
+  vec3 position = decodePosition();
   gl_Position = dirlight.view_projectio_matrix * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -3,87 +3,105 @@
 #include "demos/common/model_prototype.hpp"
 #include "engine/matrix.hpp"
 #include "util/assets_helper.hpp"
-#include "util/memory_ext.hpp"
 namespace LLShader {
 
 void ShadowMapDemo::init() {
   context = global_matrix_engine.render_manager->getRenderBaseContext();
   global_matrix_engine.input_manager->addListener(this);
-  loadVertices();
+  // texture decodes on workers while meshes parse.
   loadTextures();
+  loadVertices();
   createGPUDatas();
+  buildRenderGraph();
   setupSetAndLayout();
-  createRenderPasses();
   createPipelines();
-  createFrameBuffers();
 }
 
 void ShadowMapDemo::dispose() {
   auto device = context.device;
-  aligned_mfree(camera_data.obj.data);
+  render_graph.dispose();
 
   vkDestroyDescriptorSetLayout(device, set_config.global_data_set_layout,
                                nullptr);
 }
 
 void ShadowMapDemo::loadVertices() {
-  loadObjToMesh("./demos/shadowmap/assets/mary/Marry.obj", mary.mesh);
-  loadObjToMesh("./demos/shadowmap/assets/floor/floor.obj", floor.mesh);
-  loadObjToMesh("./demos/shadowmap/assets/cube/cube.obj", lamp.mesh);
+  auto& asset_loader = global_matrix_engine.asset_loader;
+  auto mary_mesh = asset_loader->async([] {
+    Mesh mesh;
+    loadObjToMesh("./demos/shadowmap/assets/mary/Marry.obj", mesh);
+    // reorders mary indices, each meshlet is a contiguous index range.
+    buildMeshlets(mesh);
+    return mesh;
+  });
+  auto floor_mesh =
+      asset_loader->loadMesh("./demos/shadowmap/assets/floor/floor.obj");
+  auto lamp_mesh =
+      asset_loader->loadMesh("./demos/shadowmap/assets/cube/cube.obj");
+
+  mary.mesh = asset_loader->wait(mary_mesh);
+  floor.mesh = asset_loader->wait(floor_mesh);
+  lamp.mesh = asset_loader->wait(lamp_mesh);
 }
 
 void ShadowMapDemo::loadTextures() {
-  mary.texture = global_matrix_engine.render_manager->loadTexture2D(
+  auto& asset_loader = global_matrix_engine.asset_loader;
+  mary_texture_future = asset_loader->loadTexture(
       "./demos/shadowmap/assets/mary/MC003_Kozakura_Mari.png");
+  mary.texture = asset_loader->getPlaceholderTexture();
 }
 
 void ShadowMapDemo::createGPUDatas() {
   auto& render_manager = global_matrix_engine.render_manager;
-  auto& swapchain_image_views =
-      global_matrix_engine.render_manager->getSwapchainImageViews();
-  auto sz = swapchain_image_views.size();
+
+  // vertices are packed into vertex_format, indices into uint16 if fit.
+  std::vector<unsigned char> packed;
+  std::vector<unsigned char> indices;
+
+  // all mesh buffers go out with one submit.
+  render_manager->beginUploadBatch();
 
   // mary
   {
+    mary.dequant = encodeVertices(vertex_format, mary.mesh.vertices, packed);
     render_manager->createDeviceOnlyBuffer(
-        mary.vert_buffer, mary.vert_memory,
-        mary.mesh.vertices.size() * sizeof(VertexData),
-        mary.mesh.vertices.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        mary.vert_buffer, mary.vert_memory, packed.size(), packed.data(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
+    mary.index_type = encodeIndices(mary.mesh.indices,
+                                  mary.mesh.vertices.size(), indices);
     render_manager->createDeviceOnlyBuffer(
-        mary.idx_buffer, mary.idx_memory,
-        mary.mesh.indices.size() * sizeof(u_int32_t), mary.mesh.indices.data(),
+        mary.idx_buffer, mary.idx_memory, indices.size(), indices.data(),
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   }
 
   // floor
   {
+    floor.dequant = encodeVertices(vertex_format, floor.mesh.vertices, packed);
     render_manager->createDeviceOnlyBuffer(
-        floor.vert_buffer, floor.vert_memory,
-        floor.mesh.vertices.size() * sizeof(VertexData),
-        floor.mesh.vertices.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        floor.vert_buffer, floor.vert_memory, packed.size(), packed.data(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
+    floor.index_type = encodeIndices(floor.mesh.indices,
+                                  floor.mesh.vertices.size(), indices);
     render_manager->createDeviceOnlyBuffer(
-        floor.idx_buffer, floor.idx_memory,
-        floor.mesh.indices.size() * sizeof(u_int32_t),
-        floor.mesh.indices.data(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        floor.idx_buffer, floor.idx_memory, indices.size(), indices.data(),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   }
 
   // cube
   {
+    lamp.dequant = encodeVertices(vertex_format, lamp.mesh.vertices, packed);
     render_manager->createDeviceOnlyBuffer(
-        lamp.vert_buffer, lamp.vert_memory,
-        lamp.mesh.vertices.size() * sizeof(VertexData),
-        lamp.mesh.vertices.data(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        lamp.vert_buffer, lamp.vert_memory, packed.size(), packed.data(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
+    lamp.index_type = encodeIndices(lamp.mesh.indices,
+                                  lamp.mesh.vertices.size(), indices);
     render_manager->createDeviceOnlyBuffer(
-        lamp.idx_buffer, lamp.idx_memory,
-        lamp.mesh.indices.size() * sizeof(u_int32_t), mary.mesh.indices.data(),
+        lamp.idx_buffer, lamp.idx_memory, indices.size(), indices.data(),
         VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    render_manager->submitUploadBatch();
 
     lamp_instances_data.data.resize(2);  // we have two instance.
     lamp_instances_data.data[0].model = glm::mat4(1.f);
@@ -101,67 +119,8 @@ void ShadowMapDemo::createGPUDatas() {
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
   }
 
-  // dynamic uniform
-  {
-    // code below is calulating aligned size required.
-    size_t min_uniform_aligment =
-        global_matrix_engine.vk_holder->getPhysicalDeviceProperties()
-            .limits.minUniformBufferOffsetAlignment;
-    size_t dynamic_aligment = sizeof(glm::mat4);
-    if (min_uniform_aligment > 0) {
-      // 这个算法是求 我们需要的大小 和 min_uniform_aligment 的 整数倍数
-      // 最接近的那个值
-      dynamic_aligment = (dynamic_aligment + min_uniform_aligment - 1) &
-                         ~(min_uniform_aligment - 1);
-    }
-
-    // we want flush mem by ourselves
-    render_manager->createBufferAndBindMemory(
-        camera_data.buffer, camera_data.memory,
-        dynamic_aligment * MAX_FRAMES_IN_FLIGHT, nullptr,  // we upload later.
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-    // set up data and upload.
-    camera_data.range = dynamic_aligment;
-    camera_data.obj.data = (glm::mat4*)aligned_malloc(
-        MAX_FRAMES_IN_FLIGHT * sizeof(glm::mat4), dynamic_aligment);
-
-    assert(camera_data.obj.data);
-
-    vkMapMemory(context.device, camera_data.memory, 0,
-                MAX_FRAMES_IN_FLIGHT * dynamic_aligment, 0,
-                &camera_data.mapped_memory);
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-      glm::mat4* data = (glm::mat4*)((u_int64_t)(camera_data.obj.data) +
-                                     dynamic_aligment * i);
-      (*data) =
-          camera.getPerspectiveProjectionMatrix() * camera.getViewMatrix();
-      //   glm::mat4(1.f, 2.f, 3.f, (float)i / (float)MAX_FRAMES_IN_FLIGHT);
-      // no coherent bit set,  so need flush by ourselves.
-      VkMappedMemoryRange range{VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
-      range.memory = camera_data.memory;
-      range.size = sizeof(glm::mat4);
-      range.offset = (VkDeviceSize)(i * dynamic_aligment);
-      range.pNext = nullptr;
-      memcpy((void*)((u_int64_t)camera_data.mapped_memory + range.offset), data,
-             range.size);
-      vkFlushMappedMemoryRanges(context.device, 1, &range);
-    }
-  }
-
   // direction light
   {
-    direction_light_shadow_pass.depth_resources.resize(sz);
-
-    for (size_t i = 0; i < sz; ++i) {
-      render_manager->defaultCreateDepthResource(
-          context.extent, direction_light_shadow_pass.depth_resources[i].image,
-          direction_light_shadow_pass.depth_resources[i].image_view,
-          direction_light_shadow_pass.depth_resources[i].memory);
-    }
-
     auto lookat =
         glm::lookAt(glm::vec3(25.f, 25.f, 25.f), glm::vec3(0.f, 0.f, 0.f),
                     glm::vec3(0.f, 1.f, 0.f));
@@ -178,17 +137,6 @@ void ShadowMapDemo::createGPUDatas() {
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
   }
 
-  // scence
-  {
-    scence_pass.depth_resources.resize(sz);
-    for (size_t i = 0; i < sz; ++i) {
-      render_manager->defaultCreateDepthResource(
-          context.extent, scence_pass.depth_resources[i].image,
-          scence_pass.depth_resources[i].image_view,
-          scence_pass.depth_resources[i].memory);
-    }
-  }
-
   // sampler
   {
     VkPhysicalDeviceProperties properties =
@@ -208,6 +156,8 @@ void ShadowMapDemo::createGPUDatas() {
     samplerInfo.compareEnable = VK_FALSE;
     samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
     samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
     if (vkCreateSampler(context.device, &samplerInfo, nullptr, &sampler) !=
         VK_SUCCESS) {
@@ -291,12 +241,12 @@ void ShadowMapDemo::setupSetAndLayout() {
     }
   }
 
-  // alloc set
+  // alloc set, one texture set per frame in flight.
   {
-    std::array<VkDescriptorSetLayout, 2> layouts = {
-        set_config.global_data_set_layout, set_config.texture_set_layout};
-    std::array<VkDescriptorSet, 2> sets = {set_config.global_data_set,
-                                           set_config.texture_set};
+    std::array<VkDescriptorSetLayout, 1 + MAX_FRAMES_IN_FLIGHT> layouts;
+    layouts.fill(set_config.texture_set_layout);
+    layouts[0] = set_config.global_data_set_layout;
+    std::array<VkDescriptorSet, 1 + MAX_FRAMES_IN_FLIGHT> sets;
 
     VkDescriptorSetAllocateInfo set_alloc_info{
         VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
@@ -311,11 +261,11 @@ void ShadowMapDemo::setupSetAndLayout() {
       throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    // copy back, because we make a temp variable for layouts and sets.
-    set_config.global_data_set_layout = layouts[0];
+    // copy back, because we make a temp variable for sets.
     set_config.global_data_set = sets[0];
-    set_config.texture_set_layout = layouts[1];
-    set_config.texture_set = sets[1];
+    for (u_int32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+      set_config.texture_sets[i] = sets[i + 1];
+    }
   }
 
   // update set data
@@ -323,9 +273,11 @@ void ShadowMapDemo::setupSetAndLayout() {
     // global data
     // camera uniform
     VkDescriptorBufferInfo camera_uniform_buf_info{};
-    camera_uniform_buf_info.buffer = camera_data.buffer;
+    // pv is pushed per frame, the offset is dynamic.
+    camera_uniform_buf_info.buffer =
+        global_matrix_engine.render_manager->getFrameUniforms().getBuffer();
     camera_uniform_buf_info.offset = 0;
-    camera_uniform_buf_info.range = camera_data.range;
+    camera_uniform_buf_info.range = sizeof(glm::mat4);
 
     VkWriteDescriptorSet camera_uniform_writer{
         VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
@@ -352,53 +304,56 @@ void ShadowMapDemo::setupSetAndLayout() {
     dir_light_uniform_writer.dstArrayElement = 0;
     dir_light_uniform_writer.pBufferInfo = &dir_light_uniform_buf_info;
 
-    // texture data
-
-    // mary tex
-    VkDescriptorImageInfo marry_image_info{};
-    marry_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    marry_image_info.imageView = mary.texture.texture_image_view;
-    marry_image_info.sampler = sampler;
-
-    VkWriteDescriptorSet marry_texture_sampler_writer{
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-    marry_texture_sampler_writer.dstSet = set_config.texture_set;
-    marry_texture_sampler_writer.dstBinding = 0;
-    marry_texture_sampler_writer.dstArrayElement = 0;
-    marry_texture_sampler_writer.descriptorType =
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    marry_texture_sampler_writer.descriptorCount = 1;
-    marry_texture_sampler_writer.pImageInfo = &marry_image_info;
-
-    // dir shadowmap tex (NOTE: although we have multi depth, but i do not want
-    // write more code here, use index 0 is work but bad!)
-    VkDescriptorImageInfo shadowmap_image_info{};
-    shadowmap_image_info.imageLayout =
-        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-    shadowmap_image_info.imageView =
-        direction_light_shadow_pass.depth_resources[0].image_view;
-    shadowmap_image_info.sampler = sampler;
-
-    VkWriteDescriptorSet shadowmap_image_writer{
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-    shadowmap_image_writer.dstSet = set_config.texture_set;
-    shadowmap_image_writer.dstBinding = 1;
-    shadowmap_image_writer.dstArrayElement = 0;
-    shadowmap_image_writer.descriptorType =
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    shadowmap_image_writer.descriptorCount = 1;
-    shadowmap_image_writer.pImageInfo = &shadowmap_image_info;
-
-    std::array<VkWriteDescriptorSet, 4> writer{
+    std::array<VkWriteDescriptorSet, 2> writer{
         camera_uniform_writer,
         dir_light_uniform_writer,
-        marry_texture_sampler_writer,
-        shadowmap_image_writer,
     };
 
     vkUpdateDescriptorSets(context.device, writer.size(), writer.data(), 0,
                            nullptr);
   }
+  for (u_int32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) writeTextureSet(i);
+}
+
+void ShadowMapDemo::writeTextureSet(u_int32_t frame) {
+  VkDescriptorImageInfo marry_image_info{};
+  marry_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  marry_image_info.imageView = mary.texture.texture_image_view;
+  marry_image_info.sampler = sampler;
+
+  VkWriteDescriptorSet marry_texture_sampler_writer{
+      VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  marry_texture_sampler_writer.dstSet = set_config.texture_sets[frame];
+  marry_texture_sampler_writer.dstBinding = 0;
+  marry_texture_sampler_writer.dstArrayElement = 0;
+  marry_texture_sampler_writer.descriptorType =
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  marry_texture_sampler_writer.descriptorCount = 1;
+  marry_texture_sampler_writer.pImageInfo = &marry_image_info;
+
+  VkDescriptorImageInfo shadowmap_image_info{};
+  shadowmap_image_info.imageLayout =
+      render_graph.getSampledLayout(direction_light_shadow_pass.shadow_map);
+  shadowmap_image_info.imageView =
+      render_graph.getImageView(direction_light_shadow_pass.shadow_map);
+  shadowmap_image_info.sampler = sampler;
+
+  VkWriteDescriptorSet shadowmap_image_writer{
+      VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  shadowmap_image_writer.dstSet = set_config.texture_sets[frame];
+  shadowmap_image_writer.dstBinding = 1;
+  shadowmap_image_writer.dstArrayElement = 0;
+  shadowmap_image_writer.descriptorType =
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  shadowmap_image_writer.descriptorCount = 1;
+  shadowmap_image_writer.pImageInfo = &shadowmap_image_info;
+
+  std::array<VkWriteDescriptorSet, 2> writer{
+      marry_texture_sampler_writer,
+      shadowmap_image_writer,
+  };
+  vkUpdateDescriptorSets(context.device, writer.size(), writer.data(), 0,
+                         nullptr);
 }
 
 void ShadowMapDemo::createPipelines() {
@@ -409,7 +364,7 @@ void ShadowMapDemo::createPipelines() {
   {
     VkShaderModule vs = render_manager->createShaderMoudule(
         "./demos/shadowmap/shaders/dir_light_shadowmap.vert",
-        shaderc_vertex_shader);
+        shaderc_vertex_shader, getVertexFormatMacros(vertex_format));
 
     VkShaderModule fs = render_manager->createShaderMoudule(
         "./demos/shadowmap/shaders/dir_light_shadowmap.frag",
@@ -432,25 +387,16 @@ void ShadowMapDemo::createPipelines() {
     stages[1].flags = 0;
     stages[1].pSpecializationInfo = nullptr;
 
-    std::array<VkVertexInputAttributeDescription, 1> inputs;
-
-    // position
-    inputs[0].location = 0;
-    inputs[0].binding = 0;
-    inputs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    inputs[0].offset = offsetof(VertexData, position);
-
-    VkVertexInputBindingDescription binding_desp{
-        .binding = 0,
-        .stride = sizeof(VertexData),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-    };
+    // position, normal, texcoords, shader only read position.
+    auto inputs = getVertexAttributeDescriptions(vertex_format);
+    auto binding_desp = getVertexBindingDescription(vertex_format);
 
     VkPipelineVertexInputStateCreateInfo input_state{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
         .vertexBindingDescriptionCount = 1,
         .pVertexBindingDescriptions = &binding_desp,
-        .vertexAttributeDescriptionCount = inputs.size(),
+        .vertexAttributeDescriptionCount =
+            static_cast<u_int32_t>(inputs.size()),
         .pVertexAttributeDescriptions = inputs.data(),
     };
 
@@ -460,26 +406,19 @@ void ShadowMapDemo::createPipelines() {
         .primitiveRestartEnable = VK_FALSE,
     };
 
-    VkViewport viewPort{
-        .x = 0.f,
-        .y = 0.f,
-        .width = static_cast<float>(context.extent.width),
-        .height = static_cast<float>(context.extent.height),
-        .minDepth = 0.f,
-        .maxDepth = 1.f,
-    };
-
-    VkRect2D scissor{
-        .offset = {0, 0},
-        .extent = context.extent,
-    };
-
+    // viewport & scissor follow the swapchain, set when recording.
     VkPipelineViewportStateCreateInfo viewport_state{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .viewportCount = 1,
-        .pViewports = &viewPort,
         .scissorCount = 1,
-        .pScissors = &scissor,
+    };
+
+    std::array<VkDynamicState, 2> dynamic_states{VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = static_cast<u_int32_t>(dynamic_states.size()),
+        .pDynamicStates = dynamic_states.data(),
     };
 
     // Rasterizer
@@ -506,6 +445,11 @@ void ShadowMapDemo::createPipelines() {
         VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
     pipeline_layout_c_info.setLayoutCount = 2;
 
+    // dequant params of packed vertex.
+    auto dequant_range = getVertexDequantPushConstantRange();
+    pipeline_layout_c_info.pushConstantRangeCount = 1;
+    pipeline_layout_c_info.pPushConstantRanges = &dequant_range;
+
     VkDescriptorSetLayout set_layouts[] = {set_config.global_data_set_layout,
                                            set_config.texture_set_layout};
 
@@ -527,9 +471,11 @@ void ShadowMapDemo::createPipelines() {
         .pMultisampleState = nullptr,
         .pDepthStencilState = &depthStencil,
         .pColorBlendState = nullptr,
-        .pDynamicState = nullptr,
+        .pDynamicState = &dynamic_state,
         .layout = direction_light_shadow_pass.pipeline_layout,
-        .renderPass = direction_light_shadow_pass.pass,
+        .renderPass =
+            render_graph.getRenderPass(direction_light_shadow_pass.pass),
+        .subpass = render_graph.getSubpass(direction_light_shadow_pass.pass),
     };
 
     if (vkCreateGraphicsPipelines(
@@ -545,7 +491,8 @@ void ShadowMapDemo::createPipelines() {
   // scene pipeline
   {
     VkShaderModule vs = render_manager->createShaderMoudule(
-        "./demos/shadowmap/shaders/scene.vert", shaderc_vertex_shader);
+        "./demos/shadowmap/shaders/scene.vert", shaderc_vertex_shader,
+        getVertexFormatMacros(vertex_format));
 
     VkShaderModule fs = render_manager->createShaderMoudule(
         "./demos/shadowmap/shaders/scene.frag", shaderc_fragment_shader);
@@ -569,37 +516,16 @@ void ShadowMapDemo::createPipelines() {
     stages[1].flags = 0;
     stages[1].pSpecializationInfo = nullptr;
 
-    std::array<VkVertexInputAttributeDescription, 3> inputs;
-
-    // position
-    inputs[0].location = 0;
-    inputs[0].binding = 0;
-    inputs[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    inputs[0].offset = offsetof(VertexData, position);
-
-    // normal
-    inputs[1].location = 1;
-    inputs[1].binding = 0;
-    inputs[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    inputs[1].offset = offsetof(VertexData, normal);
-
-    // texcoords
-    inputs[2].location = 2;
-    inputs[2].binding = 0;
-    inputs[2].format = VK_FORMAT_R32G32_SFLOAT;
-    inputs[2].offset = offsetof(VertexData, texcoords);
-
-    VkVertexInputBindingDescription binding_desp{
-        .binding = 0,
-        .stride = sizeof(VertexData),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-    };
+    // position, normal, texcoords
+    auto inputs = getVertexAttributeDescriptions(vertex_format);
+    auto binding_desp = getVertexBindingDescription(vertex_format);
 
     VkPipelineVertexInputStateCreateInfo input_state{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
         .vertexBindingDescriptionCount = 1,
         .pVertexBindingDescriptions = &binding_desp,
-        .vertexAttributeDescriptionCount = inputs.size(),
+        .vertexAttributeDescriptionCount =
+            static_cast<u_int32_t>(inputs.size()),
         .pVertexAttributeDescriptions = inputs.data(),
     };
 
@@ -609,26 +535,19 @@ void ShadowMapDemo::createPipelines() {
         .primitiveRestartEnable = VK_FALSE,
     };
 
-    VkViewport viewPort{
-        .x = 0.f,
-        .y = 0.f,
-        .width = static_cast<float>(context.extent.width),
-        .height = static_cast<float>(context.extent.height),
-        .minDepth = 0.f,
-        .maxDepth = 1.f,
-    };
-
-    VkRect2D scissor{
-        .offset = {0, 0},
-        .extent = context.extent,
-    };
-
+    // viewport & scissor follow the swapchain, set when recording.
     VkPipelineViewportStateCreateInfo viewport_state{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .viewportCount = 1,
-        .pViewports = &viewPort,
         .scissorCount = 1,
-        .pScissors = &scissor,
+    };
+
+    std::array<VkDynamicState, 2> dynamic_states{VK_DYNAMIC_STATE_VIEWPORT,
+                                                 VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = static_cast<u_int32_t>(dynamic_states.size()),
+        .pDynamicStates = dynamic_states.data(),
     };
 
     // Rasterizer
@@ -666,6 +585,11 @@ void ShadowMapDemo::createPipelines() {
         VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
     pipeline_layout_c_info.setLayoutCount = 2;
 
+    // dequant params of packed vertex.
+    auto dequant_range = getVertexDequantPushConstantRange();
+    pipeline_layout_c_info.pushConstantRangeCount = 1;
+    pipeline_layout_c_info.pPushConstantRanges = &dequant_range;
+
     // all set has same layout, so we use index 0.
     VkDescriptorSetLayout set_layouts[] = {set_config.global_data_set_layout,
                                            set_config.texture_set_layout};
@@ -687,9 +611,10 @@ void ShadowMapDemo::createPipelines() {
         .pMultisampleState = nullptr,
         .pDepthStencilState = &depthStencil,
         .pColorBlendState = &colorBlending,
-        .pDynamicState = nullptr,
+        .pDynamicState = &dynamic_state,
         .layout = scence_pass.pipeline_layout,
-        .renderPass = scence_pass.pass,
+        .renderPass = render_graph.getRenderPass(scence_pass.pass),
+        .subpass = render_graph.getSubpass(scence_pass.pass),
     };
 
     if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
@@ -703,185 +628,57 @@ void ShadowMapDemo::createPipelines() {
   }
 }
 
-void ShadowMapDemo::createRenderPasses() {
-  // direction light pass
-  {
-    VkAttachmentDescription attach_desp{};
-    attach_desp.format = VK_FORMAT_D32_SFLOAT;
-    attach_desp.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attach_desp.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attach_desp.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attach_desp.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attach_desp.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attach_desp.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-    attach_desp.samples = VK_SAMPLE_COUNT_1_BIT;
-    // direction_light_pass_attach_desp.flags =  I dont know
-
-    VkAttachmentReference ref{};
-    ref.attachment = 0;
-    ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass_desp{};
-    subpass_desp.colorAttachmentCount = 0;
-    subpass_desp.pDepthStencilAttachment = &ref;
-
-    // transition layout using dependency
-    std::array<VkSubpassDependency, 2> depdencies{};
-    depdencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    depdencies[0].dstSubpass = 0;
-    depdencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    depdencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    depdencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    depdencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    depdencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    depdencies[1].srcSubpass = 0;
-    depdencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-    depdencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-    depdencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    depdencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    // change layout to for scence pass to sample
-    depdencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    depdencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    VkRenderPassCreateInfo create_info{
-        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
-    create_info.attachmentCount = 1;
-    create_info.pAttachments = &attach_desp;
-    create_info.dependencyCount = depdencies.size();
-    create_info.pDependencies = depdencies.data();
-    create_info.subpassCount = 1;
-    create_info.pSubpasses = &subpass_desp;
-
-    if (vkCreateRenderPass(context.device, &create_info, nullptr,
-                           &direction_light_shadow_pass.pass)) {
-      throw std::runtime_error("Failed to create direction lighy pass!");
-    }
-  }
-
-  // scence pass
-  {
-    VkAttachmentDescription color_attach{};
-    color_attach.format = context.surface_format.format;
-    color_attach.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attach.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attach.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    color_attach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    color_attach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attach.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    color_attach.samples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkAttachmentReference color_attach_ref{};
-    color_attach_ref.attachment = 0;
-    color_attach_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentDescription depth_attach{};
-    depth_attach.format = VK_FORMAT_D32_SFLOAT;
-    depth_attach.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depth_attach.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depth_attach.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depth_attach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depth_attach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depth_attach.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-    depth_attach.samples = VK_SAMPLE_COUNT_1_BIT;
-
-    VkAttachmentReference depth_attach_ref{};
-    depth_attach_ref.attachment = 1;
-    depth_attach_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    std::array<VkAttachmentDescription, 2> attach_desps{color_attach,
-                                                        depth_attach};
-
-    std::array<VkSubpassDependency, 1> depencies{};  // wait swapchain image
-    depencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    depencies[0].dstSubpass = 0;
-    depencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    depencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    depencies[0].srcAccessMask = VK_ACCESS_NONE;
-    depencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    depencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    VkSubpassDescription subpass_desp{};
-    subpass_desp.colorAttachmentCount = 1;
-    subpass_desp.pColorAttachments = &color_attach_ref;
-    subpass_desp.pDepthStencilAttachment = &depth_attach_ref;
-
-    VkRenderPassCreateInfo create_info{
-        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO};
-    create_info.attachmentCount = attach_desps.size();
-    create_info.pAttachments = attach_desps.data();
-    create_info.dependencyCount = depencies.size();
-    create_info.pDependencies = depencies.data();
-    create_info.subpassCount = 1;
-    create_info.pSubpasses = &subpass_desp;
-    if (vkCreateRenderPass(context.device, &create_info, nullptr,
-                           &scence_pass.pass)) {
-      throw std::runtime_error("Failed to create direction lighy pass!");
-    }
-  }
+void ShadowMapDemo::buildRenderGraph() {
+  auto& render_manager = global_matrix_engine.render_manager;
+  auto& shadow_pass = direction_light_shadow_pass;
+
+  // created by the graph, one for all frames in flight.
+  shadow_pass.shadow_map = render_graph.createImage(
+      "dir light shadow map", VK_FORMAT_D32_SFLOAT, context.extent);
+  scence_pass.depth = render_graph.createImage(
+      "scene depth", VK_FORMAT_D32_SFLOAT, context.extent);
+  // imgui draws on it after us, in the color attachment layout.
+  scence_pass.backbuffer = render_graph.importImage(
+      "backbuffer", context.surface_format.format, context.extent,
+      render_manager->getSwapchainImages(),
+      render_manager->getSwapchainImageViews(), VK_IMAGE_LAYOUT_UNDEFINED,
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+  VkClearDepthStencilValue depth_clear{1.0f, 0};
+  VkClearColorValue color_clear{{0.3f, 0.4f, 0.5f, 1.0f}};
+
+  shadow_pass.pass = render_graph.addPass(
+      "dir light shadow", [this](VkCommandBuffer command_buffer) {
+        recordShadowPass(command_buffer);
+      });
+  render_graph.setDepthOutput(shadow_pass.pass, shadow_pass.shadow_map,
+                              &depth_clear);
+
+  scence_pass.pass = render_graph.addPass(
+      "scene", [this](VkCommandBuffer command_buffer) {
+        recordScenePass(command_buffer);
+      });
+  render_graph.addColorOutput(scence_pass.pass, scence_pass.backbuffer,
+                              &color_clear);
+  render_graph.setDepthOutput(scence_pass.pass, scence_pass.depth,
+                              &depth_clear);
+  render_graph.addTextureInput(scence_pass.pass, shadow_pass.shadow_map);
+
+  render_graph.compile(context.device, render_manager->getAllocator());
 }
 
-void ShadowMapDemo::createFrameBuffers() {
-  auto& swapchain_image_views =
-      global_matrix_engine.render_manager->getSwapchainImageViews();
-  auto extent = context.extent;
-  auto device = context.device;
-
-  auto sz = swapchain_image_views.size();
-  // direction light framebuffers
-  direction_light_shadow_pass.framebuffers.resize(sz);
-  scence_pass.framebuffers.resize(sz);
-
-  for (size_t i = 0; i < sz; ++i) {
-    // direction light framebuffers
-    {
-      VkImageView attachments[] = {
-          direction_light_shadow_pass.depth_resources[i].image_view,
-      };
-      VkFramebufferCreateInfo framebufferInfo{
-          .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-          .renderPass = direction_light_shadow_pass.pass,
-          .attachmentCount = 1,
-          .pAttachments = attachments,
-          .width = extent.width,
-          .height = extent.height,
-          .layers = 1,
-      };
-
-      if (vkCreateFramebuffer(device, &framebufferInfo, nullptr,
-                              &direction_light_shadow_pass.framebuffers[i]) !=
-          VK_SUCCESS) {
-        throw std::runtime_error("failed to create framebuffer!");
-      }
-    }
-
-    // scence framebuffers
-    {
-      VkImageView attachments[] = {
-          swapchain_image_views[i],  // color attachment
-          scence_pass.depth_resources[i].image_view,
-      };
-      VkFramebufferCreateInfo framebufferInfo{
-          .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-          .renderPass = scence_pass.pass,
-          .attachmentCount = 2,
-          .pAttachments = attachments,
-          .width = extent.width,
-          .height = extent.height,
-          .layers = 1,
-      };
-
-      if (vkCreateFramebuffer(device, &framebufferInfo, nullptr,
-                              &scence_pass.framebuffers[i]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create framebuffer!");
-      }
-    }
-  }
+void ShadowMapDemo::onSwapchainRecreated() {
+  auto& render_manager = global_matrix_engine.render_manager;
+  context = render_manager->getRenderBaseContext();
+  // frames in flight still render with the old images, and their texture
+  // sets name the old shadow map. each frame rewrites its own set when it
+  // records next.
+  render_manager->deferDestroy(render_graph.release());
+  buildRenderGraph();
+  stale_texture_sets = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
 }
 
 void ShadowMapDemo::onNotification() {
-  auto current_frame_idx =
-      global_matrix_engine.render_manager->getCurrenFrame();
   // cursor dx 控制 yaw(rotate.y), cursor dy 控制 pitch(rotate.x)
   // 原点在左上角，  y 轴向下，所以鼠标下移是 +
   auto cursor_delta =
@@ -892,122 +689,121 @@ void ShadowMapDemo::onNotification() {
 
   camera.move(move_delta);
   camera.rotate(glm::vec3(-cursor_delta.y, cursor_delta.x, 0.f));
+}
 
+void ShadowMapDemo::update(double dt) {
+  // swap placeholder once the texture uploaded.
+  if (mary_texture_future.valid() &&
+      mary_texture_future.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    mary.texture = mary_texture_future.get();
+    mary_texture_future = {};
+    // sets of frames in flight still name the placeholder, each frame
+    // rewrites its own when it records next.
+    stale_texture_sets = (1u << MAX_FRAMES_IN_FLIGHT) - 1;
+  }
+}
+
+void ShadowMapDemo::drawScene(VkCommandBuffer command_buffer,
+                              u_int32_t framebuffer_index) {
   auto p = camera.getPerspectiveProjectionMatrix();
   auto v = camera.getViewMatrix();
   p[1][1] *= -1;
-  auto pv = p * v;
-  auto dy_aligment = 64;
-  memcpy((void*)((u_int64_t)camera_data.mapped_memory +
-                 current_frame_idx * dy_aligment),
-         &pv, dy_aligment);
+  auto& render_manager = global_matrix_engine.render_manager;
+  dy_offset = render_manager->getFrameUniforms().push(p * v);
+  // beginFrame() waited for the last frame recorded in this slot.
+  frame_slot = render_manager->getCurrenFrame();
+  if (stale_texture_sets & (1u << frame_slot)) {
+    writeTextureSet(frame_slot);
+    stale_texture_sets &= ~(1u << frame_slot);
+  }
+  render_graph.execute(command_buffer, framebuffer_index);
 }
 
-void ShadowMapDemo::update(double dt) {}
-
-void ShadowMapDemo::drawScene(VkCommandBuffer command_buffer,
-                              u_int32_t framebuffer_index) {
+void ShadowMapDemo::recordShadowPass(VkCommandBuffer command_buffer) {
   const VkDeviceSize zero_offset[] = {0};
-  u_int32_t dy_offset = 64;  // hard code, value should be dynamic aligment.
-  // dir light shadow pass begin
-  {
-    VkRenderPassBeginInfo renderPassInfo{
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass = direction_light_shadow_pass.pass,
-        .framebuffer =
-            direction_light_shadow_pass.framebuffers[framebuffer_index],
-        .renderArea{
-            .offset = {0, 0},
-            .extent = context.extent,
-        },
-    };
-
-    std::array<VkClearValue, 1> clearValues{};
-    clearValues[0].depthStencil = {1.0, 0};
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    direction_light_shadow_pass.pipeline);
+  RenderManager::cmdSetViewport(command_buffer, context.extent);
 
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
-    vkCmdBeginRenderPass(command_buffer, &renderPassInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
+  VkDescriptorSet sets[] = {set_config.global_data_set,
+                            set_config.texture_sets[frame_slot]};
 
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      direction_light_shadow_pass.pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          direction_light_shadow_pass.pipeline_layout, 0, 2,
+                          sets, 1, &dy_offset);
 
-    VkDescriptorSet sets[] = {set_config.global_data_set,
-                              set_config.texture_set};
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &mary.vert_buffer,
+                         zero_offset);
 
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            direction_light_shadow_pass.pipeline_layout, 0, 2,
-                            sets, 1, &dy_offset);
+  vkCmdBindIndexBuffer(command_buffer, mary.idx_buffer, 0, mary.index_type);
 
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, &mary.vert_buffer,
-                           zero_offset);
+  vkCmdPushConstants(command_buffer,
+                     direction_light_shadow_pass.pipeline_layout,
+                     VK_SHADER_STAGE_VERTEX_BIT, 0,
+                     sizeof(VertexDequantParams), &mary.dequant);
 
-    vkCmdBindIndexBuffer(command_buffer, mary.idx_buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
+  vkCmdDrawIndexed(command_buffer, mary.mesh.indices.size(), 1, 0, 0, 0);
 
-    vkCmdDrawIndexed(command_buffer, mary.mesh.indices.size(), 1, 0, 0, 0);
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &floor.vert_buffer,
+                         zero_offset);
 
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, &floor.vert_buffer,
-                           zero_offset);
+  vkCmdBindIndexBuffer(command_buffer, floor.idx_buffer, 0,
+                       floor.index_type);
 
-    vkCmdBindIndexBuffer(command_buffer, floor.idx_buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
+  vkCmdPushConstants(command_buffer,
+                     direction_light_shadow_pass.pipeline_layout,
+                     VK_SHADER_STAGE_VERTEX_BIT, 0,
+                     sizeof(VertexDequantParams), &floor.dequant);
 
-    vkCmdDrawIndexed(command_buffer, floor.mesh.indices.size(), 1, 0, 0, 0);
-
-    vkCmdEndRenderPass(command_buffer);
-  }
-
-  // scene pass begin
-  {
-    VkRenderPassBeginInfo renderPassInfo{
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass = scence_pass.pass,
-        .framebuffer = scence_pass.framebuffers[framebuffer_index],
-        .renderArea{
-            .offset = {0, 0},
-            .extent = context.extent,
-        },
-    };
-
-    std::array<VkClearValue, 2> clearValues{};
-    clearValues[0].color = {0.3f, 0.4f, 0.5f, 1.0f};
-    clearValues[1].depthStencil = {1.0, 0};
+  vkCmdDrawIndexed(command_buffer, floor.mesh.indices.size(), 1, 0, 0, 0);
+}
 
-    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues = clearValues.data();
-    vkCmdBeginRenderPass(command_buffer, &renderPassInfo,
-                         VK_SUBPASS_CONTENTS_INLINE);
+void ShadowMapDemo::recordScenePass(VkCommandBuffer command_buffer) {
+  const VkDeviceSize zero_offset[] = {0};
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    scence_pass.pipeline);
+  RenderManager::cmdSetViewport(command_buffer, context.extent);
 
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      scence_pass.pipeline);
+  VkDescriptorSet sets[] = {set_config.global_data_set,
+                            set_config.texture_sets[frame_slot]};
 
-    VkDescriptorSet sets[] = {set_config.global_data_set,
-                              set_config.texture_set};
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          scence_pass.pipeline_layout, 0, 2, sets, 1,
+                          &dy_offset);
 
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            scence_pass.pipeline_layout, 0, 2, sets, 1,
-                            &dy_offset);
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &mary.vert_buffer,
+                         zero_offset);
 
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, &mary.vert_buffer,
-                           zero_offset);
+  vkCmdBindIndexBuffer(command_buffer, mary.idx_buffer, 0, mary.index_type);
 
-    vkCmdBindIndexBuffer(command_buffer, mary.idx_buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
+  vkCmdPushConstants(command_buffer, scence_pass.pipeline_layout,
+                     VK_SHADER_STAGE_VERTEX_BIT, 0,
+                     sizeof(VertexDequantParams), &mary.dequant);
 
-    vkCmdDrawIndexed(command_buffer, mary.mesh.indices.size(), 1, 0, 0, 0);
+  // skip off screen and backfacing meshlets, mary is in world space.
+  auto p = camera.getPerspectiveProjectionMatrix();
+  p[1][1] *= -1;
+  auto cull_params = makeMeshletCullParams(
+      p * camera.getViewMatrix(), glm::mat4(1.0f), camera.getPosition());
+  mary.visible_triangles =
+      cullMeshlets(mary.mesh.meshlets, cull_params, mary.visible_ranges);
+  for (const auto& range : mary.visible_ranges) {
+    vkCmdDrawIndexed(command_buffer, range.index_count, 1,
+                     range.first_index, 0, 0);
+  }
 
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, &floor.vert_buffer,
-                           zero_offset);
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &floor.vert_buffer,
+                         zero_offset);
 
-    vkCmdBindIndexBuffer(command_buffer, floor.idx_buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
+  vkCmdBindIndexBuffer(command_buffer, floor.idx_buffer, 0,
+                       floor.index_type);
 
-    vkCmdDrawIndexed(command_buffer, floor.mesh.indices.size(), 1, 0, 0, 0);
+  vkCmdPushConstants(command_buffer, scence_pass.pipeline_layout,
+                     VK_SHADER_STAGE_VERTEX_BIT, 0,
+                     sizeof(VertexDequantParams), &floor.dequant);
 
-    vkCmdEndRenderPass(command_buffer);
-  }
+  vkCmdDrawIndexed(command_buffer, floor.mesh.indices.size(), 1, 0, 0, 0);
 }
 
 void ShadowMapDemo::drawUI() {
@@ -1026,6 +822,15 @@ void ShadowMapDemo::drawUI() {
     ImGui::Text("up: %.2f, %.2f, %.2f", up.x, up.y, up.z);
     ImGui::Text("right: %.2f, %.2f, %.2f", right.x, right.y, right.z);
     ImGui::Text("front: %.2f, %.2f, %.2f", front.x, front.y, front.z);
+    ImGui::Text("mary triangles: %u / %zu, draws: %zu",
+                mary.visible_triangles, mary.mesh.indices.size() / 3,
+                mary.visible_ranges.size());
+    const auto& graph_stats = render_graph.getStats();
+    ImGui::Text("render passes: %u, barriers: %u (%u images)",
+                graph_stats.render_pass_count, graph_stats.barrier_count,
+                graph_stats.image_barrier_count);
+    ImGui::Text("transient images: %.1f MiB",
+                graph_stats.allocated_bytes / 1048576.0);
     ImGui::End();
   }
 }
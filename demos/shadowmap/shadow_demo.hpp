@@ -2,7 +2,11 @@
 
 #include "demos/common/camera.hpp"
 #include "demos/common/shader_type.hpp"
+#include "demos/common/vertex_format.hpp"
+#include "util/meshlet_builder.hpp"
+#include "render/asset_loader.hpp"
 #include "render/render_base.hpp"
+#include "render/render_graph.hpp"
 #include "render/render_manager.hpp"
 
 namespace LLShader {
@@ -14,7 +18,8 @@ class ShadowMapDemo : public RenderBase, public Listener {
     VkDescriptorSet global_data_set;
     VkDescriptorSet buffer_set;
     VkDescriptorSet sampler_set;
-    VkDescriptorSet texture_set;
+    // per frame in flight, indexed by RenderManager::getCurrenFrame().
+    VkDescriptorSet texture_sets[MAX_FRAMES_IN_FLIGHT];
 
     VkDescriptorSetLayout global_data_set_layout;
     VkDescriptorSetLayout buffer_set_layout;    // null at this demo
@@ -23,48 +28,39 @@ class ShadowMapDemo : public RenderBase, public Listener {
 
   } SetConfig;
 
-  typedef struct {
-    VkImage image;
-    VkImageView image_view;
-    VkDeviceMemory memory;
-  } DepthResource;
-
-  typedef struct {
-    glm::mat4 *data;
-  } UniformObj;
-
-  typedef struct {
-    UniformObj obj;
-    void *mapped_memory;
-    size_t range;
-    VkBuffer buffer;
-    VkDeviceMemory memory;
-  } UniformData;
-
   struct MaryModel {
     Mesh mesh;
+    VertexDequantParams dequant;
+    VkIndexType index_type;
     VkBuffer vert_buffer;
-    VkDeviceMemory vert_memory;
+    GpuAllocation vert_memory;
     VkBuffer idx_buffer;
-    VkDeviceMemory idx_memory;
+    GpuAllocation idx_memory;
     Texture2D texture;
+    // meshlets left after camera culling, rebuilt every frame.
+    std::vector<IndexRange> visible_ranges;
+    u_int32_t visible_triangles{0};
   } mary;
 
   struct FloorModel {
     Mesh mesh;
+    VertexDequantParams dequant;
+    VkIndexType index_type;
     VkBuffer vert_buffer;
-    VkDeviceMemory vert_memory;
+    GpuAllocation vert_memory;
     VkBuffer idx_buffer;
-    VkDeviceMemory idx_memory;
+    GpuAllocation idx_memory;
     Texture2D texture;
   } floor;
 
   struct LampModel {
     Mesh mesh;
+    VertexDequantParams dequant;
+    VkIndexType index_type;
     VkBuffer vert_buffer;
-    VkDeviceMemory vert_memory;
+    GpuAllocation vert_memory;
     VkBuffer idx_buffer;
-    VkDeviceMemory idx_memory;
+    GpuAllocation idx_memory;
   } lamp;
 
   struct LampInstanceData {
@@ -75,7 +71,7 @@ class ShadowMapDemo : public RenderBase, public Listener {
     };
     std::vector<InstanceData> data;
     VkBuffer property_buffer;
-    VkDeviceMemory property_memory;
+    GpuAllocation property_memory;
   } lamp_instances_data;
 
   struct CameraDataShaderType {
@@ -90,10 +86,9 @@ class ShadowMapDemo : public RenderBase, public Listener {
   struct DirectionLightShadowPass {
     VkPipeline pipeline;
     VkPipelineLayout pipeline_layout;
-    VkRenderPass pass;
-    // Pass write depth to framebuffer
-    std::vector<DepthResource> depth_resources;
-    std::vector<VkFramebuffer> framebuffers;
+    RenderGraphPass pass;
+    // Pass write depth to it, sampled by the scence pass.
+    RenderGraphResource shadow_map;
   } direction_light_shadow_pass;
 
   // gen shadow map for point light
@@ -107,11 +102,10 @@ class ShadowMapDemo : public RenderBase, public Listener {
   struct ScencePass {
     VkPipeline pipeline;
     VkPipelineLayout pipeline_layout;
-    VkRenderPass pass;
-    // Pass write depth to framebuffer
+    RenderGraphPass pass;
     // color attachment is come from render_manager.
-    std::vector<DepthResource> depth_resources;
-    std::vector<VkFramebuffer> framebuffers;
+    RenderGraphResource backbuffer;
+    RenderGraphResource depth;
   } scence_pass;
 
   // draw light for position visualization
@@ -129,7 +123,7 @@ class ShadowMapDemo : public RenderBase, public Listener {
     glm::vec4 color;
     glm::vec3 position;
     DirectionLightShaderType shader_type_data;
-    VkDeviceMemory shader_type_mem;
+    GpuAllocation shader_type_mem;
     VkBuffer shader_type_buffer;
   } direction_light;
 
@@ -146,22 +140,40 @@ class ShadowMapDemo : public RenderBase, public Listener {
 
   void onNotification() override;
 
+  void onSwapchainRecreated() override;
+
  private:
   void loadVertices();
   void loadTextures();
   void createGPUDatas();
   void setupSetAndLayout();
+  // mary texture and shadow map of texture_sets[frame].
+  void writeTextureSet(u_int32_t frame);
   void createPipelines();
-  void createRenderPasses();
-  void createFrameBuffers();
+  void buildRenderGraph();
+  void recordShadowPass(VkCommandBuffer command_buffer);
+  void recordScenePass(VkCommandBuffer command_buffer);
   RenderBaseContext context;
   SetConfig set_config;
   // demo variable
-  UniformData camera_data;
-
   FPSCamera camera;
 
   VkSampler sampler;
+
+  // shadow & scene pass, their images and barriers.
+  RenderGraph render_graph;
+  // camera uniform of the frame being recorded.
+  u_int32_t dy_offset{0};
+  // slot of the frame being recorded.
+  u_int32_t frame_slot{0};
+  // bit i set: texture_sets[i] names a replaced texture or shadow map.
+  u_int32_t stale_texture_sets{0};
+
+  // valid until mary.texture is swapped from placeholder.
+  TextureFuture mary_texture_future;
+
+  // gpu vertex layout of all models.
+  VertexFormat vertex_format{VertexFormat::kPacked12};
 };
 
 }  // namespace LLShader
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "matrix.hpp"
 
+#include <algorithm>
+#include <fstream>
+
 #include "3rd/imgui/backends/imgui_impl_glfw.h"
 #include "3rd/imgui/backends/imgui_impl_vulkan.h"
 #include "3rd/imgui/imgui.h"
@@ -7,6 +10,7 @@
 #include "demos/pcss/pcss.hpp"
 #include "demos/triangle/triangle.hpp"
 #include "io/input_manager.hpp"
+#include "render/asset_loader.hpp"
 #include "render/render_manager.hpp"
 #include "render/vk_context.hpp"
 #include "render/window_manager.hpp"
@@ -20,29 +24,43 @@ Matrix::Matrix() {}
 
 Matrix::~Matrix() {}
 
-void Matrix::init() {
+void Matrix::init(const MatrixConfig& config) {
+  config_ = config;
   // follow init sequence.
   window_manager = std::make_shared<WindowManager>();
   vk_holder = std::make_shared<VkHolder>();
   input_manager = std::make_shared<InputManager>();
   render_manager = std::make_shared<RenderManager>();
+  asset_loader = std::make_shared<AssetLoader>();
 
-  window_manager->init(1280, 720);
+  // headless keeps an uninitialized window manager, always in edit mode.
+  if (!config_.headless)
+    window_manager->init(static_cast<int>(config_.width),
+                         static_cast<int>(config_.height));
   vk_holder->init();
-  input_manager->init();
+  if (!config_.headless) input_manager->init();
   render_manager->init();
+  if (config_.frames_ahead > 0)
+    render_manager->setFramesAhead(config_.frames_ahead);
 }
 
 void Matrix::shutdown() {
   // input_manager->dispose();
   // window_manager->dispose();
   input_manager->dispose();
+  asset_loader->dispose();
   render_manager->dispose();
   vk_holder->dispose();
-  window_manager->dispose();
+  if (!config_.headless) window_manager->dispose();
 }
 
-void Matrix::run() { main_loop(); }
+void Matrix::run() {
+  if (config_.headless) {
+    headless_loop();
+  } else {
+    main_loop();
+  }
+}
 
 inline void Matrix::main_loop() {
   auto* window = window_manager->window;
@@ -78,10 +96,103 @@ inline void Matrix::main_loop() {
   vkDeviceWaitIdle(render_manager->device_);
 }
 
+void Matrix::headless_loop() {
+  using namespace std::chrono;
+  // fixed step, the same frames are rendered on any device.
+  constexpr double dt = 1.0 / 60.0;
+  const u_int64_t total = config_.warmup_frames + config_.frame_count;
+  std::vector<FrameTiming> timings;
+  timings.reserve(config_.frame_count);
+
+  for (u_int64_t i = 0; i < total; ++i) {
+    asset_loader->processUploads();
+    render_manager->p_current_draw_context->update(dt);
+
+    auto begin = steady_clock::now();
+    render_manager->beginFrame();
+    // beginFrame() waited for the frame that used this slot, its
+    // timestamps are read before this frame resets them.
+    if (i >= MAX_FRAMES_IN_FLIGHT) {
+      u_int64_t done = i - MAX_FRAMES_IN_FLIGHT;
+      if (done >= config_.warmup_frames)
+        timings[done - config_.warmup_frames].gpu_ms =
+            render_manager->getFrameGpuMs(done);
+    }
+    render_manager->drawFrame();
+    render_manager->endFrame();
+    double cpu_ms =
+        duration<double, std::milli>(steady_clock::now() - begin).count();
+
+    if (i >= config_.warmup_frames)
+      timings.push_back({i, cpu_ms, render_manager->getFrameWaitMs(), -1.0,
+                         render_manager->getFrameLatencyMs()});
+  }
+
+  vkDeviceWaitIdle(render_manager->device_);
+  u_int64_t first = total > MAX_FRAMES_IN_FLIGHT
+                        ? total - MAX_FRAMES_IN_FLIGHT
+                        : 0;
+  for (u_int64_t i = std::max<u_int64_t>(first, config_.warmup_frames);
+       i < total; ++i) {
+    timings[i - config_.warmup_frames].gpu_ms =
+        render_manager->getFrameGpuMs(i);
+  }
+
+  writeFrameTimings(timings);
+}
+
+void Matrix::writeFrameTimings(const std::vector<FrameTiming>& timings) const {
+  if (timings.empty()) return;
+
+  if (!config_.timing_file.empty()) {
+    std::ofstream out(config_.timing_file);
+    if (!out) {
+      LogUtil::LogE("can not open " + config_.timing_file + '\n');
+    } else {
+      out << "frame,cpu_ms,wait_ms,gpu_ms,latency_ms\n";
+      for (const auto& timing : timings) {
+        out << timing.frame << ',' << timing.cpu_ms << ',' << timing.wait_ms
+            << ',' << timing.gpu_ms << ',' << timing.latency_ms << '\n';
+      }
+      LogUtil::LogI("frame timings written to " + config_.timing_file +
+                    '\n');
+    }
+  }
+
+  // mean, median, 95th percentile & max, -1 when not measured.
+  auto summary = [&](double FrameTiming::*field) {
+    std::vector<double> values;
+    for (const auto& timing : timings) {
+      if (timing.*field >= 0.0) values.push_back(timing.*field);
+    }
+    if (values.empty()) return std::string("n/a");
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double value : values) sum += value;
+    char text[96];
+    snprintf(text, sizeof(text), "mean %.3f p50 %.3f p95 %.3f max %.3f",
+             sum / values.size(), values[values.size() / 2],
+             values[std::min(values.size() - 1, values.size() * 95 / 100)],
+             values.back());
+    return std::string(text);
+  };
+  LogUtil::LogI(config_.demo + " " + std::to_string(config_.width) + "x" +
+                std::to_string(config_.height) + ", " +
+                std::to_string(timings.size()) + " frames, " +
+                std::to_string(render_manager->getFramesAhead()) +
+                " ahead\n");
+  LogUtil::LogI("  cpu ms  " + summary(&FrameTiming::cpu_ms) + '\n');
+  LogUtil::LogI("  wait ms " + summary(&FrameTiming::wait_ms) + '\n');
+  LogUtil::LogI("  gpu ms  " + summary(&FrameTiming::gpu_ms) + '\n');
+  LogUtil::LogI("  latency " + summary(&FrameTiming::latency_ms) + '\n');
+}
+
 inline void Matrix::runOnceDuringEachLoopBegin() {
   glfwPollEvents();
   input_manager->updateCursorMetrices();
   input_manager->notifyListeners();
+  // textures decoded since last frame.
+  asset_loader->processUploads();
 }
 inline void Matrix::runOnceDuringEachLoopEnd() {}
 
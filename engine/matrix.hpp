@@ -3,7 +3,9 @@
 
 #include <cstdio>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "demos/pcss/pcss.hpp"
 
@@ -14,12 +16,49 @@ class InputManager;
 class WindowManager;
 class VkHolder;
 class RenderManager;
+class AssetLoader;
+
+/// how the engine runs, given to Matrix::init().
+typedef struct {
+  /// no glfw, surface or swapchain: frames render into a ring of offscreen
+  /// images, e.g. on lavapipe in ci. needs no display.
+  bool headless{false};
+  /// window size, or offscreen image size when headless.
+  u_int32_t width{1280};
+  u_int32_t height{720};
+  /// demo to run: mesh, pbr or shadowmap.
+  std::string demo{"mesh"};
+  /// headless only: run() returns after warmup_frames untimed frames and
+  /// frame_count timed ones, updated with a fixed step so runs compare.
+  u_int32_t warmup_frames{60};
+  u_int32_t frame_count{600};
+  /// headless only: per frame timings as csv, empty for none.
+  std::string timing_file;
+  /// frames the cpu may record ahead, see RenderManager::setFramesAhead().
+  /// 0 keeps the render manager default.
+  u_int32_t frames_ahead{0};
+} MatrixConfig;
+
+/// timings of one headless frame.
+typedef struct {
+  u_int64_t frame;
+  // beginFrame() to endFrame() return on the cpu, pacing wait included.
+  double cpu_ms;
+  double wait_ms;
+  // from timestamps, -1 if the queue has none.
+  double gpu_ms;
+  // submit to completion seen by the cpu of the frame paced by this one,
+  // 0 while nothing was paced.
+  double latency_ms;
+} FrameTiming;
 
 class Matrix final {
  public:
   Matrix();
 
-  void init();
+  void init(const MatrixConfig& config = {});
+
+  inline const MatrixConfig& getConfig() const { return config_; }
 
   void run();
 
@@ -32,10 +71,14 @@ class Matrix final {
   std::shared_ptr<InputManager> input_manager;
   std::shared_ptr<VkHolder> vk_holder;
   std::shared_ptr<RenderManager> render_manager;
+  std::shared_ptr<AssetLoader> asset_loader;
 
  private:
   /// render loop
   inline void main_loop();
+  /// headless loop, fixed frame count, writes timings.
+  void headless_loop();
+  void writeFrameTimings(const std::vector<FrameTiming>& timings) const;
   inline void runOnceDuringEachLoopBegin();
   inline void runOnceDuringEachLoopEnd();
 
@@ -44,6 +87,8 @@ class Matrix final {
   // std::unique_ptr<PcssPipeline> pcss_pipeline;
   //        GLFWwindow* window;
 
+  MatrixConfig config_;
+
   std::chrono::steady_clock::time_point last_tick_time_point{
       std::chrono::steady_clock::now()};
 };
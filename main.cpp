@@ -9,10 +9,32 @@
 #include "glm/gtc/quaternion.hpp"
 #include "log/log.hpp"
 #include "stb_image.h"
+#include "util/texture_baker.hpp"
 
 using namespace LLShader;
 
-int main() {
+int main(int argc, char **argv) {
+  // offline mode: LLShader bake <image> <out.ktx2> [bc1|bc3|bc7]
+  if (argc >= 4 && std::string(argv[1]) == "bake") {
+    BlockFormat format = BlockFormat::kBC7;
+    if (argc >= 5 && !parseBlockFormat(argv[4], format)) {
+      LogUtil::LogE(std::string("unknown block format ") + argv[4] + '\n');
+      return EXIT_FAILURE;
+    }
+    return bakeTexture(argv[2], argv[3], format) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  // headless benchmark, no display needed, e.g. on lavapipe:
+  // LLShader bench <mesh|pbr|shadowmap> [frames] [timings.csv] [ahead]
+  MatrixConfig config;
+  if (argc >= 3 && std::string(argv[1]) == "bench") {
+    config.headless = true;
+    config.demo = argv[2];
+    if (argc >= 4) config.frame_count = std::strtoul(argv[3], nullptr, 10);
+    if (argc >= 5) config.timing_file = argv[4];
+    if (argc >= 6) config.frames_ahead = std::strtoul(argv[5], nullptr, 10);
+  }
+
   // glm::vec4 v(1.f, 0.f, 0.f, 0.f);
   // glm::qua q{glm::radians(glm::vec3(0.f, 0.f, 90.f))};
   // auto res = glm::mat4_cast(q) * v;
@@ -26,7 +48,7 @@ int main() {
   auto res = glm::mat4_cast(origin_state * pitch * yaw) * p;
 
   try {
-    global_matrix_engine.init();
+    global_matrix_engine.init(config);
     global_matrix_engine.run();
     global_matrix_engine.shutdown();
   } catch (std::exception &e) {
@@ -0,0 +1,188 @@
+#include "asset_loader.hpp"
+
+#include "3rd/stb/stb_image.h"
+#include "engine/matrix.hpp"
+#include "log/log.hpp"
+#include "util/assets_helper.hpp"
+#include "util/ktx2.hpp"
+
+namespace LLShader {
+
+AssetLoader::AssetLoader(ThreadPool& pool) : pool_(pool) {}
+
+AssetLoader::~AssetLoader() {
+  std::unique_lock<std::mutex> lock(task_mutex_);
+  task_cv_.wait(lock, [this] { return running_tasks_ == 0; });
+}
+
+void AssetLoader::beginTask() {
+  std::lock_guard<std::mutex> lock(task_mutex_);
+  ++running_tasks_;
+}
+
+void AssetLoader::endTask() {
+  std::lock_guard<std::mutex> lock(task_mutex_);
+  if (--running_tasks_ == 0) task_cv_.notify_all();
+}
+
+MeshFuture AssetLoader::loadMesh(const std::string& obj_file) {
+  return async([obj_file] {
+    Mesh mesh;
+    loadObjToMesh(obj_file, mesh);
+    return mesh;
+  });
+}
+
+TextureFuture AssetLoader::loadTexture(const std::string& file) {
+  auto promise = std::make_shared<std::promise<Texture2D>>();
+  TextureFuture future = promise->get_future().share();
+
+  beginTask();
+  pool_.submit([this, file, promise] {
+    TaskScope scope(this);
+    PendingUpload upload{file, {}, {}, nullptr, promise};
+
+    if (isKtx2File(file)) {
+      // baked blocks, only a copy here.
+      if (!readKtx2(file, upload.compressed)) {
+        promise->set_exception(std::make_exception_ptr(
+            std::runtime_error("falied to load " + file)));
+        return;
+      }
+    } else {
+      auto& cache = getGlobalTextureCache();
+      u_int64_t key;
+      bool has_key = TextureCache::computeKey(file, true, true, key);
+      auto cached = std::make_shared<TextureCacheEntry>();
+      if (has_key && cache.load(key, *cached)) {
+        // mapping is kept until the upload copied it.
+        upload.cached = std::move(cached);
+      } else {
+        int width, height, tex_channel;
+        stbi_uc* pixels = stbi_load(file.c_str(), &width, &height,
+                                    &tex_channel, STBI_rgb_alpha);
+        if (!pixels) {
+          promise->set_exception(std::make_exception_ptr(
+              std::runtime_error("falied to load " + file)));
+          return;
+        }
+
+        generateMipChain(pixels, width, height, upload.mips);
+        stbi_image_free(pixels);
+        if (has_key) cache.store(key, upload.mips);
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    uploads_.push_back(std::move(upload));
+  });
+
+  return future;
+}
+
+size_t AssetLoader::processUploads(size_t max_bytes) {
+  auto& render_manager = global_matrix_engine.render_manager;
+
+  // the next frame acquires finished transfers, hand them out now.
+  while (!in_flight_.empty() &&
+         render_manager->isUploadComplete(in_flight_.front().token)) {
+    auto& done = in_flight_.front();
+    for (size_t i = 0; i < done.promises.size(); ++i)
+      done.promises[i]->set_value(done.textures[i]);
+    in_flight_.pop_front();
+  }
+
+  std::vector<PendingUpload> batch;
+  {
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    size_t bytes = 0;
+    while (!uploads_.empty() && (batch.empty() || bytes < max_bytes)) {
+      const auto& front = uploads_.front();
+      bytes += front.mips.pixels.size() + front.compressed.blocks.size() +
+               (front.cached ? front.cached->size : 0);
+      batch.push_back(std::move(uploads_.front()));
+      uploads_.pop_front();
+    }
+  }
+  if (batch.empty()) return 0;
+
+  InFlightUpload upload;
+  auto& textures = upload.textures;
+  textures.resize(batch.size());
+
+  // one submit for the whole batch, no frame waits for it.
+  render_manager->beginUploadBatch();
+  auto& command_buffer = render_manager->getUploadCommandBuffer();
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (batch[i].cached) {
+      textures[i] =
+          render_manager->cmdUploadTexture2D(command_buffer, *batch[i].cached);
+    } else if (!batch[i].compressed.levels.empty()) {
+      textures[i] = render_manager->cmdUploadTexture2D(command_buffer,
+                                                       batch[i].compressed);
+    } else {
+      textures[i] =
+          render_manager->cmdUploadTexture2D(command_buffer, batch[i].mips);
+    }
+    textures[i].texture_name = batch[i].name;
+    // staging holds a copy, cpu side data is no longer needed.
+    batch[i].mips = {};
+    batch[i].compressed = {};
+    batch[i].cached.reset();
+    upload.promises.push_back(std::move(batch[i].promise));
+  }
+  upload.token = render_manager->submitUploadBatch(true);
+  in_flight_.push_back(std::move(upload));
+
+  return batch.size();
+}
+
+const Texture2D& AssetLoader::getPlaceholderTexture() {
+  if (placeholder_.texture_image != VK_NULL_HANDLE) return placeholder_;
+
+  auto& render_manager = global_matrix_engine.render_manager;
+
+  const unsigned char white[4] = {255, 255, 255, 255};
+  MipChain mips;
+  generateMipChain(white, 1, 1, mips);
+
+  render_manager->beginUploadBatch();
+  placeholder_ = render_manager->cmdUploadTexture2D(
+      render_manager->getUploadCommandBuffer(), mips);
+  placeholder_.texture_name = "placeholder";
+  render_manager->submitUploadBatch();
+  return placeholder_;
+}
+
+void AssetLoader::dispose() {
+  {
+    std::unique_lock<std::mutex> lock(task_mutex_);
+    task_cv_.wait(lock, [this] { return running_tasks_ == 0; });
+  }
+  {
+    std::lock_guard<std::mutex> lock(upload_mutex_);
+    if (!uploads_.empty()) {
+      LogUtil::LogW("drop " + std::to_string(uploads_.size()) +
+                    " pending texture uploads\n");
+    }
+    uploads_.clear();
+  }
+
+  // submitted textures belong to their futures.
+  auto& render_manager = global_matrix_engine.render_manager;
+  for (auto& upload : in_flight_) {
+    render_manager->waitUpload(upload.token);
+    for (size_t i = 0; i < upload.promises.size(); ++i)
+      upload.promises[i]->set_value(upload.textures[i]);
+  }
+  in_flight_.clear();
+
+  if (placeholder_.texture_image == VK_NULL_HANDLE) return;
+  auto device = render_manager->getRenderBaseContext().device;
+  vkDestroyImageView(device, placeholder_.texture_image_view, nullptr);
+  vkDestroyImage(device, placeholder_.texture_image, nullptr);
+  render_manager->getAllocator().free(placeholder_.texture_memory);
+  placeholder_ = {};
+}
+
+}  // namespace LLShader
@@ -0,0 +1,127 @@
+#ifndef ASSET_LOADER_HPP
+#define ASSET_LOADER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+#include "render/render_manager.hpp"
+#include "util/thread_pool.hpp"
+
+namespace LLShader {
+
+typedef std::shared_future<Mesh> MeshFuture;
+typedef std::shared_future<Texture2D> TextureFuture;
+
+/// Asynchronous asset loading service.
+/// obj parsing and image decoding run on the worker pool and are returned as
+/// futures, so independent assets load in parallel. gpu work is only recorded
+/// on the render thread: decoded textures wait in a queue until
+/// processUploads(), which uploads all of them with one submit. on a device
+/// with a transfer queue the copies run there while frames keep rendering.
+class AssetLoader final {
+ public:
+  /// bytes uploaded by one processUploads() call, at least one texture.
+  static constexpr size_t default_upload_budget = 64 << 20;
+
+  explicit AssetLoader(ThreadPool& pool = getGlobalThreadPool());
+
+  AssetLoader(const AssetLoader&) = delete;
+
+  /// wait running tasks, textures not uploaded yet get broken promises.
+  ~AssetLoader();
+
+  /// run func on a worker, e.g. build a ModelProtoType.
+  template <typename F>
+  auto async(F&& func) -> std::shared_future<decltype(func())> {
+    beginTask();
+    return pool_
+        .submit([this, func = std::forward<F>(func)]() mutable {
+          TaskScope scope(this);
+          return func();
+        })
+        .share();
+  }
+
+  /// all shapes merged into one mesh, same as loadObjToMesh.
+  MeshFuture loadMesh(const std::string& obj_file);
+
+  /// rgba 32 srgb texture with full mip chain generated on the worker,
+  /// ready after the processUploads() once its copies finished on the gpu,
+  /// usable by the frame recorded next. decoded chains are
+  /// kept in the global texture cache for later launches. .ktx2 files are
+  /// only read on the worker and uploaded as compressed blocks.
+  TextureFuture loadTexture(const std::string& file);
+
+  /// render thread only. upload decoded textures in one stream upload batch
+  /// without waiting for the gpu, stop adding when max_bytes is reached.
+  /// textures of finished batches are handed out. return submitted count.
+  size_t processUploads(size_t max_bytes = default_upload_budget);
+
+  /// render thread only. block until ready, uploads keep going meanwhile.
+  template <typename T>
+  const T& wait(const std::shared_future<T>& future) {
+    while (future.wait_for(std::chrono::milliseconds(1)) !=
+           std::future_status::ready) {
+      processUploads();
+    }
+    return future.get();
+  }
+
+  /// render thread only. 1x1 white texture bound until the real one is
+  /// ready, owned by the loader.
+  const Texture2D& getPlaceholderTexture();
+
+  /// release gpu resource, call before device destroyed.
+  void dispose();
+
+ private:
+  typedef struct {
+    std::string name;
+    // one of them is filled, compressed for .ktx2 files, cached on a
+    // texture cache hit.
+    MipChain mips;
+    CompressedMipChain compressed;
+    std::shared_ptr<TextureCacheEntry> cached;
+    std::shared_ptr<std::promise<Texture2D>> promise;
+  } PendingUpload;
+
+  // marks a worker task finished even if it throws.
+  struct TaskScope {
+    explicit TaskScope(AssetLoader* loader) : loader(loader) {}
+    ~TaskScope() { loader->endTask(); }
+    AssetLoader* loader;
+  };
+
+  void beginTask();
+  void endTask();
+
+  ThreadPool& pool_;
+
+  // running worker tasks, destructor waits them.
+  std::mutex task_mutex_;
+  std::condition_variable task_cv_;
+  size_t running_tasks_{0};
+
+  std::mutex upload_mutex_;
+  std::deque<PendingUpload> uploads_;
+
+  // submitted batches, promises are kept until their copies finished.
+  typedef struct {
+    UploadToken token;
+    std::vector<Texture2D> textures;
+    std::vector<std::shared_ptr<std::promise<Texture2D>>> promises;
+  } InFlightUpload;
+  std::deque<InFlightUpload> in_flight_;
+
+  Texture2D placeholder_{};
+};
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,61 @@
+#include "frame_uniform_allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace LLShader {
+
+void FrameUniformAllocator::init(VkDevice device, GpuAllocator& allocator,
+                                 VkDeviceSize alignment, u_int32_t frame_count,
+                                 VkDeviceSize frame_size) {
+  device_ = device;
+  allocator_ = &allocator;
+  // the limit is a power of two.
+  alignment_ = std::max<VkDeviceSize>(alignment, 1);
+  frame_size_ = (frame_size + alignment_ - 1) & ~(alignment_ - 1);
+
+  VkBufferCreateInfo buf_c_info{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = frame_size_ * frame_count,
+      .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  if (vkCreateBuffer(device_, &buf_c_info, nullptr, &buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create frame uniform buffer!");
+  }
+  memory_ = allocator.allocateForBuffer(
+      buffer_,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      GpuMemoryCategory::kUniform);
+
+  frame_begin_ = 0;
+  head_ = 0;
+}
+
+void FrameUniformAllocator::dispose() {
+  if (buffer_ == VK_NULL_HANDLE) return;
+  vkDestroyBuffer(device_, buffer_, nullptr);
+  allocator_->free(memory_);
+  buffer_ = VK_NULL_HANDLE;
+}
+
+void FrameUniformAllocator::beginFrame(u_int32_t frame) {
+  frame_begin_ = frame * frame_size_;
+  head_.store(frame_begin_, std::memory_order_relaxed);
+}
+
+FrameUniform FrameUniformAllocator::allocate(VkDeviceSize size) {
+  VkDeviceSize aligned = (size + alignment_ - 1) & ~(alignment_ - 1);
+  VkDeviceSize offset = head_.fetch_add(aligned, std::memory_order_relaxed);
+  if (offset + aligned > frame_begin_ + frame_size_) {
+    throw std::runtime_error("frame uniform region of " +
+                             std::to_string(frame_size_) +
+                             " bytes is full!");
+  }
+  return {static_cast<unsigned char*>(memory_.mapped) + offset,
+          static_cast<u_int32_t>(offset)};
+}
+
+}  // namespace LLShader
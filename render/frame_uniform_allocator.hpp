@@ -0,0 +1,78 @@
+#ifndef FRAME_UNIFORM_ALLOCATOR_HPP
+#define FRAME_UNIFORM_ALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstring>
+
+#include "render/gpu_allocator.hpp"
+
+namespace LLShader {
+
+/// uniform data written for the current frame. bind getBuffer() once as
+/// VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC with offset 0, then pass offset
+/// as the dynamic offset.
+typedef struct {
+  void* data;
+  u_int32_t offset;
+} FrameUniform;
+
+/// Per frame bump allocator for dynamic uniform data.
+/// one persistently mapped, host coherent buffer split into a region per
+/// frame in flight. allocations are aligned to minUniformBufferOffsetAlignment
+/// and only move an atomic offset, a region is reused after beginFrame() of
+/// the same frame index, i.e. once that frame finished. thread safe between
+/// beginFrame() calls.
+class FrameUniformAllocator final {
+ public:
+  static constexpr VkDeviceSize default_frame_size = 2ull << 20;
+
+  FrameUniformAllocator() = default;
+
+  FrameUniformAllocator(const FrameUniformAllocator&) = delete;
+
+  void init(VkDevice device, GpuAllocator& allocator, VkDeviceSize alignment,
+            u_int32_t frame_count,
+            VkDeviceSize frame_size = default_frame_size);
+
+  void dispose();
+
+  /// call once the gpu finished frame, previous data is dropped.
+  void beginFrame(u_int32_t frame);
+
+  /// throw if the frame region is full.
+  FrameUniform allocate(VkDeviceSize size);
+
+  /// copy value in, return its dynamic offset.
+  template <typename T>
+  inline u_int32_t push(const T& value) {
+    auto uniform = allocate(sizeof(T));
+    memcpy(uniform.data, &value, sizeof(T));
+    return uniform.offset;
+  }
+
+  inline VkBuffer getBuffer() const { return buffer_; }
+  inline VkDeviceSize getAlignment() const { return alignment_; }
+  /// bytes used by the current frame.
+  inline VkDeviceSize getFrameUsage() const {
+    return head_.load(std::memory_order_relaxed) - frame_begin_;
+  }
+
+ private:
+  VkDevice device_{VK_NULL_HANDLE};
+  GpuAllocator* allocator_{nullptr};
+
+  VkBuffer buffer_{VK_NULL_HANDLE};
+  GpuAllocation memory_{};
+  VkDeviceSize alignment_{1};
+  VkDeviceSize frame_size_{0};
+
+  // [frame_begin_, frame_begin_ + frame_size_) is the current region.
+  VkDeviceSize frame_begin_{0};
+  std::atomic<VkDeviceSize> head_{0};
+};
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,400 @@
+#include "gpu_allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "log/log.hpp"
+
+namespace LLShader {
+
+namespace {
+
+inline VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize alignment) {
+  return (v + alignment - 1) & ~(alignment - 1);
+}
+
+inline std::string toMiB(VkDeviceSize bytes) {
+  return std::to_string(bytes >> 20) + "." +
+         std::to_string(((bytes & ((1 << 20) - 1)) * 10) >> 20) + " MiB";
+}
+
+}  // namespace
+
+const char* getGpuMemoryCategoryName(GpuMemoryCategory category) {
+  switch (category) {
+    case GpuMemoryCategory::kVertex:
+      return "vertex";
+    case GpuMemoryCategory::kIndex:
+      return "index";
+    case GpuMemoryCategory::kTexture:
+      return "texture";
+    case GpuMemoryCategory::kUniform:
+      return "uniform";
+    case GpuMemoryCategory::kDepth:
+      return "depth";
+    case GpuMemoryCategory::kRenderTarget:
+      return "render target";
+    case GpuMemoryCategory::kStaging:
+      return "staging";
+    default:
+      return "other";
+  }
+}
+
+void GpuAllocator::init(VkPhysicalDevice physical_device, VkDevice device,
+                        VkDeviceSize block_size) {
+  device_ = device;
+  block_size_ = block_size;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  buffer_image_granularity_ =
+      std::max<VkDeviceSize>(properties.limits.bufferImageGranularity, 1);
+  non_coherent_atom_size_ =
+      std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+  max_allocation_count_ = properties.limits.maxMemoryAllocationCount;
+
+  // two pools per type, buffers & images.
+  pools_.assign(memory_properties_.memoryTypeCount * 2, {});
+  stats_.assign(memory_properties_.memoryTypeCount, GpuMemoryStats{});
+  for (auto& stats : category_stats_) stats = {};
+}
+
+void GpuAllocator::dispose() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  u_int64_t leaked = 0;
+  for (const auto& stats : stats_) leaked += stats.allocation_count;
+  if (leaked > 0) {
+    LogUtil::LogW(std::to_string(leaked) +
+                  " gpu allocations still alive, released with their blocks\n");
+  }
+
+  for (u_int32_t i = 0; i < blocks_.size(); ++i) {
+    if (blocks_[i].memory != VK_NULL_HANDLE) destroyBlock(i);
+  }
+  blocks_.clear();
+  free_block_slots_.clear();
+  pools_.clear();
+  stats_.clear();
+}
+
+u_int32_t GpuAllocator::findMemoryType(u_int32_t type_bits,
+                                       VkMemoryPropertyFlags property) const {
+  for (u_int32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+    if ((type_bits & (1 << i)) &&
+        (memory_properties_.memoryTypes[i].propertyFlags & property) ==
+            property) {
+      return i;
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceSize GpuAllocator::getBlockSize(u_int32_t memory_type) const {
+  // small heaps (e.g. 256 MiB bar memory) should not be eaten by few blocks.
+  auto heap = memory_properties_.memoryTypes[memory_type].heapIndex;
+  VkDeviceSize heap_size = memory_properties_.memoryHeaps[heap].size;
+  return std::max<VkDeviceSize>(std::min(block_size_, heap_size / 8), 1 << 20);
+}
+
+u_int32_t GpuAllocator::createBlock(u_int32_t memory_type, u_int32_t pool,
+                                    VkDeviceSize size, bool dedicated) {
+  auto& stats = stats_[memory_type];
+  u_int32_t live_blocks = 0;
+  for (const auto& s : stats_) live_blocks += s.block_count + s.dedicated_count;
+  if (live_blocks >= max_allocation_count_) {
+    LogUtil::LogW("vkAllocateMemory count exceeds maxMemoryAllocationCount " +
+                  std::to_string(max_allocation_count_) + '\n');
+  }
+
+  VkMemoryAllocateInfo alloc_info{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = size,
+      .memoryTypeIndex = memory_type,
+  };
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(device_, &alloc_info, nullptr, &memory) != VK_SUCCESS) {
+    throw std::runtime_error("failed to allocate gpu memory block of " +
+                             toMiB(size) + "!");
+  }
+
+  void* mapped = nullptr;
+  if (memory_properties_.memoryTypes[memory_type].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(device_, memory, 0, VK_WHOLE_SIZE, 0, &mapped) !=
+        VK_SUCCESS) {
+      vkFreeMemory(device_, memory, nullptr);
+      throw std::runtime_error("failed to map gpu memory block!");
+    }
+  }
+
+  u_int32_t id;
+  if (!free_block_slots_.empty()) {
+    id = free_block_slots_.back();
+    free_block_slots_.pop_back();
+  } else {
+    id = static_cast<u_int32_t>(blocks_.size());
+    blocks_.emplace_back();
+  }
+  auto& block = blocks_[id];
+  block.memory = memory;
+  block.size = size;
+  block.mapped = static_cast<unsigned char*>(mapped);
+  block.memory_type = memory_type;
+  block.pool = pool;
+  block.tlsf = dedicated ? nullptr : std::make_unique<TlsfAllocator>(size);
+
+  if (dedicated) {
+    ++stats.dedicated_count;
+  } else {
+    ++stats.block_count;
+    pools_[pool].push_back(id);
+  }
+  stats.block_bytes += size;
+  return id;
+}
+
+void GpuAllocator::destroyBlock(u_int32_t id) {
+  auto& block = blocks_[id];
+  auto& stats = stats_[block.memory_type];
+  if (block.mapped) vkUnmapMemory(device_, block.memory);
+  vkFreeMemory(device_, block.memory, nullptr);
+
+  if (block.tlsf) {
+    --stats.block_count;
+    auto& pool = pools_[block.pool];
+    pool.erase(std::find(pool.begin(), pool.end(), id));
+  } else {
+    --stats.dedicated_count;
+  }
+  stats.block_bytes -= block.size;
+
+  block.memory = VK_NULL_HANDLE;
+  block.mapped = nullptr;
+  block.tlsf.reset();
+  free_block_slots_.push_back(id);
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements,
+                                     VkMemoryPropertyFlags property,
+                                     GpuResourceKind kind,
+                                     GpuMemoryCategory category) {
+  u_int32_t memory_type =
+      findMemoryType(requirements.memoryTypeBits, property);
+  auto flags = memory_properties_.memoryTypes[memory_type].propertyFlags;
+
+  VkDeviceSize size = requirements.size;
+  VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+  // flushed ranges are rounded to atoms, keep them inside the allocation.
+  if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+      !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+    alignment = std::max(alignment, non_coherent_atom_size_);
+    size = alignUp(size, non_coherent_atom_size_);
+  }
+
+  u_int32_t pool = memory_type * 2;
+  if (buffer_image_granularity_ > 1 && kind == GpuResourceKind::kOptimal)
+    pool += 1;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  GpuAllocation allocation{};
+  allocation.size = size;
+  allocation.memory_type = memory_type;
+  allocation.category = category;
+
+  VkDeviceSize block_size = getBlockSize(memory_type);
+  if (size > block_size / 2) {
+    allocation.block = createBlock(memory_type, pool, size, true);
+    allocation.node = dedicated_node;
+  } else {
+    bool placed = false;
+    for (u_int32_t id : pools_[pool]) {
+      if (blocks_[id].tlsf->allocate(size, alignment, allocation.offset,
+                                     allocation.node)) {
+        allocation.block = id;
+        placed = true;
+        break;
+      }
+    }
+    if (!placed) {
+      allocation.block = createBlock(memory_type, pool, block_size, false);
+      blocks_[allocation.block].tlsf->allocate(
+          size, alignment, allocation.offset, allocation.node);
+    }
+  }
+
+  const auto& block = blocks_[allocation.block];
+  allocation.memory = block.memory;
+  if (block.mapped) allocation.mapped = block.mapped + allocation.offset;
+
+  auto& stats = stats_[memory_type];
+  ++stats.allocation_count;
+  ++stats.total_allocations;
+  stats.used_bytes += size;
+  stats.peak_used_bytes = std::max(stats.peak_used_bytes, stats.used_bytes);
+  auto& category_stats = category_stats_[static_cast<u_int32_t>(category)];
+  ++category_stats.allocation_count;
+  category_stats.used_bytes += size;
+  category_stats.peak_used_bytes =
+      std::max(category_stats.peak_used_bytes, category_stats.used_bytes);
+  return allocation;
+}
+
+GpuAllocation GpuAllocator::allocateForBuffer(VkBuffer buffer,
+                                              VkMemoryPropertyFlags property,
+                                              GpuMemoryCategory category) {
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+  auto allocation =
+      allocate(requirements, property, GpuResourceKind::kLinear, category);
+  vkBindBufferMemory(device_, buffer, allocation.memory, allocation.offset);
+  return allocation;
+}
+
+GpuAllocation GpuAllocator::allocateForImage(VkImage image,
+                                             VkMemoryPropertyFlags property,
+                                             GpuMemoryCategory category) {
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device_, image, &requirements);
+  auto allocation =
+      allocate(requirements, property, GpuResourceKind::kOptimal, category);
+  vkBindImageMemory(device_, image, allocation.memory, allocation.offset);
+  return allocation;
+}
+
+void GpuAllocator::free(GpuAllocation& allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& stats = stats_[allocation.memory_type];
+  --stats.allocation_count;
+  ++stats.total_frees;
+  stats.used_bytes -= allocation.size;
+  auto& category_stats =
+      category_stats_[static_cast<u_int32_t>(allocation.category)];
+  --category_stats.allocation_count;
+  category_stats.used_bytes -= allocation.size;
+
+  if (allocation.node == dedicated_node) {
+    destroyBlock(allocation.block);
+  } else {
+    auto& block = blocks_[allocation.block];
+    block.tlsf->free(allocation.node);
+    // keep one empty block per pool, so alloc / free cycles do not hit
+    // vkAllocateMemory every time.
+    if (block.tlsf->isEmpty()) {
+      for (u_int32_t id : pools_[block.pool]) {
+        if (id != allocation.block && blocks_[id].tlsf->isEmpty()) {
+          destroyBlock(allocation.block);
+          break;
+        }
+      }
+    }
+  }
+
+  allocation = {};
+}
+
+void GpuAllocator::flush(const GpuAllocation& allocation, VkDeviceSize offset,
+                         VkDeviceSize size) {
+  auto flags =
+      memory_properties_.memoryTypes[allocation.memory_type].propertyFlags;
+  if (allocation.memory == VK_NULL_HANDLE ||
+      (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+    return;
+  }
+
+  // allocation is atom aligned, so the rounded range stays inside it.
+  VkDeviceSize begin = allocation.offset + offset;
+  VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size
+                                           : begin + size;
+  begin -= begin % non_coherent_atom_size_;
+  end = alignUp(end, non_coherent_atom_size_);
+
+  VkMappedMemoryRange range{VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
+  range.memory = allocation.memory;
+  range.offset = begin;
+  range.size = end - begin;
+  vkFlushMappedMemoryRanges(device_, 1, &range);
+}
+
+GpuMemoryStats GpuAllocator::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  GpuMemoryStats total{};
+  for (const auto& stats : stats_) {
+    total.block_count += stats.block_count;
+    total.dedicated_count += stats.dedicated_count;
+    total.block_bytes += stats.block_bytes;
+    total.allocation_count += stats.allocation_count;
+    total.used_bytes += stats.used_bytes;
+    // peaks of types may not overlap in time, the sum is an upper bound.
+    total.peak_used_bytes += stats.peak_used_bytes;
+    total.total_allocations += stats.total_allocations;
+    total.total_frees += stats.total_frees;
+  }
+  return total;
+}
+
+GpuMemoryStats GpuAllocator::getMemoryTypeStats(u_int32_t memory_type) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_[memory_type];
+}
+
+GpuCategoryStats GpuAllocator::getCategoryStats(
+    GpuMemoryCategory category) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return category_stats_[static_cast<u_int32_t>(category)];
+}
+
+VkDeviceSize GpuAllocator::getHeapBlockBytes(u_int32_t heap) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  VkDeviceSize bytes = 0;
+  for (u_int32_t i = 0; i < stats_.size(); ++i) {
+    if (memory_properties_.memoryTypes[i].heapIndex == heap)
+      bytes += stats_[i].block_bytes;
+  }
+  return bytes;
+}
+
+void GpuAllocator::logStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (u_int32_t i = 0; i < stats_.size(); ++i) {
+    const auto& stats = stats_[i];
+    if (stats.total_allocations == 0) continue;
+    LogUtil::LogI(
+        "memory type " + std::to_string(i) + ": " +
+        std::to_string(stats.block_count) + " blocks + " +
+        std::to_string(stats.dedicated_count) + " dedicated (" +
+        toMiB(stats.block_bytes) + "), " +
+        std::to_string(stats.allocation_count) + " allocations (" +
+        toMiB(stats.used_bytes) + ", peak " + toMiB(stats.peak_used_bytes) +
+        "), " + std::to_string(stats.total_allocations) + " allocs / " +
+        std::to_string(stats.total_frees) + " frees\n");
+  }
+  for (u_int32_t i = 0; i < static_cast<u_int32_t>(GpuMemoryCategory::kCount);
+       ++i) {
+    const auto& stats = category_stats_[i];
+    if (stats.peak_used_bytes == 0) continue;
+    auto name = getGpuMemoryCategoryName(static_cast<GpuMemoryCategory>(i));
+    LogUtil::LogI(
+        std::string(name) + ": " + std::to_string(stats.allocation_count) +
+        " allocations (" + toMiB(stats.used_bytes) + ", peak " +
+        toMiB(stats.peak_used_bytes) + ")\n");
+  }
+}
+
+bool GpuAllocator::validate() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& block : blocks_) {
+    if (block.memory != VK_NULL_HANDLE && block.tlsf &&
+        !block.tlsf->validate()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace LLShader
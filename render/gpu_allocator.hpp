@@ -0,0 +1,176 @@
+#ifndef GPU_ALLOCATOR_HPP
+#define GPU_ALLOCATOR_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util/tlsf_allocator.hpp"
+
+namespace LLShader {
+
+/// what an allocation is used for, only for statistics.
+enum class GpuMemoryCategory : u_int32_t {
+  kOther,
+  kVertex,
+  kIndex,
+  kTexture,
+  kUniform,
+  kDepth,
+  // color attachments and images owned by a RenderGraph, aliased ones
+  // share an allocation.
+  kRenderTarget,
+  kStaging,
+  kCount,
+};
+
+/// lowercase name, e.g. "vertex".
+const char* getGpuMemoryCategoryName(GpuMemoryCategory category);
+
+/// a range of a VkDeviceMemory owned by GpuAllocator. never pass memory to
+/// vkFreeMemory / vkMapMemory, other resources live in the same block.
+typedef struct {
+  VkDeviceMemory memory{VK_NULL_HANDLE};
+  VkDeviceSize offset{0};
+  VkDeviceSize size{0};
+  // host visible blocks stay mapped, points at offset.
+  void* mapped{nullptr};
+  u_int32_t memory_type{0};
+  GpuMemoryCategory category{GpuMemoryCategory::kOther};
+  // owner block & tlsf node, internal.
+  u_int32_t block{0};
+  u_int32_t node{0};
+} GpuAllocation;
+
+/// linear: buffers, optimal: images with VK_IMAGE_TILING_OPTIMAL.
+/// they must not share a bufferImageGranularity page.
+enum class GpuResourceKind : u_int32_t {
+  kLinear,
+  kOptimal,
+};
+
+typedef struct {
+  // vkAllocateMemory calls alive and their bytes.
+  u_int32_t block_count;
+  u_int32_t dedicated_count;
+  VkDeviceSize block_bytes;
+  // sub allocations alive and their bytes.
+  u_int64_t allocation_count;
+  VkDeviceSize used_bytes;
+  VkDeviceSize peak_used_bytes;
+  // since init.
+  u_int64_t total_allocations;
+  u_int64_t total_frees;
+} GpuMemoryStats;
+
+typedef struct {
+  u_int64_t allocation_count;
+  VkDeviceSize used_bytes;
+  VkDeviceSize peak_used_bytes;
+} GpuCategoryStats;
+
+/// Pooled VkDeviceMemory sub allocator.
+/// every memory type keeps a list of large blocks, resources are placed in
+/// them by a TlsfAllocator and bound at their offset, so thousands of
+/// resources only need a handful of vkAllocateMemory calls. requests larger
+/// than half a block get a dedicated allocation. when the device's
+/// bufferImageGranularity is larger than 1, buffers and optimal images use
+/// separate blocks so they never share a granularity page. host visible
+/// blocks are mapped once for their lifetime.
+/// thread safe.
+class GpuAllocator final {
+ public:
+  static constexpr VkDeviceSize default_block_size = 64ull << 20;
+
+  GpuAllocator() = default;
+
+  GpuAllocator(const GpuAllocator&) = delete;
+
+  void init(VkPhysicalDevice physical_device, VkDevice device,
+            VkDeviceSize block_size = default_block_size);
+
+  /// free all blocks, call before device destroyed. allocations still
+  /// alive are reported as leaks.
+  void dispose();
+
+  /// throw if no memory type has property or device out of memory.
+  GpuAllocation allocate(
+      const VkMemoryRequirements& requirements, VkMemoryPropertyFlags property,
+      GpuResourceKind kind,
+      GpuMemoryCategory category = GpuMemoryCategory::kOther);
+
+  /// allocate for and bind the resource.
+  GpuAllocation allocateForBuffer(
+      VkBuffer buffer, VkMemoryPropertyFlags property,
+      GpuMemoryCategory category = GpuMemoryCategory::kOther);
+  GpuAllocation allocateForImage(
+      VkImage image, VkMemoryPropertyFlags property,
+      GpuMemoryCategory category = GpuMemoryCategory::kOther);
+
+  /// release the range, allocation is reset. empty allocation is ignored.
+  void free(GpuAllocation& allocation);
+
+  /// make host writes visible for non coherent memory, no-op otherwise.
+  /// offset is relative to the allocation.
+  void flush(const GpuAllocation& allocation, VkDeviceSize offset = 0,
+             VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /// first memory type in type_bits having all property bits.
+  u_int32_t findMemoryType(u_int32_t type_bits,
+                           VkMemoryPropertyFlags property) const;
+
+  GpuMemoryStats getStats() const;
+  GpuMemoryStats getMemoryTypeStats(u_int32_t memory_type) const;
+  GpuCategoryStats getCategoryStats(GpuMemoryCategory category) const;
+  /// bytes of blocks & dedicated allocations on heap.
+  VkDeviceSize getHeapBlockBytes(u_int32_t heap) const;
+  inline const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const {
+    return memory_properties_;
+  }
+
+  void logStats() const;
+
+  /// check every block, bench/gpu_allocator_stress runs it after each step.
+  bool validate() const;
+
+ private:
+  static constexpr u_int32_t dedicated_node = TlsfAllocator::invalid_node;
+
+  typedef struct {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    unsigned char* mapped;
+    u_int32_t memory_type;
+    u_int32_t pool;
+    // null for dedicated allocations.
+    std::unique_ptr<TlsfAllocator> tlsf;
+  } Block;
+
+  u_int32_t createBlock(u_int32_t memory_type, u_int32_t pool,
+                        VkDeviceSize size, bool dedicated);
+  void destroyBlock(u_int32_t block);
+  VkDeviceSize getBlockSize(u_int32_t memory_type) const;
+
+  VkDevice device_{VK_NULL_HANDLE};
+  VkPhysicalDeviceMemoryProperties memory_properties_{};
+  VkDeviceSize block_size_{default_block_size};
+  VkDeviceSize buffer_image_granularity_{1};
+  VkDeviceSize non_coherent_atom_size_{1};
+  u_int32_t max_allocation_count_{0};
+
+  mutable std::mutex mutex_;
+  // slots of destroyed blocks are reused.
+  std::vector<Block> blocks_;
+  std::vector<u_int32_t> free_block_slots_;
+  // block ids of every memory type & resource kind.
+  std::vector<std::vector<u_int32_t>> pools_;
+  std::vector<GpuMemoryStats> stats_;
+  GpuCategoryStats category_stats_[static_cast<u_int32_t>(
+      GpuMemoryCategory::kCount)]{};
+};
+
+}  // namespace LLShader
+
+#endif
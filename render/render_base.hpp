@@ -24,6 +24,11 @@ class RenderBase {
   // render_manager class.
   virtual void drawUI() = 0;
 
+  // the swapchain was recreated, e.g. the window resized. rebuild what
+  // depends on its images or extent: framebuffers and depth images. frames
+  // in flight still use the old ones, release them with deferDestroy().
+  virtual void onSwapchainRecreated() {}
+
   // call should be followed by declare order.
   // virtual void createRenderPass() = 0;
   // virtual void createPipelines() = 0;
@@ -0,0 +1,776 @@
+#include "render_graph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "log/log.hpp"
+
+namespace LLShader {
+
+namespace {
+
+bool isDepthFormat(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D32_SFLOAT:
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+VkAccessFlags getUseAccess(bool color, bool depth, bool clear) {
+  if (color) {
+    return VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+           (clear ? 0 : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
+  }
+  if (depth) {
+    return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  }
+  return VK_ACCESS_SHADER_READ_BIT;
+}
+
+std::string toMiB(VkDeviceSize bytes) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.1f MiB", bytes / 1048576.0);
+  return text;
+}
+
+}  // namespace
+
+RenderGraphResource RenderGraph::createImage(const std::string& name,
+                                             VkFormat format,
+                                             VkExtent2D extent) {
+  Resource resource{};
+  resource.name = name;
+  resource.format = format;
+  resource.extent = extent;
+  resource.first_group = ~0u;
+  resources_.push_back(std::move(resource));
+  return static_cast<RenderGraphResource>(resources_.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(
+    const std::string& name, VkFormat format, VkExtent2D extent,
+    const std::vector<VkImage>& images, const std::vector<VkImageView>& views,
+    VkImageLayout initial_layout, VkImageLayout final_layout) {
+  auto index = createImage(name, format, extent);
+  auto& resource = resources_[index];
+  resource.imported = true;
+  resource.output = true;
+  resource.images = images;
+  resource.views = views;
+  resource.initial_layout = initial_layout;
+  resource.final_layout = final_layout;
+  return index;
+}
+
+void RenderGraph::setOutput(RenderGraphResource resource) {
+  resources_[resource].output = true;
+}
+
+RenderGraphPass RenderGraph::addPass(const std::string& name,
+                                     RecordFunc record) {
+  passes_.push_back({name, std::move(record), {}, false, ~0u, 0});
+  return static_cast<RenderGraphPass>(passes_.size() - 1);
+}
+
+void RenderGraph::addColorOutput(RenderGraphPass pass,
+                                 RenderGraphResource resource,
+                                 const VkClearColorValue* clear) {
+  Use use{resource, Access::kColor, clear != nullptr, {},
+          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  if (clear) use.clear_value.color = *clear;
+  passes_[pass].uses.push_back(use);
+}
+
+void RenderGraph::setDepthOutput(RenderGraphPass pass,
+                                 RenderGraphResource resource,
+                                 const VkClearDepthStencilValue* clear) {
+  auto& uses = passes_[pass].uses;
+  uses.erase(std::remove_if(uses.begin(), uses.end(),
+                            [](const Use& use) {
+                              return use.access == Access::kDepth;
+                            }),
+             uses.end());
+  Use use{resource, Access::kDepth, clear != nullptr, {},
+          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+              VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT};
+  if (clear) use.clear_value.depthStencil = *clear;
+  uses.push_back(use);
+}
+
+void RenderGraph::addTextureInput(RenderGraphPass pass,
+                                  RenderGraphResource resource,
+                                  VkPipelineStageFlags stages) {
+  passes_[pass].uses.push_back(
+      {resource, Access::kTexture, false, {}, stages});
+}
+
+void RenderGraph::compile(VkDevice device, GpuAllocator& allocator) {
+  device_ = device;
+  allocator_ = &allocator;
+  stats_ = {};
+  stats_.pass_count = static_cast<u_int32_t>(passes_.size());
+
+  cullPasses();
+  mergePasses();
+  createImages();
+  createRenderPasses();
+  computeBarriers();
+  logStats();
+}
+
+void RenderGraph::cullPasses() {
+  // walk back from the outputs, a cleared attachment needs no earlier
+  // writer.
+  std::vector<bool> needed(resources_.size());
+  for (size_t i = 0; i < resources_.size(); ++i)
+    needed[i] = resources_[i].output;
+
+  for (size_t i = passes_.size(); i-- > 0;) {
+    auto& pass = passes_[i];
+    pass.culled = true;
+    for (const auto& use : pass.uses) {
+      if (use.access != Access::kTexture && needed[use.resource])
+        pass.culled = false;
+    }
+    if (pass.culled) {
+      ++stats_.culled_pass_count;
+      continue;
+    }
+    for (const auto& use : pass.uses) {
+      if (use.access != Access::kTexture && use.clear)
+        needed[use.resource] = false;
+    }
+    for (const auto& use : pass.uses) {
+      if (use.access == Access::kTexture || !use.clear)
+        needed[use.resource] = true;
+    }
+  }
+}
+
+std::vector<const RenderGraph::Use*> RenderGraph::getAttachments(
+    const Pass& pass) const {
+  // colors in declare order, depth last.
+  std::vector<const Use*> attachments;
+  const Use* depth = nullptr;
+  for (const auto& use : pass.uses) {
+    if (use.access == Access::kColor) attachments.push_back(&use);
+    if (use.access == Access::kDepth) depth = &use;
+  }
+  if (depth) attachments.push_back(depth);
+  return attachments;
+}
+
+void RenderGraph::mergePasses() {
+  groups_.clear();
+  for (u_int32_t i = 0; i < passes_.size(); ++i) {
+    auto& pass = passes_[i];
+    if (pass.culled) continue;
+    auto attachments = getAttachments(pass);
+    if (attachments.empty()) {
+      throw std::runtime_error("render graph pass " + pass.name +
+                               " has no attachment!");
+    }
+
+    // same attachments, loaded, and none of them sampled: a subpass of the
+    // previous render pass.
+    bool merge = !groups_.empty();
+    if (merge) {
+      auto& group = groups_.back();
+      auto previous = getAttachments(passes_[group.passes.back()]);
+      merge = previous.size() == attachments.size();
+      for (size_t k = 0; merge && k < attachments.size(); ++k) {
+        merge = previous[k]->resource == attachments[k]->resource &&
+                previous[k]->access == attachments[k]->access &&
+                !attachments[k]->clear;
+      }
+      for (const auto& use : pass.uses) {
+        if (use.access == Access::kTexture &&
+            std::find(group.attachments.begin(), group.attachments.end(),
+                      use.resource) != group.attachments.end()) {
+          merge = false;
+        }
+      }
+    }
+
+    if (!merge) {
+      Group group{};
+      group.extent = resources_[attachments[0]->resource].extent;
+      for (const auto* use : attachments) {
+        const auto& extent = resources_[use->resource].extent;
+        if (extent.width != group.extent.width ||
+            extent.height != group.extent.height) {
+          throw std::runtime_error("render graph pass " + pass.name +
+                                   " has attachments of different size!");
+        }
+        group.attachments.push_back(use->resource);
+        group.clear_values.push_back(use->clear_value);
+      }
+      groups_.push_back(std::move(group));
+    }
+
+    auto& group = groups_.back();
+    pass.group = static_cast<u_int32_t>(groups_.size() - 1);
+    pass.subpass = static_cast<u_int32_t>(group.passes.size());
+    group.passes.push_back(i);
+    for (const auto& use : pass.uses) {
+      auto& resource = resources_[use.resource];
+      resource.first_group = std::min(resource.first_group, pass.group);
+      resource.last_group = std::max(resource.last_group, pass.group);
+    }
+  }
+  stats_.render_pass_count = static_cast<u_int32_t>(groups_.size());
+}
+
+void RenderGraph::createImages() {
+  std::vector<RenderGraphResource> aliased;
+  for (u_int32_t i = 0; i < resources_.size(); ++i) {
+    auto& resource = resources_[i];
+    if (resource.imported || resource.first_group == ~0u) continue;
+
+    resource.usage = 0;
+    for (const auto& pass : passes_) {
+      if (pass.culled) continue;
+      for (const auto& use : pass.uses) {
+        if (use.resource != i) continue;
+        if (use.access == Access::kColor)
+          resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (use.access == Access::kDepth)
+          resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if (use.access == Access::kTexture)
+          resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+      }
+    }
+    // never leaves its render pass.
+    resource.lazy = resource.first_group == resource.last_group &&
+                    !(resource.usage & VK_IMAGE_USAGE_SAMPLED_BIT) &&
+                    !resource.output;
+    if (resource.lazy)
+      resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+    VkImageCreateInfo image_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = resource.format,
+        .extent = {resource.extent.width, resource.extent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = resource.usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    VkImage image;
+    if (vkCreateImage(device_, &image_info, nullptr, &image) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create render graph image " +
+                               resource.name + "!");
+    }
+    resource.images = {image};
+    vkGetImageMemoryRequirements(device_, image, &resource.requirements);
+    stats_.transient_bytes += resource.requirements.size;
+    ++stats_.transient_count;
+
+    if (resource.lazy) {
+      VkMemoryPropertyFlags property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+      const auto& memory_properties = allocator_->getMemoryProperties();
+      for (u_int32_t t = 0; t < memory_properties.memoryTypeCount; ++t) {
+        if ((resource.requirements.memoryTypeBits & (1u << t)) &&
+            (memory_properties.memoryTypes[t].propertyFlags &
+             VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+          property |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+          break;
+        }
+      }
+      resource.memory = allocator_->allocateForImage(
+          image, property, GpuMemoryCategory::kRenderTarget);
+      stats_.allocated_bytes += resource.requirements.size;
+    } else {
+      aliased.push_back(i);
+    }
+  }
+
+  // largest first, each at the lowest offset clear of the images living at
+  // the same time.
+  std::sort(aliased.begin(), aliased.end(),
+            [this](RenderGraphResource a, RenderGraphResource b) {
+              return resources_[a].requirements.size >
+                     resources_[b].requirements.size;
+            });
+  VkMemoryRequirements total{0, 1, ~0u};
+  for (size_t i = 0; i < aliased.size(); ++i) {
+    auto& resource = resources_[aliased[i]];
+    const auto& requirements = resource.requirements;
+    auto overlaps = [&resource](const Resource& other) {
+      return resource.first_group <= other.last_group &&
+             other.first_group <= resource.last_group;
+    };
+
+    std::vector<VkDeviceSize> candidates{0};
+    for (size_t k = 0; k < i; ++k) {
+      const auto& placed = resources_[aliased[k]];
+      if (overlaps(placed))
+        candidates.push_back(placed.alias_offset + placed.requirements.size);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    for (auto candidate : candidates) {
+      VkDeviceSize offset = (candidate + requirements.alignment - 1) /
+                            requirements.alignment * requirements.alignment;
+      bool clear = true;
+      for (size_t k = 0; k < i && clear; ++k) {
+        const auto& placed = resources_[aliased[k]];
+        clear = !overlaps(placed) ||
+                offset + requirements.size <= placed.alias_offset ||
+                placed.alias_offset + placed.requirements.size <= offset;
+      }
+      if (clear) {
+        resource.alias_offset = offset;
+        break;
+      }
+    }
+
+    total.size =
+        std::max(total.size, resource.alias_offset + requirements.size);
+    total.alignment = std::max(total.alignment, requirements.alignment);
+    total.memoryTypeBits &= requirements.memoryTypeBits;
+  }
+
+  if (!aliased.empty()) {
+    alias_memory_ = allocator_->allocate(total,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                         GpuResourceKind::kOptimal,
+                                         GpuMemoryCategory::kRenderTarget);
+    stats_.allocated_bytes += total.size;
+    for (auto index : aliased) {
+      auto& resource = resources_[index];
+      vkBindImageMemory(device_, resource.images[0], alias_memory_.memory,
+                        alias_memory_.offset + resource.alias_offset);
+    }
+  }
+
+  for (auto& resource : resources_) {
+    if (resource.imported || resource.images.empty()) continue;
+    VkImageViewCreateInfo view_info{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = resource.images[0],
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = resource.format,
+        .subresourceRange{
+            .aspectMask = isDepthFormat(resource.format)
+                              ? VK_IMAGE_ASPECT_DEPTH_BIT
+                              : VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    };
+    VkImageView view;
+    if (vkCreateImageView(device_, &view_info, nullptr, &view) !=
+        VK_SUCCESS) {
+      throw std::runtime_error("failed to create render graph view " +
+                               resource.name + "!");
+    }
+    resource.views = {view};
+  }
+}
+
+void RenderGraph::createRenderPasses() {
+  for (u_int32_t g = 0; g < groups_.size(); ++g) {
+    auto& group = groups_[g];
+    auto attachments = getAttachments(passes_[group.passes.front()]);
+
+    std::vector<VkAttachmentDescription> descriptions;
+    std::vector<VkAttachmentReference> color_refs;
+    VkAttachmentReference depth_ref{VK_ATTACHMENT_UNUSED};
+    for (u_int32_t k = 0; k < attachments.size(); ++k) {
+      const auto& use = *attachments[k];
+      const auto& resource = resources_[use.resource];
+      bool color = use.access == Access::kColor;
+      VkImageLayout layout =
+          color ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+      // contents written by an earlier render pass, or imported ones.
+      bool defined = g > resource.first_group ||
+                     (resource.imported &&
+                      resource.initial_layout != VK_IMAGE_LAYOUT_UNDEFINED);
+      bool used_later = resource.output || g < resource.last_group;
+
+      // layouts stay, barriers in front of the pass transition them.
+      descriptions.push_back({
+          .format = resource.format,
+          .samples = VK_SAMPLE_COUNT_1_BIT,
+          .loadOp = use.clear   ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                    : defined   ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+          .storeOp = used_later ? VK_ATTACHMENT_STORE_OP_STORE
+                                : VK_ATTACHMENT_STORE_OP_DONT_CARE,
+          .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+          .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+          .initialLayout = layout,
+          .finalLayout = layout,
+      });
+      if (color) {
+        color_refs.push_back({k, layout});
+      } else {
+        depth_ref = {k, layout};
+      }
+    }
+
+    // merged passes share every attachment.
+    std::vector<VkSubpassDescription> subpasses(group.passes.size());
+    for (auto& subpass : subpasses) {
+      subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+      subpass.colorAttachmentCount = static_cast<u_int32_t>(color_refs.size());
+      subpass.pColorAttachments = color_refs.data();
+      if (depth_ref.attachment != VK_ATTACHMENT_UNUSED)
+        subpass.pDepthStencilAttachment = &depth_ref;
+    }
+    std::vector<VkSubpassDependency> dependencies;
+    for (u_int32_t s = 1; s < subpasses.size(); ++s) {
+      dependencies.push_back({
+          .srcSubpass = s - 1,
+          .dstSubpass = s,
+          .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+          .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                          VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                          VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+          .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+          .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                           VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+          .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
+      });
+    }
+
+    VkRenderPassCreateInfo create_info{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = static_cast<u_int32_t>(descriptions.size()),
+        .pAttachments = descriptions.data(),
+        .subpassCount = static_cast<u_int32_t>(subpasses.size()),
+        .pSubpasses = subpasses.data(),
+        .dependencyCount = static_cast<u_int32_t>(dependencies.size()),
+        .pDependencies = dependencies.data(),
+    };
+    if (vkCreateRenderPass(device_, &create_info, nullptr,
+                           &group.render_pass) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create render pass of " +
+                               passes_[group.passes.front()].name + "!");
+    }
+
+    size_t framebuffer_count = 1;
+    for (auto resource : group.attachments) {
+      framebuffer_count =
+          std::max(framebuffer_count, resources_[resource].views.size());
+    }
+    group.framebuffers.resize(framebuffer_count);
+    for (size_t i = 0; i < framebuffer_count; ++i) {
+      std::vector<VkImageView> views;
+      for (auto resource : group.attachments) {
+        const auto& resource_views = resources_[resource].views;
+        views.push_back(resource_views.size() > 1 ? resource_views[i]
+                                                  : resource_views[0]);
+      }
+      VkFramebufferCreateInfo framebuffer_info{
+          .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+          .renderPass = group.render_pass,
+          .attachmentCount = static_cast<u_int32_t>(views.size()),
+          .pAttachments = views.data(),
+          .width = group.extent.width,
+          .height = group.extent.height,
+          .layers = 1,
+      };
+      if (vkCreateFramebuffer(device_, &framebuffer_info, nullptr,
+                              &group.framebuffers[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer!");
+      }
+    }
+  }
+}
+
+RenderGraph::State RenderGraph::getUseState(const Use& use) const {
+  switch (use.access) {
+    case Access::kColor:
+      return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, use.stages,
+              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0};
+    case Access::kDepth:
+      return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, use.stages,
+              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 0};
+    default:
+      return {getSampledLayout(use.resource), 0, 0, use.stages};
+  }
+}
+
+void RenderGraph::addBarrier(BarrierBatch& batch,
+                             RenderGraphResource resource, const State& from,
+                             VkImageLayout layout,
+                             VkPipelineStageFlags dst_stages,
+                             VkAccessFlags dst_access) {
+  const auto& image = resources_[resource];
+  VkPipelineStageFlags src_stages = from.write_stages | from.read_stages;
+  // nothing ran before in this frame, the submit waits at dst_stages.
+  batch.src_stages |= src_stages ? src_stages : dst_stages;
+  batch.dst_stages |= dst_stages;
+  batch.images.push_back({
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = from.write_access,
+      .dstAccessMask = dst_access,
+      .oldLayout = from.layout,
+      .newLayout = layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image.images.empty() ? VK_NULL_HANDLE : image.images[0],
+      .subresourceRange{
+          .aspectMask = isDepthFormat(image.format) ? VK_IMAGE_ASPECT_DEPTH_BIT
+                                                    : VK_IMAGE_ASPECT_COLOR_BIT,
+          .baseMipLevel = 0,
+          .levelCount = 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+      },
+  });
+  batch.resources.push_back(resource);
+}
+
+void RenderGraph::computeBarriers() {
+  // last use of every image in a frame, waited by its first use in the
+  // next one.
+  std::vector<State> last(resources_.size(), State{});
+  for (const auto& group : groups_) {
+    for (auto p : group.passes) {
+      for (const auto& use : passes_[p].uses) {
+        auto state = getUseState(use);
+        auto& previous = last[use.resource];
+        if (use.access == Access::kTexture) {
+          previous.read_stages |= state.read_stages;
+        } else {
+          previous = state;
+        }
+      }
+    }
+  }
+
+  std::vector<State> current(resources_.size());
+  for (u_int32_t i = 0; i < resources_.size(); ++i) {
+    const auto& resource = resources_[i];
+    current[i] = {resource.imported ? resource.initial_layout
+                                    : VK_IMAGE_LAYOUT_UNDEFINED,
+                  0, 0, 0};
+  }
+  // contents of a created image are dropped at its first use, which waits
+  // the last use of the images sharing its memory, in this frame if they
+  // are used already, else in the previous one.
+  std::vector<bool> used(resources_.size());
+  auto getDiscardState = [&](RenderGraphResource index) {
+    const auto& resource = resources_[index];
+    State state{VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0};
+    for (u_int32_t k = 0; k < resources_.size(); ++k) {
+      const auto& other = resources_[k];
+      bool shared =
+          k == index ||
+          (!resource.lazy && !other.lazy && !other.imported &&
+           !other.images.empty() &&
+           resource.alias_offset <
+               other.alias_offset + other.requirements.size &&
+           other.alias_offset <
+               resource.alias_offset + resource.requirements.size);
+      if (!shared) continue;
+      const auto& other_state = k != index && used[k] ? current[k] : last[k];
+      state.write_stages |= other_state.write_stages | other_state.read_stages;
+      state.write_access |= other_state.write_access;
+    }
+    return state;
+  };
+
+  for (auto& group : groups_) {
+    auto& batch = group.barriers;
+    for (size_t s = 0; s < group.passes.size(); ++s) {
+      for (const auto& use : passes_[group.passes[s]].uses) {
+        auto& from = current[use.resource];
+        if (!used[use.resource] && !resources_[use.resource].imported)
+          from = getDiscardState(use.resource);
+        used[use.resource] = true;
+        auto to = getUseState(use);
+        bool write = use.access != Access::kTexture;
+        // later subpasses are ordered by the subpass dependencies.
+        if (write && s > 0) continue;
+
+        bool needed = from.layout != to.layout;
+        if (write) {
+          needed |= (from.write_stages | from.read_stages) != 0;
+        } else {
+          needed |= from.write_stages && (to.read_stages & ~from.read_stages);
+        }
+        if (needed) {
+          addBarrier(batch, use.resource, from, to.layout,
+                     write ? to.write_stages : to.read_stages,
+                     getUseAccess(use.access == Access::kColor,
+                                  use.access == Access::kDepth, use.clear));
+        }
+
+        if (write) {
+          from = to;
+        } else {
+          from.layout = to.layout;
+          from.read_stages |= to.read_stages;
+        }
+      }
+    }
+  }
+
+  final_barriers_ = {};
+  for (u_int32_t i = 0; i < resources_.size(); ++i) {
+    const auto& resource = resources_[i];
+    if (!resource.imported || resource.final_layout == current[i].layout ||
+        resource.final_layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+      continue;
+    }
+    addBarrier(final_barriers_, i, current[i], resource.final_layout,
+               VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+               VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+  }
+
+  for (const auto& group : groups_) {
+    if (group.barriers.images.empty()) continue;
+    ++stats_.barrier_count;
+    stats_.image_barrier_count +=
+        static_cast<u_int32_t>(group.barriers.images.size());
+  }
+  if (!final_barriers_.images.empty()) {
+    ++stats_.barrier_count;
+    stats_.image_barrier_count +=
+        static_cast<u_int32_t>(final_barriers_.images.size());
+  }
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer command_buffer,
+                                 BarrierBatch& batch, u_int32_t index) {
+  if (batch.images.empty()) return;
+  for (size_t k = 0; k < batch.images.size(); ++k) {
+    const auto& resource = resources_[batch.resources[k]];
+    if (resource.imported) {
+      batch.images[k].image =
+          resource.images[index < resource.images.size() ? index : 0];
+    }
+  }
+  vkCmdPipelineBarrier(command_buffer, batch.src_stages, batch.dst_stages, 0,
+                       0, nullptr, 0, nullptr,
+                       static_cast<u_int32_t>(batch.images.size()),
+                       batch.images.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer command_buffer, u_int32_t index) {
+  for (auto& group : groups_) {
+    recordBarriers(command_buffer, group.barriers, index);
+
+    VkRenderPassBeginInfo begin_info{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = group.render_pass,
+        .framebuffer = group.framebuffers[group.framebuffers.size() > 1
+                                              ? index
+                                              : 0],
+        .renderArea{
+            .offset = {0, 0},
+            .extent = group.extent,
+        },
+        .clearValueCount = static_cast<u_int32_t>(group.clear_values.size()),
+        .pClearValues = group.clear_values.data(),
+    };
+    vkCmdBeginRenderPass(command_buffer, &begin_info,
+                         VK_SUBPASS_CONTENTS_INLINE);
+    for (size_t s = 0; s < group.passes.size(); ++s) {
+      if (s > 0) vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+      passes_[group.passes[s]].record(command_buffer);
+    }
+    vkCmdEndRenderPass(command_buffer);
+  }
+  recordBarriers(command_buffer, final_barriers_, index);
+}
+
+void RenderGraph::dispose() { release()(); }
+
+std::function<void()> RenderGraph::release() {
+  std::vector<VkFramebuffer> framebuffers;
+  std::vector<VkRenderPass> render_passes;
+  for (auto& group : groups_) {
+    framebuffers.insert(framebuffers.end(), group.framebuffers.begin(),
+                        group.framebuffers.end());
+    render_passes.push_back(group.render_pass);
+  }
+  std::vector<VkImageView> views;
+  std::vector<VkImage> images;
+  std::vector<GpuAllocation> memories{alias_memory_};
+  for (auto& resource : resources_) {
+    if (resource.imported) continue;
+    views.insert(views.end(), resource.views.begin(), resource.views.end());
+    images.insert(images.end(), resource.images.begin(),
+                  resource.images.end());
+    memories.push_back(resource.memory);
+  }
+  auto destroy = [device = device_, allocator = allocator_, framebuffers,
+                  render_passes, views, images, memories]() mutable {
+    for (auto framebuffer : framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    for (auto render_pass : render_passes)
+      vkDestroyRenderPass(device, render_pass, nullptr);
+    for (auto view : views) vkDestroyImageView(device, view, nullptr);
+    for (auto image : images) vkDestroyImage(device, image, nullptr);
+    if (allocator) {
+      for (auto& memory : memories) allocator->free(memory);
+    }
+  };
+
+  alias_memory_ = {};
+  groups_.clear();
+  resources_.clear();
+  passes_.clear();
+  final_barriers_ = {};
+  stats_ = {};
+  return destroy;
+}
+
+VkRenderPass RenderGraph::getRenderPass(RenderGraphPass pass) const {
+  if (passes_[pass].culled) return VK_NULL_HANDLE;
+  return groups_[passes_[pass].group].render_pass;
+}
+
+u_int32_t RenderGraph::getSubpass(RenderGraphPass pass) const {
+  return passes_[pass].subpass;
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource resource) const {
+  const auto& views = resources_[resource].views;
+  return views.empty() ? VK_NULL_HANDLE : views[0];
+}
+
+VkImageLayout RenderGraph::getSampledLayout(
+    RenderGraphResource resource) const {
+  return isDepthFormat(resources_[resource].format)
+             ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+             : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
+
+void RenderGraph::logStats() const {
+  LogUtil::LogI("render graph: " + std::to_string(stats_.pass_count) +
+                " passes, " + std::to_string(stats_.culled_pass_count) +
+                " culled, " + std::to_string(stats_.render_pass_count) +
+                " render passes\n");
+  LogUtil::LogI("render graph: " + std::to_string(stats_.barrier_count) +
+                " barriers (" + std::to_string(stats_.image_barrier_count) +
+                " images) per frame\n");
+  LogUtil::LogI("render graph: " + std::to_string(stats_.transient_count) +
+                " transient images, " + toMiB(stats_.transient_bytes) +
+                " -> " + toMiB(stats_.allocated_bytes) + " after aliasing\n");
+}
+
+}  // namespace LLShader
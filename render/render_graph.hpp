@@ -0,0 +1,228 @@
+#ifndef RENDER_GRAPH_HPP
+#define RENDER_GRAPH_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "render/gpu_allocator.hpp"
+
+namespace LLShader {
+
+/// image of a RenderGraph, index in declare order.
+typedef u_int32_t RenderGraphResource;
+
+/// pass of a RenderGraph, index in declare order.
+typedef u_int32_t RenderGraphPass;
+
+typedef struct {
+  u_int32_t pass_count;
+  u_int32_t culled_pass_count;
+  // VkRenderPass count, merged passes are subpasses of one.
+  u_int32_t render_pass_count;
+  // vkCmdPipelineBarrier calls and image barriers per execute().
+  u_int32_t barrier_count;
+  u_int32_t image_barrier_count;
+  // transient images, and the memory they got after aliasing. lazily
+  // allocated ones are counted in both.
+  u_int32_t transient_count;
+  VkDeviceSize transient_bytes;
+  VkDeviceSize allocated_bytes;
+} RenderGraphStats;
+
+/// Frame graph above the render manager.
+/// passes declare the images they write as attachments and the ones they
+/// sample, then compile():
+/// - culls passes not contributing to an output.
+/// - merges consecutive passes on the same attachments into subpasses.
+/// - creates render passes & framebuffers, attachments keep their layout
+///   inside a render pass, every transition is an explicit barrier batched
+///   in front of it, only where a hazard or layout change needs one.
+/// - creates transient images. the ones never leaving a render pass are
+///   transient attachments in lazily allocated memory if the device has
+///   it, the others share one allocation, aliased when their lifetimes
+///   don't overlap.
+/// transient images are shared by the frames in flight, frames are
+/// submitted in order to one queue and the first barrier of a frame waits
+/// the previous frame's last use. declare & compile once, execute() every
+/// frame. render thread only.
+class RenderGraph final {
+ public:
+  /// records the pass, inside its subpass.
+  typedef std::function<void(VkCommandBuffer command_buffer)> RecordFunc;
+
+  RenderGraph() = default;
+
+  RenderGraph(const RenderGraph&) = delete;
+
+  /// image created by compile(), contents don't survive the frame.
+  RenderGraphResource createImage(const std::string& name, VkFormat format,
+                                  VkExtent2D extent);
+
+  /// image owned outside, e.g. the swapchain, with one image & view per
+  /// index given to execute(). it is in initial_layout when a frame starts,
+  /// UNDEFINED drops the contents, and left in final_layout. the submit
+  /// waits for it at the stage of its first use.
+  RenderGraphResource importImage(const std::string& name, VkFormat format,
+                                  VkExtent2D extent,
+                                  const std::vector<VkImage>& images,
+                                  const std::vector<VkImageView>& views,
+                                  VkImageLayout initial_layout,
+                                  VkImageLayout final_layout);
+
+  /// kept by culling, imported images are outputs already.
+  void setOutput(RenderGraphResource resource);
+
+  RenderGraphPass addPass(const std::string& name, RecordFunc record);
+
+  /// write as attachment, cleared if clear is given, else loaded.
+  void addColorOutput(RenderGraphPass pass, RenderGraphResource resource,
+                      const VkClearColorValue* clear = nullptr);
+  void setDepthOutput(RenderGraphPass pass, RenderGraphResource resource,
+                      const VkClearDepthStencilValue* clear = nullptr);
+
+  /// sampled by stages, see getSampledLayout().
+  void addTextureInput(
+      RenderGraphPass pass, RenderGraphResource resource,
+      VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+  /// throw if a pass has no attachment or attachments differ in extent.
+  void compile(VkDevice device, GpuAllocator& allocator);
+
+  /// record every pass not culled. index picks imported images.
+  void execute(VkCommandBuffer command_buffer, u_int32_t index = 0);
+
+  void dispose();
+
+  /// empty the graph like dispose(), but hand its vulkan objects to the
+  /// returned function instead of destroying them, for
+  /// RenderManager::deferDestroy() while frames in flight still use them.
+  /// declare & compile again after.
+  std::function<void()> release();
+
+  /// valid after compile(), for pipelines. null for culled passes.
+  VkRenderPass getRenderPass(RenderGraphPass pass) const;
+  u_int32_t getSubpass(RenderGraphPass pass) const;
+  inline bool isCulled(RenderGraphPass pass) const {
+    return passes_[pass].culled;
+  }
+
+  /// view of a created image, valid after compile().
+  VkImageView getImageView(RenderGraphResource resource) const;
+
+  /// layout of resource while sampled, for descriptor writes.
+  VkImageLayout getSampledLayout(RenderGraphResource resource) const;
+
+  inline const RenderGraphStats& getStats() const { return stats_; }
+
+  void logStats() const;
+
+ private:
+  enum class Access : u_int32_t {
+    kColor,
+    kDepth,
+    kTexture,
+  };
+
+  typedef struct {
+    RenderGraphResource resource;
+    Access access;
+    bool clear;
+    VkClearValue clear_value;
+    VkPipelineStageFlags stages;
+  } Use;
+
+  typedef struct {
+    std::string name;
+    RecordFunc record;
+    std::vector<Use> uses;
+    bool culled;
+    u_int32_t group;
+    u_int32_t subpass;
+  } Pass;
+
+  // layout, stages & access of the last use.
+  typedef struct {
+    VkImageLayout layout;
+    VkPipelineStageFlags write_stages;
+    VkAccessFlags write_access;
+    // reads since the last write.
+    VkPipelineStageFlags read_stages;
+  } State;
+
+  typedef struct {
+    std::string name;
+    VkFormat format;
+    VkExtent2D extent;
+    bool imported;
+    bool output;
+    // one per index for imported images, else one.
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    VkImageLayout initial_layout;
+    VkImageLayout final_layout;
+    // compile results.
+    VkImageUsageFlags usage;
+    bool lazy;
+    // groups of the first & last use, ~0u if unused.
+    u_int32_t first_group;
+    u_int32_t last_group;
+    VkMemoryRequirements requirements;
+    VkDeviceSize alias_offset;
+    GpuAllocation memory;
+  } Resource;
+
+  // one barrier call, image is patched per index for imported resources.
+  typedef struct {
+    VkPipelineStageFlags src_stages;
+    VkPipelineStageFlags dst_stages;
+    std::vector<VkImageMemoryBarrier> images;
+    std::vector<RenderGraphResource> resources;
+  } BarrierBatch;
+
+  // one VkRenderPass.
+  typedef struct {
+    std::vector<RenderGraphPass> passes;
+    std::vector<RenderGraphResource> attachments;
+    std::vector<VkClearValue> clear_values;
+    VkExtent2D extent;
+    VkRenderPass render_pass;
+    // one per index if an attachment is imported.
+    std::vector<VkFramebuffer> framebuffers;
+    BarrierBatch barriers;
+  } Group;
+
+  void cullPasses();
+  void mergePasses();
+  void createImages();
+  void computeBarriers();
+  void createRenderPasses();
+
+  // attachment uses of pass, in declare order.
+  std::vector<const Use*> getAttachments(const Pass& pass) const;
+  // state a use leaves the resource in.
+  State getUseState(const Use& use) const;
+  void addBarrier(BarrierBatch& batch, RenderGraphResource resource,
+                  const State& from, VkImageLayout layout,
+                  VkPipelineStageFlags dst_stages, VkAccessFlags dst_access);
+  void recordBarriers(VkCommandBuffer command_buffer,
+                      BarrierBatch& batch, u_int32_t index);
+
+  VkDevice device_{VK_NULL_HANDLE};
+  GpuAllocator* allocator_{nullptr};
+
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;
+  std::vector<Group> groups_;
+  // transitions of imported images to their final layout.
+  BarrierBatch final_barriers_;
+  // shared by aliased images.
+  GpuAllocation alias_memory_{};
+  RenderGraphStats stats_{};
+};
+
+}  // namespace LLShader
+
+#endif
@@ -1,5 +1,8 @@
 #include "render_manager.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 
@@ -11,16 +14,59 @@
 #include "3rd/stb/stb_image.h"
 #include "demos/guitest/gui_test.hpp"
 #include "demos/obj2mesh/mesh_demo.hpp"
+#include "demos/pbr/pbr_demo.hpp"
 #include "demos/shadow/shadow.hpp"
+#include "demos/shadowmap/shadow_demo.hpp"
 #include "engine/matrix.hpp"
 #include "render/window_manager.hpp"
+#include "util/ktx2.hpp"
 #include "util/shader_compiler_helper.hpp"
 
 namespace LLShader {
 
+namespace {
+
+// where uploaded buffers & textures are read by later frames.
+constexpr VkPipelineStageFlags upload_dst_stages =
+    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+constexpr VkAccessFlags upload_dst_access =
+    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+    VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+GpuMemoryCategory bufferCategory(VkBufferUsageFlags usage) {
+  if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+    return GpuMemoryCategory::kVertex;
+  if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+    return GpuMemoryCategory::kIndex;
+  if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+    return GpuMemoryCategory::kUniform;
+  if (usage == VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+    return GpuMemoryCategory::kStaging;
+  return GpuMemoryCategory::kOther;
+}
+
+GpuMemoryCategory imageCategory(VkImageUsageFlags usage) {
+  if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+    return GpuMemoryCategory::kDepth;
+  if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+    return GpuMemoryCategory::kRenderTarget;
+  if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) return GpuMemoryCategory::kTexture;
+  return GpuMemoryCategory::kOther;
+}
+
+std::unique_ptr<RenderBase> createDemo(const std::string& name) {
+  if (name == "mesh") return std::make_unique<MeshDemo>();
+  if (name == "pbr") return std::make_unique<PBRDemo>();
+  if (name == "shadowmap") return std::make_unique<ShadowMapDemo>();
+  throw std::runtime_error("unknown demo " + name);
+}
+
+}  // namespace
+
 /// util func below
 void RenderManager::createBufferAndBindMemory(VkBuffer& buf,
-                                              VkDeviceMemory& mem, size_t size,
+                                              GpuAllocation& mem, size_t size,
                                               void* data,
                                               VkBufferUsageFlags usage,
                                               VkMemoryPropertyFlags property) {
@@ -35,116 +81,252 @@ void RenderManager::createBufferAndBindMemory(VkBuffer& buf,
     throw std::runtime_error("failed to create buffer!");
   }
 
-  VkMemoryRequirements mem_req;
-  vkGetBufferMemoryRequirements(device_, buf, &mem_req);
-
-  VkMemoryAllocateInfo allocInfo{
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize = mem_req.size,
-      .memoryTypeIndex = getMemoryTypeIndex(mem_req.memoryTypeBits, property),
-  };
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &mem) != VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate buffer memory!");
-  }
-
-  vkBindBufferMemory(device_, buf, mem, 0);
+  mem = allocator_.allocateForBuffer(buf, property, bufferCategory(usage));
 
-  if (data && (property & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ==
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-    void* dst_data;
-    vkMapMemory(device_, mem, 0, size, 0, &dst_data);
-    memcpy(dst_data, data, size);
-    vkUnmapMemory(device_, mem);
+  // host visible blocks are always mapped.
+  if (data && mem.mapped) {
+    memcpy(mem.mapped, data, size);
+    allocator_.flush(mem);
   }
 }
 
-void RenderManager::createDeviceOnlyBuffer(VkBuffer& buf, VkDeviceMemory& mem,
+void RenderManager::createDeviceOnlyBuffer(VkBuffer& buf, GpuAllocation& mem,
                                            size_t size, void* data,
                                            VkBufferUsageFlags usage,
                                            VkMemoryPropertyFlags property) {
-  VkBuffer stage_buf;
-  VkDeviceMemory stage_mem;
-  VkBufferCreateInfo stage_buf_info{
+  assert(data);
+
+  VkBufferCreateInfo target_buf_info{
       .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
       .size = size,
-      .usage =
-          VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,  // typically, only
+                                                          // device local bit.
       .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
   };
 
-  if (vkCreateBuffer(device_, &stage_buf_info, nullptr, &stage_buf) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to create stage buffer!");
+  if (vkCreateBuffer(device_, &target_buf_info, nullptr, &buf) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create buffer!");
   }
 
-  VkMemoryRequirements mem_req;
-  vkGetBufferMemoryRequirements(device_, stage_buf, &mem_req);
-
-  VkMemoryAllocateInfo allocInfo{
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize = mem_req.size,
-      .memoryTypeIndex = getMemoryTypeIndex(
-          mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
-                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
-  };
+  // property device only
+  mem = allocator_.allocateForBuffer(buf, property, bufferCategory(usage));
+
+  // copy through the staging ring, large buffers take several passes.
+  const VkDeviceSize chunk_size = staging_ring_.getSize() / 4;
+  const auto* src = static_cast<const unsigned char*>(data);
+  beginUploadBatch();
+  for (VkDeviceSize offset = 0; offset < size; offset += chunk_size) {
+    VkDeviceSize chunk = std::min<VkDeviceSize>(chunk_size, size - offset);
+    StagingRange range = stageUpload(upload_cmd_, chunk);
+    memcpy(range.mapped, src + offset, chunk);
+
+    VkBufferCopy copy_region;
+    copy_region.srcOffset = range.offset;
+    copy_region.dstOffset = offset;
+    copy_region.size = chunk;
+    vkCmdCopyBuffer(upload_cmd_, range.buffer, buf, 1, &copy_region);
+  }
 
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &stage_mem) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate stage memory!");
+  // handed to the graphics family when the batch is submitted.
+  if (hasTransferQueue()) {
+    upload_transfer_.buffers.push_back(VkBufferMemoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcQueueFamilyIndex = family_indices_.transfer_family.value(),
+        .dstQueueFamilyIndex = family_indices_.graphic_family.value(),
+        .buffer = buf,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    });
   }
+  submitUploadBatch();
+}
 
-  vkBindBufferMemory(device_, stage_buf, stage_mem, 0);
+void RenderManager::deferDestroy(u_int64_t last_frame,
+                                 std::function<void()> destroy) {
+  deferred_destroys_.push_back({last_frame, std::move(destroy)});
+}
 
-  assert(data);
+void RenderManager::deferDestroyBuffer(VkBuffer buffer, GpuAllocation memory) {
+  deferDestroy([this, buffer, memory] {
+    vkDestroyBuffer(device_, buffer, nullptr);
+    allocator_.free(memory);
+  });
+}
 
-  void* dst_data;
-  vkMapMemory(device_, stage_mem, 0, size, 0, &dst_data);
-  memcpy(dst_data, data, size);
-  vkUnmapMemory(device_, stage_mem);
+void RenderManager::deferDestroyTexture(const Texture2D& texture) {
+  deferDestroy([this, view = texture.texture_image_view,
+                image = texture.texture_image,
+                memory = texture.texture_memory] {
+    vkDestroyImageView(device_, view, nullptr);
+    vkDestroyImage(device_, image, nullptr);
+    allocator_.free(memory);
+  });
+}
 
-  // copy data from stage buf -> taget buf
-  VkBufferCreateInfo target_buf_info{
-      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-      .size = size,
-      .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,  // typically, only
-                                                          // device local bit.
-      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-  };
+void RenderManager::runDeferredDestroys(u_int64_t completed_frames) {
+  // an entry of an older frame behind a newer one only runs later.
+  while (!deferred_destroys_.empty() &&
+         deferred_destroys_.front().frame < completed_frames) {
+    auto destroy = std::move(deferred_destroys_.front().destroy);
+    deferred_destroys_.pop_front();
+    destroy();
+  }
+}
 
-  if (vkCreateBuffer(device_, &target_buf_info, nullptr, &buf) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create buffer!");
+void RenderManager::beginUploadBatch() {
+  if (upload_depth_++ == 0) upload_cmd_ = beginUploadCommands();
+}
+
+UploadToken RenderManager::submitUploadBatch(bool stream) {
+  assert(upload_depth_ > 0);
+  if (--upload_depth_ > 0) return 0;
+
+  if (!hasTransferQueue()) {
+    // copies of this batch, including parts submitted early when the ring
+    // was full, are visible to everything submitted later.
+    VkMemoryBarrier barrier{
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = upload_dst_access,
+    };
+    vkCmdPipelineBarrier(upload_cmd_, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         upload_dst_stages, 0, 1, &barrier, 0, nullptr, 0,
+                         nullptr);
+
+    UploadToken token = submitStagingCommands(upload_cmd_);
+    upload_cmd_ = VK_NULL_HANDLE;
+    return token;
   }
 
-  vkGetBufferMemoryRequirements(device_, buf, &mem_req);
+  // release to the graphics family, acquired by cmdAcquireUploads().
+  auto& transfer = upload_transfer_;
+  for (auto& barrier : transfer.buffers) {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+  }
+  for (auto& barrier : transfer.images) {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+  }
+  if (!transfer.buffers.empty() || !transfer.images.empty()) {
+    vkCmdPipelineBarrier(
+        upload_cmd_, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+        static_cast<u_int32_t>(transfer.buffers.size()),
+        transfer.buffers.data(),
+        static_cast<u_int32_t>(transfer.images.size()), transfer.images.data());
+  }
 
-  VkMemoryAllocateInfo target_mem_alloc_info{
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize = mem_req.size,
-      .memoryTypeIndex = getMemoryTypeIndex(mem_req.memoryTypeBits,
-                                            property),  // property device only
-  };
+  transfer.token = submitStagingCommands(upload_cmd_);
+  transfer.stream = stream;
+  upload_cmd_ = VK_NULL_HANDLE;
 
-  if (vkAllocateMemory(device_, &target_mem_alloc_info, nullptr, &mem) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate buffer memory!");
+  UploadToken token = transfer.token;
+  pending_transfers_.push_back(std::move(transfer));
+  upload_transfer_ = {};
+  return token;
+}
+
+void RenderManager::cmdAcquireUploads(VkCommandBuffer commandBuffer) {
+  // every batch up to the last non stream one, then finished stream ones.
+  size_t count = 0;
+  for (size_t i = 0; i < pending_transfers_.size(); ++i) {
+    if (!pending_transfers_[i].stream) count = i + 1;
+  }
+  while (count < pending_transfers_.size() &&
+         staging_ring_.isComplete(pending_transfers_[count].token)) {
+    ++count;
   }
 
-  vkBindBufferMemory(device_, buf, mem, 0);
+  for (size_t i = 0; i < count; ++i) {
+    auto& transfer = pending_transfers_.front();
+    for (auto& barrier : transfer.buffers) {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = upload_dst_access;
+    }
+    for (auto& barrier : transfer.images) {
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = upload_dst_access;
+    }
+    if (!transfer.buffers.empty() || !transfer.images.empty()) {
+      vkCmdPipelineBarrier(
+          commandBuffer, upload_dst_stages, upload_dst_stages, 0, 0, nullptr,
+          static_cast<u_int32_t>(transfer.buffers.size()),
+          transfer.buffers.data(),
+          static_cast<u_int32_t>(transfer.images.size()),
+          transfer.images.data());
+    }
 
-  // copy stage buffer to target buffer.
-  auto temp_cmdbuf = beginSingleTimeCommands();
-  VkBufferCopy copy_region;
-  copy_region.dstOffset = 0;
-  copy_region.srcOffset = 0;
-  copy_region.size = size;
-  vkCmdCopyBuffer(temp_cmdbuf, stage_buf, buf, 1, &copy_region);
+    // the frame submit waits the transfer, a no-op once it finished. tokens
+    // grow, the last one covers every earlier batch.
+    frame_upload_token_ = transfer.token;
+    pending_transfers_.pop_front();
+  }
+}
 
-  endSingleTimeCommands(temp_cmdbuf);
+VkCommandBuffer RenderManager::beginUploadCommands() {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = upload_command_pool_;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  vkAllocateCommandBuffers(device_, &allocInfo, &commandBuffer);
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  vkDestroyBuffer(device_, stage_buf, nullptr);
-  vkFreeMemory(device_, stage_mem, nullptr);
+  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+  return commandBuffer;
+}
+
+UploadToken RenderManager::submitStagingCommands(
+    VkCommandBuffer commandBuffer) {
+  vkEndCommandBuffer(commandBuffer);
+
+  // the ring frees commandBuffer once the timeline reached token.
+  UploadToken token = staging_ring_.closeBatch(commandBuffer);
+  VkSemaphore timeline = staging_ring_.getTimeline();
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &token,
+  };
+  VkSubmitInfo submitInfo{
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &timelineInfo,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &commandBuffer,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &timeline,
+  };
+  vkQueueSubmit(upload_queue_, 1, &submitInfo, VK_NULL_HANDLE);
+  return token;
+}
+
+StagingRange RenderManager::stageUpload(VkCommandBuffer& commandBuffer,
+                                        VkDeviceSize size,
+                                        VkDeviceSize alignment) {
+  if (size > staging_ring_.getSize())
+    throw std::runtime_error("upload larger than the staging ring!");
+
+  StagingRange range;
+  while (!staging_ring_.allocate(size, alignment, range)) {
+    staging_ring_.reclaim();
+    if (staging_ring_.allocate(size, alignment, range)) break;
+
+    // the rest of the ring is used by commandBuffer itself, send it off
+    // and continue recording into a new one.
+    if (staging_ring_.hasOpenRanges()) {
+      submitStagingCommands(commandBuffer);
+      commandBuffer = beginUploadCommands();
+    }
+    staging_ring_.waitOldest();
+  }
+  return range;
 }
 
 VkCommandBuffer RenderManager::beginSingleTimeCommands() {
@@ -174,8 +356,15 @@ void RenderManager::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(g_queue_, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(g_queue_);
+  // wait for this submit only, not the frames in flight.
+  VkFenceCreateInfo fence_info{
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+  VkFence fence;
+  vkCreateFence(device_, &fence_info, nullptr, &fence);
+  vkQueueSubmit(g_queue_, 1, &submitInfo, fence);
+  vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX);
+  vkDestroyFence(device_, fence, nullptr);
 
   vkFreeCommandBuffers(device_, g_command_pool_, 1, &commandBuffer);
 }
@@ -184,7 +373,33 @@ void RenderManager::transitionImageLayout(VkImage image, VkFormat format,
                                           VkImageLayout old_layout,
                                           VkImageLayout new_layout) {
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  cmdTransitionImageLayout(commandBuffer, image, old_layout, new_layout);
+  endSingleTimeCommands(commandBuffer);
+}
 
+void RenderManager::cmdSetViewport(VkCommandBuffer commandBuffer,
+                                   VkExtent2D extent) {
+  VkViewport viewport{
+      .x = 0.f,
+      .y = 0.f,
+      .width = static_cast<float>(extent.width),
+      .height = static_cast<float>(extent.height),
+      .minDepth = 0.f,
+      .maxDepth = 1.f,
+  };
+  VkRect2D scissor{
+      .offset = {0, 0},
+      .extent = extent,
+  };
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void RenderManager::cmdTransitionImageLayout(VkCommandBuffer commandBuffer,
+                                             VkImage image,
+                                             VkImageLayout old_layout,
+                                             VkImageLayout new_layout,
+                                             u_int32_t level_count) {
   VkImageMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
                                .oldLayout = old_layout,
                                .newLayout = new_layout,
@@ -194,7 +409,7 @@ void RenderManager::transitionImageLayout(VkImage image, VkFormat format,
                                .subresourceRange{
                                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
                                    .baseMipLevel = 0,
-                                   .levelCount = 1,
+                                   .levelCount = level_count,
                                    .baseArrayLayer = 0,
                                    .layerCount = 1,
                                }};
@@ -222,14 +437,18 @@ void RenderManager::transitionImageLayout(VkImage image, VkFormat format,
 
   vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0,
                        nullptr, 0, nullptr, 1, &barrier);
-
-  endSingleTimeCommands(commandBuffer);
 }
 
 void RenderManager::copyBufferToImage(VkBuffer buffer, VkImage image,
                                       uint32_t width, uint32_t height) {
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  cmdCopyBufferToImage(commandBuffer, buffer, image, width, height);
+  endSingleTimeCommands(commandBuffer);
+}
 
+void RenderManager::cmdCopyBufferToImage(VkCommandBuffer commandBuffer,
+                                         VkBuffer buffer, VkImage image,
+                                         uint32_t width, uint32_t height) {
   VkBufferImageCopy region{};
   region.bufferOffset = 0;
   region.bufferRowLength = 0;
@@ -243,58 +462,181 @@ void RenderManager::copyBufferToImage(VkBuffer buffer, VkImage image,
 
   vkCmdCopyBufferToImage(commandBuffer, buffer, image,
                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  endSingleTimeCommands(commandBuffer);
 }
 
 Texture2D RenderManager::loadTexture2D(const std::string& file) {
-  Texture2D texture2D{};
-  int width, height, tex_channel;
-  stbi_uc* pixels =
-      stbi_load(file.c_str(), &width, &height, &tex_channel, STBI_rgb_alpha);
+  // all levels staged through the ring, one submit unless it is full. no
+  // wait, later frames are ordered after the upload.
+  Texture2D texture2D;
+
+  if (isKtx2File(file)) {
+    // baked offline, blocks go to the staging ring as they are.
+    CompressedMipChain chain;
+    if (!readKtx2(file, chain))
+      throw std::runtime_error("falied to load " + file);
+
+    beginUploadBatch();
+    texture2D = cmdUploadTexture2D(upload_cmd_, chain);
+    submitUploadBatch();
+  } else {
+    // decoded pixels of a previous launch are copied from the mapped cache.
+    auto& cache = getGlobalTextureCache();
+    u_int64_t key;
+    bool has_key = TextureCache::computeKey(file, true, true, key);
+    TextureCacheEntry cached;
+    if (has_key && cache.load(key, cached)) {
+      beginUploadBatch();
+      texture2D = cmdUploadTexture2D(upload_cmd_, cached);
+      submitUploadBatch();
+    } else {
+      int width, height, tex_channel;
+      stbi_uc* pixels = stbi_load(file.c_str(), &width, &height, &tex_channel,
+                                  STBI_rgb_alpha);
+
+      if (!pixels) throw std::runtime_error("falied to load " + file);
+
+      MipChain mips;
+      generateMipChain(pixels, width, height, mips);
+      stbi_image_free(pixels);
+      if (has_key) cache.store(key, mips);
+
+      beginUploadBatch();
+      texture2D = cmdUploadTexture2D(upload_cmd_, mips);
+      submitUploadBatch();
+    }
+  }
 
-  if (!pixels) throw std::runtime_error("falied to load " + file);
+  texture2D.texture_name = file;
+  return texture2D;
+}
 
-  VkDeviceSize sz = width * height * sizeof(u_int32_t);
+Texture2D RenderManager::cmdUploadTexture2D(VkCommandBuffer& commandBuffer,
+                                            const MipChain& mips) {
+  return cmdUploadImage2D(commandBuffer, VK_FORMAT_R8G8B8A8_SRGB,
+                          mips.pixels.data(), mips.levels, 1, 4);
+}
 
-  VkBuffer stage_buf;
-  VkDeviceMemory stage_mem;
-  createBufferAndBindMemory(
-      stage_buf, stage_mem, sz, pixels,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+Texture2D RenderManager::cmdUploadTexture2D(VkCommandBuffer& commandBuffer,
+                                            const TextureCacheEntry& cached) {
+  return cmdUploadImage2D(commandBuffer, VK_FORMAT_R8G8B8A8_SRGB,
+                          cached.pixels, cached.levels, 1, 4);
+}
 
-  stbi_image_free(pixels);
+Texture2D RenderManager::cmdUploadTexture2D(VkCommandBuffer& commandBuffer,
+                                            const CompressedMipChain& chain) {
+  VkFormat format = getBlockVkFormat(chain.format, chain.srgb);
+  if (isFormatSampleable(format)) {
+    return cmdUploadImage2D(commandBuffer, format, chain.blocks.data(),
+                            chain.levels, 4, getBlockByteSize(chain.format));
+  }
 
-  createImageAndBindMemory(
-      texture2D.texture_image, width, height,
-      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-      texture2D.texture_memory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // no bc sampling on this device (e.g. most mobile gpu), decode on cpu.
+  LogUtil::LogW(std::string(getBlockFormatName(chain.format)) +
+                " is not sampleable, decode to rgba 32 on cpu\n");
+  MipChain mips;
+  if (!decompressMipChain(chain, mips))
+    throw std::runtime_error("failed to decode compressed texture!");
+  return cmdUploadImage2D(
+      commandBuffer,
+      chain.srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM,
+      mips.pixels.data(), mips.levels, 1, 4);
+}
 
-  transitionImageLayout(texture2D.texture_image, VK_FORMAT_R8G8B8A8_SRGB,
-                        VK_IMAGE_LAYOUT_UNDEFINED,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+bool RenderManager::isFormatSampleable(VkFormat format) {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(vk_context.physical_device, format,
+                                      &properties);
+  return properties.optimalTilingFeatures &
+         VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+}
 
-  copyBufferToImage(stage_buf, texture2D.texture_image, width, height);
+Texture2D RenderManager::cmdUploadImage2D(VkCommandBuffer& commandBuffer,
+                                          VkFormat format,
+                                          const unsigned char* data,
+                                          const std::vector<MipLevel>& levels,
+                                          u_int32_t block_dim,
+                                          u_int32_t block_bytes) {
+  Texture2D texture2D{};
+  u_int32_t level_count = static_cast<u_int32_t>(levels.size());
 
-  transitionImageLayout(texture2D.texture_image, VK_FORMAT_R8G8B8A8_SRGB,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  createImageAndBindMemory(
+      texture2D.texture_image, levels.front().width, levels.front().height,
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+      texture2D.texture_memory, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      level_count, format);
+
+  cmdTransitionImageLayout(commandBuffer, texture2D.texture_image,
+                           VK_IMAGE_LAYOUT_UNDEFINED,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_count);
+
+  // levels are copied in bands of whole block rows, so a level larger than
+  // the ring is split over several passes. extent is in texels for block
+  // formats too, rows are tightly packed.
+  const VkDeviceSize chunk_size = staging_ring_.getSize() / 4;
+  for (u_int32_t i = 0; i < level_count; ++i) {
+    const auto& level = levels[i];
+    VkDeviceSize row_pitch =
+        VkDeviceSize((level.width + block_dim - 1) / block_dim) * block_bytes;
+    u_int32_t block_rows = (level.height + block_dim - 1) / block_dim;
+    u_int32_t band_rows = static_cast<u_int32_t>(
+        std::max<VkDeviceSize>(1, chunk_size / row_pitch));
+
+    for (u_int32_t row = 0; row < block_rows; row += band_rows) {
+      u_int32_t rows = std::min(band_rows, block_rows - row);
+      VkDeviceSize bytes = rows * row_pitch;
+      StagingRange range = stageUpload(commandBuffer, bytes);
+      memcpy(range.mapped, data + level.offset + row * row_pitch, bytes);
+
+      u_int32_t y = row * block_dim;
+      VkBufferImageCopy region{};
+      region.bufferOffset = range.offset;
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel = i;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.layerCount = 1;
+      region.imageOffset = {0, static_cast<int32_t>(y), 0};
+      region.imageExtent = {level.width,
+                            std::min(rows * block_dim, level.height - y), 1};
+      vkCmdCopyBufferToImage(commandBuffer, range.buffer,
+                             texture2D.texture_image,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+  }
 
-  vkDestroyBuffer(device_, stage_buf, nullptr);
-  vkFreeMemory(device_, stage_mem, nullptr);
+  if (hasTransferQueue()) {
+    // layout changes with the ownership transfer when the batch is
+    // submitted.
+    upload_transfer_.images.push_back(VkImageMemoryBarrier{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = family_indices_.transfer_family.value(),
+        .dstQueueFamilyIndex = family_indices_.graphic_family.value(),
+        .image = texture2D.texture_image,
+        .subresourceRange{
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = level_count,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+    });
+  } else {
+    cmdTransitionImageLayout(commandBuffer, texture2D.texture_image,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                             level_count);
+  }
 
-  // TODO: support different format, level...
   {
     VkImageViewCreateInfo viewInfo{};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = texture2D.texture_image;
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.levelCount = level_count;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
@@ -310,18 +652,20 @@ Texture2D RenderManager::loadTexture2D(const std::string& file) {
 void RenderManager::createImageAndBindMemory(VkImage& image, u_int32_t width,
                                              u_int32_t height,
                                              VkImageUsageFlags usage,
-                                             VkDeviceMemory& memory,
-                                             VkMemoryPropertyFlags property) {
+                                             GpuAllocation& memory,
+                                             VkMemoryPropertyFlags property,
+                                             u_int32_t mip_levels,
+                                             VkFormat format) {
   VkImageCreateInfo image_c_info{
       .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
       .imageType = VK_IMAGE_TYPE_2D,
-      .format = VK_FORMAT_R8G8B8A8_SRGB,
+      .format = format,
       .extent{
           .width = width,
           .height = height,
           .depth = 1,
       },
-      .mipLevels = 1,
+      .mipLevels = mip_levels,
       .arrayLayers = 1,
       .samples = VK_SAMPLE_COUNT_1_BIT,
       .tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -334,39 +678,17 @@ void RenderManager::createImageAndBindMemory(VkImage& image, u_int32_t width,
     throw std::runtime_error("create VkImage failed.");
   }
 
-  VkMemoryRequirements mem_req;
-  vkGetImageMemoryRequirements(device_, image, &mem_req);
-  VkMemoryAllocateInfo alloc_info{
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .allocationSize = mem_req.size,
-      .memoryTypeIndex = getMemoryTypeIndex(mem_req.memoryTypeBits, property),
-  };
-
-  if (vkAllocateMemory(device_, &alloc_info, nullptr, &memory) != VK_SUCCESS) {
-    throw std::runtime_error("failed to create marry_tex_mem! ");
-  }
-
-  vkBindImageMemory(device_, image, memory, 0);
+  memory = allocator_.allocateForImage(image, property, imageCategory(usage));
 }
 
 uint32_t RenderManager::getMemoryTypeIndex(uint32_t type_bit,
                                            VkMemoryPropertyFlags property) {
-  VkPhysicalDeviceMemoryProperties physcial_device_mem_prop;
-  vkGetPhysicalDeviceMemoryProperties(vk_context.physical_device,
-                                      &physcial_device_mem_prop);
-  for (uint32_t i = 0; i < physcial_device_mem_prop.memoryTypeCount; i++) {
-    if ((type_bit & (1 << i)) &&
-        (physcial_device_mem_prop.memoryTypes[i].propertyFlags & property) ==
-            property) {
-      return i;
-    }
-  }
-
-  throw std::runtime_error("failed to find suitable memory type!");
+  return allocator_.findMemoryType(type_bit, property);
 }
 
 VkShaderModule RenderManager::createShaderMoudule(
-    const std::string& file, shaderc_shader_kind shaderType) {
+    const std::string& file, shaderc_shader_kind shaderType,
+    const std::vector<std::string>& macros) {
   VkShaderModule shaderModule;
   std::vector<uint32_t> spirv;
 
@@ -386,8 +708,12 @@ VkShaderModule RenderManager::createShaderMoudule(
   // TODO: using a global persistent compiler.
   shaderc::Compiler c;
 
-  auto result =
-      c.CompileGlslToSpv(buf.data(), buf.size(), shaderType, file.c_str());
+  shaderc::CompileOptions options;
+  options.SetIncluder(std::make_unique<ShaderFileIncluder>());
+  for (const auto& macro : macros) options.AddMacroDefinition(macro);
+
+  auto result = c.CompileGlslToSpv(buf.data(), buf.size(), shaderType,
+                                   file.c_str(), options);
 
   if (!result.GetErrorMessage().empty()) {
     LogUtil::LogE(result.GetErrorMessage() + '\n');
@@ -413,20 +739,33 @@ VkShaderModule RenderManager::createShaderMoudule(
 /// member func
 void RenderManager::init() {
   vk_context = global_matrix_engine.vk_holder->getVkContext();
-  createVkSurface();
+  headless_ = global_matrix_engine.getConfig().headless;
+  if (!headless_) createVkSurface();
   findGraphicAndPresentFamily();
   createVkDevice();
+  allocator_.init(vk_context.physical_device, device_);
   getRequiredQueues();
   createCommandPool();
+  staging_ring_.init(device_, allocator_, upload_command_pool_);
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vk_context.physical_device, &properties);
+  frame_uniforms_.init(device_, allocator_,
+                       properties.limits.minUniformBufferOffsetAlignment,
+                       MAX_FRAMES_IN_FLIGHT);
   createCommandBuffers();
+  createRecordContexts();
   createDescriptorPool();
-  createSwapchain();
-  getSwapchainImages();
+  if (headless_) {
+    createOffscreenImages();
+  } else {
+    createSwapchain();
+    getSwapchainImages();
+  }
   createSwapchainImageViews();
   createSyncObject();
+  createTimestampQueries();
   // @entery-point.
-  // TODO: Make demo pickable.
-  p_current_draw_context = std::make_unique<MeshDemo>();
+  p_current_draw_context = createDemo(global_matrix_engine.getConfig().demo);
   p_current_draw_context->init();
   installIMGUI();
 }
@@ -434,12 +773,24 @@ void RenderManager::init() {
 void RenderManager::dispose() {
   uninstallIMGUI();
   p_current_draw_context->dispose();
+  // the device is idle, every frame finished.
+  runDeferredDestroys(UINT64_MAX);
 
   if (desp_pool_ != VK_NULL_HANDLE)
     vkDestroyDescriptorPool(device_, desp_pool_, nullptr);
   // note: not need to explict free.
   // vkFreeCommandBuffers(device, cmdPool, cmdbuffers_.size(),
   // cmdbuffers_.data());
+  // frees the upload command buffers, before their pool goes.
+  staging_ring_.dispose();
+  frame_uniforms_.dispose();
+  if (upload_command_pool_ != g_command_pool_)
+    vkDestroyCommandPool(device_, upload_command_pool_, nullptr);
+  for (auto& contexts : record_contexts_) {
+    for (auto& context : contexts)
+      vkDestroyCommandPool(device_, context.pool, nullptr);
+  }
+  record_pool_.reset();
   if (g_command_pool_ != VK_NULL_HANDLE)
     vkDestroyCommandPool(device_, g_command_pool_, nullptr);
 
@@ -452,6 +803,11 @@ void RenderManager::dispose() {
     }
     if (swapchain_ != VK_NULL_HANDLE)
       vkDestroySwapchainKHR(device_, swapchain_, nullptr);
+    // headless images are ours.
+    for (size_t i = 0; i < offscreen_memory_.size(); ++i) {
+      vkDestroyImage(device_, swapchain_images_[i], nullptr);
+      allocator_.free(offscreen_memory_[i]);
+    }
   }
 
   if (surface_ != VK_NULL_HANDLE)
@@ -464,17 +820,43 @@ void RenderManager::dispose() {
         vkDestroySemaphore(device_, render_finished_semaphores_[i], nullptr);
       if (image_available_semaphores_[i] != VK_NULL_HANDLE)
         vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
-      if (in_flight_fences_[i] != VK_NULL_HANDLE)
-        vkDestroyFence(device_, in_flight_fences_[i], nullptr);
     }
+    if (frame_timeline_ != VK_NULL_HANDLE)
+      vkDestroySemaphore(device_, frame_timeline_, nullptr);
   }
+  if (timestamp_pool_ != VK_NULL_HANDLE)
+    vkDestroyQueryPool(device_, timestamp_pool_, nullptr);
+
+  // all pooled memory goes with the allocator.
+  allocator_.logStats();
+  allocator_.dispose();
 
   if (device_ != VK_NULL_HANDLE) vkDestroyDevice(device_, nullptr);
 }
 
 void RenderManager::defaultCreateDepthResource(
     VkExtent2D extent, VkImage& depth_image, VkImageView& depth_image_view,
-    VkDeviceMemory& depth_image_memory) {
+    GpuAllocation& depth_image_memory) {
+  createDepthImage(
+      extent,
+      VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      depth_image, depth_image_view, depth_image_memory);
+}
+
+void RenderManager::createTransientDepthResource(
+    VkExtent2D extent, VkImage& depth_image, VkImageView& depth_image_view,
+    GpuAllocation& depth_image_memory) {
+  createDepthImage(extent,
+                   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                       VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                   depth_image, depth_image_view, depth_image_memory);
+}
+
+void RenderManager::createDepthImage(VkExtent2D extent,
+                                     VkImageUsageFlags usage,
+                                     VkImage& depth_image,
+                                     VkImageView& depth_image_view,
+                                     GpuAllocation& depth_image_memory) {
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -486,8 +868,7 @@ void RenderManager::defaultCreateDepthResource(
   imageInfo.format = VK_FORMAT_D32_SFLOAT;
   imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
   imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
-                    VK_IMAGE_USAGE_SAMPLED_BIT;  // TODO: refactor to setable.
+  imageInfo.usage = usage;
   imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
@@ -495,21 +876,27 @@ void RenderManager::defaultCreateDepthResource(
     throw std::runtime_error("failed to create image!");
   }
 
-  VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(device_, depth_image, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = getMemoryTypeIndex(
-      memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  if (vkAllocateMemory(device_, &allocInfo, nullptr, &depth_image_memory) !=
-      VK_SUCCESS) {
-    throw std::runtime_error("failed to allocate image memory!");
+  VkMemoryPropertyFlags property = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device_, depth_image, &requirements);
+    const auto& memory_properties = allocator_.getMemoryProperties();
+    for (u_int32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+      if ((requirements.memoryTypeBits & (1u << i)) &&
+          (memory_properties.memoryTypes[i].propertyFlags &
+           VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+        property |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        break;
+      }
+    }
+    LogUtil::LogI("transient depth " + std::to_string(extent.width) + "x" +
+                  std::to_string(extent.height) +
+                  ((property & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+                       ? " in lazily allocated memory\n"
+                       : " in device local memory\n"));
   }
-
-  vkBindImageMemory(device_, depth_image, depth_image_memory, 0);
+  depth_image_memory = allocator_.allocateForImage(depth_image, property,
+                                                   GpuMemoryCategory::kDepth);
 
   VkImageViewCreateInfo viewInfo{};
   viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -530,14 +917,55 @@ void RenderManager::defaultCreateDepthResource(
 
 void RenderManager::beginFrame() {
   VkCommandBuffer cmdBuffer = cmdbuffers_[current_frame];
-  vkAcquireNextImageKHR(device_, swapchain_, UINT64_MAX,
-                        image_available_semaphores_[current_frame],
-                        VK_NULL_HANDLE, &current_image_index);
 
-  vkWaitForFences(device_, 1, &in_flight_fences_[current_frame], VK_TRUE,
-                  UINT64_MAX);
+  // pace first: at most frames_ahead_ frames in flight, which also frees
+  // this frame's slot. acquiring before would hold a swapchain image and
+  // its semaphore while blocked here.
+  if (frame_number_ >= frames_ahead_) {
+    u_int64_t paced = frame_number_ - frames_ahead_;
+    auto begin = std::chrono::steady_clock::now();
+    waitFrame(paced);
+    auto end = std::chrono::steady_clock::now();
+    frame_wait_ms_ =
+        std::chrono::duration<double, std::milli>(end - begin).count();
+    frame_latency_ms_ =
+        std::chrono::duration<double, std::milli>(
+            end - frame_submit_times_[paced % MAX_FRAMES_IN_FLIGHT])
+            .count();
+  }
 
-  vkResetFences(device_, 1, &in_flight_fences_[current_frame]);
+  if (headless_) {
+    // one offscreen image per slot, the paced frame was its last user.
+    current_image_index = current_frame;
+  } else {
+    VkResult acquired = vkAcquireNextImageKHR(
+        device_, swapchain_, UINT64_MAX,
+        image_available_semaphores_[current_frame], VK_NULL_HANDLE,
+        &current_image_index);
+    // nothing acquired, the semaphore stays unsignaled for the retry.
+    while (acquired == VK_ERROR_OUT_OF_DATE_KHR) {
+      recreateSwapchain();
+      acquired = vkAcquireNextImageKHR(
+          device_, swapchain_, UINT64_MAX,
+          image_available_semaphores_[current_frame], VK_NULL_HANDLE,
+          &current_image_index);
+    }
+    if (acquired != VK_SUCCESS && acquired != VK_SUBOPTIMAL_KHR) {
+      throw std::runtime_error("failed to acquire swapchain image!");
+    }
+    // still presentable, this frame goes out first.
+    if (acquired == VK_SUBOPTIMAL_KHR) swapchain_suboptimal_ = true;
+  }
+
+  // the gpu is done with this frame's uniforms & secondaries.
+  frame_uniforms_.beginFrame(current_frame);
+  for (auto& context : record_contexts_[current_frame]) {
+    if (context.used == 0) continue;
+    vkResetCommandPool(device_, context.pool, 0);
+    context.used = 0;
+  }
+  runDeferredDestroys(getCompletedFrames());
+  frame_upload_token_ = 0;
 
   VkCommandBufferBeginInfo beginInfo{
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -545,6 +973,14 @@ void RenderManager::beginFrame() {
   if (vkBeginCommandBuffer(cmdBuffer, &beginInfo) != VK_SUCCESS) {
     throw std::runtime_error("failed to begin recording command buffer!");
   }
+
+  if (timestamp_pool_ != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(cmdBuffer, timestamp_pool_, current_frame * 2, 2);
+    vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        timestamp_pool_, current_frame * 2);
+  }
+
+  if (hasTransferQueue()) cmdAcquireUploads(cmdBuffer);
 }
 
 void RenderManager::drawFrame() {
@@ -559,7 +995,8 @@ void RenderManager::drawFrame() {
   if (!global_matrix_engine.window_manager->isEditMode()) {
     ImGui::SetMouseCursor(ImGuiMouseCursor_None);
   }
-  ImGui_ImplGlfw_NewFrame();
+  // headless has no input, display size is set once by installIMGUI().
+  if (!headless_) ImGui_ImplGlfw_NewFrame();
   ImGui::NewFrame();
 
   VkRenderPassBeginInfo renderPassInfo{
@@ -594,31 +1031,203 @@ void RenderManager::drawGlobalUIToolKit() {
     }
     ImGui::End();
   }
+  // gpu memory
+  {
+    ImGui::Begin("GPU Memory");
+    ImGui::Text(memory_budget_supported_ ? "budget: VK_EXT_memory_budget"
+                                         : "budget: heap size");
+    auto budgets = getMemoryBudgets();
+    for (size_t i = 0; i < budgets.size(); ++i) {
+      const auto& heap = budgets[i];
+      char overlay[64];
+      snprintf(overlay, sizeof(overlay), "%.1f / %.1f MiB",
+               heap.usage / 1048576.0, heap.budget / 1048576.0);
+      ImGui::Text("heap %zu%s, ours %.1f MiB", i,
+                  heap.device_local ? " (device local)" : "",
+                  heap.allocated / 1048576.0);
+      ImGui::ProgressBar(
+          heap.budget ? static_cast<float>(heap.usage) / heap.budget : 0.f,
+          ImVec2(-1.f, 0.f), overlay);
+    }
+    ImGui::Separator();
+    for (u_int32_t i = 0;
+         i < static_cast<u_int32_t>(GpuMemoryCategory::kCount); ++i) {
+      auto category = static_cast<GpuMemoryCategory>(i);
+      auto stats = allocator_.getCategoryStats(category);
+      ImGui::Text("%-13s %5llu allocs %8.1f MiB (peak %.1f)",
+                  getGpuMemoryCategoryName(category),
+                  static_cast<unsigned long long>(stats.allocation_count),
+                  stats.used_bytes / 1048576.0,
+                  stats.peak_used_bytes / 1048576.0);
+    }
+    if (ImGui::Button("Dump JSON")) dumpMemoryStatsJson("gpu_memory.json");
+    ImGui::End();
+  }
+  // frame pacing
+  {
+    ImGui::Begin("Frame Pacing");
+    int frames_ahead = static_cast<int>(frames_ahead_);
+    if (ImGui::SliderInt("frames ahead", &frames_ahead, 1,
+                         MAX_FRAMES_IN_FLIGHT)) {
+      setFramesAhead(static_cast<u_int32_t>(frames_ahead));
+    }
+    ImGui::Text("cpu wait %.2f ms, latency %.2f ms", frame_wait_ms_,
+                frame_latency_ms_);
+    // the oldest frame in flight finished in beginFrame().
+    if (frame_number_ >= MAX_FRAMES_IN_FLIGHT) {
+      ImGui::Text("gpu %.2f ms",
+                  getFrameGpuMs(frame_number_ - MAX_FRAMES_IN_FLIGHT));
+    }
+    ImGui::Text("swapchain %ux%u, recreated %u times, last %.2f ms",
+                swapchain_extent_.width, swapchain_extent_.height,
+                swapchain_recreate_count_, swapchain_recreate_ms_);
+    ImGui::End();
+  }
+}
+
+std::vector<GpuHeapBudget> RenderManager::getMemoryBudgets() const {
+  const auto& memory_properties = allocator_.getMemoryProperties();
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+  };
+  if (memory_budget_supported_) {
+    VkPhysicalDeviceMemoryProperties2 properties2{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budget_properties,
+    };
+    vkGetPhysicalDeviceMemoryProperties2(vk_context.physical_device,
+                                         &properties2);
+  }
+
+  std::vector<GpuHeapBudget> budgets(memory_properties.memoryHeapCount);
+  for (u_int32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+    auto& heap = budgets[i];
+    heap.size = memory_properties.memoryHeaps[i].size;
+    heap.allocated = allocator_.getHeapBlockBytes(i);
+    heap.device_local = memory_properties.memoryHeaps[i].flags &
+                        VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    heap.budget = heap.size;
+    heap.usage = heap.allocated;
+    if (memory_budget_supported_) {
+      heap.budget = budget_properties.heapBudget[i];
+      heap.usage = budget_properties.heapUsage[i];
+    }
+  }
+  return budgets;
+}
+
+std::string RenderManager::getMemoryStatsJson() const {
+  std::string json = "{\n  \"frame\": " + std::to_string(frame_number_) +
+                     ",\n  \"memory_budget\": " +
+                     (memory_budget_supported_ ? "true" : "false") +
+                     ",\n  \"heaps\": [";
+  auto budgets = getMemoryBudgets();
+  for (size_t i = 0; i < budgets.size(); ++i) {
+    const auto& heap = budgets[i];
+    json += std::string(i ? "," : "") + "\n    {\"index\": " +
+            std::to_string(i) + ", \"device_local\": " +
+            (heap.device_local ? "true" : "false") +
+            ", \"size\": " + std::to_string(heap.size) +
+            ", \"budget\": " + std::to_string(heap.budget) +
+            ", \"usage\": " + std::to_string(heap.usage) +
+            ", \"allocated\": " + std::to_string(heap.allocated) + "}";
+  }
+  json += "\n  ],\n  \"categories\": {";
+  for (u_int32_t i = 0; i < static_cast<u_int32_t>(GpuMemoryCategory::kCount);
+       ++i) {
+    auto category = static_cast<GpuMemoryCategory>(i);
+    auto stats = allocator_.getCategoryStats(category);
+    json += std::string(i ? "," : "") + "\n    \"" +
+            getGpuMemoryCategoryName(category) + "\": {\"allocations\": " +
+            std::to_string(stats.allocation_count) +
+            ", \"bytes\": " + std::to_string(stats.used_bytes) +
+            ", \"peak_bytes\": " + std::to_string(stats.peak_used_bytes) + "}";
+  }
+  auto total = allocator_.getStats();
+  json += "\n  },\n  \"total\": {\"blocks\": " +
+          std::to_string(total.block_count) +
+          ", \"dedicated\": " + std::to_string(total.dedicated_count) +
+          ", \"block_bytes\": " + std::to_string(total.block_bytes) +
+          ", \"allocations\": " + std::to_string(total.allocation_count) +
+          ", \"used_bytes\": " + std::to_string(total.used_bytes) + "}\n}\n";
+  return json;
+}
+
+bool RenderManager::dumpMemoryStatsJson(const std::string& file) const {
+  std::ofstream out(file, std::ios::trunc);
+  if (!out) {
+    LogUtil::LogE("failed to write memory stats to " + file + '\n');
+    return false;
+  }
+  out << getMemoryStatsJson();
+  LogUtil::LogI("memory stats written to " + file + '\n');
+  return true;
 }
 
 void RenderManager::endFrame() {
+  if (timestamp_pool_ != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(cmdbuffers_[current_frame],
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool_,
+                        current_frame * 2 + 1);
+  }
   if (vkEndCommandBuffer(cmdbuffers_[current_frame]) != VK_SUCCESS) {
     throw std::runtime_error("failed to record command buffer!");
   }
 
-  VkPipelineStageFlags waitStage[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<VkPipelineStageFlags> waitStage;
+  std::vector<u_int64_t> waitValues;
+  // offscreen images are not acquired.
+  if (!headless_) {
+    waitSemaphores.push_back(image_available_semaphores_[current_frame]);
+    waitStage.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    // binary semaphores ignore their value.
+    waitValues.push_back(0);
+  }
+  // transfers acquired by this frame.
+  if (frame_upload_token_ != 0) {
+    waitSemaphores.push_back(staging_ring_.getTimeline());
+    waitStage.push_back(upload_dst_stages);
+    waitValues.push_back(frame_upload_token_);
+  }
 
+  std::vector<VkSemaphore> signalSemaphores{frame_timeline_};
+  std::vector<u_int64_t> signalValues{frame_number_ + 1};
+  // waited by the present.
+  if (!headless_) {
+    signalSemaphores.push_back(render_finished_semaphores_[current_frame]);
+    signalValues.push_back(0);
+  }
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .waitSemaphoreValueCount = static_cast<u_int32_t>(waitValues.size()),
+      .pWaitSemaphoreValues = waitValues.data(),
+      .signalSemaphoreValueCount =
+          static_cast<u_int32_t>(signalValues.size()),
+      .pSignalSemaphoreValues = signalValues.data(),
+  };
   VkSubmitInfo submitInfo{
       .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = &image_available_semaphores_[current_frame],
-      .pWaitDstStageMask = waitStage,
+      .pNext = &timelineInfo,
+      .waitSemaphoreCount = static_cast<u_int32_t>(waitSemaphores.size()),
+      .pWaitSemaphores = waitSemaphores.data(),
+      .pWaitDstStageMask = waitStage.data(),
       .commandBufferCount = 1,
       .pCommandBuffers = &cmdbuffers_[current_frame],
-      .signalSemaphoreCount = 1,
-      .pSignalSemaphores = &render_finished_semaphores_[current_frame],
+      .signalSemaphoreCount = static_cast<u_int32_t>(signalSemaphores.size()),
+      .pSignalSemaphores = signalSemaphores.data(),
   };
 
-  if (vkQueueSubmit(g_queue_, 1, &submitInfo,
-                    in_flight_fences_[current_frame]) != VK_SUCCESS) {
+  if (vkQueueSubmit(g_queue_, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
     throw std::runtime_error("failed to submit draw command buffer!");
   }
+  frame_submit_times_[current_frame] = std::chrono::steady_clock::now();
+
+  if (headless_) {
+    current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+    ++frame_number_;
+    return;
+  }
 
   VkPresentInfoKHR presentInfo{
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -629,8 +1238,57 @@ void RenderManager::endFrame() {
       .pImageIndices = &current_image_index,
   };
 
-  vkQueuePresentKHR(p_queue_, &presentInfo);
+  VkResult presented = vkQueuePresentKHR(p_queue_, &presentInfo);
   current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+  ++frame_number_;
+
+  if (presented == VK_ERROR_OUT_OF_DATE_KHR ||
+      presented == VK_SUBOPTIMAL_KHR || swapchain_suboptimal_) {
+    swapchain_suboptimal_ = false;
+    recreateSwapchain();
+  } else if (presented != VK_SUCCESS) {
+    throw std::runtime_error("failed to present swapchain image!");
+  }
+}
+
+void RenderManager::recreateSwapchain() {
+  auto begin = std::chrono::steady_clock::now();
+  // a minimized window has no size to create a swapchain of.
+  auto wd = global_matrix_engine.window_manager->window;
+  int width = 0, height = 0;
+  glfwGetFramebufferSize(wd, &width, &height);
+  while (width == 0 || height == 0) {
+    glfwWaitEvents();
+    glfwGetFramebufferSize(wd, &width, &height);
+  }
+
+  // retired by createSwapchain(). frames in flight may still render to or
+  // present its images, so it goes with them, no vkDeviceWaitIdle.
+  auto old_swapchain = swapchain_;
+  auto old_views = swapchain_image_views_;
+  auto old_framebuffers = gui_context.gui_framebuffers_;
+  createSwapchain();
+  getSwapchainImages();
+  createSwapchainImageViews();
+  createGuiFramebuffers();
+  auto device = device_;
+  deferDestroy([device, old_swapchain, old_views, old_framebuffers] {
+    for (auto framebuffer : old_framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    for (auto view : old_views) vkDestroyImageView(device, view, nullptr);
+    vkDestroySwapchainKHR(device, old_swapchain, nullptr);
+  });
+
+  p_current_draw_context->onSwapchainRecreated();
+
+  swapchain_recreate_ms_ = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - begin)
+                               .count();
+  ++swapchain_recreate_count_;
+  LogUtil::LogI("swapchain recreated " +
+                std::to_string(swapchain_extent_.width) + "x" +
+                std::to_string(swapchain_extent_.height) + " in " +
+                std::to_string(swapchain_recreate_ms_) + " ms\n");
 }
 
 void RenderManager::createVkSurface() {
@@ -654,6 +1312,11 @@ void RenderManager::findGraphicAndPresentFamily() {
   for (uint32_t i = 0; i < queue_family_properties.size(); ++i) {
     if (queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
       family_indices_.graphic_family = i;
+      // nothing is presented.
+      if (headless_) {
+        family_indices_.present_family = i;
+        break;
+      }
       VkBool32 presentSupport = false;
       vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface_,
                                            &presentSupport);
@@ -666,6 +1329,35 @@ void RenderManager::findGraphicAndPresentFamily() {
 
   if (!family_indices_.isComplete())
     throw std::runtime_error("Queue Family we need do not supported.");
+
+  u_int32_t timestamp_bits =
+      queue_family_properties[family_indices_.graphic_family.value()]
+          .timestampValidBits;
+  timestamp_mask_ = timestamp_bits >= 64 ? ~0ull
+                                         : (1ull << timestamp_bits) - 1;
+
+  // a transfer only family (dma engine) uploads while the graphics queue
+  // renders. texture bands are copied at any row, so it must not have a
+  // transfer granularity.
+  for (uint32_t i = 0; i < queue_family_properties.size(); ++i) {
+    const auto& properties = queue_family_properties[i];
+    const auto& granularity = properties.minImageTransferGranularity;
+    if ((properties.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+        !(properties.queueFlags &
+          (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+        granularity.width == 1 && granularity.height == 1 &&
+        granularity.depth == 1) {
+      family_indices_.transfer_family = i;
+      break;
+    }
+  }
+  if (family_indices_.transfer_family) {
+    LogUtil::LogI("uploads on transfer queue family " +
+                  std::to_string(family_indices_.transfer_family.value()) +
+                  '\n');
+  } else {
+    LogUtil::LogI("no transfer queue family, uploads on graphics queue\n");
+  }
 }
 
 void RenderManager::createVkDevice() {
@@ -674,13 +1366,54 @@ void RenderManager::createVkDevice() {
       .samplerAnisotropy = VK_TRUE,
   };
 
+  // frame pacing & uploads run on timeline semaphores, core in 1.2.
+  VkPhysicalDeviceVulkan12Features supported12{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+  };
+  VkPhysicalDeviceFeatures2 supportedFeatures{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &supported12,
+  };
+  vkGetPhysicalDeviceFeatures2(vk_context.physical_device, &supportedFeatures);
+  if (!supported12.timelineSemaphore) {
+    throw std::runtime_error("timeline semaphores are not supported.");
+  }
+  VkPhysicalDeviceVulkan12Features deviceFeature12{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+      .timelineSemaphore = VK_TRUE,
+  };
+
+  // optional extensions. headless needs no swapchain.
+  auto extensions =
+      headless_ ? std::vector<const char*>{} : device_extensions;
+  {
+    uint32_t count;
+    vkEnumerateDeviceExtensionProperties(vk_context.physical_device, nullptr,
+                                         &count, nullptr);
+    std::vector<VkExtensionProperties> supported(count);
+    vkEnumerateDeviceExtensionProperties(vk_context.physical_device, nullptr,
+                                         &count, supported.data());
+    for (const auto& extension : supported) {
+      if (strcmp(extension.extensionName,
+                 VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+        memory_budget_supported_ = true;
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+      }
+      // must be enabled where supported, e.g. MoltenVK.
+      if (strcmp(extension.extensionName, "VK_KHR_portability_subset") == 0)
+        extensions.push_back("VK_KHR_portability_subset");
+    }
+  }
+
   // set up queue
-  // currently, we only want graphic and present family.
+  // graphic and present family, plus transfer family for uploads.
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueIndices{
       family_indices_.graphic_family.value(),
       family_indices_.present_family.value(),
   };
+  if (family_indices_.transfer_family)
+    uniqueQueueIndices.insert(family_indices_.transfer_family.value());
   const float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueIndices) {
     VkDeviceQueueCreateInfo info{
@@ -694,12 +1427,13 @@ void RenderManager::createVkDevice() {
 
   VkDeviceCreateInfo deviceCreateInfo{
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pNext = &deviceFeature12,
       .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
       .pQueueCreateInfos = queueCreateInfos.data(),
       .enabledLayerCount = static_cast<uint32_t>(layers.size()),
       .ppEnabledLayerNames = layers.data(),
-      .enabledExtensionCount = static_cast<uint32_t>(device_extensions.size()),
-      .ppEnabledExtensionNames = device_extensions.data(),
+      .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+      .ppEnabledExtensionNames = extensions.data(),
       .pEnabledFeatures = &deviceFeature,
   };
 
@@ -714,6 +1448,11 @@ void RenderManager::getRequiredQueues() {
                    &g_queue_);
   vkGetDeviceQueue(device_, family_indices_.present_family.value(), 0,
                    &p_queue_);
+  upload_queue_ = g_queue_;
+  if (family_indices_.transfer_family) {
+    vkGetDeviceQueue(device_, family_indices_.transfer_family.value(), 0,
+                     &upload_queue_);
+  }
 }
 
 void RenderManager::createCommandPool() {
@@ -727,6 +1466,19 @@ void RenderManager::createCommandPool() {
       VK_SUCCESS) {
     throw std::runtime_error("failed to create graphic command pool!");
   }
+
+  upload_command_pool_ = g_command_pool_;
+  if (family_indices_.transfer_family) {
+    VkCommandPoolCreateInfo upload_pool_info{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = family_indices_.transfer_family.value(),
+    };
+    if (vkCreateCommandPool(device_, &upload_pool_info, nullptr,
+                            &upload_command_pool_) != VK_SUCCESS) {
+      throw std::runtime_error("failed to create transfer command pool!");
+    }
+  }
 }
 
 void RenderManager::createCommandBuffers() {
@@ -746,6 +1498,81 @@ void RenderManager::createCommandBuffers() {
   }
 }
 
+void RenderManager::createRecordContexts() {
+  record_pool_ = std::make_unique<ThreadPool>(
+      std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+  VkCommandPoolCreateInfo pool_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = family_indices_.graphic_family.value(),
+  };
+  for (auto& contexts : record_contexts_) {
+    contexts.resize(getRecordThreadCount());
+    for (auto& context : contexts) {
+      context.used = 0;
+      if (vkCreateCommandPool(device_, &pool_info, nullptr, &context.pool) !=
+          VK_SUCCESS) {
+        throw std::runtime_error("failed to create record command pool!");
+      }
+    }
+  }
+}
+
+void RenderManager::cmdRecordParallel(VkCommandBuffer primary,
+                                      VkRenderPass pass, u_int32_t subpass,
+                                      VkFramebuffer framebuffer, size_t count,
+                                      const RecordJob& record,
+                                      size_t min_draws) {
+  if (count == 0) return;
+  auto& contexts = record_contexts_[current_frame];
+  min_draws = std::max<size_t>(min_draws, 1);
+  size_t ranges =
+      std::min(contexts.size(), (count + min_draws - 1) / min_draws);
+  size_t step = (count + ranges - 1) / ranges;
+  ranges = (count + step - 1) / step;
+
+  VkCommandBufferInheritanceInfo inheritance{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+      .renderPass = pass,
+      .subpass = subpass,
+      .framebuffer = framebuffer,
+  };
+  VkCommandBufferBeginInfo begin_info{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+               VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+      .pInheritanceInfo = &inheritance,
+  };
+
+  std::vector<VkCommandBuffer> secondaries(ranges);
+  record_pool_->parallelFor(ranges, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      auto& context = contexts[i];
+      if (context.used == context.buffers.size()) {
+        VkCommandBufferAllocateInfo alloc_info{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = context.pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1,
+        };
+        VkCommandBuffer buffer;
+        vkAllocateCommandBuffers(device_, &alloc_info, &buffer);
+        context.buffers.push_back(buffer);
+      }
+      auto command_buffer = context.buffers[context.used++];
+
+      vkBeginCommandBuffer(command_buffer, &begin_info);
+      record(command_buffer, i * step, std::min(count, (i + 1) * step));
+      vkEndCommandBuffer(command_buffer);
+      secondaries[i] = command_buffer;
+    }
+  });
+
+  vkCmdExecuteCommands(primary, static_cast<u_int32_t>(ranges),
+                       secondaries.data());
+}
+
 void RenderManager::createDescriptorPool() {
   VkDescriptorPoolSize pool_sizes[] = {
       {VK_DESCRIPTOR_TYPE_SAMPLER, 1000},
@@ -811,12 +1638,12 @@ void RenderManager::createSwapchain() {
     int width, height;
     glfwGetFramebufferSize(wd, &width, &height);
     VkExtent2D actualExtent = {
-        .width =
-            std::clamp(actualExtent.width, capabilities.minImageExtent.width,
-                       capabilities.maxImageExtent.width),
-        .height =
-            std::clamp(actualExtent.height, capabilities.minImageExtent.height,
-                       capabilities.maxImageExtent.height),
+        .width = std::clamp(static_cast<uint32_t>(width),
+                            capabilities.minImageExtent.width,
+                            capabilities.maxImageExtent.width),
+        .height = std::clamp(static_cast<uint32_t>(height),
+                             capabilities.minImageExtent.height,
+                             capabilities.maxImageExtent.height),
     };
     swapchain_extent_ = actualExtent;
   }
@@ -857,7 +1684,8 @@ void RenderManager::createSwapchain() {
       .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
       .presentMode = presentMode,
       .clipped = VK_TRUE,
-      .oldSwapchain = VK_NULL_HANDLE,  // TODO: Opt resize performance
+      // hands over to the new one, the driver may reuse its memory.
+      .oldSwapchain = swapchain_,
   };
 
   // if two queues are diff, we need set vkimage sharing mode.
@@ -870,10 +1698,12 @@ void RenderManager::createSwapchain() {
     swapChainCreateInfo.queueFamilyIndexCount = 2;
     swapChainCreateInfo.pQueueFamilyIndices = pIndices;
   }
+  VkSwapchainKHR swapchain;
   if (vkCreateSwapchainKHR(device_, &swapChainCreateInfo, nullptr,
-                           &swapchain_) != VK_SUCCESS) {
+                           &swapchain) != VK_SUCCESS) {
     throw std::runtime_error("Failed to create swapchain!");
   }
+  swapchain_ = swapchain;
 }
 
 void RenderManager::getSwapchainImages() {
@@ -884,6 +1714,27 @@ void RenderManager::getSwapchainImages() {
                           swapchain_images_.data());
 }
 
+void RenderManager::createOffscreenImages() {
+  const auto& config = global_matrix_engine.getConfig();
+  swapchain_extent_ = {config.width, config.height};
+  swapchain_format_ = {VK_FORMAT_B8G8R8A8_SRGB,
+                       VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+  // a slot's image is free once beginFrame() paced it.
+  swapchain_images_.resize(MAX_FRAMES_IN_FLIGHT);
+  offscreen_memory_.resize(MAX_FRAMES_IN_FLIGHT);
+  for (size_t i = 0; i < swapchain_images_.size(); ++i) {
+    createImageAndBindMemory(
+        swapchain_images_[i], swapchain_extent_.width,
+        swapchain_extent_.height,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        offscreen_memory_[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1,
+        swapchain_format_.format);
+  }
+  LogUtil::LogI("headless, " + std::to_string(swapchain_images_.size()) +
+                " offscreen images " + std::to_string(swapchain_extent_.width) +
+                "x" + std::to_string(swapchain_extent_.height) + '\n');
+}
+
 void RenderManager::createSwapchainImageViews() {
   swapchain_image_views_.resize(swapchain_images_.size());
   for (int i = 0; i < swapchain_image_views_.size(); ++i) {
@@ -914,27 +1765,92 @@ void RenderManager::createSyncObject() {
   // set up sync object.
   image_available_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
   render_finished_semaphores_.resize(MAX_FRAMES_IN_FLIGHT);
-  in_flight_fences_.resize(MAX_FRAMES_IN_FLIGHT);
 
   VkSemaphoreCreateInfo semaphoreInfo{
       .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
 
-  VkFenceCreateInfo fenceInfo{
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-  };
-
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     if (vkCreateSemaphore(device_, &semaphoreInfo, nullptr,
                           &image_available_semaphores_[i]) != VK_SUCCESS ||
         vkCreateSemaphore(device_, &semaphoreInfo, nullptr,
-                          &render_finished_semaphores_[i]) != VK_SUCCESS ||
-        vkCreateFence(device_, &fenceInfo, nullptr, &in_flight_fences_[i]) !=
-            VK_SUCCESS) {
+                          &render_finished_semaphores_[i]) != VK_SUCCESS) {
       throw std::runtime_error(
           "failed to create synchronization objects for a frame!");
     }
   }
+
+  // value is the number of finished frames.
+  VkSemaphoreTypeCreateInfo timelineInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo timelineSemaphoreInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &timelineInfo,
+  };
+  if (vkCreateSemaphore(device_, &timelineSemaphoreInfo, nullptr,
+                        &frame_timeline_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create frame timeline!");
+  }
+}
+
+void RenderManager::createTimestampQueries() {
+  if (timestamp_mask_ == 0) {
+    LogUtil::LogI("graphics queue has no timestamps, no gpu frame times\n");
+    return;
+  }
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vk_context.physical_device, &properties);
+  timestamp_period_ns_ = properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo info{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = MAX_FRAMES_IN_FLIGHT * 2,
+  };
+  if (vkCreateQueryPool(device_, &info, nullptr, &timestamp_pool_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create timestamp query pool!");
+  }
+}
+
+double RenderManager::getFrameGpuMs(u_int64_t frame) const {
+  // not submitted, or reset by a later frame in its slot.
+  if (timestamp_pool_ == VK_NULL_HANDLE || frame >= frame_number_ ||
+      frame + MAX_FRAMES_IN_FLIGHT < frame_number_) {
+    return -1.0;
+  }
+  std::array<u_int64_t, 2> ticks;
+  u_int32_t slot = static_cast<u_int32_t>(frame % MAX_FRAMES_IN_FLIGHT);
+  if (vkGetQueryPoolResults(device_, timestamp_pool_, slot * 2, 2,
+                            sizeof(ticks), ticks.data(), sizeof(u_int64_t),
+                            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+    return -1.0;
+  }
+  return ((ticks[1] - ticks[0]) & timestamp_mask_) * timestamp_period_ns_ /
+         1e6;
+}
+
+u_int64_t RenderManager::getCompletedFrames() const {
+  u_int64_t value;
+  vkGetSemaphoreCounterValue(device_, frame_timeline_, &value);
+  return value;
+}
+
+void RenderManager::waitFrame(u_int64_t frame) const {
+  u_int64_t value = frame + 1;
+  VkSemaphoreWaitInfo waitInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &frame_timeline_,
+      .pValues = &value,
+  };
+  vkWaitSemaphores(device_, &waitInfo, UINT64_MAX);
+}
+
+void RenderManager::setFramesAhead(u_int32_t frames) {
+  frames_ahead_ = std::clamp<u_int32_t>(frames, 1, MAX_FRAMES_IN_FLIGHT);
 }
 
 void RenderManager::installIMGUI() {
@@ -944,9 +1860,15 @@ void RenderManager::installIMGUI() {
   (void)io;
   // io.ConfigFlags |= ImGuiConfigFlags_NoMouse,
   ImGui::StyleColorsDark();
-  bool result = ImGui_ImplGlfw_InitForVulkan(
-      global_matrix_engine.window_manager->window,
-      true);  // TODO: set false, handle install by yourself
+  bool result = true;
+  if (headless_) {
+    io.DisplaySize = ImVec2(static_cast<float>(swapchain_extent_.width),
+                            static_cast<float>(swapchain_extent_.height));
+  } else {
+    result = ImGui_ImplGlfw_InitForVulkan(
+        global_matrix_engine.window_manager->window,
+        true);  // TODO: set false, handle install by yourself
+  }
   assert(result);
   ImGui_ImplVulkan_InitInfo init_info = {};
   init_info.Instance = vk_context.instance;
@@ -972,7 +1894,9 @@ void RenderManager::installIMGUI() {
             VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // note: demo renderpass
                                                        // should change layout
                                                        // to this!.
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        // headless images can be copied out.
+        .finalLayout = headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                 : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
     };
 
     VkAttachmentReference colorAttachmentRef{
@@ -1047,7 +1971,10 @@ void RenderManager::installIMGUI() {
   ImGui_ImplVulkan_DestroyFontUploadObjects();
   vkFreeCommandBuffers(device_, command_pool, 1, &command_buffer);
 
-  // imgui framebuffer.
+  createGuiFramebuffers();
+}
+
+void RenderManager::createGuiFramebuffers() {
   gui_context.gui_framebuffers_.resize(swapchain_image_views_.size());
   for (size_t i = 0; i < swapchain_image_views_.size(); ++i) {
     VkImageView attachments[] = {
@@ -1071,10 +1998,9 @@ void RenderManager::installIMGUI() {
   }
 }
 
-// TODO: add perform recreate.
 void RenderManager::uninstallIMGUI() {
   ImGui_ImplVulkan_Shutdown();
-  ImGui_ImplGlfw_Shutdown();
+  if (!headless_) ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
 
   if (!gui_context.imgui_pass)
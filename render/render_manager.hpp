@@ -3,11 +3,22 @@
 
 #define MAX_FRAMES_IN_FLIGHT 3
 
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <shaderc/shaderc.hpp>
 
+#include "render/frame_uniform_allocator.hpp"
+#include "render/gpu_allocator.hpp"
 #include "render/render_base.hpp"
+#include "render/staging_ring.hpp"
 #include "render/vk_context.hpp"
+#include "util/bc_encoder.hpp"
+#include "util/mipmap_generator.hpp"
+#include "util/texture_cache.hpp"
+#include "util/thread_pool.hpp"
 
 namespace LLShader {
 
@@ -36,17 +47,42 @@ typedef struct {
 struct RenderQueueFamilyIndices {
   std::optional<uint32_t> graphic_family;
   std::optional<uint32_t> present_family;
+  // transfer only family for uploads, empty if there is none.
+  std::optional<uint32_t> transfer_family;
 
   bool isComplete() {
     return graphic_family.has_value() && present_family.has_value();
   }
 };
 
+/// resources of an upload batch on the transfer queue, released by the
+/// transfer submit and acquired by a later frame on the graphics queue.
+typedef struct {
+  // the acquiring frame waits the staging timeline at it.
+  UploadToken token;
+  // acquired once the transfer finished instead of by the next frame.
+  bool stream;
+  std::vector<VkBufferMemoryBarrier> buffers;
+  std::vector<VkImageMemoryBarrier> images;
+} QueueOwnershipTransfer;
+
+/// usage of a memory heap against its budget.
+typedef struct {
+  VkDeviceSize size;
+  // from VK_EXT_memory_budget, heap size without it.
+  VkDeviceSize budget;
+  // whole process as seen by the driver, allocated without the extension.
+  VkDeviceSize usage;
+  // blocks of RenderManager::getAllocator() on the heap.
+  VkDeviceSize allocated;
+  bool device_local;
+} GpuHeapBudget;
+
 typedef struct {
   std::string texture_name;
   VkImage texture_image;
   VkImageView texture_image_view;
-  VkDeviceMemory texture_memory;
+  GpuAllocation texture_memory;
 } Texture2D;
 
 class RenderManager final {
@@ -66,7 +102,10 @@ class RenderManager final {
   /// 提交指令
   void endFrame();
 
-  // these two func is used for renderbass to create framebuffers.
+  // these func are used for renderbass to create framebuffers.
+  inline const std::vector<VkImage>& getSwapchainImages() const {
+    return swapchain_images_;
+  }
   inline const std::vector<VkImageView>& getSwapchainImageViews() const {
     return swapchain_image_views_;
   }
@@ -75,62 +114,265 @@ class RenderManager final {
   }
   inline uint32_t getCurrenFrame() const { return current_frame; }
 
+  /// no surface: swapchain images are a ring of offscreen images, one per
+  /// frame in flight, left in TRANSFER_SRC_OPTIMAL. nothing is presented.
+  inline bool isHeadless() const { return headless_; }
+
+  /// every buffer & image memory comes from here. release with
+  /// getAllocator().free(), not vkFreeMemory.
+  inline GpuAllocator& getAllocator() { return allocator_; }
+  /// dynamic uniform data of the current frame, valid from beginFrame().
+  inline FrameUniformAllocator& getFrameUniforms() { return frame_uniforms_; }
+
+  /// VK_EXT_memory_budget is enabled, budgets are driver reported.
+  inline bool hasMemoryBudget() const { return memory_budget_supported_; }
+
+  /// queried now, one per memory heap.
+  std::vector<GpuHeapBudget> getMemoryBudgets() const;
+
+  /// snapshot of heap budgets and allocations per GpuMemoryCategory.
+  std::string getMemoryStatsJson() const;
+
+  /// write getMemoryStatsJson() to file, return false if it can't be opened.
+  bool dumpMemoryStatsJson(const std::string& file) const;
+
+  /// monotonic number of the frame being recorded, or of the next one
+  /// outside beginFrame() & endFrame().
+  inline u_int64_t getFrameNumber() const { return frame_number_; }
+
+  /// frames finished on the gpu, value of the frame timeline semaphore.
+  /// frame n is done once it exceeds n.
+  u_int64_t getCompletedFrames() const;
+
+  /// block until frame finished on the gpu.
+  void waitFrame(u_int64_t frame) const;
+
+  /// frames the cpu may record ahead of the gpu, clamped to
+  /// [1, MAX_FRAMES_IN_FLIGHT]. 1 trades throughput for input latency.
+  void setFramesAhead(u_int32_t frames);
+  inline u_int32_t getFramesAhead() const { return frames_ahead_; }
+
+  /// ms beginFrame() blocked on the frame timeline, last frame.
+  inline double getFrameWaitMs() const { return frame_wait_ms_; }
+  /// ms from submit until the cpu saw the frame done, last paced frame.
+  /// an upper bound of the gpu latency, 0 while nothing was paced.
+  inline double getFrameLatencyMs() const { return frame_latency_ms_; }
+
+  /// gpu ms of frame, from timestamps at the start & end of its command
+  /// buffer. -1 if the graphics queue has no timestamps or frame has not
+  /// finished. its slot is reused MAX_FRAMES_IN_FLIGHT frames later, read
+  /// it before the endFrame() of that frame.
+  double getFrameGpuMs(u_int64_t frame) const;
+
+  /// swapchain recreations so far, and ms the last one blocked the render
+  /// thread, demo rebuild included.
+  inline u_int32_t getSwapchainRecreateCount() const {
+    return swapchain_recreate_count_;
+  }
+  inline double getSwapchainRecreateMs() const {
+    return swapchain_recreate_ms_;
+  }
+
+  /// deferred destruction: destroy runs in a later beginFrame(), once frame
+  /// last_frame finished on the gpu, no vkDeviceWaitIdle needed. use
+  /// getFrameNumber() of the last frame that recorded the resource. pending
+  /// ones run at dispose(). render thread only.
+  void deferDestroy(u_int64_t last_frame, std::function<void()> destroy);
+
+  /// last used by the current frame.
+  inline void deferDestroy(std::function<void()> destroy) {
+    deferDestroy(frame_number_, std::move(destroy));
+  }
+
+  /// memory goes back to getAllocator() with it.
+  void deferDestroyBuffer(VkBuffer buffer, GpuAllocation memory);
+
+  /// records draws [begin, end) into command_buffer.
+  typedef std::function<void(VkCommandBuffer command_buffer, size_t begin,
+                             size_t end)>
+      RecordJob;
+
+  /// parallel recording: split [0, count) into ranges of at least
+  /// min_draws, record each on a worker into a secondary command buffer
+  /// from that worker's pool of the current frame, then execute them into
+  /// primary in range order. primary must be inside subpass of pass,
+  /// begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. nothing is
+  /// inherited, record binds its own state. render thread only.
+  void cmdRecordParallel(VkCommandBuffer primary, VkRenderPass pass,
+                         u_int32_t subpass, VkFramebuffer framebuffer,
+                         size_t count, const RecordJob& record,
+                         size_t min_draws = 64);
+
+  /// ranges cmdRecordParallel() may record at once.
+  inline size_t getRecordThreadCount() const {
+    return record_pool_->getWorkerCount() + 1;
+  }
+
+  void deferDestroyTexture(const Texture2D& texture);
+
   // util funcs for renderbase
   /// this func only used for host visiable flags
-  /// it will create buf & mem using given parameter.
-  void createBufferAndBindMemory(VkBuffer& buf, VkDeviceMemory& mem,
+  /// it will create buf & mem using given parameter, mem.mapped stays valid
+  /// until freed.
+  void createBufferAndBindMemory(VkBuffer& buf, GpuAllocation& mem,
                                  size_t size, void* data,
                                  VkBufferUsageFlags usage,
                                  VkMemoryPropertyFlags property);
 
-  /// using stage buffer to create only device visiable buf.
-  void createDeviceOnlyBuffer(VkBuffer& buf, VkDeviceMemory& mem, size_t size,
+  /// using the staging ring to create only device visiable buf.
+  void createDeviceOnlyBuffer(VkBuffer& buf, GpuAllocation& mem, size_t size,
                               void* data, VkBufferUsageFlags usage,
                               VkMemoryPropertyFlags property);
 
-  /// load simple 2D texture to GPU.
-  /// paramater: path to texture file.
+  /// load simple 2D texture with full mip chain to GPU.
+  /// paramater: path to texture file, .ktx2 files baked by bakeTexture() are
+  /// uploaded as compressed blocks. decoded images go through the global
+  /// texture cache.
   Texture2D loadTexture2D(const std::string& file);
 
+  /// submit on the graphics queue & wait.
   void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
                          uint32_t height);
 
+  /// record version of copyBufferToImage, no submit.
+  void cmdCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer,
+                            VkImage image, uint32_t width, uint32_t height);
+
+  /// record upload of a rgba 32 mip chain into a new sampled texture, no
+  /// final submit. pixels go through the staging ring, pass
+  /// getUploadCommandBuffer() of an open upload batch.
+  Texture2D cmdUploadTexture2D(VkCommandBuffer& commandBuffer,
+                               const MipChain& mips);
+
+  /// same for a decoded texture cache entry, copied from the mapping.
+  Texture2D cmdUploadTexture2D(VkCommandBuffer& commandBuffer,
+                               const TextureCacheEntry& cached);
+
+  /// same for a block compressed chain, blocks are copied without cpu work.
+  /// fall back to cpu decode if the device can not sample the format.
+  Texture2D cmdUploadTexture2D(VkCommandBuffer& commandBuffer,
+                               const CompressedMipChain& chain);
+
+  /// upload batch: createDeviceOnlyBuffer(), loadTexture2D() and commands
+  /// recorded into getUploadCommandBuffer() between beginUploadBatch() and
+  /// submitUploadBatch() go out with one submit, nothing waits. batches nest,
+  /// only the outermost one submits, a single upload is a batch of its own.
+  /// batches run on the transfer queue if the device has one, else on the
+  /// graphics queue.
+  void beginUploadBatch();
+
+  /// return 0 if still nested. uploaded resources can be used by the next
+  /// frame, which waits on the gpu for the transfer if needed. stream
+  /// batches are handed to the graphics queue by the first frame after
+  /// isUploadComplete(), so no frame waits for them. use them from then on.
+  UploadToken submitUploadBatch(bool stream = false);
+
+  /// only valid inside a batch. may be replaced by a new command buffer when
+  /// the staging ring is full, pass it by reference. commands must be
+  /// supported by the transfer queue.
+  inline VkCommandBuffer& getUploadCommandBuffer() { return upload_cmd_; }
+
+  inline bool hasTransferQueue() const {
+    return family_indices_.transfer_family.has_value();
+  }
+
+  /// copies of token ran on the gpu, staging memory is reused.
+  inline bool isUploadComplete(UploadToken token) {
+    return staging_ring_.isComplete(token);
+  }
+
+  inline void waitUpload(UploadToken token) { staging_ring_.wait(token); }
+
+  /// sub-allocate size bytes of the staging ring for commandBuffer, fill
+  /// range.mapped then copy from range.buffer. if the ring is full,
+  /// commandBuffer is submitted and replaced by a new one before waiting for
+  /// the oldest upload. size must not exceed the ring size.
+  StagingRange stageUpload(VkCommandBuffer& commandBuffer, VkDeviceSize size,
+                           VkDeviceSize alignment = 16);
+
+  /// optimal tiling can be sampled.
+  bool isFormatSampleable(VkFormat format);
+
   /// it will create buf & mem using given parameter.
-  /// used for 2D tex, rgba 32
+  /// used for 2D tex, rgba 32 unless format given
   void createImageAndBindMemory(VkImage& image, u_int32_t width,
                                 u_int32_t height, VkImageUsageFlags usage,
-                                VkDeviceMemory& memory,
-                                VkMemoryPropertyFlags property);
+                                GpuAllocation& memory,
+                                VkMemoryPropertyFlags property,
+                                u_int32_t mip_levels = 1,
+                                VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
 
   VkCommandBuffer beginSingleTimeCommands();
 
+  /// graphics queue, submit & wait. commands must not use the staging ring,
+  /// record those into an upload batch.
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 
-  /// only support load texture image! used by loadTexture2D func
+  /// only support load texture image! submit on the graphics queue & wait.
   void transitionImageLayout(VkImage image, VkFormat format,
                              VkImageLayout old_layout,
                              VkImageLayout new_layout);
 
-  /// format always D32
+  /// record version of transitionImageLayout, no submit.
+  void cmdTransitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+                                VkImageLayout old_layout,
+                                VkImageLayout new_layout,
+                                u_int32_t level_count = 1);
+
+  /// full extent viewport & scissor, for pipelines with them dynamic so
+  /// they survive a swapchain recreation.
+  static void cmdSetViewport(VkCommandBuffer commandBuffer, VkExtent2D extent);
+
+  /// format always D32, can be sampled.
   void defaultCreateDepthResource(VkExtent2D extent, VkImage& depth_image,
                                   VkImageView& depth_image_view,
-                                  VkDeviceMemory& depth_image_memory);
+                                  GpuAllocation& depth_image_memory);
+
+  /// D32 attachment only alive inside its render pass: load op clear, store
+  /// op don't care, never sampled. lazily allocated memory where the device
+  /// has it, so tilers keep it on chip, device local else. every frame in
+  /// flight can share one if the pass has an external dependency from
+  /// LATE_FRAGMENT_TESTS writes to EARLY_FRAGMENT_TESTS writes.
+  void createTransientDepthResource(VkExtent2D extent, VkImage& depth_image,
+                                    VkImageView& depth_image_view,
+                                    GpuAllocation& depth_image_memory);
 
   uint32_t getMemoryTypeIndex(uint32_t type_bit,
                               VkMemoryPropertyFlags property);
 
-  VkShaderModule createShaderMoudule(const std::string& loc,
-                                     shaderc_shader_kind shaderType);
+  /// macros: defined before compiling, like -DNAME.
+  /// #include "file" is resolved relative to the shader file.
+  VkShaderModule createShaderMoudule(
+      const std::string& loc, shaderc_shader_kind shaderType,
+      const std::vector<std::string>& macros = {});
 
  private:
   void init();
   void dispose();
 
+  // upload queue version of beginSingleTimeCommands.
+  VkCommandBuffer beginUploadCommands();
+
+  // end & submit commandBuffer to the upload queue, signaling the staging
+  // timeline with the returned token, no wait.
+  UploadToken submitStagingCommands(VkCommandBuffer commandBuffer);
+
+  // record the acquire side of finished transfers into the frame.
+  void cmdAcquireUploads(VkCommandBuffer commandBuffer);
+
+  // shared by the cmdUploadTexture2D overloads, data holds all levels.
+  // block_dim x block_dim texels take block_bytes, 1 x 4 for rgba 32.
+  Texture2D cmdUploadImage2D(VkCommandBuffer& commandBuffer, VkFormat format,
+                             const unsigned char* data,
+                             const std::vector<MipLevel>& levels,
+                             u_int32_t block_dim, u_int32_t block_bytes);
+
   // imgui context
   GuiContext gui_context{VK_NULL_HANDLE};
   void drawGlobalUIToolKit();
   void installIMGUI();
   void uninstallIMGUI();
+  void createGuiFramebuffers();
 
   // current draw context
   std::unique_ptr<RenderBase> p_current_draw_context;
@@ -141,6 +383,18 @@ class RenderManager final {
   void createSwapchainImageViews();
   void createSyncObject();
   void createCommandBuffers();
+  void createRecordContexts();
+  void createTimestampQueries();
+
+  // headless version of createSwapchain() & getSwapchainImages().
+  void createOffscreenImages();
+
+  /// on out of date or suboptimal: new swapchain of the current surface
+  /// size, handed over through oldSwapchain without waiting for the device,
+  /// then RenderBase::onSwapchainRecreated(). the old swapchain, views and
+  /// framebuffers go once the frames using them finished. blocks while the
+  /// window is minimized.
+  void recreateSwapchain();
 
   // call follow the sequence.
   void createVkSurface();
@@ -150,23 +404,81 @@ class RenderManager final {
   void createCommandPool();
   void createDescriptorPool();
 
+  void createDepthImage(VkExtent2D extent, VkImageUsageFlags usage,
+                        VkImage& depth_image, VkImageView& depth_image_view,
+                        GpuAllocation& depth_image_memory);
+
+  /// run deferred destroys of frames before completed_frames.
+  void runDeferredDestroys(u_int64_t completed_frames);
+
   // vulkan context
   VkContext vk_context;
 
+  bool headless_{false};
+
   // WSI
-  VkSurfaceKHR surface_;
+  VkSurfaceKHR surface_{VK_NULL_HANDLE};
 
   // manage resource
   VkDevice device_;
+  bool memory_budget_supported_{false};
   VkDescriptorPool desp_pool_;
+  GpuAllocator allocator_;
   VkCommandPool g_command_pool_;
+  // every upload is staged here.
+  StagingRing staging_ring_;
+  // per frame uniform data, a region per frame in flight.
+  FrameUniformAllocator frame_uniforms_;
+  // open upload batch.
+  VkCommandBuffer upload_cmd_{VK_NULL_HANDLE};
+  u_int32_t upload_depth_{0};
+  QueueOwnershipTransfer upload_transfer_{};
+  // uploads on the transfer queue, g_queue_ & g_command_pool_ without one.
+  VkQueue upload_queue_;
+  VkCommandPool upload_command_pool_;
+  // submitted transfers not acquired yet, in token order.
+  std::deque<QueueOwnershipTransfer> pending_transfers_;
+  // staging timeline value waited by the current frame, 0 for none.
+  UploadToken frame_upload_token_{0};
 
   // sync obj
   std::vector<VkSemaphore> image_available_semaphores_;
   std::vector<VkSemaphore> render_finished_semaphores_;
-  std::vector<VkFence> in_flight_fences_;
+  // timeline semaphore, frame n signals n + 1. cpu pacing, per frame
+  // resources and deferred destroys all key off it.
+  VkSemaphore frame_timeline_{VK_NULL_HANDLE};
+  u_int32_t frames_ahead_{MAX_FRAMES_IN_FLIGHT};
+  std::array<std::chrono::steady_clock::time_point, MAX_FRAMES_IN_FLIGHT>
+      frame_submit_times_{};
+  double frame_wait_ms_{0.0};
+  double frame_latency_ms_{0.0};
+  // begin & end timestamp per frame slot, null if the queue has none.
+  VkQueryPool timestamp_pool_{VK_NULL_HANDLE};
+  // valid bits of the graphics queue timestamps, 0 for none.
+  u_int64_t timestamp_mask_{0};
+  double timestamp_period_ns_{0.0};
   std::vector<VkCommandBuffer> cmdbuffers_;
+  // secondary command buffers of one recording range, the pool is only
+  // touched by the thread recording that range.
+  typedef struct {
+    VkCommandPool pool;
+    std::vector<VkCommandBuffer> buffers;
+    u_int32_t used;
+  } RecordContext;
+  // frame slot x range, reset with the slot.
+  std::array<std::vector<RecordContext>, MAX_FRAMES_IN_FLIGHT>
+      record_contexts_;
+  // own workers, asset tasks on the global pool would stall recording.
+  std::unique_ptr<ThreadPool> record_pool_;
   uint32_t current_frame{0};
+  // current_frame == frame_number_ % MAX_FRAMES_IN_FLIGHT.
+  u_int64_t frame_number_{0};
+  // in enqueue order, run once frame finished on the gpu.
+  typedef struct {
+    u_int64_t frame;
+    std::function<void()> destroy;
+  } DeferredDestroy;
+  std::deque<DeferredDestroy> deferred_destroys_;
   uint32_t current_image_index{0};
 
   // render queue
@@ -175,11 +487,17 @@ class RenderManager final {
   VkQueue p_queue_;  // present
 
   // swapchain
-  VkSwapchainKHR swapchain_;
+  VkSwapchainKHR swapchain_{VK_NULL_HANDLE};
+  // acquire said suboptimal, recreate after the present.
+  bool swapchain_suboptimal_{false};
+  u_int32_t swapchain_recreate_count_{0};
+  double swapchain_recreate_ms_{0.0};
   VkExtent2D swapchain_extent_;
   VkSurfaceFormatKHR swapchain_format_;
   std::vector<VkImage> swapchain_images_;
   std::vector<VkImageView> swapchain_image_views_;
+  // memory of the headless images, swapchain_images_ holds them.
+  std::vector<GpuAllocation> offscreen_memory_;
 };
 
 }  // namespace LLShader
@@ -0,0 +1,136 @@
+#include "staging_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace LLShader {
+
+void StagingRing::init(VkDevice device, GpuAllocator& allocator,
+                       VkCommandPool command_pool, VkDeviceSize size) {
+  device_ = device;
+  allocator_ = &allocator;
+  command_pool_ = command_pool;
+  size_ = size;
+
+  VkBufferCreateInfo buf_c_info{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  if (vkCreateBuffer(device_, &buf_c_info, nullptr, &buffer_) != VK_SUCCESS) {
+    throw std::runtime_error("failed to create staging ring!");
+  }
+  memory_ = allocator.allocateForBuffer(
+      buffer_,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      GpuMemoryCategory::kStaging);
+
+  VkSemaphoreTypeCreateInfo type_info{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphore_info{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &type_info,
+  };
+  if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &timeline_) !=
+      VK_SUCCESS) {
+    throw std::runtime_error("failed to create staging timeline!");
+  }
+}
+
+void StagingRing::dispose() {
+  if (buffer_ == VK_NULL_HANDLE) return;
+  waitIdle();
+  vkDestroySemaphore(device_, timeline_, nullptr);
+  timeline_ = VK_NULL_HANDLE;
+
+  vkDestroyBuffer(device_, buffer_, nullptr);
+  allocator_->free(memory_);
+  buffer_ = VK_NULL_HANDLE;
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment,
+                           StagingRange& range) {
+  if (size > size_) return false;
+
+  if (head_ == tail_) {
+    // nothing in use, restart at the beginning of the ring.
+    head_ = tail_ = batch_begin_ = (head_ + size_ - 1) & ~(size_ - 1);
+  }
+
+  u_int64_t pos = head_;
+  VkDeviceSize offset = pos % size_;
+  VkDeviceSize aligned = (offset + alignment - 1) & ~(alignment - 1);
+  if (aligned + size > size_) {
+    // not enough room before the end, skip to the start.
+    pos += size_ - offset;
+    aligned = 0;
+  } else {
+    pos += aligned - offset;
+  }
+  if (pos + size - tail_ > size_) return false;
+
+  head_ = pos + size;
+  range = {buffer_, aligned, size,
+           static_cast<unsigned char*>(memory_.mapped) + aligned};
+  return true;
+}
+
+UploadToken StagingRing::closeBatch(VkCommandBuffer command_buffer) {
+  UploadToken token = ++submitted_token_;
+  batches_.push_back({command_buffer, token, head_});
+  batch_begin_ = head_;
+  return token;
+}
+
+void StagingRing::releaseFront() {
+  auto& batch = batches_.front();
+  // batches without ranges may end before a restart.
+  tail_ = std::max(tail_, batch.end);
+  completed_token_ = batch.token;
+  if (batch.command_buffer != VK_NULL_HANDLE) {
+    vkFreeCommandBuffers(device_, command_pool_, 1, &batch.command_buffer);
+  }
+  batches_.pop_front();
+}
+
+void StagingRing::reclaim() {
+  if (batches_.empty()) return;
+  u_int64_t value;
+  vkGetSemaphoreCounterValue(device_, timeline_, &value);
+  while (!batches_.empty() && batches_.front().token <= value) releaseFront();
+}
+
+bool StagingRing::waitOldest() {
+  if (batches_.empty()) return false;
+  VkSemaphoreWaitInfo wait_info{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &timeline_,
+      .pValues = &batches_.front().token,
+  };
+  vkWaitSemaphores(device_, &wait_info, UINT64_MAX);
+  releaseFront();
+  return true;
+}
+
+void StagingRing::waitIdle() {
+  while (waitOldest()) {
+  }
+}
+
+bool StagingRing::isComplete(UploadToken token) {
+  reclaim();
+  return completed_token_ >= token;
+}
+
+void StagingRing::wait(UploadToken token) {
+  while (completed_token_ < token && waitOldest()) {
+  }
+}
+
+}  // namespace LLShader
@@ -0,0 +1,113 @@
+#ifndef STAGING_RING_HPP
+#define STAGING_RING_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <vector>
+
+#include "render/gpu_allocator.hpp"
+
+namespace LLShader {
+
+/// a range of the staging ring, write through mapped then copy from
+/// buffer at offset.
+typedef struct {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+  unsigned char* mapped;
+} StagingRange;
+
+/// identifies a submission closed by the staging ring, increasing from 1.
+/// it is the value the ring's timeline semaphore reaches once the
+/// submission finished. 0 is always complete.
+typedef u_int64_t UploadToken;
+
+/// Persistently mapped, host coherent ring buffer shared by all uploads.
+/// ranges are handed out in order. closeBatch() tags everything handed out
+/// since the last batch with the next token, the submission reading them
+/// signals the ring's timeline semaphore with it. the space is reused once
+/// the timeline reached the token, together with the batch's command
+/// buffer. render thread only.
+class StagingRing final {
+ public:
+  static constexpr VkDeviceSize default_size = 32ull << 20;
+
+  StagingRing() = default;
+
+  StagingRing(const StagingRing&) = delete;
+
+  /// size must be a power of two.
+  void init(VkDevice device, GpuAllocator& allocator,
+            VkCommandPool command_pool, VkDeviceSize size = default_size);
+
+  /// wait pending batches and release everything.
+  void dispose();
+
+  /// never waits. return false if the ring has no room right now, or size
+  /// is larger than the ring.
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment,
+                StagingRange& range);
+
+  /// close the open batch, return its token. the submit of command_buffer
+  /// must signal getTimeline() with it. command_buffer is freed once the
+  /// timeline reached the token, may be null.
+  UploadToken closeBatch(VkCommandBuffer command_buffer);
+
+  /// release finished batches.
+  void reclaim();
+
+  /// block until the oldest batch is done, return false if none pending.
+  bool waitOldest();
+
+  /// block until all batches are done.
+  void waitIdle();
+
+  /// non blocking, true if the batch of token is done.
+  bool isComplete(UploadToken token);
+
+  /// block until the batch of token is done.
+  void wait(UploadToken token);
+
+  /// ranges handed out since the last closeBatch().
+  inline bool hasOpenRanges() const { return head_ != batch_begin_; }
+  inline VkDeviceSize getSize() const { return size_; }
+  inline VkBuffer getBuffer() const { return buffer_; }
+  /// timeline semaphore, queues wait it at a token to use the upload.
+  inline VkSemaphore getTimeline() const { return timeline_; }
+
+ private:
+  typedef struct {
+    VkCommandBuffer command_buffer;
+    UploadToken token;
+    // ring position after the last range of the batch.
+    u_int64_t end;
+  } Batch;
+
+  void releaseFront();
+
+  VkDevice device_{VK_NULL_HANDLE};
+  GpuAllocator* allocator_{nullptr};
+  VkCommandPool command_pool_{VK_NULL_HANDLE};
+
+  VkBuffer buffer_{VK_NULL_HANDLE};
+  GpuAllocation memory_{};
+  VkDeviceSize size_{0};
+  VkSemaphore timeline_{VK_NULL_HANDLE};
+
+  // monotonic positions, offset is position % size_. [tail_, head_) is in
+  // use by the gpu or by the open batch.
+  u_int64_t head_{0};
+  u_int64_t tail_{0};
+  u_int64_t batch_begin_{0};
+
+  UploadToken submitted_token_{0};
+  UploadToken completed_token_{0};
+
+  std::deque<Batch> batches_;
+};
+
+}  // namespace LLShader
+
+#endif
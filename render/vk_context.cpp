@@ -4,6 +4,7 @@
 #include "util/vk_debug_helper.hpp"
 #endif
 
+#include "engine/matrix.hpp"
 #include "log/log.hpp"
 #include "render/render_manager.hpp"
 
@@ -32,14 +33,16 @@ void VkHolder::dispose() {
 }
 
 void VkHolder::createVkInstance() {
-  // 添加 glfw 所需要的 扩展
-  uint32_t glfwRequiredExtCount;
-  const char** glfwRequiredExts =
-      glfwGetRequiredInstanceExtensions(&glfwRequiredExtCount);
-  std::vector<const char*> glfwReExt(glfwRequiredExts,
-                                     glfwRequiredExts + glfwRequiredExtCount);
-  instance_extensions.insert(instance_extensions.end(), glfwReExt.begin(),
-                             glfwReExt.end());
+  // 添加 glfw 所需要的 扩展, headless has no surface.
+  if (!global_matrix_engine.getConfig().headless) {
+    uint32_t glfwRequiredExtCount;
+    const char** glfwRequiredExts =
+        glfwGetRequiredInstanceExtensions(&glfwRequiredExtCount);
+    std::vector<const char*> glfwReExt(
+        glfwRequiredExts, glfwRequiredExts + glfwRequiredExtCount);
+    instance_extensions.insert(instance_extensions.end(), glfwReExt.begin(),
+                               glfwReExt.end());
+  }
 
 #ifdef DEBUG
   DebugPopulateInstanceExt(instance_extensions);
@@ -36,9 +36,10 @@ inline std::vector<const char *> layers{
 
 };
 
+/// required ones, not used when headless. VK_KHR_portability_subset is
+/// enabled where the device has it.
 inline std::vector<const char *> device_extensions{
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-    "VK_KHR_portability_subset",
 };
 
 class VkHolder final {
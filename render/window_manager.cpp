@@ -12,7 +12,9 @@ namespace LLShader
             throw std::runtime_error("glfwInit Failed\n");
         }
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        // resize recreates the swapchain, demos rebuild size dependent
+        // resources in onSwapchainRecreated().
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         window = glfwCreateWindow(width, height, "LLShader", nullptr, nullptr);
         if(glfwVulkanSupported() != GLFW_TRUE){
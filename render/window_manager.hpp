@@ -46,7 +46,8 @@ class WindowManager : public Listener{
     void onNotification() override;
 
  public:
-    GLFWwindow *window;
+    // null when headless.
+    GLFWwindow *window{nullptr};
 
  private:
     void init(const int width, const int height);
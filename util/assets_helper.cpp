@@ -1,6 +1,8 @@
 #include "assets_helper.hpp"
 
-#include <unordered_map>
+#include "util/obj_parser.hpp"
+#include "util/thread_pool.hpp"
+#include "util/vertex_weld.hpp"
 
 namespace LLShader {
 
@@ -68,66 +70,85 @@ namespace LLShader {
 //   }
 // }
 
-void loadObjToMesh(const std::string& file, Mesh& mesh) {
-  using namespace std;
+namespace {
+
+// append triangles to mesh, dedup vertices with the weld table of this mesh.
+void appendObjIndices(const ObjData& data,
+                      const std::vector<ObjIndex>& obj_indices, Mesh& mesh,
+                      VertexWeldTable& weld_table) {
+  mesh.indices.reserve(mesh.indices.size() + obj_indices.size());
+  for (const auto& index : obj_indices) {
+    VertexData vertex{};
+    // 提取 position
+    size_t v_start = index.vertex_index * 3;
+    auto vx = data.vertices[v_start];
+    auto vy = data.vertices[v_start + 1];
+    auto vz = data.vertices[v_start + 2];
+    vertex.position = {vx, vy, vz};
+
+    // 提取 normal
+    if (index.normal_index >= 0) {
+      size_t n_start = index.normal_index * 3;
+      auto nx = data.normals[n_start];
+      auto ny = data.normals[n_start + 1];
+      auto nz = data.normals[n_start + 2];
+      vertex.normal = {nx, ny, nz};
+    }
 
-  tinyobj::ObjReader reader;
-  tinyobj::ObjReaderConfig reader_config;
-  if (!reader.ParseFromFile(file, reader_config)) {
-    if (!reader.Error().empty()) {
-      throw std::runtime_error(reader.Error());
+    // 提取 texcoords
+    // reverse y for vulkan
+    if (index.texcoord_index >= 0) {
+      size_t t_start = 2 * index.texcoord_index;
+      auto s = data.texcoords[t_start];
+      auto t = 1.0f - data.texcoords[t_start + 1];
+      vertex.texcoords = {s, t};
     }
+
+    mesh.indices.push_back(weld_table.insertOrGet(vertex));
   }
-  if (!reader.Warning().empty()) {
-    LogUtil::LogW(reader.Warning());
-  }
+}
 
-  auto& attrib = reader.GetAttrib();
-  auto& shapes = reader.GetShapes();
-
-  std::unordered_map<VertexData, u_int32_t> unique_vertices;
-
-  for (const auto& shape : shapes) {
-    for (const auto& index : shape.mesh.indices) {
-      VertexData vertex;
-      // 提取 position
-      size_t v_start = index.vertex_index * 3;
-      auto vx = attrib.vertices[v_start];
-      auto vy = attrib.vertices[v_start + 1];
-      auto vz = attrib.vertices[v_start + 2];
-      vertex.position = {vx, vy, vz};
-
-      // 提取 normal
-      if (index.normal_index >= 0) {
-        size_t n_start = index.normal_index * 3;
-        auto nx = attrib.normals[n_start];
-        auto ny = attrib.normals[n_start + 1];
-        auto nz = attrib.normals[n_start + 2];
-        vertex.normal = {nx, ny, nz};
-      }
-
-      // 提取 texcoords
-      // reverse y for vulkan
-      if (index.texcoord_index >= 0) {
-        size_t t_start = 2 * index.texcoord_index;
-        auto s = attrib.texcoords[t_start];
-        auto t = 1.0 - attrib.texcoords[t_start + 1];
-        vertex.texcoords = {s, t};
-      }
-      // not exitst
-      if (!unique_vertices.count(vertex)) {
-        unique_vertices[vertex] = mesh.vertices.size();
-        mesh.vertices.push_back(vertex);
-      }
-
-      mesh.indices.push_back(unique_vertices[vertex]);
-    }
+}  // namespace
+
+void loadObjToMesh(const std::string& file, Mesh& mesh) {
+  ObjData data;
+  parseObjFile(file, data);
+
+  size_t index_count = 0;
+  for (const auto& shape : data.shapes) index_count += shape.indices.size();
+
+  VertexWeldTable weld_table(mesh.vertices, index_count);
+  for (const auto& shape : data.shapes) {
+    appendObjIndices(data, shape.indices, mesh, weld_table);
   }
   LogUtil::LogI(file +
                 " loded.\n vertices: " + std::to_string(mesh.vertices.size()) +
                 "\n indices: " + std::to_string(mesh.indices.size()) + '\n');
 }
 
+void loadObjToMeshes(const std::string& file, std::vector<Mesh>& meshes,
+                     std::vector<std::string>* material_libs,
+                     float weld_epsilon) {
+  ObjData data;
+  parseObjFile(file, data);
+
+  meshes.clear();
+  meshes.resize(data.shapes.size());
+  // every shape has its own index space, build them in parallel.
+  getGlobalThreadPool().parallelFor(
+      meshes.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          const auto& shape = data.shapes[i];
+          meshes[i].name = shape.name;
+          VertexWeldTable weld_table(meshes[i].vertices, shape.indices.size(),
+                                     weld_epsilon);
+          appendObjIndices(data, shape.indices, meshes[i], weld_table);
+        }
+      });
+
+  if (material_libs) *material_libs = std::move(data.material_libs);
+}
+
 std::vector<glm::vec3> covertVerticesToVector3(
     const tinyobj::attrib_t& attrib) {
   std::vector<glm::vec3> vs;
@@ -16,8 +16,16 @@ namespace LLShader {
 
 // 只加载obj 文件的顶点
 // TODO: perform like std::move with mesh.
+// 所有 shape 合并成一个 mesh
 void loadObjToMesh(const std::string& file, Mesh& mesh);
 
+// 每个 shape 一个 mesh, 索引各自独立.
+// material_libs 为 obj 中 mtllib 声明的文件名 (相对 obj 所在目录).
+// weld_epsilon > 0 时, 属性差小于 epsilon 的顶点会被合并.
+void loadObjToMeshes(const std::string& file, std::vector<Mesh>& meshes,
+                     std::vector<std::string>* material_libs = nullptr,
+                     float weld_epsilon = 0.0f);
+
 // obj to model
 // std::shared_ptr<tinyobj::material_t> loadMaterial(const std)
 
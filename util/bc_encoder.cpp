@@ -0,0 +1,649 @@
+#include "bc_encoder.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include "util/thread_pool.hpp"
+
+namespace LLShader {
+
+namespace {
+
+// levels with fewer blocks are encoded on the calling thread.
+constexpr size_t parallel_min_blocks = 256;
+
+// bc7 4 bit index interpolation weights, out of 64.
+constexpr int bc7_weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                 34, 38, 43, 47, 51, 55, 60, 64};
+
+inline int clampInt(int v, int lo, int hi) {
+  return std::min(std::max(v, lo), hi);
+}
+
+inline size_t alignUp(size_t v, size_t alignment) {
+  return (v + alignment - 1) & ~(alignment - 1);
+}
+
+// lsb first bit stream, out must be zeroed.
+struct BitWriter {
+  unsigned char* out;
+  u_int32_t pos{0};
+
+  void write(u_int32_t value, u_int32_t bits) {
+    for (u_int32_t b = 0; b < bits; ++b, ++pos) {
+      if ((value >> b) & 1) out[pos >> 3] |= 1 << (pos & 7);
+    }
+  }
+};
+
+struct BitReader {
+  const unsigned char* in;
+  u_int32_t pos{0};
+
+  u_int32_t read(u_int32_t bits) {
+    u_int32_t value = 0;
+    for (u_int32_t b = 0; b < bits; ++b, ++pos) {
+      value |= ((in[pos >> 3] >> (pos & 7)) & 1) << b;
+    }
+    return value;
+  }
+};
+
+// principal axis of the first N channels by power iteration, zero when all
+// texels are the same.
+template <int N>
+void computePrincipalAxis(const float (*texels)[4], float mean[N],
+                          float axis[N]) {
+  for (int c = 0; c < N; ++c) {
+    mean[c] = 0.0f;
+    for (int i = 0; i < 16; ++i) mean[c] += texels[i][c];
+    mean[c] /= 16.0f;
+  }
+
+  float cov[N][N] = {};
+  for (int i = 0; i < 16; ++i) {
+    float d[N];
+    for (int c = 0; c < N; ++c) d[c] = texels[i][c] - mean[c];
+    for (int r = 0; r < N; ++r) {
+      for (int c = 0; c < N; ++c) cov[r][c] += d[r] * d[c];
+    }
+  }
+
+  // start from the row of the widest channel, never orthogonal to the axis.
+  int widest = 0;
+  for (int c = 1; c < N; ++c) {
+    if (cov[c][c] > cov[widest][widest]) widest = c;
+  }
+  for (int c = 0; c < N; ++c) axis[c] = cov[widest][c];
+
+  for (int iter = 0; iter < 8; ++iter) {
+    float next[N] = {};
+    float length = 0.0f;
+    for (int r = 0; r < N; ++r) {
+      for (int c = 0; c < N; ++c) next[r] += cov[r][c] * axis[c];
+      length += next[r] * next[r];
+    }
+    length = std::sqrt(length);
+    if (length <= 1e-12f) {
+      for (int c = 0; c < N; ++c) axis[c] = 0.0f;
+      return;
+    }
+    for (int c = 0; c < N; ++c) axis[c] = next[c] / length;
+  }
+}
+
+// endpoints at both ends of the texels projected on the principal axis.
+template <int N>
+void computeAxisEndpoints(const float (*texels)[4], float lo[N],
+                          float hi[N]) {
+  float mean[N];
+  float axis[N];
+  computePrincipalAxis<N>(texels, mean, axis);
+  float t_min = 0.0f;
+  float t_max = 0.0f;
+  for (int i = 0; i < 16; ++i) {
+    float t = 0.0f;
+    for (int c = 0; c < N; ++c) t += (texels[i][c] - mean[c]) * axis[c];
+    t_min = std::min(t_min, t);
+    t_max = std::max(t_max, t);
+  }
+  for (int c = 0; c < N; ++c) {
+    lo[c] = mean[c] + axis[c] * t_min;
+    hi[c] = mean[c] + axis[c] * t_max;
+  }
+}
+
+// least squares endpoints for fixed indices, weight[i] is the share of e1.
+// false when all texels use the same weight.
+template <int N>
+bool solveEndpoints(const float (*texels)[4], const float weight[16],
+                    float e0[N], float e1[N]) {
+  float a = 0.0f, b = 0.0f, c = 0.0f;
+  float x0[N] = {};
+  float x1[N] = {};
+  for (int i = 0; i < 16; ++i) {
+    float w1 = weight[i];
+    float w0 = 1.0f - w1;
+    a += w0 * w0;
+    b += w0 * w1;
+    c += w1 * w1;
+    for (int k = 0; k < N; ++k) {
+      x0[k] += w0 * texels[i][k];
+      x1[k] += w1 * texels[i][k];
+    }
+  }
+  float det = a * c - b * b;
+  if (std::fabs(det) < 1e-6f) return false;
+  for (int k = 0; k < N; ++k) {
+    e0[k] = (c * x0[k] - b * x1[k]) / det;
+    e1[k] = (a * x1[k] - b * x0[k]) / det;
+  }
+  return true;
+}
+
+void loadTexels(const unsigned char rgba[64], float texels[16][4]) {
+  for (int i = 0; i < 64; ++i) texels[i / 4][i % 4] = rgba[i];
+}
+
+// ---- bc1 color ----
+
+inline u_int16_t pack565(const float color[3]) {
+  int r = clampInt(static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+  int g = clampInt(static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+  int b = clampInt(static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+  return static_cast<u_int16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void unpack565(u_int16_t v, int color[3]) {
+  int r = (v >> 11) & 31;
+  int g = (v >> 5) & 63;
+  int b = v & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+// four color mode palette, also the only mode of bc3 color.
+void buildColorPalette(u_int16_t c0, u_int16_t c1, int palette[4][3]) {
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for (int c = 0; c < 3; ++c) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+}
+
+float fitColorIndices(const float (*texels)[4], const int palette[4][3],
+                      int count, u_int8_t indices[16]) {
+  float total = 0.0f;
+  for (int i = 0; i < 16; ++i) {
+    float best = FLT_MAX;
+    for (int k = 0; k < count; ++k) {
+      float err = 0.0f;
+      for (int c = 0; c < 3; ++c) {
+        float d = texels[i][c] - palette[k][c];
+        err += d * d;
+      }
+      if (err < best) {
+        best = err;
+        indices[i] = static_cast<u_int8_t>(k);
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+void encodeColorBlock(const unsigned char rgba[64], unsigned char out[8]) {
+  float texels[16][4];
+  loadTexels(rgba, texels);
+
+  u_int16_t best_c0 = 0, best_c1 = 0;
+  u_int8_t best_indices[16] = {};
+  float best_error = FLT_MAX;
+
+  auto tryEndpoints = [&](const float e0[3], const float e1[3]) {
+    u_int16_t c0 = pack565(e0);
+    u_int16_t c1 = pack565(e1);
+    // c0 > c1 selects four color mode, equal ones can only use index 0.
+    if (c0 < c1) std::swap(c0, c1);
+    int palette[4][3];
+    buildColorPalette(c0, c1, palette);
+    u_int8_t indices[16];
+    float error = fitColorIndices(texels, palette, c0 == c1 ? 1 : 4, indices);
+    if (error < best_error) {
+      best_error = error;
+      best_c0 = c0;
+      best_c1 = c1;
+      memcpy(best_indices, indices, sizeof(indices));
+    }
+  };
+
+  float lo[3], hi[3];
+  computeAxisEndpoints<3>(texels, lo, hi);
+  tryEndpoints(hi, lo);
+
+  static const float c1_weight[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  for (int iter = 0; iter < 2 && best_error > 0.0f; ++iter) {
+    float weight[16];
+    for (int i = 0; i < 16; ++i) weight[i] = c1_weight[best_indices[i]];
+    float e0[3], e1[3];
+    if (!solveEndpoints<3>(texels, weight, e0, e1)) break;
+    tryEndpoints(e0, e1);
+  }
+
+  u_int32_t bits = 0;
+  for (int i = 0; i < 16; ++i) bits |= best_indices[i] << (i * 2);
+  out[0] = best_c0 & 0xff;
+  out[1] = best_c0 >> 8;
+  out[2] = best_c1 & 0xff;
+  out[3] = best_c1 >> 8;
+  for (int b = 0; b < 4; ++b) out[4 + b] = (bits >> (b * 8)) & 0xff;
+}
+
+void decodeColorBlock(const unsigned char block[8], unsigned char rgba[64],
+                      bool four_color_only) {
+  u_int16_t c0 = block[0] | (block[1] << 8);
+  u_int16_t c1 = block[2] | (block[3] << 8);
+  int palette[4][4];
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+  for (int c = 0; c < 3; ++c) {
+    if (four_color_only || c0 > c1) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  if (!four_color_only && c0 <= c1) palette[3][3] = 0;
+
+  u_int32_t bits = block[4] | (block[5] << 8) | (block[6] << 16) |
+                   (static_cast<u_int32_t>(block[7]) << 24);
+  for (int i = 0; i < 16; ++i) {
+    const int* color = palette[(bits >> (i * 2)) & 3];
+    for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = color[c];
+  }
+}
+
+// ---- bc3 alpha ----
+
+void buildAlphaPalette(int a0, int a1, int palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if (a0 > a1) {
+    for (int i = 1; i < 7; ++i) palette[1 + i] = ((7 - i) * a0 + i * a1) / 7;
+  } else {
+    for (int i = 1; i < 5; ++i) palette[1 + i] = ((5 - i) * a0 + i * a1) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void encodeAlphaBlock(const unsigned char rgba[64], unsigned char out[8]) {
+  int a_min = 255, a_max = 0;
+  for (int i = 0; i < 16; ++i) {
+    a_min = std::min<int>(a_min, rgba[i * 4 + 3]);
+    a_max = std::max<int>(a_max, rgba[i * 4 + 3]);
+  }
+  out[0] = static_cast<unsigned char>(a_max);
+  out[1] = static_cast<unsigned char>(a_min);
+
+  u_int64_t bits = 0;
+  if (a_max > a_min) {
+    int palette[8];
+    buildAlphaPalette(a_max, a_min, palette);
+    for (int i = 0; i < 16; ++i) {
+      int a = rgba[i * 4 + 3];
+      int best = 0;
+      for (int k = 1; k < 8; ++k) {
+        if (std::abs(a - palette[k]) < std::abs(a - palette[best])) best = k;
+      }
+      bits |= static_cast<u_int64_t>(best) << (i * 3);
+    }
+  }
+  for (int b = 0; b < 6; ++b) out[2 + b] = (bits >> (b * 8)) & 0xff;
+}
+
+void decodeAlphaBlock(const unsigned char block[8], unsigned char rgba[64]) {
+  int palette[8];
+  buildAlphaPalette(block[0], block[1], palette);
+  u_int64_t bits = 0;
+  for (int b = 0; b < 6; ++b) {
+    bits |= static_cast<u_int64_t>(block[2 + b]) << (b * 8);
+  }
+  for (int i = 0; i < 16; ++i) rgba[i * 4 + 3] = palette[(bits >> (i * 3)) & 7];
+}
+
+// ---- bc7 mode 6 ----
+
+// 7 bit endpoint with p-bit -> 8 bit.
+inline int expandBC7(int q, int p) { return (q << 1) | p; }
+
+inline int quantizeBC7(float v, int p) {
+  return clampInt(static_cast<int>(std::floor((v - p) * 0.5f + 0.5f)), 0, 127);
+}
+
+void buildBC7Palette(const int e0[4], const int e1[4], int palette[16][4]) {
+  for (int k = 0; k < 16; ++k) {
+    int w = bc7_weights[k];
+    for (int c = 0; c < 4; ++c) {
+      palette[k][c] = ((64 - w) * e0[c] + w * e1[c] + 32) >> 6;
+    }
+  }
+}
+
+// projection on the endpoint line picks the index, only it and its two
+// neighbours are compared, palette rounding can move the best one by one.
+float fitBC7Indices(const float (*texels)[4], const int e0[4],
+                    const int e1[4], const int palette[16][4],
+                    u_int8_t indices[16]) {
+  float dir[4];
+  float length = 0.0f;
+  for (int c = 0; c < 4; ++c) {
+    dir[c] = static_cast<float>(e1[c] - e0[c]);
+    length += dir[c] * dir[c];
+  }
+  float scale = length > 0.0f ? 64.0f / length : 0.0f;
+
+  float total = 0.0f;
+  for (int i = 0; i < 16; ++i) {
+    float t = 0.0f;
+    for (int c = 0; c < 4; ++c) t += (texels[i][c] - e0[c]) * dir[c];
+    t *= scale;
+    int guess = 0;
+    while (guess < 15 &&
+           t > (bc7_weights[guess] + bc7_weights[guess + 1]) * 0.5f) {
+      ++guess;
+    }
+
+    float best = FLT_MAX;
+    for (int k = std::max(guess - 1, 0); k <= std::min(guess + 1, 15); ++k) {
+      float err = 0.0f;
+      for (int c = 0; c < 4; ++c) {
+        float d = texels[i][c] - palette[k][c];
+        err += d * d;
+      }
+      if (err < best) {
+        best = err;
+        indices[i] = static_cast<u_int8_t>(k);
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+}  // namespace
+
+u_int32_t getBlockByteSize(BlockFormat format) {
+  return format == BlockFormat::kBC1 ? 8 : 16;
+}
+
+const char* getBlockFormatName(BlockFormat format) {
+  switch (format) {
+    case BlockFormat::kBC1:
+      return "bc1";
+    case BlockFormat::kBC3:
+      return "bc3";
+    case BlockFormat::kBC7:
+      return "bc7";
+  }
+  return "unknown";
+}
+
+size_t CompressedMipChain::getLevelByteSize(size_t level) const {
+  size_t blocks_x = (levels[level].width + 3) / 4;
+  size_t blocks_y = (levels[level].height + 3) / 4;
+  return blocks_x * blocks_y * getBlockByteSize(format);
+}
+
+void encodeBC1Block(const unsigned char rgba[64], unsigned char out[8]) {
+  encodeColorBlock(rgba, out);
+}
+
+void encodeBC3Block(const unsigned char rgba[64], unsigned char out[16]) {
+  encodeAlphaBlock(rgba, out);
+  encodeColorBlock(rgba, out + 8);
+}
+
+void encodeBC7Block(const unsigned char rgba[64], unsigned char out[16]) {
+  float texels[16][4];
+  loadTexels(rgba, texels);
+
+  int best_q[2][4] = {};
+  int best_p[2] = {};
+  u_int8_t best_indices[16] = {};
+  float best_error = FLT_MAX;
+
+  // all 4 p-bit pairs, the shared bit moves each channel by one step.
+  auto tryEndpoints = [&](const float e0[4], const float e1[4]) {
+    for (int p0 = 0; p0 < 2; ++p0) {
+      for (int p1 = 0; p1 < 2; ++p1) {
+        int q[2][4], d0[4], d1[4];
+        for (int c = 0; c < 4; ++c) {
+          q[0][c] = quantizeBC7(e0[c], p0);
+          q[1][c] = quantizeBC7(e1[c], p1);
+          d0[c] = expandBC7(q[0][c], p0);
+          d1[c] = expandBC7(q[1][c], p1);
+        }
+        int palette[16][4];
+        buildBC7Palette(d0, d1, palette);
+        u_int8_t indices[16];
+        float error = fitBC7Indices(texels, d0, d1, palette, indices);
+        if (error < best_error) {
+          best_error = error;
+          memcpy(best_q, q, sizeof(q));
+          best_p[0] = p0;
+          best_p[1] = p1;
+          memcpy(best_indices, indices, sizeof(indices));
+        }
+      }
+    }
+  };
+
+  float lo[4], hi[4];
+  computeAxisEndpoints<4>(texels, lo, hi);
+  tryEndpoints(lo, hi);
+
+  for (int iter = 0; iter < 2 && best_error > 0.0f; ++iter) {
+    float weight[16];
+    for (int i = 0; i < 16; ++i) {
+      weight[i] = bc7_weights[best_indices[i]] / 64.0f;
+    }
+    float e0[4], e1[4];
+    if (!solveEndpoints<4>(texels, weight, e0, e1)) break;
+    tryEndpoints(e0, e1);
+  }
+
+  // msb of the anchor index is implicit 0.
+  if (best_indices[0] & 8) {
+    for (int c = 0; c < 4; ++c) std::swap(best_q[0][c], best_q[1][c]);
+    std::swap(best_p[0], best_p[1]);
+    for (auto& index : best_indices) index = 15 - index;
+  }
+
+  memset(out, 0, 16);
+  BitWriter writer{out};
+  writer.write(1 << 6, 7);
+  for (int c = 0; c < 4; ++c) {
+    writer.write(best_q[0][c], 7);
+    writer.write(best_q[1][c], 7);
+  }
+  writer.write(best_p[0], 1);
+  writer.write(best_p[1], 1);
+  writer.write(best_indices[0], 3);
+  for (int i = 1; i < 16; ++i) writer.write(best_indices[i], 4);
+}
+
+void decodeBC1Block(const unsigned char block[8], unsigned char rgba[64]) {
+  decodeColorBlock(block, rgba, false);
+}
+
+void decodeBC3Block(const unsigned char block[16], unsigned char rgba[64]) {
+  decodeColorBlock(block + 8, rgba, true);
+  decodeAlphaBlock(block, rgba);
+}
+
+bool decodeBC7Block(const unsigned char block[16], unsigned char rgba[64]) {
+  if ((block[0] & 0x7f) != 0x40) return false;
+
+  BitReader reader{block, 7};
+  int q[2][4], p[2];
+  for (int c = 0; c < 4; ++c) {
+    q[0][c] = reader.read(7);
+    q[1][c] = reader.read(7);
+  }
+  p[0] = reader.read(1);
+  p[1] = reader.read(1);
+
+  int e0[4], e1[4];
+  for (int c = 0; c < 4; ++c) {
+    e0[c] = expandBC7(q[0][c], p[0]);
+    e1[c] = expandBC7(q[1][c], p[1]);
+  }
+  int palette[16][4];
+  buildBC7Palette(e0, e1, palette);
+  for (int i = 0; i < 16; ++i) {
+    u_int32_t index = reader.read(i == 0 ? 3 : 4);
+    for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = palette[index][c];
+  }
+  return true;
+}
+
+void compressMipChain(const MipChain& mips, BlockFormat format, bool srgb,
+                      CompressedMipChain& chain) {
+  u_int32_t block_size = getBlockByteSize(format);
+  chain.format = format;
+  chain.srgb = srgb;
+  chain.levels.resize(mips.levels.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < mips.levels.size(); ++i) {
+    chain.levels[i] = {mips.levels[i].width, mips.levels[i].height, offset};
+    offset = alignUp(offset + chain.getLevelByteSize(i), 16);
+  }
+  chain.blocks.assign(offset, 0);
+
+  for (size_t level = 0; level < mips.levels.size(); ++level) {
+    const auto& src = mips.levels[level];
+    const unsigned char* pixels = mips.pixels.data() + src.offset;
+    unsigned char* out = chain.blocks.data() + chain.levels[level].offset;
+    u_int32_t blocks_x = (src.width + 3) / 4;
+    u_int32_t blocks_y = (src.height + 3) / 4;
+
+    auto rows = [&](size_t begin, size_t end) {
+      unsigned char texels[64];
+      for (size_t by = begin; by < end; ++by) {
+        for (u_int32_t bx = 0; bx < blocks_x; ++bx) {
+          for (u_int32_t y = 0; y < 4; ++y) {
+            u_int32_t sy = std::min<u_int32_t>(by * 4 + y, src.height - 1);
+            for (u_int32_t x = 0; x < 4; ++x) {
+              u_int32_t sx = std::min(bx * 4 + x, src.width - 1);
+              memcpy(texels + (y * 4 + x) * 4,
+                     pixels + (static_cast<size_t>(sy) * src.width + sx) * 4,
+                     4);
+            }
+          }
+          unsigned char* block = out + (by * blocks_x + bx) * block_size;
+          switch (format) {
+            case BlockFormat::kBC1:
+              encodeBC1Block(texels, block);
+              break;
+            case BlockFormat::kBC3:
+              encodeBC3Block(texels, block);
+              break;
+            case BlockFormat::kBC7:
+              encodeBC7Block(texels, block);
+              break;
+          }
+        }
+      }
+    };
+
+    if (static_cast<size_t>(blocks_x) * blocks_y >= parallel_min_blocks) {
+      getGlobalThreadPool().parallelFor(blocks_y, rows);
+    } else {
+      rows(0, blocks_y);
+    }
+  }
+}
+
+bool decompressMipChain(const CompressedMipChain& chain, MipChain& mips) {
+  u_int32_t block_size = getBlockByteSize(chain.format);
+  mips.levels.resize(chain.levels.size());
+  size_t offset = 0;
+  for (size_t i = 0; i < chain.levels.size(); ++i) {
+    mips.levels[i] = {chain.levels[i].width, chain.levels[i].height, offset};
+    offset += static_cast<size_t>(chain.levels[i].width) *
+              chain.levels[i].height * 4;
+  }
+  mips.pixels.assign(offset, 0);
+
+  std::atomic<bool> ok{true};
+  for (size_t level = 0; level < chain.levels.size(); ++level) {
+    const auto& dst = mips.levels[level];
+    const unsigned char* blocks = chain.blocks.data() + chain.levels[level].offset;
+    unsigned char* pixels = mips.pixels.data() + dst.offset;
+    u_int32_t blocks_x = (dst.width + 3) / 4;
+    u_int32_t blocks_y = (dst.height + 3) / 4;
+
+    auto rows = [&](size_t begin, size_t end) {
+      unsigned char texels[64];
+      for (size_t by = begin; by < end; ++by) {
+        for (u_int32_t bx = 0; bx < blocks_x; ++bx) {
+          const unsigned char* block =
+              blocks + (by * blocks_x + bx) * block_size;
+          switch (chain.format) {
+            case BlockFormat::kBC1:
+              decodeBC1Block(block, texels);
+              break;
+            case BlockFormat::kBC3:
+              decodeBC3Block(block, texels);
+              break;
+            case BlockFormat::kBC7:
+              if (!decodeBC7Block(block, texels)) {
+                ok.store(false, std::memory_order_relaxed);
+                continue;
+              }
+              break;
+          }
+          for (u_int32_t y = 0; y < 4 && by * 4 + y < dst.height; ++y) {
+            for (u_int32_t x = 0; x < 4 && bx * 4 + x < dst.width; ++x) {
+              memcpy(pixels + ((by * 4 + y) * dst.width + bx * 4 + x) * 4,
+                     texels + (y * 4 + x) * 4, 4);
+            }
+          }
+        }
+      }
+    };
+
+    if (static_cast<size_t>(blocks_x) * blocks_y >= parallel_min_blocks) {
+      getGlobalThreadPool().parallelFor(blocks_y, rows);
+    } else {
+      rows(0, blocks_y);
+    }
+  }
+  return ok.load();
+}
+
+double computePsnr(const unsigned char* a, const unsigned char* b,
+                   size_t pixel_count, bool include_alpha) {
+  int channels = include_alpha ? 4 : 3;
+  double sum = 0.0;
+  for (size_t i = 0; i < pixel_count; ++i) {
+    for (int c = 0; c < channels; ++c) {
+      double d = static_cast<double>(a[i * 4 + c]) - b[i * 4 + c];
+      sum += d * d;
+    }
+  }
+  double mse = sum / (static_cast<double>(pixel_count) * channels);
+  if (mse <= 0.0) return 99.0;
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+}  // namespace LLShader
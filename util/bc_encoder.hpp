@@ -0,0 +1,61 @@
+#ifndef BC_ENCODER_HPP
+#define BC_ENCODER_HPP
+
+#include <cstdlib>
+#include <vector>
+
+#include "util/mipmap_generator.hpp"
+
+namespace LLShader {
+
+/// block compressed formats, 4x4 texels per block.
+enum class BlockFormat : u_int32_t {
+  kBC1,  // 565 color endpoints, 8 bytes, opaque.
+  kBC3,  // bc1 color + interpolated alpha, 16 bytes.
+  kBC7,  // mode 6 only, rgba 7777 + p-bit endpoints, 16 bytes.
+};
+
+u_int32_t getBlockByteSize(BlockFormat format);
+
+/// "bc1" / "bc3" / "bc7".
+const char* getBlockFormatName(BlockFormat format);
+
+/// blocks of all levels, level 0 first, each level 16 aligned.
+struct CompressedMipChain {
+  BlockFormat format{BlockFormat::kBC7};
+  bool srgb{true};
+  std::vector<unsigned char> blocks;
+  // width & height in texels, byte offset in blocks.
+  std::vector<MipLevel> levels;
+
+  size_t getLevelByteSize(size_t level) const;
+};
+
+/// single 4x4 block, rgba 32 texels in row major order.
+void encodeBC1Block(const unsigned char rgba[64], unsigned char out[8]);
+void encodeBC3Block(const unsigned char rgba[64], unsigned char out[16]);
+void encodeBC7Block(const unsigned char rgba[64], unsigned char out[16]);
+
+void decodeBC1Block(const unsigned char block[8], unsigned char rgba[64]);
+void decodeBC3Block(const unsigned char block[16], unsigned char rgba[64]);
+/// mode 6 only, return false on other modes.
+bool decodeBC7Block(const unsigned char block[16], unsigned char rgba[64]);
+
+/// compress every level, block rows are split over the global thread pool.
+/// blocks crossing the level edge repeat the last row / column.
+/// the encoders work on encoded values, srgb only tags the output.
+void compressMipChain(const MipChain& mips, BlockFormat format, bool srgb,
+                      CompressedMipChain& chain);
+
+/// cpu decode, for quality checks and devices without bc sampling.
+/// return false if a block can not be decoded.
+bool decompressMipChain(const CompressedMipChain& chain, MipChain& mips);
+
+/// peak signal to noise ratio in dB of two rgba 32 images, alpha is left
+/// out unless include_alpha. identical images return 99.
+double computePsnr(const unsigned char* a, const unsigned char* b,
+                   size_t pixel_count, bool include_alpha);
+
+}  // namespace LLShader
+
+#endif
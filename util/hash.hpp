@@ -0,0 +1,115 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdlib>
+#include <cstring>
+
+namespace LLShader {
+
+/// 64 bit non-cryptographic hash (xxHash64 algorithm), used for content
+/// hashing of asset files and as the base of vertex hashing.
+namespace hash_detail {
+
+constexpr u_int64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr u_int64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr u_int64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr u_int64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr u_int64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+inline u_int64_t rotl(u_int64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline u_int64_t read64(const unsigned char* p) {
+  u_int64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline u_int32_t read32(const unsigned char* p) {
+  u_int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline u_int64_t accumulate(u_int64_t acc, u_int64_t input) {
+  acc += input * prime2;
+  acc = rotl(acc, 31);
+  return acc * prime1;
+}
+
+inline u_int64_t mergeRound(u_int64_t acc, u_int64_t val) {
+  acc ^= accumulate(0, val);
+  return acc * prime1 + prime4;
+}
+
+inline u_int64_t avalanche(u_int64_t h) {
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+}  // namespace hash_detail
+
+inline u_int64_t hashBytes(const void* data, size_t size, u_int64_t seed = 0) {
+  using namespace hash_detail;
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  const unsigned char* end = p + size;
+  u_int64_t h;
+
+  if (size >= 32) {
+    u_int64_t v1 = seed + prime1 + prime2;
+    u_int64_t v2 = seed + prime2;
+    u_int64_t v3 = seed;
+    u_int64_t v4 = seed - prime1;
+    const unsigned char* limit = end - 32;
+    do {
+      v1 = accumulate(v1, read64(p));
+      v2 = accumulate(v2, read64(p + 8));
+      v3 = accumulate(v3, read64(p + 16));
+      v4 = accumulate(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = mergeRound(h, v1);
+    h = mergeRound(h, v2);
+    h = mergeRound(h, v3);
+    h = mergeRound(h, v4);
+  } else {
+    h = seed + prime5;
+  }
+
+  h += static_cast<u_int64_t>(size);
+
+  while (p + 8 <= end) {
+    h ^= accumulate(0, read64(p));
+    h = rotl(h, 27) * prime1 + prime4;
+    p += 8;
+  }
+
+  if (p + 4 <= end) {
+    h ^= static_cast<u_int64_t>(read32(p)) * prime1;
+    h = rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+
+  while (p < end) {
+    h ^= (*p) * prime5;
+    h = rotl(h, 11) * prime1;
+    ++p;
+  }
+
+  return avalanche(h);
+}
+
+/// mix a value into an existing hash, order dependent.
+inline u_int64_t hashCombine(u_int64_t seed, u_int64_t value) {
+  return hash_detail::avalanche(seed ^ (value + hash_detail::prime1 +
+                                        (seed << 6) + (seed >> 2)));
+}
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,301 @@
+#include "ktx2.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "log/log.hpp"
+#include "util/mapped_file.hpp"
+
+namespace LLShader {
+
+namespace {
+
+constexpr unsigned char ktx2_identifier[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+typedef struct {
+  unsigned char identifier[12];
+  u_int32_t vk_format;
+  u_int32_t type_size;
+  u_int32_t pixel_width;
+  u_int32_t pixel_height;
+  u_int32_t pixel_depth;
+  u_int32_t layer_count;
+  u_int32_t face_count;
+  u_int32_t level_count;
+  u_int32_t supercompression_scheme;
+  u_int32_t dfd_byte_offset;
+  u_int32_t dfd_byte_length;
+  u_int32_t kvd_byte_offset;
+  u_int32_t kvd_byte_length;
+  u_int64_t sgd_byte_offset;
+  u_int64_t sgd_byte_length;
+} Ktx2Header;
+
+typedef struct {
+  u_int64_t byte_offset;
+  u_int64_t byte_length;
+  u_int64_t uncompressed_byte_length;
+} Ktx2LevelIndex;
+
+static_assert(sizeof(Ktx2Header) == 80, "ktx2 header layout");
+static_assert(sizeof(Ktx2LevelIndex) == 24, "ktx2 level index layout");
+
+// khronos data format descriptor values.
+constexpr u_int8_t dfd_model_bc1a = 128;
+constexpr u_int8_t dfd_model_bc3 = 130;
+constexpr u_int8_t dfd_model_bc7 = 134;
+constexpr u_int8_t dfd_primaries_bt709 = 1;
+constexpr u_int8_t dfd_transfer_linear = 1;
+constexpr u_int8_t dfd_transfer_srgb = 2;
+constexpr u_int8_t dfd_channel_color = 0;
+constexpr u_int8_t dfd_channel_alpha = 15;
+
+inline size_t alignUp(size_t v, size_t alignment) {
+  return (v + alignment - 1) & ~(alignment - 1);
+}
+
+inline void putU16(std::vector<unsigned char>& out, u_int16_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back(v >> 8);
+}
+
+inline void putU32(std::vector<unsigned char>& out, u_int32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back((v >> (8 * i)) & 0xFF);
+}
+
+void putSample(std::vector<unsigned char>& out, u_int16_t bit_offset,
+               u_int8_t bit_length, u_int8_t channel) {
+  putU16(out, bit_offset);
+  out.push_back(bit_length - 1);
+  out.push_back(channel);
+  putU32(out, 0);  // sample position
+  putU32(out, 0);
+  putU32(out, 0xFFFFFFFF);
+}
+
+std::vector<unsigned char> buildDataFormatDescriptor(BlockFormat format,
+                                                     bool srgb) {
+  u_int8_t model = dfd_model_bc7;
+  u_int32_t sample_count = 1;
+  if (format == BlockFormat::kBC1) model = dfd_model_bc1a;
+  if (format == BlockFormat::kBC3) {
+    model = dfd_model_bc3;
+    sample_count = 2;
+  }
+
+  std::vector<unsigned char> dfd;
+  u_int16_t block_size = 24 + 16 * sample_count;
+  putU32(dfd, 4 + block_size);  // total size
+  putU32(dfd, 0);               // khronos vendor, basic descriptor type
+  putU16(dfd, 2);               // version
+  putU16(dfd, block_size);
+  dfd.push_back(model);
+  dfd.push_back(dfd_primaries_bt709);
+  dfd.push_back(srgb ? dfd_transfer_srgb : dfd_transfer_linear);
+  dfd.push_back(0);  // flags, straight alpha
+  // texel block dimension minus one, 4x4x1x1.
+  dfd.push_back(3);
+  dfd.push_back(3);
+  dfd.push_back(0);
+  dfd.push_back(0);
+  // bytes plane 0..7.
+  dfd.push_back(getBlockByteSize(format));
+  for (int i = 0; i < 7; ++i) dfd.push_back(0);
+
+  switch (format) {
+    case BlockFormat::kBC1:
+      putSample(dfd, 0, 64, dfd_channel_color);
+      break;
+    case BlockFormat::kBC3:
+      putSample(dfd, 0, 64, dfd_channel_alpha);
+      putSample(dfd, 64, 64, dfd_channel_color);
+      break;
+    case BlockFormat::kBC7:
+      putSample(dfd, 0, 128, dfd_channel_color);
+      break;
+  }
+  return dfd;
+}
+
+bool getBlockFormat(VkFormat vk_format, BlockFormat& format, bool& srgb) {
+  switch (vk_format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+      format = BlockFormat::kBC1;
+      break;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+      format = BlockFormat::kBC3;
+      break;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      format = BlockFormat::kBC7;
+      break;
+    default:
+      return false;
+  }
+  srgb = vk_format == getBlockVkFormat(format, true);
+  return true;
+}
+
+}  // namespace
+
+VkFormat getBlockVkFormat(BlockFormat format, bool srgb) {
+  switch (format) {
+    case BlockFormat::kBC1:
+      return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK
+                  : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case BlockFormat::kBC3:
+      return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+    case BlockFormat::kBC7:
+      return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+bool isKtx2File(const std::string& file) {
+  constexpr char suffix[] = ".ktx2";
+  constexpr size_t suffix_len = sizeof(suffix) - 1;
+  return file.size() >= suffix_len &&
+         file.compare(file.size() - suffix_len, suffix_len, suffix) == 0;
+}
+
+bool writeKtx2(const std::string& file, const CompressedMipChain& chain) {
+  if (chain.levels.empty()) {
+    LogUtil::LogW("skip writing empty ktx2 " + file + '\n');
+    return false;
+  }
+
+  auto dfd = buildDataFormatDescriptor(chain.format, chain.srgb);
+  u_int32_t level_count = chain.levels.size();
+  size_t level_index_end =
+      sizeof(Ktx2Header) + level_count * sizeof(Ktx2LevelIndex);
+
+  Ktx2Header header{};
+  memcpy(header.identifier, ktx2_identifier, sizeof(ktx2_identifier));
+  header.vk_format = getBlockVkFormat(chain.format, chain.srgb);
+  header.type_size = 1;
+  header.pixel_width = chain.levels.front().width;
+  header.pixel_height = chain.levels.front().height;
+  header.face_count = 1;
+  header.level_count = level_count;
+  header.dfd_byte_offset = level_index_end;
+  header.dfd_byte_length = dfd.size();
+
+  // level data follows the dfd, smallest level first as the spec requires,
+  // each aligned to the texel block size.
+  size_t alignment = getBlockByteSize(chain.format);
+  size_t offset = level_index_end + dfd.size();
+  std::vector<Ktx2LevelIndex> level_index(level_count);
+  for (u_int32_t i = level_count; i-- > 0;) {
+    offset = alignUp(offset, alignment);
+    size_t bytes = chain.getLevelByteSize(i);
+    level_index[i] = {offset, bytes, bytes};
+    offset += bytes;
+  }
+
+  std::vector<unsigned char> blob(offset, 0);
+  memcpy(blob.data(), &header, sizeof(header));
+  memcpy(blob.data() + sizeof(header), level_index.data(),
+         level_count * sizeof(Ktx2LevelIndex));
+  memcpy(blob.data() + level_index_end, dfd.data(), dfd.size());
+  for (u_int32_t i = 0; i < level_count; ++i) {
+    memcpy(blob.data() + level_index[i].byte_offset,
+           chain.blocks.data() + chain.levels[i].offset,
+           level_index[i].byte_length);
+  }
+
+  // write to temp file then rename, so a reader never see a half file.
+  auto temp_path = file + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open() ||
+        !out.write(reinterpret_cast<const char*>(blob.data()), blob.size())) {
+      LogUtil::LogW("failed to write ktx2 " + temp_path + '\n');
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(temp_path.c_str(), file.c_str()) != 0) {
+    LogUtil::LogW("failed to write ktx2 " + file + '\n');
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool readKtx2(const std::string& file, CompressedMipChain& chain) {
+  MappedFile mapped;
+  if (!mapped.open(file)) {
+    LogUtil::LogW("can not open ktx2 " + file + '\n');
+    return false;
+  }
+
+  auto reject = [&file](const std::string& reason) {
+    LogUtil::LogW("unsupported ktx2 " + file + ", " + reason + '\n');
+    return false;
+  };
+
+  if (mapped.size() < sizeof(Ktx2Header)) return reject("truncated header");
+  Ktx2Header header;
+  memcpy(&header, mapped.data(), sizeof(header));
+  if (memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier)) != 0)
+    return reject("bad identifier");
+
+  BlockFormat format;
+  bool srgb;
+  if (!getBlockFormat(static_cast<VkFormat>(header.vk_format), format, srgb))
+    return reject("vkFormat " + std::to_string(header.vk_format));
+  if (header.supercompression_scheme != 0) return reject("supercompressed");
+  if (header.pixel_width == 0 || header.pixel_height == 0 ||
+      header.pixel_depth != 0 || header.layer_count > 1 ||
+      header.face_count != 1) {
+    return reject("not a single 2d image");
+  }
+
+  // level count 0 asks the loader to generate mips, we never write that.
+  u_int32_t level_count = header.level_count;
+  if (level_count == 0 ||
+      level_count > getMipLevelCount(header.pixel_width, header.pixel_height))
+    return reject("level count " + std::to_string(level_count));
+
+  size_t level_index_end =
+      sizeof(Ktx2Header) + level_count * sizeof(Ktx2LevelIndex);
+  if (mapped.size() < level_index_end) return reject("truncated level index");
+  std::vector<Ktx2LevelIndex> level_index(level_count);
+  memcpy(level_index.data(), mapped.data() + sizeof(Ktx2Header),
+         level_count * sizeof(Ktx2LevelIndex));
+
+  chain.format = format;
+  chain.srgb = srgb;
+  chain.levels.resize(level_count);
+  size_t offset = 0;
+  for (u_int32_t i = 0; i < level_count; ++i) {
+    u_int32_t width = std::max(header.pixel_width >> i, 1u);
+    u_int32_t height = std::max(header.pixel_height >> i, 1u);
+    chain.levels[i] = {width, height, offset};
+    size_t bytes = chain.getLevelByteSize(i);
+    const auto& index = level_index[i];
+    if (index.byte_length != bytes ||
+        index.byte_offset > mapped.size() - bytes) {
+      return reject("bad level " + std::to_string(i));
+    }
+    offset = alignUp(offset + bytes, 16);
+  }
+
+  chain.blocks.resize(offset);
+  for (u_int32_t i = 0; i < level_count; ++i) {
+    memcpy(chain.blocks.data() + chain.levels[i].offset,
+           mapped.data() + level_index[i].byte_offset,
+           level_index[i].byte_length);
+  }
+
+  return true;
+}
+
+}  // namespace LLShader
@@ -0,0 +1,33 @@
+#ifndef KTX2_HPP
+#define KTX2_HPP
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+#include "util/bc_encoder.hpp"
+
+namespace LLShader {
+
+/// KTX 2.0 container for block compressed mip chains.
+/// layout: header, level index, data format descriptor, then the levels from
+/// the smallest to level 0, each aligned to the block size. no
+/// supercompression, no key/value data, single layer & face.
+
+/// VK_FORMAT_BC*_SRGB / _UNORM of a block format.
+VkFormat getBlockVkFormat(BlockFormat format, bool srgb);
+
+/// true if file ends with ".ktx2".
+bool isKtx2File(const std::string& file);
+
+/// write to temp file then rename. failure only logs a warning.
+bool writeKtx2(const std::string& file, const CompressedMipChain& chain);
+
+/// map the file and copy level blocks into chain, no pixel decoding.
+/// return false if the file is missing, malformed or not a format written by
+/// writeKtx2.
+bool readKtx2(const std::string& file, CompressedMipChain& chain);
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,76 @@
+#include "mapped_file.hpp"
+
+#include <sys/stat.h>
+
+#include <fstream>
+
+#if defined(_WIN32)
+#define LLSHADER_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace LLShader {
+
+bool MappedFile::open(const std::string& file) {
+  close();
+
+#ifndef LLSHADER_NO_MMAP
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                 MAP_PRIVATE, fd, 0);
+  // mapping keeps its own reference to the file.
+  ::close(fd);
+  if (p == MAP_FAILED) return false;
+
+  data_ = static_cast<const unsigned char*>(p);
+  size_ = static_cast<size_t>(st.st_size);
+  return true;
+#else
+  std::ifstream in(file, std::ios::binary | std::ios::ate);
+  if (!in.is_open()) return false;
+  std::streamsize sz = in.tellg();
+  if (sz <= 0) return false;
+  in.seekg(0, std::ios::beg);
+  fallback_buffer_.resize(static_cast<size_t>(sz));
+  if (!in.read(reinterpret_cast<char*>(fallback_buffer_.data()), sz)) {
+    fallback_buffer_.clear();
+    return false;
+  }
+  data_ = fallback_buffer_.data();
+  size_ = fallback_buffer_.size();
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+  if (!data_) return;
+#ifndef LLSHADER_NO_MMAP
+  munmap(const_cast<unsigned char*>(data_), size_);
+#else
+  fallback_buffer_.clear();
+  fallback_buffer_.shrink_to_fit();
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool getFileStamp(const std::string& file, FileStamp& stamp) {
+  struct stat st;
+  if (stat(file.c_str(), &st) != 0) return false;
+  stamp.size = static_cast<u_int64_t>(st.st_size);
+  stamp.mtime = static_cast<int64_t>(st.st_mtime);
+  return true;
+}
+
+}  // namespace LLShader
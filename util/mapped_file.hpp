@@ -0,0 +1,48 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace LLShader {
+
+/// Read only view of a whole file.
+/// Using mmap on posix, fallback to read the file into memory otherwise.
+class MappedFile final {
+ public:
+  MappedFile() = default;
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() { close(); }
+
+  /// return false if file not exist or can not be mapped.
+  bool open(const std::string& file);
+
+  void close();
+
+  inline const unsigned char* data() const { return data_; }
+  inline size_t size() const { return size_; }
+  inline bool isOpen() const { return data_ != nullptr; }
+
+ private:
+  const unsigned char* data_{nullptr};
+  size_t size_{0};
+
+  // only used by fallback path.
+  std::vector<unsigned char> fallback_buffer_;
+};
+
+/// file size and last modify time, used to invalidate caches.
+typedef struct {
+  u_int64_t size;
+  int64_t mtime;
+} FileStamp;
+
+bool getFileStamp(const std::string& file, FileStamp& stamp);
+
+}  // namespace LLShader
+
+#endif
@@ -28,7 +28,7 @@ inline void aligned_mfree(void* data) {
 }
 
 /// make sure vk_holder is init!
-/// @deprecated
+/// @deprecated use RenderManager::getFrameUniforms() for dynamic uniforms.
 inline size_t getDynamicAlignedSize(size_t size) {
   size_t min_uniform_aligment =
       global_matrix_engine.vk_holder->getPhysicalDeviceProperties()
@@ -45,6 +45,7 @@ inline size_t getDynamicAlignedSize(size_t size) {
   return dynamic_aligment;
 }
 
+/// @deprecated use RenderManager::getFrameUniforms() for dynamic uniforms.
 inline u_int32_t getDynamicAlignedSize2(u_int32_t size) {
   u_int32_t t = 1;
   u_int32_t cnt = 0;
@@ -69,6 +70,7 @@ inline u_int32_t getDynamicAlignedSize2(u_int32_t size) {
 /// Allocate mem at runtime, cal size at compile time.
 /// If your data contain some implict data such like pointer and
 /// call destruct function, it cause memory leak!!!
+/// @deprecated use RenderManager::getFrameUniforms() for dynamic uniforms.
 template <typename _Tp, size_t _Size>
 class AlignedArray final {
  public:
@@ -0,0 +1,344 @@
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "log/log.hpp"
+#include "util/hash.hpp"
+#include "util/mapped_file.hpp"
+
+namespace LLShader {
+
+namespace {
+
+constexpr char cache_magic[8] = {'L', 'L', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+inline u_int64_t alignUp(u_int64_t v, u_int64_t alignment) {
+  return (v + alignment - 1) & ~(alignment - 1);
+}
+
+// count elements at offset fit in file_size, checked without overflow.
+inline bool isRangeInFile(u_int64_t offset, u_int64_t count,
+                          u_int64_t element_size, u_int64_t file_size) {
+  return offset <= file_size && count <= (file_size - offset) / element_size;
+}
+
+// write to temp file then rename, so a reader never see a half file.
+bool writeCacheFile(const std::string& cache_path,
+                    const std::vector<char>& blob) {
+  auto temp_path = cache_path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open() || !out.write(blob.data(), blob.size())) {
+      LogUtil::LogW("failed to write mesh cache " + temp_path + '\n');
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0) {
+    LogUtil::LogW("failed to write mesh cache " + cache_path + '\n');
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// every index of count indices at offset is below vertex_count.
+bool isIndexRangeValid(const unsigned char* data, u_int64_t offset,
+                       u_int64_t count, u_int64_t vertex_count) {
+  auto* indices = reinterpret_cast<const u_int32_t*>(data + offset);
+  for (u_int64_t i = 0; i < count; ++i) {
+    if (indices[i] >= vertex_count) return false;
+  }
+  return true;
+}
+
+// what the arrays of an entry point to stays inside the entry, so a stale or
+// corrupt cache can not make the draws read out of bounds on the gpu. ranges
+// of the entry itself are checked before.
+bool isEntryContentValid(const unsigned char* data,
+                         const MeshCacheEntry& entry) {
+  if (entry.index_count % 3 != 0 || entry.meshlet_triangle_size % 3 != 0 ||
+      !isIndexRangeValid(data, entry.index_offset, entry.index_count,
+                         entry.vertex_count) ||
+      !isIndexRangeValid(data, entry.meshlet_vertex_offset,
+                         entry.meshlet_vertex_count, entry.vertex_count)) {
+    return false;
+  }
+
+  for (u_int64_t l = 0; l < entry.lod_count; ++l) {
+    MeshCacheLod lod;
+    memcpy(&lod, data + entry.lod_offset + l * sizeof(lod), sizeof(lod));
+    if (lod.index_count % 3 != 0 ||
+        !isIndexRangeValid(data, lod.index_offset, lod.index_count,
+                           entry.vertex_count)) {
+      return false;
+    }
+  }
+
+  // meshlet triangles are also ranges of lod 0 indices.
+  const u_int64_t triangle_count =
+      std::min(entry.meshlet_triangle_size, entry.index_count) / 3;
+  for (u_int64_t m = 0; m < entry.meshlet_count; ++m) {
+    Meshlet meshlet;
+    memcpy(&meshlet, data + entry.meshlet_offset + m * sizeof(meshlet),
+           sizeof(meshlet));
+    if (u_int64_t(meshlet.vertex_offset) + meshlet.vertex_count >
+            entry.meshlet_vertex_count ||
+        u_int64_t(meshlet.triangle_offset) + meshlet.triangle_count >
+            triangle_count) {
+      return false;
+    }
+    const unsigned char* local = data + entry.meshlet_triangle_offset +
+                                 u_int64_t(meshlet.triangle_offset) * 3;
+    for (u_int64_t i = 0; i < u_int64_t(meshlet.triangle_count) * 3; ++i) {
+      if (local[i] >= meshlet.vertex_count) return false;
+    }
+  }
+  return true;
+}
+
+bool hashSourceFile(const std::string& file, u_int64_t& hash) {
+  MappedFile source;
+  if (!source.open(file)) return false;
+  hash = hashBytes(source.data(), source.size());
+  return true;
+}
+
+}  // namespace
+
+std::string getMeshCachePath(const std::string& source_file) {
+  return source_file + ".meshcache";
+}
+
+bool loadMeshCache(const std::string& source_file, std::vector<Mesh>& meshes,
+                   u_int64_t options_hash) {
+  FileStamp stamp;
+  if (!getFileStamp(source_file, stamp)) return false;
+
+  auto cache_path = getMeshCachePath(source_file);
+  MappedFile cache;
+  if (!cache.open(cache_path)) return false;
+  if (cache.size() < sizeof(MeshCacheHeader)) return false;
+
+  MeshCacheHeader header;
+  memcpy(&header, cache.data(), sizeof(header));
+
+  if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+      header.version != mesh_cache_version ||
+      header.vertex_stride != sizeof(VertexData) ||
+      header.options_hash != options_hash ||
+      header.file_size != cache.size()) {
+    return false;
+  }
+
+  // size is cheap to check, mtime may changed by checkout or copy, so fall
+  // back to content hash.
+  if (header.source_size != stamp.size) return false;
+  bool mtime_changed = header.source_mtime != stamp.mtime;
+  if (mtime_changed) {
+    u_int64_t hash;
+    if (!hashSourceFile(source_file, hash) || hash != header.source_hash)
+      return false;
+  }
+
+  // counts come from the file, compare before multiplying so a corrupt one
+  // can not wrap.
+  const u_int64_t size = cache.size();
+  if (!isRangeInFile(sizeof(MeshCacheHeader), header.sub_mesh_count,
+                     sizeof(MeshCacheEntry), size)) {
+    return false;
+  }
+
+  std::vector<MeshCacheEntry> entries(header.sub_mesh_count);
+  memcpy(entries.data(), cache.data() + sizeof(MeshCacheHeader),
+         entries.size() * sizeof(MeshCacheEntry));
+
+  // validate all ranges before touching output.
+  for (const auto& entry : entries) {
+    if (!isRangeInFile(entry.name_offset, entry.name_size, 1, size) ||
+        !isRangeInFile(entry.vertex_offset, entry.vertex_count,
+                       sizeof(VertexData), size) ||
+        !isRangeInFile(entry.index_offset, entry.index_count,
+                       sizeof(u_int32_t), size) ||
+        !isRangeInFile(entry.lod_offset, entry.lod_count,
+                       sizeof(MeshCacheLod), size) ||
+        !isRangeInFile(entry.meshlet_offset, entry.meshlet_count,
+                       sizeof(Meshlet), size) ||
+        !isRangeInFile(entry.meshlet_vertex_offset,
+                       entry.meshlet_vertex_count, sizeof(u_int32_t), size) ||
+        !isRangeInFile(entry.meshlet_triangle_offset,
+                       entry.meshlet_triangle_size, 1, size)) {
+      return false;
+    }
+    for (u_int64_t l = 0; l < entry.lod_count; ++l) {
+      MeshCacheLod lod;
+      memcpy(&lod, cache.data() + entry.lod_offset + l * sizeof(lod),
+             sizeof(lod));
+      if (!isRangeInFile(lod.index_offset, lod.index_count,
+                         sizeof(u_int32_t), size)) {
+        return false;
+      }
+    }
+    if (!isEntryContentValid(cache.data(), entry)) return false;
+  }
+
+  meshes.clear();
+  meshes.resize(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto& entry = entries[i];
+    auto& mesh = meshes[i];
+    mesh.name.assign(
+        reinterpret_cast<const char*>(cache.data() + entry.name_offset),
+        entry.name_size);
+
+    // plain memcpy from the mapped pages.
+    auto* vertices =
+        reinterpret_cast<const VertexData*>(cache.data() + entry.vertex_offset);
+    mesh.vertices.assign(vertices, vertices + entry.vertex_count);
+
+    auto* indices =
+        reinterpret_cast<const u_int32_t*>(cache.data() + entry.index_offset);
+    mesh.indices.assign(indices, indices + entry.index_count);
+
+    mesh.lods.resize(entry.lod_count);
+    for (size_t l = 0; l < mesh.lods.size(); ++l) {
+      MeshCacheLod lod;
+      memcpy(&lod, cache.data() + entry.lod_offset + l * sizeof(lod),
+             sizeof(lod));
+      auto* lod_indices =
+          reinterpret_cast<const u_int32_t*>(cache.data() + lod.index_offset);
+      mesh.lods[l].error = lod.error;
+      mesh.lods[l].indices.assign(lod_indices, lod_indices + lod.index_count);
+    }
+
+    auto* meshlets =
+        reinterpret_cast<const Meshlet*>(cache.data() + entry.meshlet_offset);
+    mesh.meshlets.assign(meshlets, meshlets + entry.meshlet_count);
+    auto* meshlet_vertices = reinterpret_cast<const u_int32_t*>(
+        cache.data() + entry.meshlet_vertex_offset);
+    mesh.meshlet_vertices.assign(
+        meshlet_vertices, meshlet_vertices + entry.meshlet_vertex_count);
+    auto* meshlet_triangles = cache.data() + entry.meshlet_triangle_offset;
+    mesh.meshlet_triangles.assign(
+        meshlet_triangles, meshlet_triangles + entry.meshlet_triangle_size);
+  }
+
+  // content matched but mtime changed, e.g. by checkout. store the new mtime
+  // so later loads take the cheap path again, through the same temp file as
+  // the writer instead of patching the file in place.
+  if (mtime_changed) {
+    header.source_mtime = stamp.mtime;
+    std::vector<char> blob(cache.data(), cache.data() + size);
+    memcpy(blob.data(), &header, sizeof(header));
+    cache.close();
+    writeCacheFile(cache_path, blob);
+  }
+
+  return true;
+}
+
+bool writeMeshCache(const std::string& source_file,
+                    const std::vector<Mesh>& meshes, u_int64_t options_hash) {
+  FileStamp stamp;
+  MeshCacheHeader header{};
+  if (!getFileStamp(source_file, stamp) ||
+      !hashSourceFile(source_file, header.source_hash)) {
+    LogUtil::LogW("skip mesh cache, can not read " + source_file + '\n');
+    return false;
+  }
+
+  memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.version = mesh_cache_version;
+  header.vertex_stride = sizeof(VertexData);
+  header.source_size = stamp.size;
+  header.source_mtime = stamp.mtime;
+  header.options_hash = options_hash;
+  header.sub_mesh_count = meshes.size();
+
+  // layout pass
+  std::vector<MeshCacheEntry> entries(meshes.size());
+  std::vector<std::vector<MeshCacheLod>> lods(meshes.size());
+  u_int64_t offset =
+      sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry);
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    entries[i].name_offset = offset;
+    entries[i].name_size = meshes[i].name.size();
+    offset += meshes[i].name.size();
+  }
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    offset = alignUp(offset, 16);
+    entries[i].vertex_offset = offset;
+    entries[i].vertex_count = meshes[i].vertices.size();
+    offset += meshes[i].getVerticesByteSize();
+
+    offset = alignUp(offset, 16);
+    entries[i].index_offset = offset;
+    entries[i].index_count = meshes[i].indices.size();
+    offset += meshes[i].getIndicesByteSize();
+
+    offset = alignUp(offset, 16);
+    entries[i].lod_offset = offset;
+    entries[i].lod_count = meshes[i].lods.size();
+    offset += meshes[i].lods.size() * sizeof(MeshCacheLod);
+
+    lods[i].resize(meshes[i].lods.size());
+    for (size_t l = 0; l < lods[i].size(); ++l) {
+      offset = alignUp(offset, 16);
+      lods[i][l].index_offset = offset;
+      lods[i][l].index_count = meshes[i].lods[l].indices.size();
+      lods[i][l].error = meshes[i].lods[l].error;
+      offset += meshes[i].lods[l].indices.size() * sizeof(u_int32_t);
+    }
+
+    offset = alignUp(offset, 16);
+    entries[i].meshlet_offset = offset;
+    entries[i].meshlet_count = meshes[i].meshlets.size();
+    offset += meshes[i].meshlets.size() * sizeof(Meshlet);
+
+    offset = alignUp(offset, 16);
+    entries[i].meshlet_vertex_offset = offset;
+    entries[i].meshlet_vertex_count = meshes[i].meshlet_vertices.size();
+    offset += meshes[i].meshlet_vertices.size() * sizeof(u_int32_t);
+
+    offset = alignUp(offset, 16);
+    entries[i].meshlet_triangle_offset = offset;
+    entries[i].meshlet_triangle_size = meshes[i].meshlet_triangles.size();
+    offset += meshes[i].meshlet_triangles.size();
+  }
+  header.file_size = offset;
+
+  std::vector<char> blob(offset, 0);
+  memcpy(blob.data(), &header, sizeof(header));
+  memcpy(blob.data() + sizeof(header), entries.data(),
+         entries.size() * sizeof(MeshCacheEntry));
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    memcpy(blob.data() + entries[i].name_offset, meshes[i].name.data(),
+           meshes[i].name.size());
+    memcpy(blob.data() + entries[i].vertex_offset, meshes[i].vertices.data(),
+           meshes[i].getVerticesByteSize());
+    memcpy(blob.data() + entries[i].index_offset, meshes[i].indices.data(),
+           meshes[i].getIndicesByteSize());
+    memcpy(blob.data() + entries[i].lod_offset, lods[i].data(),
+           lods[i].size() * sizeof(MeshCacheLod));
+    for (size_t l = 0; l < lods[i].size(); ++l) {
+      memcpy(blob.data() + lods[i][l].index_offset,
+             meshes[i].lods[l].indices.data(),
+             lods[i][l].index_count * sizeof(u_int32_t));
+    }
+    memcpy(blob.data() + entries[i].meshlet_offset, meshes[i].meshlets.data(),
+           meshes[i].meshlets.size() * sizeof(Meshlet));
+    memcpy(blob.data() + entries[i].meshlet_vertex_offset,
+           meshes[i].meshlet_vertices.data(),
+           meshes[i].meshlet_vertices.size() * sizeof(u_int32_t));
+    memcpy(blob.data() + entries[i].meshlet_triangle_offset,
+           meshes[i].meshlet_triangles.data(),
+           meshes[i].meshlet_triangles.size());
+  }
+
+  return writeCacheFile(getMeshCachePath(source_file), blob);
+}
+
+}  // namespace LLShader
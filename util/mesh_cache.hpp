@@ -0,0 +1,83 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+
+namespace LLShader {
+
+/// Binary mesh cache, written next to source file after the first parse.
+/// layout:
+///   MeshCacheHeader
+///   MeshCacheEntry[sub_mesh_count]
+///   name blob
+///   for each sub mesh: VertexData[] (16 aligned), u_int32_t[] (16 aligned),
+///     MeshCacheLod[lod_count] (16 aligned), u_int32_t[] of each lod,
+///     Meshlet[] (16 aligned), u_int32_t[] meshlet vertices (16 aligned),
+///     u_int8_t[] meshlet triangles (16 aligned)
+/// bump the version when layout, VertexData, Meshlet or the stored order
+/// changed.
+constexpr u_int32_t mesh_cache_version = 7;
+
+typedef struct {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t vertex_stride;
+  // used to invalidate cache when source changed.
+  u_int64_t source_size;
+  int64_t source_mtime;
+  u_int64_t source_hash;
+  // hash of load options which change the output meshes.
+  u_int64_t options_hash;
+  u_int64_t sub_mesh_count;
+  // whole cache file size, reject truncated file.
+  u_int64_t file_size;
+} MeshCacheHeader;
+
+typedef struct {
+  u_int64_t name_offset;
+  u_int64_t name_size;
+  u_int64_t vertex_offset;
+  u_int64_t vertex_count;
+  u_int64_t index_offset;
+  u_int64_t index_count;
+  u_int64_t lod_offset;
+  u_int64_t lod_count;
+  u_int64_t meshlet_offset;
+  u_int64_t meshlet_count;
+  u_int64_t meshlet_vertex_offset;
+  u_int64_t meshlet_vertex_count;
+  u_int64_t meshlet_triangle_offset;
+  // in bytes, 3 per triangle.
+  u_int64_t meshlet_triangle_size;
+} MeshCacheEntry;
+
+typedef struct {
+  u_int64_t index_offset;
+  u_int64_t index_count;
+  float error;
+  u_int32_t reserved;
+} MeshCacheLod;
+
+/// cache file path of a source obj.
+std::string getMeshCachePath(const std::string& source_file);
+
+/// load sub meshes from mapped cache file, no text parsing.
+/// return false if cache not exist, broken, out of date or built with other
+/// options_hash. broken includes indices, meshlet ranges or meshlet local
+/// indices pointing outside their arrays. a source whose mtime changed but
+/// content did not gets its stored mtime refreshed by rewriting the cache,
+/// so the next load skips the content hash.
+bool loadMeshCache(const std::string& source_file, std::vector<Mesh>& meshes,
+                   u_int64_t options_hash = 0);
+
+/// write meshes into cache, failure only log a warning.
+bool writeMeshCache(const std::string& source_file,
+                    const std::vector<Mesh>& meshes,
+                    u_int64_t options_hash = 0);
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,299 @@
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "log/log.hpp"
+
+namespace LLShader {
+
+namespace {
+
+constexpr u_int32_t invalid_index = ~0u;
+
+// vertex -> triangles, CSR layout.
+struct TriangleAdjacency {
+  std::vector<u_int32_t> offsets;
+  std::vector<u_int32_t> triangles;
+
+  TriangleAdjacency(const std::vector<u_int32_t>& indices,
+                    size_t vertex_count)
+      : offsets(vertex_count + 1, 0), triangles(indices.size()) {
+    for (auto index : indices) ++offsets[index + 1];
+    for (size_t i = 0; i < vertex_count; ++i) offsets[i + 1] += offsets[i];
+
+    std::vector<u_int32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      triangles[fill[indices[i]]++] = static_cast<u_int32_t>(i / 3);
+    }
+  }
+
+  inline u_int32_t count(u_int32_t v) const {
+    return offsets[v + 1] - offsets[v];
+  }
+};
+
+// FIFO cache with timestamps, a vertex is in cache if at most cache_size
+// misses happened since it was inserted, itself included.
+class FifoCache {
+ public:
+  FifoCache(size_t vertex_count, u_int32_t cache_size)
+      : timestamps_(vertex_count, 0), cache_size_(cache_size) {}
+
+  // return true on miss.
+  inline bool access(u_int32_t v) {
+    if (time_ - timestamps_[v] <= cache_size_ && timestamps_[v] != 0) {
+      return false;
+    }
+    timestamps_[v] = time_++;
+    return true;
+  }
+
+  inline void reset() { time_ += cache_size_; }
+
+ private:
+  std::vector<u_int32_t> timestamps_;
+  u_int32_t cache_size_;
+  // time 0 means never inserted.
+  u_int32_t time_{1};
+};
+
+}  // namespace
+
+VertexCacheStats analyzeVertexCache(const std::vector<u_int32_t>& indices,
+                                    size_t vertex_count,
+                                    u_int32_t cache_size) {
+  VertexCacheStats stats{0.0f, 0.0f};
+  if (indices.empty() || vertex_count == 0) return stats;
+
+  FifoCache cache(vertex_count, cache_size);
+  size_t misses = 0;
+  for (auto index : indices) misses += cache.access(index);
+
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / vertex_count;
+  return stats;
+}
+
+void optimizeVertexCache(std::vector<u_int32_t>& indices, size_t vertex_count,
+                         std::vector<u_int32_t>* clusters,
+                         u_int32_t cache_size) {
+  size_t triangle_count = indices.size() / 3;
+  if (clusters) clusters->clear();
+  if (triangle_count == 0) return;
+
+  TriangleAdjacency adjacency(indices, vertex_count);
+
+  std::vector<u_int32_t> live(vertex_count);
+  for (size_t v = 0; v < vertex_count; ++v) {
+    live[v] = adjacency.count(static_cast<u_int32_t>(v));
+  }
+  std::vector<u_int32_t> cache_time(vertex_count, 0);
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<u_int32_t> dead_end;
+  dead_end.reserve(indices.size());
+  std::vector<u_int32_t> candidates;
+
+  std::vector<u_int32_t> result;
+  result.reserve(indices.size());
+
+  u_int32_t time = cache_size + 1;
+  u_int32_t cursor = 0;
+  u_int32_t fanning = 0;
+  // first fanning vertex opens the first cluster.
+  bool jumped = true;
+
+  while (fanning != invalid_index) {
+    auto emitted_count = static_cast<u_int32_t>(result.size() / 3);
+    if (jumped && clusters &&
+        (clusters->empty() || clusters->back() != emitted_count)) {
+      clusters->push_back(emitted_count);
+    }
+
+    candidates.clear();
+    for (u_int32_t i = adjacency.offsets[fanning];
+         i < adjacency.offsets[fanning + 1]; ++i) {
+      u_int32_t t = adjacency.triangles[i];
+      if (emitted[t]) continue;
+      emitted[t] = true;
+      for (int k = 0; k < 3; ++k) {
+        u_int32_t v = indices[t * 3 + k];
+        result.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        --live[v];
+        if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+      }
+    }
+
+    // best candidate which is still in cache after emitting its triangles.
+    u_int32_t next = invalid_index;
+    int best = 0;
+    for (auto v : candidates) {
+      if (live[v] == 0) continue;
+      int priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+        priority = static_cast<int>(time - cache_time[v]);
+      }
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+
+    jumped = next == invalid_index;
+    if (jumped) {
+      // dead end, go back through recent vertices, then scan in order.
+      while (!dead_end.empty() && next == invalid_index) {
+        u_int32_t v = dead_end.back();
+        dead_end.pop_back();
+        if (live[v] > 0) next = v;
+      }
+      while (next == invalid_index && cursor < vertex_count) {
+        if (live[cursor] > 0) next = cursor;
+        ++cursor;
+      }
+    }
+    fanning = next;
+  }
+
+  indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<u_int32_t>& indices,
+                      const std::vector<VertexData>& vertices,
+                      const std::vector<u_int32_t>& clusters, float threshold,
+                      u_int32_t cache_size) {
+  u_int32_t triangle_count = static_cast<u_int32_t>(indices.size() / 3);
+  if (triangle_count == 0 || clusters.empty()) return;
+
+  // misses of the cache order up to each triangle, on one warm cache.
+  std::vector<size_t> warm_misses(triangle_count);
+  FifoCache cache(vertices.size(), cache_size);
+  size_t misses = 0;
+  for (u_int32_t t = 0; t < triangle_count; ++t) {
+    for (int k = 0; k < 3; ++k) misses += cache.access(indices[t * 3 + k]);
+    warm_misses[t] = misses;
+  }
+
+  // split hard clusters at soft boundaries. once sorted any cluster may
+  // follow any other, so each is counted from a cold cache. a boundary is
+  // only taken while the misses so far stay within threshold times the warm
+  // cache order, hard boundaries use up the same budget.
+  std::vector<u_int32_t> starts;
+  size_t committed = 0;
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    u_int32_t begin = clusters[c];
+    u_int32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+    cache.reset();
+    starts.push_back(begin);
+    misses = 0;
+    for (u_int32_t t = begin; t < end; ++t) {
+      for (int k = 0; k < 3; ++k) misses += cache.access(indices[t * 3 + k]);
+      if (t + 1 < end && committed + misses <= threshold * warm_misses[t]) {
+        starts.push_back(t + 1);
+        committed += misses;
+        misses = 0;
+        cache.reset();
+      }
+    }
+    committed += misses;
+  }
+
+  // mesh centroid.
+  glm::vec3 mesh_center{0.0f};
+  for (auto index : indices) mesh_center += vertices[index].position;
+  mesh_center /= static_cast<float>(indices.size());
+
+  // view independent sort key, dot(cluster center - mesh center, normal).
+  typedef struct {
+    float key;
+    u_int32_t begin;
+    u_int32_t end;
+  } Cluster;
+  std::vector<Cluster> sorted(starts.size());
+  for (size_t c = 0; c < starts.size(); ++c) {
+    auto& cluster = sorted[c];
+    cluster.begin = starts[c];
+    cluster.end = c + 1 < starts.size() ? starts[c + 1] : triangle_count;
+
+    glm::vec3 center{0.0f};
+    glm::vec3 normal{0.0f};
+    float area = 0.0f;
+    for (u_int32_t t = cluster.begin; t < cluster.end; ++t) {
+      const auto& p0 = vertices[indices[t * 3 + 0]].position;
+      const auto& p1 = vertices[indices[t * 3 + 1]].position;
+      const auto& p2 = vertices[indices[t * 3 + 2]].position;
+      // length of cross is twice the area, weight center and normal by it.
+      glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      float a = glm::length(n);
+      center += (p0 + p1 + p2) * (a / 3.0f);
+      normal += n;
+      area += a;
+    }
+    if (area > 0.0f) center /= area;
+    float length = glm::length(normal);
+    if (length > 0.0f) normal /= length;
+    cluster.key = glm::dot(center - mesh_center, normal);
+  }
+
+  std::stable_sort(
+      sorted.begin(), sorted.end(),
+      [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+  std::vector<u_int32_t> result;
+  result.reserve(indices.size());
+  for (const auto& cluster : sorted) {
+    result.insert(result.end(), indices.begin() + cluster.begin * 3,
+                  indices.begin() + cluster.end * 3);
+  }
+  indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<VertexData>& vertices,
+                         std::vector<u_int32_t>& indices) {
+  std::vector<u_int32_t> remap(vertices.size(), invalid_index);
+  std::vector<VertexData> result;
+  result.reserve(vertices.size());
+
+  for (auto& index : indices) {
+    if (remap[index] == invalid_index) {
+      remap[index] = static_cast<u_int32_t>(result.size());
+      result.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+  vertices.swap(result);
+}
+
+void optimizeMesh(Mesh& mesh) {
+  auto before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+  std::vector<u_int32_t> clusters;
+  optimizeVertexCache(mesh.indices, mesh.vertices.size(), &clusters);
+  auto cache_order = mesh.indices;
+  float cache_acmr =
+      analyzeVertexCache(cache_order, mesh.vertices.size()).acmr;
+  optimizeOverdraw(mesh.indices, mesh.vertices, clusters,
+                   overdraw_threshold);
+  // the split only bounds the misses up to its last soft boundary, the tail
+  // of each hard cluster can still go over. keep the cache order then.
+  float overdraw_acmr =
+      analyzeVertexCache(mesh.indices, mesh.vertices.size()).acmr;
+  if (overdraw_acmr > overdraw_threshold * cache_acmr ||
+      overdraw_acmr > before.acmr) {
+    mesh.indices.swap(cache_order);
+  }
+  optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+  auto after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer),
+           " ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr,
+           before.atvr, after.atvr);
+  LogUtil::LogI("optimized mesh " + mesh.name + buffer);
+}
+
+}  // namespace LLShader
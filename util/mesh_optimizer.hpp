@@ -0,0 +1,58 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+
+namespace LLShader {
+
+/// cache size used by the optimizer and the simulation, close to the post
+/// transform cache of current desktop GPUs.
+constexpr u_int32_t vertex_cache_size = 16;
+
+/// ACMR optimizeMesh() may give up for less overdraw, 1.05 is 5% worse.
+constexpr float overdraw_threshold = 1.05f;
+
+typedef struct {
+  // average cache miss ratio, transformed vertices per triangle (0.5 - 3).
+  float acmr;
+  // average transform to vertex ratio, transformed vertices per vertex (>= 1).
+  float atvr;
+} VertexCacheStats;
+
+/// simulate a FIFO post transform cache over the index buffer.
+VertexCacheStats analyzeVertexCache(const std::vector<u_int32_t>& indices,
+                                    size_t vertex_count,
+                                    u_int32_t cache_size = vertex_cache_size);
+
+/// reorder triangles for vertex cache locality (Tipsify, Sander et al.).
+/// clusters: optional, receive the first triangle of each cluster, a new
+/// cluster starts each time the algorithm has to jump to a dead end.
+void optimizeVertexCache(std::vector<u_int32_t>& indices, size_t vertex_count,
+                         std::vector<u_int32_t>* clusters = nullptr,
+                         u_int32_t cache_size = vertex_cache_size);
+
+/// reorder clusters of triangles so the ones facing outward are drawn first.
+/// clusters are splitted further while the misses so far, each cluster
+/// counted from a cold cache, stay below threshold * misses of the input
+/// order on a warm cache. input must be cache optimized.
+void optimizeOverdraw(std::vector<u_int32_t>& indices,
+                      const std::vector<VertexData>& vertices,
+                      const std::vector<u_int32_t>& clusters,
+                      float threshold = overdraw_threshold,
+                      u_int32_t cache_size = vertex_cache_size);
+
+/// reorder vertices in first use order of the index buffer, unused vertices
+/// are dropped.
+void optimizeVertexFetch(std::vector<VertexData>& vertices,
+                         std::vector<u_int32_t>& indices);
+
+/// run vertex cache, overdraw and vertex fetch passes on mesh, log ACMR and
+/// ATVR before and after. the overdraw order is dropped if it costs more
+/// than overdraw_threshold over the cache order, or ends above the input.
+void optimizeMesh(Mesh& mesh);
+
+}  // namespace LLShader
+
+#endif
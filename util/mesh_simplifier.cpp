@@ -0,0 +1,459 @@
+#include "mesh_simplifier.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "log/log.hpp"
+#include "util/mesh_optimizer.hpp"
+
+namespace LLShader {
+
+namespace {
+
+constexpr u_int32_t invalid_index = ~0u;
+
+// weight of the planes which keep open borders in place, relative to the
+// squared edge length.
+constexpr float border_weight = 10.0f;
+
+enum class VertexKind : u_int8_t {
+  // one wedge, surrounded by triangles.
+  kManifold,
+  // on an open border, collapse along the border only.
+  kBorder,
+  // two wedges (uv or normal seam), collapse along the seam only.
+  kSeam,
+  // corners, seams on border, non manifold, never collapsed.
+  kLocked,
+};
+
+// sum of weight * (dot(n, p) + d)^2 over planes, as symmetric matrix.
+struct Quadric {
+  double a00 = 0.0, a11 = 0.0, a22 = 0.0;
+  double a10 = 0.0, a20 = 0.0, a21 = 0.0;
+  double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+  double c = 0.0;
+  // sum of weight, error is normalized by it.
+  double w = 0.0;
+
+  void addPlane(glm::vec3 n, float d, float weight) {
+    double x = n.x, y = n.y, z = n.z;
+    a00 += weight * x * x;
+    a11 += weight * y * y;
+    a22 += weight * z * z;
+    a10 += weight * y * x;
+    a20 += weight * z * x;
+    a21 += weight * z * y;
+    b0 += weight * x * d;
+    b1 += weight * y * d;
+    b2 += weight * z * d;
+    c += static_cast<double>(weight) * d * d;
+    w += weight;
+  }
+
+  void add(const Quadric& q) {
+    a00 += q.a00;
+    a11 += q.a11;
+    a22 += q.a22;
+    a10 += q.a10;
+    a20 += q.a20;
+    a21 += q.a21;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+    w += q.w;
+  }
+
+  // weighted mean of squared distance from p to the planes.
+  double error(glm::vec3 p) const {
+    if (w <= 0.0) return 0.0;
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2.0 * (a10 * x * y + a20 * x * z + a21 * y * z) +
+               2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::fabs(e) / w;
+  }
+};
+
+typedef struct {
+  u_int32_t from;
+  u_int32_t to;
+  double error;
+} Collapse;
+
+inline u_int64_t edgeKey(u_int32_t a, u_int32_t b) {
+  return (static_cast<u_int64_t>(a) << 32) | b;
+}
+
+class Simplifier {
+ public:
+  Simplifier(const std::vector<VertexData>& vertices,
+             const std::vector<u_int32_t>& indices)
+      : vertices_(vertices),
+        position_of_(vertices.size()),
+        next_wedge_(vertices.size()),
+        wedge_count_(vertices.size(), 0),
+        border_count_(vertices.size(), 0),
+        kinds_(vertices.size(), VertexKind::kManifold),
+        quadrics_(vertices.size()),
+        vertex_remap_(vertices.size()),
+        locked_(vertices.size()) {
+    buildWedges(indices);
+    buildQuadricsAndKinds(indices);
+  }
+
+  double simplify(std::vector<u_int32_t>& indices, size_t target_index_count,
+                  double error_limit) {
+    double result_error = 0.0;
+    size_t target_triangles = target_index_count / 3;
+
+    while (indices.size() / 3 > target_triangles) {
+      buildAdjacency(indices);
+      collectCollapses(indices);
+
+      std::sort(collapses_.begin(), collapses_.end(),
+                [](const Collapse& a, const Collapse& b) {
+                  return a.error < b.error;
+                });
+
+      // one collapse removes two triangles, one on border.
+      size_t triangle_count = indices.size() / 3;
+      size_t goal =
+          std::max<size_t>((triangle_count - target_triangles) / 2, 1);
+
+      for (size_t v = 0; v < vertex_remap_.size(); ++v) {
+        vertex_remap_[v] = static_cast<u_int32_t>(v);
+      }
+      std::fill(locked_.begin(), locked_.end(), false);
+
+      size_t collapsed = 0;
+      for (const auto& collapse : collapses_) {
+        if (collapse.error > error_limit || collapsed >= goal) break;
+        // each vertex moves at most once per pass, so costs and flip checks
+        // stay valid.
+        if (locked_[collapse.from] || locked_[collapse.to]) continue;
+        if (!tryCollapse(indices, collapse.from, collapse.to)) continue;
+
+        locked_[collapse.from] = true;
+        locked_[collapse.to] = true;
+        quadrics_[collapse.to].add(quadrics_[collapse.from]);
+        result_error = std::max(result_error, collapse.error);
+        ++collapsed;
+      }
+      if (collapsed == 0) break;
+
+      // remap and drop collapsed triangles.
+      size_t write = 0;
+      for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        u_int32_t v0 = vertex_remap_[indices[i + 0]];
+        u_int32_t v1 = vertex_remap_[indices[i + 1]];
+        u_int32_t v2 = vertex_remap_[indices[i + 2]];
+        u_int32_t p0 = position_of_[v0];
+        u_int32_t p1 = position_of_[v1];
+        u_int32_t p2 = position_of_[v2];
+        if (p0 == p1 || p1 == p2 || p0 == p2) continue;
+        indices[write++] = v0;
+        indices[write++] = v1;
+        indices[write++] = v2;
+      }
+      indices.resize(write);
+    }
+
+    return result_error;
+  }
+
+ private:
+  // position_of_: first vertex at the same position, next_wedge_: circular
+  // list of vertices at the same position.
+  void buildWedges(const std::vector<u_int32_t>& indices) {
+    std::unordered_map<glm::vec3, u_int32_t> first;
+    first.reserve(vertices_.size());
+    for (size_t i = 0; i < vertices_.size(); ++i) {
+      auto v = static_cast<u_int32_t>(i);
+      // -0.0 and 0.0 are the same position.
+      auto it = first.emplace(vertices_[v].position + 0.0f, v).first;
+      u_int32_t head = it->second;
+      position_of_[v] = head;
+      if (head == v) {
+        next_wedge_[v] = v;
+      } else {
+        next_wedge_[v] = next_wedge_[head];
+        next_wedge_[head] = v;
+      }
+    }
+
+    std::vector<bool> used(vertices_.size(), false);
+    for (auto index : indices) used[index] = true;
+    for (size_t v = 0; v < vertices_.size(); ++v) {
+      if (used[v]) ++wedge_count_[position_of_[v]];
+    }
+
+    used_ = std::move(used);
+  }
+
+  void buildQuadricsAndKinds(const std::vector<u_int32_t>& indices) {
+    std::unordered_set<u_int64_t> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        edges.insert(edgeKey(position_of_[indices[i + k]],
+                             position_of_[indices[i + (k + 1) % 3]]));
+      }
+    }
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      u_int32_t p[3];
+      for (int k = 0; k < 3; ++k) p[k] = position_of_[indices[i + k]];
+      const auto& p0 = vertices_[p[0]].position;
+      const auto& p1 = vertices_[p[1]].position;
+      const auto& p2 = vertices_[p[2]].position;
+
+      glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      float length = glm::length(n);
+      if (length <= 0.0f) continue;
+      n /= length;
+
+      // weight by area.
+      float d = -glm::dot(n, p0);
+      for (int k = 0; k < 3; ++k) quadrics_[p[k]].addPlane(n, d, length * 0.5f);
+
+      // an edge without its opposite half edge is on an open border.
+      for (int k = 0; k < 3; ++k) {
+        u_int32_t a = p[k];
+        u_int32_t b = p[(k + 1) % 3];
+        if (edges.count(edgeKey(b, a))) continue;
+        ++border_count_[a];
+        ++border_count_[b];
+
+        glm::vec3 e = vertices_[b].position - vertices_[a].position;
+        glm::vec3 bn = glm::cross(e, n);
+        float bn_length = glm::length(bn);
+        if (bn_length <= 0.0f) continue;
+        bn /= bn_length;
+        float bd = -glm::dot(bn, vertices_[a].position);
+        float weight = glm::dot(e, e) * border_weight;
+        quadrics_[a].addPlane(bn, bd, weight);
+        quadrics_[b].addPlane(bn, bd, weight);
+      }
+    }
+
+    for (size_t v = 0; v < vertices_.size(); ++v) {
+      if (position_of_[v] != v) continue;
+      if (border_count_[v] > 0) {
+        kinds_[v] = wedge_count_[v] > 1 || border_count_[v] > 2
+                        ? VertexKind::kLocked
+                        : VertexKind::kBorder;
+      } else if (wedge_count_[v] <= 1) {
+        kinds_[v] = VertexKind::kManifold;
+      } else if (wedge_count_[v] == 2) {
+        kinds_[v] = VertexKind::kSeam;
+      } else {
+        kinds_[v] = VertexKind::kLocked;
+      }
+    }
+  }
+
+  // triangles around each position, CSR layout.
+  void buildAdjacency(const std::vector<u_int32_t>& indices) {
+    adjacency_offsets_.assign(vertices_.size() + 1, 0);
+    for (auto index : indices) ++adjacency_offsets_[position_of_[index] + 1];
+    for (size_t i = 0; i < vertices_.size(); ++i) {
+      adjacency_offsets_[i + 1] += adjacency_offsets_[i];
+    }
+
+    adjacency_.resize(indices.size());
+    std::vector<u_int32_t> fill(adjacency_offsets_.begin(),
+                                adjacency_offsets_.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacency_[fill[position_of_[indices[i]]]++] =
+          static_cast<u_int32_t>(i / 3);
+    }
+  }
+
+  double collapseError(u_int32_t from, u_int32_t to) const {
+    switch (kinds_[from]) {
+      case VertexKind::kLocked:
+        return DBL_MAX;
+      case VertexKind::kBorder:
+        if (border_count_[to] == 0) return DBL_MAX;
+        break;
+      case VertexKind::kSeam:
+        if (wedge_count_[to] < 2) return DBL_MAX;
+        break;
+      default:
+        break;
+    }
+
+    Quadric q = quadrics_[from];
+    q.add(quadrics_[to]);
+    return q.error(vertices_[to].position);
+  }
+
+  // cheaper direction of every edge.
+  void collectCollapses(const std::vector<u_int32_t>& indices) {
+    edges_.clear();
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        u_int32_t a = position_of_[indices[i + k]];
+        u_int32_t b = position_of_[indices[i + (k + 1) % 3]];
+        edges_.push_back(a < b ? edgeKey(a, b) : edgeKey(b, a));
+      }
+    }
+    std::sort(edges_.begin(), edges_.end());
+    edges_.erase(std::unique(edges_.begin(), edges_.end()), edges_.end());
+
+    collapses_.clear();
+    for (auto key : edges_) {
+      auto a = static_cast<u_int32_t>(key >> 32);
+      auto b = static_cast<u_int32_t>(key & 0xffffffff);
+      double ab = collapseError(a, b);
+      double ba = collapseError(b, a);
+      if (ab == DBL_MAX && ba == DBL_MAX) continue;
+      collapses_.push_back(ab <= ba ? Collapse{a, b, ab} : Collapse{b, a, ba});
+    }
+  }
+
+  // check topology and flips of collapsing position from into to, write the
+  // wedge remap when it is valid.
+  bool tryCollapse(const std::vector<u_int32_t>& indices, u_int32_t from,
+                   u_int32_t to) {
+    // manifold and border vertex have one wedge, seam has two.
+    u_int32_t wedges[2];
+    u_int32_t targets[2] = {invalid_index, invalid_index};
+    int count = 0;
+    u_int32_t w = from;
+    do {
+      if (used_[w] && count < 2) wedges[count++] = w;
+      w = next_wedge_[w];
+    } while (w != from);
+
+    const glm::vec3& target = vertices_[to].position;
+    size_t shared = 0;
+    for (u_int32_t i = adjacency_offsets_[from];
+         i < adjacency_offsets_[from + 1]; ++i) {
+      u_int32_t t = adjacency_[i];
+      u_int32_t v[3];
+      int slot = -1;
+      int to_slot = -1;
+      for (int k = 0; k < 3; ++k) {
+        v[k] = vertex_remap_[indices[t * 3 + k]];
+        if (position_of_[v[k]] == from) slot = k;
+        if (position_of_[v[k]] == to) to_slot = k;
+      }
+      if (slot < 0) continue;
+
+      if (to_slot >= 0) {
+        // triangle on the edge, its wedge of from maps to its wedge of to.
+        ++shared;
+        for (int k = 0; k < count; ++k) {
+          if (wedges[k] != v[slot]) continue;
+          if (targets[k] == invalid_index) {
+            targets[k] = v[to_slot];
+          } else if (targets[k] != v[to_slot]) {
+            return false;
+          }
+        }
+        continue;
+      }
+
+      // reject triangles which flip or rotate too much.
+      glm::vec3 p[3];
+      for (int k = 0; k < 3; ++k) p[k] = vertices_[v[k]].position;
+      glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+      p[slot] = target;
+      glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+      if (glm::dot(before, after) <
+          0.25f * glm::length(before) * glm::length(after)) {
+        return false;
+      }
+    }
+
+    if (kinds_[from] == VertexKind::kBorder && shared != 1) return false;
+    for (int k = 0; k < count; ++k) {
+      if (targets[k] == invalid_index) return false;
+    }
+    // both sides of a seam into one wedge would close the seam.
+    if (count == 2 && targets[0] == targets[1]) return false;
+
+    for (int k = 0; k < count; ++k) vertex_remap_[wedges[k]] = targets[k];
+    return true;
+  }
+
+  const std::vector<VertexData>& vertices_;
+
+  // per vertex
+  std::vector<u_int32_t> position_of_;
+  std::vector<u_int32_t> next_wedge_;
+  std::vector<bool> used_;
+
+  // per position, indexed by the first vertex at that position.
+  std::vector<u_int32_t> wedge_count_;
+  std::vector<u_int32_t> border_count_;
+  std::vector<VertexKind> kinds_;
+  std::vector<Quadric> quadrics_;
+
+  // per pass
+  std::vector<u_int32_t> vertex_remap_;
+  std::vector<bool> locked_;
+  std::vector<u_int32_t> adjacency_offsets_;
+  std::vector<u_int32_t> adjacency_;
+  std::vector<u_int64_t> edges_;
+  std::vector<Collapse> collapses_;
+};
+
+}  // namespace
+
+float simplifyMesh(const std::vector<VertexData>& vertices,
+                   const std::vector<u_int32_t>& indices,
+                   size_t target_index_count, float target_error,
+                   std::vector<u_int32_t>& out) {
+  out = indices;
+  if (indices.size() <= target_index_count || vertices.empty()) return 0.0f;
+
+  double error_limit = target_error >= FLT_MAX
+                           ? DBL_MAX
+                           : static_cast<double>(target_error) * target_error;
+  Simplifier simplifier(vertices, indices);
+  double error = simplifier.simplify(out, target_index_count, error_limit);
+  return static_cast<float>(std::sqrt(error));
+}
+
+void generateMeshLods(Mesh& mesh, u_int32_t lod_count, bool optimize) {
+  mesh.lods.clear();
+
+  size_t previous_count = mesh.indices.size();
+  float previous_error = 0.0f;
+  std::string summary;
+  for (u_int32_t i = 0; i < lod_count; ++i) {
+    MeshLod lod;
+    // always from the full mesh, so error is measured against it.
+    lod.error = simplifyMesh(mesh.vertices, mesh.indices, previous_count / 2,
+                             FLT_MAX, lod.indices);
+    // stuck on locked vertices, following lods would be the same.
+    if (lod.indices.empty() || lod.indices.size() > previous_count * 3 / 4) {
+      break;
+    }
+
+    lod.error = std::max(lod.error, previous_error);
+    if (optimize) optimizeVertexCache(lod.indices, mesh.vertices.size());
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), " %zu (%.4f)", lod.indices.size() / 3,
+             lod.error);
+    summary += buffer;
+
+    previous_count = lod.indices.size();
+    previous_error = lod.error;
+    mesh.lods.push_back(std::move(lod));
+  }
+
+  LogUtil::LogI("mesh " + mesh.name + " lod triangles " +
+                std::to_string(mesh.indices.size() / 3) + summary + '\n');
+}
+
+}  // namespace LLShader
@@ -0,0 +1,31 @@
+#ifndef MESH_SIMPLIFIER_HPP
+#define MESH_SIMPLIFIER_HPP
+
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+
+namespace LLShader {
+
+/// edge collapse simplification with quadric error metric (Garland and
+/// Heckbert). a vertex is always collapsed into the other end of the edge,
+/// so vertices never move and the result still indexes into vertices.
+/// open borders only collapse along the border, attribute seams only along
+/// the seam.
+/// target_index_count: stop when the result has no more indices than this.
+/// target_error: object space error limit, collapses above it are not done.
+/// return the object space error of the result.
+float simplifyMesh(const std::vector<VertexData>& vertices,
+                   const std::vector<u_int32_t>& indices,
+                   size_t target_index_count, float target_error,
+                   std::vector<u_int32_t>& out);
+
+/// fill mesh.lods with up to lod_count lods, each one targets half triangles
+/// of the previous one. the chain stops early when simplification can not
+/// reduce triangles any more. optimize: reorder lod triangles for vertex
+/// cache.
+void generateMeshLods(Mesh& mesh, u_int32_t lod_count, bool optimize);
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,332 @@
+#include "meshlet_builder.hpp"
+
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+#include "util/mesh_optimizer.hpp"
+
+namespace LLShader {
+
+namespace {
+
+constexpr u_int32_t invalid_index = ~0u;
+
+// normals of a cluster spread wider than this can not be culled by cone.
+constexpr float min_cone_dot = 0.1f;
+
+// 0 grows meshlets by distance only, 1 by normal only.
+constexpr float cone_weight = 0.5f;
+
+void computeMeshletBounds(const Mesh& mesh, Meshlet& meshlet) {
+  const auto* local_vertices =
+      mesh.meshlet_vertices.data() + meshlet.vertex_offset;
+  const auto* local_triangles =
+      mesh.meshlet_triangles.data() + meshlet.triangle_offset * 3;
+
+  // sphere around bounding box center.
+  glm::vec3 lo = mesh.vertices[local_vertices[0]].position;
+  glm::vec3 hi = lo;
+  for (u_int32_t i = 1; i < meshlet.vertex_count; ++i) {
+    const auto& p = mesh.vertices[local_vertices[i]].position;
+    lo = glm::min(lo, p);
+    hi = glm::max(hi, p);
+  }
+  glm::vec3 center = (lo + hi) * 0.5f;
+  float radius = 0.0f;
+  for (u_int32_t i = 0; i < meshlet.vertex_count; ++i) {
+    const auto& p = mesh.vertices[local_vertices[i]].position;
+    radius = std::fmax(radius, glm::length(p - center));
+  }
+  meshlet.sphere = glm::vec4(center, radius);
+
+  // never culled by cone, dot with zero axis is 0.
+  meshlet.cone_apex = glm::vec4(center, 0.0f);
+  meshlet.cone_axis = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+  glm::vec3 normals[meshlet_max_triangles];
+  glm::vec3 points[meshlet_max_triangles];
+  u_int32_t count = 0;
+  glm::vec3 axis{0.0f};
+  for (u_int32_t t = 0; t < meshlet.triangle_count; ++t) {
+    const auto& p0 =
+        mesh.vertices[local_vertices[local_triangles[t * 3 + 0]]].position;
+    const auto& p1 =
+        mesh.vertices[local_vertices[local_triangles[t * 3 + 1]]].position;
+    const auto& p2 =
+        mesh.vertices[local_vertices[local_triangles[t * 3 + 2]]].position;
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(n);
+    if (length <= 0.0f) continue;
+    normals[count] = n / length;
+    points[count] = p0;
+    axis += normals[count];
+    ++count;
+  }
+
+  float axis_length = glm::length(axis);
+  if (count == 0 || axis_length <= 0.0f) return;
+  axis /= axis_length;
+
+  float min_dot = 1.0f;
+  for (u_int32_t i = 0; i < count; ++i) {
+    min_dot = std::fmin(min_dot, glm::dot(axis, normals[i]));
+  }
+  if (min_dot <= min_cone_dot) return;
+
+  // move the apex back along axis until it is behind every triangle plane,
+  // then any eye inside the cone sees only back faces.
+  float max_t = 0.0f;
+  for (u_int32_t i = 0; i < count; ++i) {
+    float t = glm::dot(center - points[i], normals[i]) /
+              glm::dot(axis, normals[i]);
+    max_t = std::fmax(max_t, t);
+  }
+  meshlet.cone_apex = glm::vec4(center - axis * max_t, 0.0f);
+  meshlet.cone_axis = glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+}
+
+}  // namespace
+
+void buildMeshlets(Mesh& mesh, u_int32_t max_vertices,
+                   u_int32_t max_triangles) {
+  assert(max_vertices >= 3 && max_vertices <= 255);
+  assert(max_triangles >= 1 && max_triangles <= meshlet_max_triangles);
+
+  mesh.meshlets.clear();
+  mesh.meshlet_vertices.clear();
+  mesh.meshlet_triangles.clear();
+
+  const auto& indices = mesh.indices;
+  size_t triangle_count = indices.size() / 3;
+  size_t vertex_count = mesh.vertices.size();
+  if (triangle_count == 0) return;
+
+  // first vertex at the same position, so triangles across uv seams are
+  // still neighbours.
+  std::vector<u_int32_t> position_of(vertex_count);
+  {
+    std::unordered_map<glm::vec3, u_int32_t> first;
+    first.reserve(vertex_count);
+    for (size_t i = 0; i < vertex_count; ++i) {
+      auto v = static_cast<u_int32_t>(i);
+      position_of[v] =
+          first.emplace(mesh.vertices[v].position + 0.0f, v).first->second;
+    }
+  }
+
+  // position -> triangles, CSR layout.
+  std::vector<u_int32_t> offsets(vertex_count + 1, 0);
+  for (auto index : indices) ++offsets[position_of[index] + 1];
+  for (size_t i = 0; i < vertex_count; ++i) offsets[i + 1] += offsets[i];
+  std::vector<u_int32_t> adjacency(indices.size());
+  {
+    std::vector<u_int32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      adjacency[fill[position_of[indices[i]]]++] =
+          static_cast<u_int32_t>(i / 3);
+    }
+  }
+
+  std::vector<glm::vec3> centroids(triangle_count);
+  std::vector<glm::vec3> normals(triangle_count);
+  float mesh_area = 0.0f;
+  for (size_t t = 0; t < triangle_count; ++t) {
+    const auto& p0 = mesh.vertices[indices[t * 3 + 0]].position;
+    const auto& p1 = mesh.vertices[indices[t * 3 + 1]].position;
+    const auto& p2 = mesh.vertices[indices[t * 3 + 2]].position;
+    centroids[t] = (p0 + p1 + p2) / 3.0f;
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(n);
+    normals[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+    mesh_area += length * 0.5f;
+  }
+  // radius of a full meshlet of average triangles, normalizes distance.
+  float expected_radius =
+      std::sqrt(mesh_area * max_triangles / triangle_count / 3.14159265f);
+  if (expected_radius <= 0.0f) expected_radius = 1.0f;
+
+  std::vector<bool> emitted(triangle_count, false);
+  // local index of vertex in the current meshlet.
+  std::vector<u_int32_t> local(vertex_count, invalid_index);
+  std::vector<u_int32_t> reordered;
+  reordered.reserve(indices.size());
+
+  Meshlet current{};
+  glm::vec3 centroid_sum{0.0f};
+  glm::vec3 normal_sum{0.0f};
+  size_t cursor = 0;
+
+  auto finish = [&]() {
+    if (current.triangle_count == 0) return;
+    computeMeshletBounds(mesh, current);
+    mesh.meshlets.push_back(current);
+    for (u_int32_t i = 0; i < current.vertex_count; ++i) {
+      local[mesh.meshlet_vertices[current.vertex_offset + i]] = invalid_index;
+    }
+
+    Meshlet next{};
+    next.vertex_offset = static_cast<u_int32_t>(mesh.meshlet_vertices.size());
+    next.triangle_offset = current.triangle_offset + current.triangle_count;
+    current = next;
+    centroid_sum = glm::vec3(0.0f);
+    normal_sum = glm::vec3(0.0f);
+  };
+
+  for (size_t emitted_count = 0; emitted_count < triangle_count;
+       ++emitted_count) {
+    u_int32_t best = invalid_index;
+    u_int32_t best_extra = 4;
+    float best_score = FLT_MAX;
+
+    if (current.triangle_count > 0) {
+      glm::vec3 center =
+          centroid_sum / static_cast<float>(current.triangle_count);
+      float normal_length = glm::length(normal_sum);
+      glm::vec3 axis =
+          normal_length > 0.0f ? normal_sum / normal_length : glm::vec3(0.0f);
+      for (u_int32_t i = 0; i < current.vertex_count; ++i) {
+        u_int32_t p =
+            position_of[mesh.meshlet_vertices[current.vertex_offset + i]];
+        for (u_int32_t a = offsets[p]; a < offsets[p + 1]; ++a) {
+          u_int32_t t = adjacency[a];
+          if (emitted[t]) continue;
+
+          u_int32_t extra = 0;
+          for (int k = 0; k < 3; ++k) {
+            extra += local[indices[t * 3 + k]] == invalid_index;
+          }
+          // close and facing the same way, keeps sphere and cone tight.
+          float distance = glm::length(centroids[t] - center);
+          float spread = glm::dot(axis, normals[t]);
+          float cone = std::fmax(1.0f - spread * cone_weight, 1e-3f);
+          float score =
+              (1.0f + distance / expected_radius * (1.0f - cone_weight)) *
+              cone;
+          if (extra < best_extra ||
+              (extra == best_extra && score < best_score)) {
+            best = t;
+            best_extra = extra;
+            best_score = score;
+          }
+        }
+      }
+    }
+
+    if (best == invalid_index) {
+      // no neighbour left, continue with the next triangle in index order,
+      // close after vertex cache optimization.
+      while (emitted[cursor]) ++cursor;
+      best = static_cast<u_int32_t>(cursor);
+      best_extra = 0;
+      for (int k = 0; k < 3; ++k) {
+        best_extra += local[indices[best * 3 + k]] == invalid_index;
+      }
+    }
+
+    // a full meshlet is followed by the best candidate.
+    if (current.vertex_count + best_extra > max_vertices ||
+        current.triangle_count >= max_triangles) {
+      finish();
+    }
+
+    for (int k = 0; k < 3; ++k) {
+      u_int32_t v = indices[best * 3 + k];
+      if (local[v] == invalid_index) {
+        local[v] = current.vertex_count++;
+        mesh.meshlet_vertices.push_back(v);
+      }
+      mesh.meshlet_triangles.push_back(static_cast<u_int8_t>(local[v]));
+      reordered.push_back(v);
+    }
+    emitted[best] = true;
+    centroid_sum += centroids[best];
+    normal_sum += normals[best];
+    ++current.triangle_count;
+  }
+  finish();
+
+  // the growth order keeps meshlets tight, not the vertex cache order the
+  // input came with. run Tipsify again on the local indices of each meshlet,
+  // triangles never move across meshlets.
+  std::vector<u_int32_t> local_indices;
+  for (const auto& meshlet : mesh.meshlets) {
+    auto* triangles =
+        mesh.meshlet_triangles.data() + meshlet.triangle_offset * 3;
+    const auto* vertices =
+        mesh.meshlet_vertices.data() + meshlet.vertex_offset;
+    local_indices.assign(triangles, triangles + meshlet.triangle_count * 3);
+    optimizeVertexCache(local_indices, meshlet.vertex_count);
+    for (size_t i = 0; i < local_indices.size(); ++i) {
+      triangles[i] = static_cast<u_int8_t>(local_indices[i]);
+      reordered[meshlet.triangle_offset * 3 + i] = vertices[local_indices[i]];
+    }
+  }
+
+  mesh.indices.swap(reordered);
+}
+
+MeshletCullParams makeMeshletCullParams(const glm::mat4& view_proj,
+                                        const glm::mat4& model,
+                                        glm::vec3 eye) {
+  MeshletCullParams params;
+  glm::mat4 m = view_proj * model;
+  glm::vec4 row[4];
+  for (int i = 0; i < 4; ++i) {
+    row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+  }
+
+  // near is -w <= z, looser than vulkan 0 <= z, never culls visible ones.
+  params.planes[0] = row[3] + row[0];
+  params.planes[1] = row[3] - row[0];
+  params.planes[2] = row[3] + row[1];
+  params.planes[3] = row[3] - row[1];
+  params.planes[4] = row[3] + row[2];
+  params.planes[5] = row[3] - row[2];
+  for (auto& plane : params.planes) {
+    float length = glm::length(glm::vec3(plane));
+    if (length > 0.0f) plane /= length;
+  }
+
+  params.eye = glm::vec3(glm::inverse(model) * glm::vec4(eye, 1.0f));
+  return params;
+}
+
+bool isMeshletVisible(const Meshlet& meshlet, const MeshletCullParams& params) {
+  glm::vec3 center(meshlet.sphere);
+  for (const auto& plane : params.planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -meshlet.sphere.w) {
+      return false;
+    }
+  }
+
+  glm::vec3 view = glm::vec3(meshlet.cone_apex) - params.eye;
+  float length = glm::length(view);
+  if (length <= 0.0f) return true;
+  return glm::dot(view / length, glm::vec3(meshlet.cone_axis)) <
+         meshlet.cone_axis.w;
+}
+
+u_int32_t cullMeshlets(const std::vector<Meshlet>& meshlets,
+                       const MeshletCullParams& params,
+                       std::vector<IndexRange>& ranges) {
+  ranges.clear();
+  u_int32_t visible = 0;
+  for (const auto& meshlet : meshlets) {
+    if (!isMeshletVisible(meshlet, params)) continue;
+    visible += meshlet.triangle_count;
+
+    u_int32_t first = meshlet.triangle_offset * 3;
+    u_int32_t count = meshlet.triangle_count * 3;
+    if (!ranges.empty() &&
+        ranges.back().first_index + ranges.back().index_count == first) {
+      ranges.back().index_count += count;
+    } else {
+      ranges.push_back({first, count});
+    }
+  }
+  return visible;
+}
+
+}  // namespace LLShader
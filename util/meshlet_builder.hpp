@@ -0,0 +1,53 @@
+#ifndef MESHLET_BUILDER_HPP
+#define MESHLET_BUILDER_HPP
+
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+
+namespace LLShader {
+
+/// limits of mesh shader friendly clusters, 124 keeps the local index list
+/// of a meshlet within 372 bytes.
+constexpr u_int32_t meshlet_max_vertices = 64;
+constexpr u_int32_t meshlet_max_triangles = 124;
+
+/// split mesh.indices into meshlets with bounding sphere and normal cone.
+/// a meshlet grows with the neighbour triangle which adds the fewest new
+/// vertices, the closest one to the meshlet center on tie. mesh.indices is
+/// reordered so the triangles of a meshlet are contiguous, then each meshlet
+/// is vertex cache optimized on its own.
+/// max_vertices must not exceed 255.
+void buildMeshlets(Mesh& mesh, u_int32_t max_vertices = meshlet_max_vertices,
+                   u_int32_t max_triangles = meshlet_max_triangles);
+
+/// culling input, in object space of the mesh.
+typedef struct {
+  // frustum planes, xyz normal pointing inside, w distance.
+  glm::vec4 planes[6];
+  glm::vec3 eye;
+} MeshletCullParams;
+
+/// planes of view_proj * model and eye moved into object space.
+/// model is expected to have uniform scale.
+MeshletCullParams makeMeshletCullParams(const glm::mat4& view_proj,
+                                        const glm::mat4& model,
+                                        glm::vec3 eye);
+
+/// false when the meshlet is out of frustum or all its triangles face away.
+bool isMeshletVisible(const Meshlet& meshlet, const MeshletCullParams& params);
+
+typedef struct {
+  u_int32_t first_index;
+  u_int32_t index_count;
+} IndexRange;
+
+/// index ranges of visible meshlets, adjacent ones are merged into one
+/// draw. return the visible triangle count.
+u_int32_t cullMeshlets(const std::vector<Meshlet>& meshlets,
+                       const MeshletCullParams& params,
+                       std::vector<IndexRange>& ranges);
+
+}  // namespace LLShader
+
+#endif
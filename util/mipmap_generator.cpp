@@ -0,0 +1,290 @@
+#include "mipmap_generator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "util/thread_pool.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MIPMAP_USE_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIPMAP_USE_NEON
+#endif
+
+namespace LLShader {
+
+namespace {
+
+// linear -> srgb lookup steps, dark end moves about 0.2 of a 8 bit code per
+// step.
+constexpr u_int32_t encode_steps = 16383;
+
+// levels smaller than this are filtered on the calling thread.
+constexpr size_t parallel_min_pixels = 16384;
+
+inline float srgbToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float l) {
+  return l <= 0.0031308f ? l * 12.92f
+                         : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+}
+
+struct GammaTables {
+  float decode_srgb[256];
+  float decode_unorm[256];
+  u_int8_t encode_srgb[encode_steps + 1];
+
+  GammaTables() {
+    for (int i = 0; i < 256; ++i) {
+      decode_srgb[i] = srgbToLinear(i / 255.0f);
+      decode_unorm[i] = i / 255.0f;
+    }
+    for (u_int32_t i = 0; i <= encode_steps; ++i) {
+      float l = static_cast<float>(i) / encode_steps;
+      encode_srgb[i] = static_cast<u_int8_t>(linearToSrgb(l) * 255.0f + 0.5f);
+    }
+  }
+};
+
+const GammaTables& getGammaTables() {
+  static GammaTables tables;
+  return tables;
+}
+
+// 8 bit row -> linear float rgba.
+void decodeRow(const unsigned char* src, u_int32_t width, float* dst,
+               bool srgb) {
+  const auto& tables = getGammaTables();
+  const float* rgb = srgb ? tables.decode_srgb : tables.decode_unorm;
+  for (u_int32_t x = 0; x < width; ++x) {
+    dst[x * 4 + 0] = rgb[src[x * 4 + 0]];
+    dst[x * 4 + 1] = rgb[src[x * 4 + 1]];
+    dst[x * 4 + 2] = rgb[src[x * 4 + 2]];
+    dst[x * 4 + 3] = tables.decode_unorm[src[x * 4 + 3]];
+  }
+}
+
+// reference of decodeRow, no table.
+void decodeRowScalar(const unsigned char* src, u_int32_t width, float* dst,
+                     bool srgb) {
+  for (u_int32_t x = 0; x < width * 4; ++x) {
+    float c = src[x] / 255.0f;
+    bool alpha = (x & 3) == 3;
+    dst[x] = srgb && !alpha ? srgbToLinear(c) : c;
+  }
+}
+
+// average 2x2 blocks of two source rows, one float4 pixel per lane group.
+// odd source width repeats the last column.
+void downsampleRowScalar(const float* row0, const float* row1,
+                         u_int32_t src_width, float* dst,
+                         u_int32_t dst_width) {
+  for (u_int32_t x = 0; x < dst_width; ++x) {
+    u_int32_t x0 = x * 2 * 4;
+    u_int32_t x1 = std::min(x * 2 + 1, src_width - 1) * 4;
+    for (int c = 0; c < 4; ++c) {
+      dst[x * 4 + c] =
+          ((row0[x0 + c] + row0[x1 + c]) + (row1[x0 + c] + row1[x1 + c])) *
+          0.25f;
+    }
+  }
+}
+
+void downsampleRow(const float* row0, const float* row1, u_int32_t src_width,
+                   float* dst, u_int32_t dst_width) {
+#if defined(MIPMAP_USE_SSE2)
+  const __m128 quarter = _mm_set1_ps(0.25f);
+  // full 2x2 blocks, two pixels per source load pair.
+  u_int32_t full = src_width / 2;
+  for (u_int32_t x = 0; x < full; ++x) {
+    __m128 a = _mm_loadu_ps(row0 + x * 8);
+    __m128 b = _mm_loadu_ps(row0 + x * 8 + 4);
+    __m128 c = _mm_loadu_ps(row1 + x * 8);
+    __m128 d = _mm_loadu_ps(row1 + x * 8 + 4);
+    __m128 sum = _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+    _mm_storeu_ps(dst + x * 4, _mm_mul_ps(sum, quarter));
+  }
+  if (full < dst_width) {
+    downsampleRowScalar(row0 + full * 8, row1 + full * 8, src_width - full * 2,
+                        dst + full * 4, dst_width - full);
+  }
+#elif defined(MIPMAP_USE_NEON)
+  u_int32_t full = src_width / 2;
+  for (u_int32_t x = 0; x < full; ++x) {
+    float32x4_t a = vld1q_f32(row0 + x * 8);
+    float32x4_t b = vld1q_f32(row0 + x * 8 + 4);
+    float32x4_t c = vld1q_f32(row1 + x * 8);
+    float32x4_t d = vld1q_f32(row1 + x * 8 + 4);
+    float32x4_t sum = vaddq_f32(vaddq_f32(a, b), vaddq_f32(c, d));
+    vst1q_f32(dst + x * 4, vmulq_n_f32(sum, 0.25f));
+  }
+  if (full < dst_width) {
+    downsampleRowScalar(row0 + full * 8, row1 + full * 8, src_width - full * 2,
+                        dst + full * 4, dst_width - full);
+  }
+#else
+  downsampleRowScalar(row0, row1, src_width, dst, dst_width);
+#endif
+}
+
+// reference of encodeRow, no table.
+void encodeRowScalar(const float* src, u_int32_t width, unsigned char* dst,
+                     bool srgb) {
+  for (u_int32_t x = 0; x < width * 4; ++x) {
+    bool alpha = (x & 3) == 3;
+    float c = srgb && !alpha ? linearToSrgb(src[x]) : src[x];
+    dst[x] = static_cast<unsigned char>(c * 255.0f + 0.5f);
+  }
+}
+
+// linear float rgba -> 8 bit, lut index and unorm value are computed for
+// all 4 channels at once, then alpha or rgb picks one of them.
+void encodeRow(const float* src, u_int32_t width, unsigned char* dst,
+               bool srgb) {
+#if defined(MIPMAP_USE_SSE2) || defined(MIPMAP_USE_NEON)
+  const auto& tables = getGammaTables();
+  alignas(16) int32_t lut[4];
+  alignas(16) int32_t unorm[4];
+  for (u_int32_t x = 0; x < width; ++x) {
+#if defined(MIPMAP_USE_SSE2)
+    __m128 v = _mm_loadu_ps(src + x * 4);
+    __m128 half = _mm_set1_ps(0.5f);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lut),
+                    _mm_cvttps_epi32(_mm_add_ps(
+                        _mm_mul_ps(v, _mm_set1_ps(encode_steps)), half)));
+    _mm_store_si128(
+        reinterpret_cast<__m128i*>(unorm),
+        _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), half)));
+#else
+    float32x4_t v = vld1q_f32(src + x * 4);
+    float32x4_t half = vdupq_n_f32(0.5f);
+    vst1q_s32(lut, vcvtq_s32_f32(vmlaq_n_f32(half, v, encode_steps)));
+    vst1q_s32(unorm, vcvtq_s32_f32(vmlaq_n_f32(half, v, 255.0f)));
+#endif
+    unsigned char* out = dst + x * 4;
+    if (srgb) {
+      out[0] = tables.encode_srgb[lut[0]];
+      out[1] = tables.encode_srgb[lut[1]];
+      out[2] = tables.encode_srgb[lut[2]];
+    } else {
+      out[0] = static_cast<unsigned char>(unorm[0]);
+      out[1] = static_cast<unsigned char>(unorm[1]);
+      out[2] = static_cast<unsigned char>(unorm[2]);
+    }
+    out[3] = static_cast<unsigned char>(unorm[3]);
+  }
+#else
+  const auto& tables = getGammaTables();
+  for (u_int32_t x = 0; x < width * 4; ++x) {
+    bool alpha = (x & 3) == 3;
+    if (srgb && !alpha) {
+      dst[x] = tables.encode_srgb[static_cast<int32_t>(
+          src[x] * encode_steps + 0.5f)];
+    } else {
+      dst[x] = static_cast<unsigned char>(src[x] * 255.0f + 0.5f);
+    }
+  }
+#endif
+}
+
+void layoutChain(u_int32_t width, u_int32_t height, MipChain& chain) {
+  u_int32_t count = getMipLevelCount(width, height);
+  chain.levels.resize(count);
+  size_t offset = 0;
+  for (u_int32_t i = 0; i < count; ++i) {
+    chain.levels[i] = {width, height, offset};
+    offset += static_cast<size_t>(width) * height * 4;
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+  chain.pixels.resize(offset);
+}
+
+template <bool fast>
+void buildChain(const unsigned char* rgba, u_int32_t width, u_int32_t height,
+                MipChain& chain, bool srgb) {
+  layoutChain(width, height, chain);
+  memcpy(chain.pixels.data(), rgba, static_cast<size_t>(width) * height * 4);
+
+  // linear float copy of the previous and current level.
+  std::vector<float> src_linear;
+  std::vector<float> dst_linear;
+
+  for (size_t level = 1; level < chain.levels.size(); ++level) {
+    const auto& src = chain.levels[level - 1];
+    const auto& dst = chain.levels[level];
+    dst_linear.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+    const unsigned char* src_bytes = chain.pixels.data() + src.offset;
+    unsigned char* dst_bytes = chain.pixels.data() + dst.offset;
+
+    auto rows = [&](size_t begin, size_t end) {
+      // level 1 decodes its source rows from 8 bit on the fly.
+      std::vector<float> scratch;
+      if (level == 1) scratch.resize(static_cast<size_t>(src.width) * 8);
+
+      for (size_t y = begin; y < end; ++y) {
+        u_int32_t y0 = static_cast<u_int32_t>(y * 2);
+        u_int32_t y1 = std::min(y0 + 1, src.height - 1);
+        const float* row0;
+        const float* row1;
+        if (level == 1) {
+          float* r0 = scratch.data();
+          float* r1 = scratch.data() + src.width * 4;
+          auto decode = fast ? decodeRow : decodeRowScalar;
+          decode(src_bytes + static_cast<size_t>(y0) * src.width * 4,
+                 src.width, r0, srgb);
+          decode(src_bytes + static_cast<size_t>(y1) * src.width * 4,
+                 src.width, r1, srgb);
+          row0 = r0;
+          row1 = r1;
+        } else {
+          row0 = src_linear.data() + static_cast<size_t>(y0) * src.width * 4;
+          row1 = src_linear.data() + static_cast<size_t>(y1) * src.width * 4;
+        }
+
+        float* out = dst_linear.data() + y * dst.width * 4;
+        unsigned char* out_bytes = dst_bytes + y * dst.width * 4;
+        if (fast) {
+          downsampleRow(row0, row1, src.width, out, dst.width);
+          encodeRow(out, dst.width, out_bytes, srgb);
+        } else {
+          downsampleRowScalar(row0, row1, src.width, out, dst.width);
+          encodeRowScalar(out, dst.width, out_bytes, srgb);
+        }
+      }
+    };
+
+    if (fast && static_cast<size_t>(dst.width) * dst.height >=
+                    parallel_min_pixels) {
+      getGlobalThreadPool().parallelFor(dst.height, rows);
+    } else {
+      rows(0, dst.height);
+    }
+    src_linear.swap(dst_linear);
+  }
+}
+
+}  // namespace
+
+u_int32_t getMipLevelCount(u_int32_t width, u_int32_t height) {
+  u_int32_t count = 1;
+  for (u_int32_t size = std::max(width, height); size > 1; size /= 2) ++count;
+  return count;
+}
+
+void generateMipChain(const unsigned char* rgba, u_int32_t width,
+                      u_int32_t height, MipChain& chain, bool srgb) {
+  buildChain<true>(rgba, width, height, chain, srgb);
+}
+
+void generateMipChainScalar(const unsigned char* rgba, u_int32_t width,
+                            u_int32_t height, MipChain& chain, bool srgb) {
+  buildChain<false>(rgba, width, height, chain, srgb);
+}
+
+}  // namespace LLShader
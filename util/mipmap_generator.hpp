@@ -0,0 +1,46 @@
+#ifndef MIPMAP_GENERATOR_HPP
+#define MIPMAP_GENERATOR_HPP
+
+#include <cstdlib>
+#include <vector>
+
+namespace LLShader {
+
+typedef struct {
+  u_int32_t width;
+  u_int32_t height;
+  // byte offset in MipChain::pixels.
+  size_t offset;
+} MipLevel;
+
+/// rgba 32 mip levels packed tightly in one blob, level 0 first, so the whole
+/// chain can be uploaded with one staging copy.
+struct MipChain {
+  std::vector<unsigned char> pixels;
+  std::vector<MipLevel> levels;
+
+  inline u_int32_t getWidth() const { return levels.front().width; }
+  inline u_int32_t getHeight() const { return levels.front().height; }
+};
+
+/// levels of a full chain down to 1x1.
+u_int32_t getMipLevelCount(u_int32_t width, u_int32_t height);
+
+/// build the full chain of a rgba 32 image with a 2x2 box filter.
+/// srgb: rgb is averaged in linear space, alpha is always linear.
+/// each level is filtered from the float result of the previous one, so
+/// 8 bit rounding does not accumulate down the chain. rows are split over
+/// the global thread pool, the filter uses SSE2 / NEON when available.
+void generateMipChain(const unsigned char* rgba, u_int32_t width,
+                      u_int32_t height, MipChain& chain, bool srgb = true);
+
+/// reference with the same filter, single thread scalar code and exact
+/// srgb math instead of tables. the fast path differs by at most 1 per
+/// channel, bench/mipmap_check checks and times it against this one.
+void generateMipChainScalar(const unsigned char* rgba, u_int32_t width,
+                            u_int32_t height, MipChain& chain,
+                            bool srgb = true);
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,446 @@
+#include "obj_parser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "util/mapped_file.hpp"
+#include "util/thread_pool.hpp"
+
+namespace LLShader {
+
+namespace {
+
+// chunk smaller than this is not worth a task.
+constexpr size_t min_chunk_size = 256 * 1024;
+
+enum RawIndexKind : u_int8_t { kNone, kAbsolute, kChunkLocal };
+
+// raw obj index of v, vt, vn. negative obj index is stored as chunk local
+// (may be negative when point into previous chunk), resolved after all
+// chunks parsed.
+typedef struct {
+  int64_t value[3];
+  RawIndexKind kind[3];
+} RawIndex;
+
+typedef struct {
+  size_t face_count;  // number of faces before this marker
+  std::string name;
+} ShapeMarker;
+
+struct ChunkResult {
+  std::vector<float> vertices;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+
+  std::vector<RawIndex> face_indices;
+  std::vector<u_int32_t> face_sizes;
+  std::vector<ShapeMarker> markers;
+  std::vector<std::string> material_libs;
+
+  // filled by resolve pass
+  std::vector<ObjIndex> triangles;
+  std::vector<size_t> marker_offsets;
+
+  // attribute count of all previous chunks
+  int64_t vertex_base = 0;
+  int64_t texcoord_base = 0;
+  int64_t normal_base = 0;
+
+  std::string error;
+};
+
+inline bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+inline bool isLineEnd(char c) { return c == '\n' || c == '\r'; }
+
+inline void skipSpace(const char*& p, const char* end) {
+  while (p < end && isSpace(*p)) ++p;
+}
+
+inline void skipToken(const char*& p, const char* end) {
+  while (p < end && !isSpace(*p) && !isLineEnd(*p)) ++p;
+}
+
+bool parseInt(const char*& p, const char* end, int64_t& out) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  if (p >= end || *p < '0' || *p > '9') return false;
+  int64_t value = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p - '0');
+    ++p;
+  }
+  out = negative ? -value : value;
+  return true;
+}
+
+// strtod is locale dependent and slow, from_chars for float is missing on
+// older libc++, so parse the common decimal / exponent forms here.
+bool parseFloat(const char*& p, const char* end, float& out) {
+  static const double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18};
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  u_int64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  bool any = false;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (digits < 18) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa) ++digits;
+    } else {
+      ++exponent;
+    }
+    any = true;
+    ++p;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (digits < 18) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa) ++digits;
+        --exponent;
+      }
+      any = true;
+      ++p;
+    }
+  }
+  if (!any) return false;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    int64_t e;
+    if (parseInt(q, end, e)) {
+      e = std::max<int64_t>(-400, std::min<int64_t>(e, 400));
+      exponent += static_cast<int>(e);
+      p = q;
+    }
+  }
+
+  double value = static_cast<double>(mantissa);
+  if (exponent > 0) {
+    value *= exponent <= 18 ? pow10[exponent] : std::pow(10.0, exponent);
+  } else if (exponent < 0) {
+    value /= -exponent <= 18 ? pow10[-exponent] : std::pow(10.0, -exponent);
+  }
+  out = static_cast<float>(negative ? -value : value);
+  return true;
+}
+
+// read up to `count` floats, missing trailing values keep default.
+int parseFloats(const char*& p, const char* end, float* out, int count) {
+  int n = 0;
+  for (; n < count; ++n) {
+    skipSpace(p, end);
+    if (!parseFloat(p, end, out[n])) break;
+  }
+  return n;
+}
+
+// rest of the line without trailing spaces.
+std::string parseName(const char* p, const char* end) {
+  skipSpace(p, end);
+  const char* q = end;
+  while (q > p && isSpace(q[-1])) --q;
+  return std::string(p, q);
+}
+
+// one `v/vt/vn` token, local counts turn negative index into chunk local.
+bool parseFaceIndex(const char*& p, const char* end, const ChunkResult& chunk,
+                    RawIndex& index) {
+  const int64_t counts[3] = {
+      static_cast<int64_t>(chunk.vertices.size() / 3),
+      static_cast<int64_t>(chunk.texcoords.size() / 2),
+      static_cast<int64_t>(chunk.normals.size() / 3)};
+  for (int k = 0; k < 3; ++k) {
+    index.kind[k] = kNone;
+    if (k > 0) {
+      if (p >= end || *p != '/') continue;
+      ++p;
+    }
+    int64_t value;
+    if (!parseInt(p, end, value)) {
+      if (k == 0) return false;
+      continue;
+    }
+    if (value == 0) return false;
+    if (value > 0) {
+      index.kind[k] = kAbsolute;
+      index.value[k] = value - 1;
+    } else {
+      index.kind[k] = kChunkLocal;
+      index.value[k] = counts[k] + value;
+    }
+  }
+  return true;
+}
+
+void parseLine(const char* p, const char* end, ChunkResult& chunk) {
+  skipSpace(p, end);
+  if (p >= end || *p == '#') return;
+
+  const char* key = p;
+  skipToken(p, end);
+  size_t key_size = p - key;
+
+  if (key_size == 1 && key[0] == 'v') {
+    float v[3] = {0.0f, 0.0f, 0.0f};
+    parseFloats(p, end, v, 3);
+    chunk.vertices.insert(chunk.vertices.end(), v, v + 3);
+  } else if (key_size == 2 && key[0] == 'v' && key[1] == 'n') {
+    float v[3] = {0.0f, 0.0f, 0.0f};
+    parseFloats(p, end, v, 3);
+    chunk.normals.insert(chunk.normals.end(), v, v + 3);
+  } else if (key_size == 2 && key[0] == 'v' && key[1] == 't') {
+    float v[2] = {0.0f, 0.0f};
+    parseFloats(p, end, v, 2);
+    chunk.texcoords.insert(chunk.texcoords.end(), v, v + 2);
+  } else if (key_size == 1 && key[0] == 'f') {
+    u_int32_t size = 0;
+    for (;;) {
+      skipSpace(p, end);
+      if (p >= end) break;
+      RawIndex index;
+      if (!parseFaceIndex(p, end, chunk, index)) {
+        if (chunk.error.empty())
+          chunk.error = "invalid face: " + std::string(key, end);
+        return;
+      }
+      chunk.face_indices.push_back(index);
+      ++size;
+    }
+    if (size < 3) {
+      // degenerated face, tinyobj drop it too.
+      chunk.face_indices.resize(chunk.face_indices.size() - size);
+      return;
+    }
+    chunk.face_sizes.push_back(size);
+  } else if (key_size == 1 && (key[0] == 'o' || key[0] == 'g')) {
+    chunk.markers.push_back({chunk.face_sizes.size(), parseName(p, end)});
+  } else if (key_size == 6 && std::string(key, key_size) == "mtllib") {
+    for (;;) {
+      skipSpace(p, end);
+      if (p >= end) break;
+      const char* name = p;
+      skipToken(p, end);
+      chunk.material_libs.emplace_back(name, p);
+    }
+  }
+}
+
+void parseChunk(const char* p, const char* end, ChunkResult& chunk) {
+  while (p < end) {
+    const char* line_end = p;
+    while (line_end < end && !isLineEnd(*line_end)) ++line_end;
+    parseLine(p, line_end, chunk);
+    if (!chunk.error.empty()) return;
+    p = line_end;
+    while (p < end && isLineEnd(*p)) ++p;
+  }
+}
+
+bool resolveIndex(const RawIndex& raw, const ChunkResult& chunk,
+                  const size_t counts[3], ObjIndex& index) {
+  const int64_t bases[3] = {chunk.vertex_base, chunk.texcoord_base,
+                            chunk.normal_base};
+  int32_t* outs[3] = {&index.vertex_index, &index.texcoord_index,
+                      &index.normal_index};
+  for (int k = 0; k < 3; ++k) {
+    if (raw.kind[k] == kNone) {
+      *outs[k] = -1;
+      continue;
+    }
+    int64_t value = raw.value[k];
+    if (raw.kind[k] == kChunkLocal) value += bases[k];
+    if (value < 0 || value >= static_cast<int64_t>(counts[k])) return false;
+    *outs[k] = static_cast<int32_t>(value);
+  }
+  return true;
+}
+
+inline float distance2(const std::vector<float>& v, int32_t a, int32_t b) {
+  float dx = v[a * 3 + 0] - v[b * 3 + 0];
+  float dy = v[a * 3 + 1] - v[b * 3 + 1];
+  float dz = v[a * 3 + 2] - v[b * 3 + 2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+void resolveChunk(ChunkResult& chunk, const ObjData& data) {
+  const size_t counts[3] = {data.vertices.size() / 3,
+                            data.texcoords.size() / 2,
+                            data.normals.size() / 3};
+  size_t triangle_count = 0;
+  for (auto size : chunk.face_sizes) triangle_count += size - 2;
+  chunk.triangles.reserve(triangle_count * 3);
+  chunk.marker_offsets.reserve(chunk.markers.size());
+
+  std::vector<ObjIndex> polygon;
+  size_t next_marker = 0;
+  size_t cursor = 0;
+  for (size_t face = 0; face < chunk.face_sizes.size(); ++face) {
+    while (next_marker < chunk.markers.size() &&
+           chunk.markers[next_marker].face_count == face) {
+      chunk.marker_offsets.push_back(chunk.triangles.size());
+      ++next_marker;
+    }
+
+    u_int32_t size = chunk.face_sizes[face];
+    polygon.resize(size);
+    for (u_int32_t i = 0; i < size; ++i) {
+      if (!resolveIndex(chunk.face_indices[cursor + i], chunk, counts,
+                        polygon[i])) {
+        chunk.error = "face index out of range";
+        return;
+      }
+    }
+    cursor += size;
+
+    if (size == 4) {
+      // split along the shorter diagonal.
+      float d02 = distance2(data.vertices, polygon[0].vertex_index,
+                            polygon[2].vertex_index);
+      float d13 = distance2(data.vertices, polygon[1].vertex_index,
+                            polygon[3].vertex_index);
+      if (d02 < d13) {
+        chunk.triangles.insert(chunk.triangles.end(),
+                               {polygon[0], polygon[1], polygon[2], polygon[0],
+                                polygon[2], polygon[3]});
+      } else {
+        chunk.triangles.insert(chunk.triangles.end(),
+                               {polygon[0], polygon[1], polygon[3], polygon[1],
+                                polygon[2], polygon[3]});
+      }
+    } else {
+      for (u_int32_t i = 1; i + 1 < size; ++i) {
+        chunk.triangles.insert(chunk.triangles.end(),
+                               {polygon[0], polygon[i], polygon[i + 1]});
+      }
+    }
+  }
+  while (next_marker < chunk.markers.size()) {
+    chunk.marker_offsets.push_back(chunk.triangles.size());
+    ++next_marker;
+  }
+
+  // raw data is no longer needed.
+  std::vector<RawIndex>().swap(chunk.face_indices);
+  std::vector<u_int32_t>().swap(chunk.face_sizes);
+}
+
+template <typename T>
+void appendChunks(std::vector<ChunkResult>& chunks,
+                  std::vector<T> ChunkResult::*member, std::vector<T>& out) {
+  size_t total = 0;
+  for (auto& chunk : chunks) total += (chunk.*member).size();
+  out.clear();
+  out.reserve(total);
+  for (auto& chunk : chunks) {
+    out.insert(out.end(), (chunk.*member).begin(), (chunk.*member).end());
+    std::vector<T>().swap(chunk.*member);
+  }
+}
+
+}  // namespace
+
+void parseObjFile(const std::string& file, ObjData& data) {
+  MappedFile mapped;
+  if (!mapped.open(file)) {
+    throw std::runtime_error("failed to open obj file: " + file);
+  }
+
+  const char* begin = reinterpret_cast<const char*>(mapped.data());
+  const char* end = begin + mapped.size();
+
+  // newline aligned chunk boundaries.
+  auto& pool = getGlobalThreadPool();
+  size_t chunk_count = std::max<size_t>(
+      1, std::min(pool.getWorkerCount() * 4, mapped.size() / min_chunk_size));
+  std::vector<const char*> bounds;
+  bounds.push_back(begin);
+  for (size_t i = 1; i < chunk_count; ++i) {
+    const char* p = begin + mapped.size() * i / chunk_count;
+    if (p < bounds.back()) p = bounds.back();
+    while (p < end && *p != '\n') ++p;
+    if (p < end) ++p;
+    bounds.push_back(p);
+  }
+  bounds.push_back(end);
+
+  std::vector<ChunkResult> chunks(chunk_count);
+  pool.parallelFor(chunk_count, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      parseChunk(bounds[i], bounds[i + 1], chunks[i]);
+    }
+  });
+
+  for (size_t i = 0; i < chunk_count; ++i) {
+    if (!chunks[i].error.empty()) {
+      throw std::runtime_error(file + ": " + chunks[i].error);
+    }
+    if (i > 0) {
+      const auto& prev = chunks[i - 1];
+      chunks[i].vertex_base =
+          prev.vertex_base + static_cast<int64_t>(prev.vertices.size() / 3);
+      chunks[i].texcoord_base =
+          prev.texcoord_base + static_cast<int64_t>(prev.texcoords.size() / 2);
+      chunks[i].normal_base =
+          prev.normal_base + static_cast<int64_t>(prev.normals.size() / 3);
+    }
+  }
+
+  appendChunks(chunks, &ChunkResult::vertices, data.vertices);
+  appendChunks(chunks, &ChunkResult::normals, data.normals);
+  appendChunks(chunks, &ChunkResult::texcoords, data.texcoords);
+
+  pool.parallelFor(chunk_count, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) resolveChunk(chunks[i], data);
+  });
+
+  for (const auto& chunk : chunks) {
+    if (!chunk.error.empty()) {
+      throw std::runtime_error(file + ": " + chunk.error);
+    }
+  }
+
+  // stitch shapes, a marker only opens a new shape when current one has
+  // faces, empty shapes are dropped like tinyobj does.
+  data.shapes.clear();
+  data.material_libs.clear();
+  data.shapes.emplace_back();
+  for (auto& chunk : chunks) {
+    size_t copied = 0;
+    for (size_t m = 0; m <= chunk.markers.size(); ++m) {
+      size_t until = m < chunk.markers.size() ? chunk.marker_offsets[m]
+                                              : chunk.triangles.size();
+      auto& indices = data.shapes.back().indices;
+      indices.insert(indices.end(), chunk.triangles.begin() + copied,
+                     chunk.triangles.begin() + until);
+      copied = until;
+
+      if (m < chunk.markers.size()) {
+        if (!data.shapes.back().indices.empty()) data.shapes.emplace_back();
+        data.shapes.back().name = chunk.markers[m].name;
+      }
+    }
+    std::vector<ObjIndex>().swap(chunk.triangles);
+    data.material_libs.insert(data.material_libs.end(),
+                              chunk.material_libs.begin(),
+                              chunk.material_libs.end());
+  }
+  if (data.shapes.back().indices.empty()) data.shapes.pop_back();
+}
+
+}  // namespace LLShader
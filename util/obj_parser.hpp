@@ -0,0 +1,42 @@
+#ifndef OBJ_PARSER_HPP
+#define OBJ_PARSER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace LLShader {
+
+/// zero based, -1 if not exist. same meaning as tinyobj::index_t.
+typedef struct {
+  int32_t vertex_index;
+  int32_t texcoord_index;
+  int32_t normal_index;
+} ObjIndex;
+
+/// triangulated face indices of one `o` / `g` block.
+struct ObjShape {
+  std::string name;
+  std::vector<ObjIndex> indices;
+};
+
+/// flat attribute arrays, layout same as tinyobj::attrib_t.
+struct ObjData {
+  std::vector<float> vertices;   // xyz
+  std::vector<float> normals;    // xyz
+  std::vector<float> texcoords;  // uv
+  std::vector<ObjShape> shapes;
+  std::vector<std::string> material_libs;
+};
+
+/// Native obj parser used on the asset load path.
+/// The file is mapped and splitted into newline aligned chunks, chunks are
+/// parsed in parallel on the global thread pool then merged in file order.
+/// Only v/vn/vt/f/o/g/mtllib records are read, polygons are triangulated
+/// like tinyobj (quads split along the shorter diagonal, others as fan).
+/// throw std::runtime_error if file can not be read or is malformed.
+void parseObjFile(const std::string& file, ObjData& data);
+
+}  // namespace LLShader
+
+#endif
@@ -1,5 +1,8 @@
 #include "shader_compiler_helper.hpp"
 
+#include <fstream>
+#include <sstream>
+
 namespace LLShader{
 
     std::string preprocessGlslShader(   const std::string& source_name,
@@ -85,4 +88,49 @@ namespace LLShader{
         return {module.cbegin(), module.cend()};
     }
 
-}
\ No newline at end of file
+
+    namespace {
+        // keep name and content alive until ReleaseInclude.
+        struct IncludeData{
+            shaderc_include_result result;
+            std::string name;
+            std::string content;
+        };
+    }
+
+    shaderc_include_result* ShaderFileIncluder::GetInclude(const char* requested_source,
+                                                           shaderc_include_type type,
+                                                           const char* requesting_source,
+                                                           size_t include_depth){
+        auto* data = new IncludeData();
+        std::string requesting(requesting_source);
+        std::string dir;
+        auto slash = requesting.find_last_of('/');
+        if(type == shaderc_include_type_relative && slash != std::string::npos){
+            dir = requesting.substr(0, slash + 1);
+        }
+        data->name = dir + requested_source;
+
+        std::ifstream in(data->name);
+        if(in.is_open()){
+            std::stringstream ss;
+            ss << in.rdbuf();
+            data->content = ss.str();
+        }else{
+            // empty source name means failure, content is the error message.
+            data->content = "can not open include file " + data->name;
+            data->name.clear();
+        }
+
+        data->result.source_name = data->name.c_str();
+        data->result.source_name_length = data->name.size();
+        data->result.content = data->content.c_str();
+        data->result.content_length = data->content.size();
+        data->result.user_data = data;
+        return &data->result;
+    }
+
+    void ShaderFileIncluder::ReleaseInclude(shaderc_include_result* data){
+        delete static_cast<IncludeData*>(data->user_data);
+    }
+}
@@ -41,6 +41,17 @@ namespace LLShader{
     std::string preprocessGlslShader(   const std::string& source_name,
                                         shaderc_shader_kind kind,
                                         const std::vector<char>& source);
+
+    /// 处理 #include "xxx", 路径相对于发起 include 的 shader 文件
+    class ShaderFileIncluder : public shaderc::CompileOptions::IncluderInterface{
+    public:
+        shaderc_include_result* GetInclude(const char* requested_source,
+                                           shaderc_include_type type,
+                                           const char* requesting_source,
+                                           size_t include_depth) override;
+
+        void ReleaseInclude(shaderc_include_result* data) override;
+    };
 }
 
 #endif
\ No newline at end of file
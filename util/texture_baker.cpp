@@ -0,0 +1,64 @@
+#include "texture_baker.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+#include "3rd/stb/stb_image.h"
+#include "log/log.hpp"
+#include "util/ktx2.hpp"
+
+namespace LLShader {
+
+bool bakeTexture(const std::string& source, const std::string& ktx2_file,
+                 BlockFormat format, bool srgb) {
+  int width, height, tex_channel;
+  stbi_uc* pixels =
+      stbi_load(source.c_str(), &width, &height, &tex_channel, STBI_rgb_alpha);
+  if (!pixels) {
+    LogUtil::LogE("failed to load " + source + '\n');
+    return false;
+  }
+
+  MipChain mips;
+  generateMipChain(pixels, width, height, mips, srgb);
+  stbi_image_free(pixels);
+
+  auto begin = std::chrono::steady_clock::now();
+  CompressedMipChain chain;
+  compressMipChain(mips, format, srgb, chain);
+  auto end = std::chrono::steady_clock::now();
+
+  if (!writeKtx2(ktx2_file, chain)) return false;
+
+  // quality of level 0, the level the eye sees most.
+  MipChain decoded;
+  decompressMipChain(chain, decoded);
+  bool has_alpha = format != BlockFormat::kBC1;
+  double psnr = computePsnr(mips.pixels.data(), decoded.pixels.data(),
+                            static_cast<size_t>(width) * height, has_alpha);
+
+  double seconds = std::chrono::duration<double>(end - begin).count();
+  double mpix = mips.pixels.size() / 4 / 1e6;
+  char info[256];
+  snprintf(info, sizeof(info),
+           "%s %dx%d %zu levels, %zu -> %zu bytes, psnr %.2f dB, "
+           "%.2f Mpix/s\n",
+           getBlockFormatName(format), width, height, chain.levels.size(),
+           mips.pixels.size(), chain.blocks.size(), psnr,
+           seconds > 0 ? mpix / seconds : 0.0);
+  LogUtil::LogI("baked " + ktx2_file + ": " + info);
+  return true;
+}
+
+bool parseBlockFormat(const std::string& name, BlockFormat& format) {
+  for (auto candidate :
+       {BlockFormat::kBC1, BlockFormat::kBC3, BlockFormat::kBC7}) {
+    if (name == getBlockFormatName(candidate)) {
+      format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace LLShader
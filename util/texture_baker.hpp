@@ -0,0 +1,22 @@
+#ifndef TEXTURE_BAKER_HPP
+#define TEXTURE_BAKER_HPP
+
+#include <string>
+
+#include "util/bc_encoder.hpp"
+
+namespace LLShader {
+
+/// Offline texture bake: decode an image, build the full mip chain, block
+/// compress every level on the thread pool and write a KTX2 file that
+/// RenderManager uploads without touching the pixels.
+/// log level count, size, level 0 psnr and encode throughput.
+bool bakeTexture(const std::string& source, const std::string& ktx2_file,
+                 BlockFormat format = BlockFormat::kBC7, bool srgb = true);
+
+/// parse "bc1" / "bc3" / "bc7", return false on other names.
+bool parseBlockFormat(const std::string& name, BlockFormat& format);
+
+}  // namespace LLShader
+
+#endif
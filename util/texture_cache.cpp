@@ -0,0 +1,186 @@
+#include "texture_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "log/log.hpp"
+#include "util/hash.hpp"
+
+namespace LLShader {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr char cache_magic[8] = {'L', 'L', 'T', 'E', 'X', 'C', '\0', '\0'};
+constexpr char cache_suffix[] = ".texcache";
+
+inline u_int64_t alignUp(u_int64_t v, u_int64_t alignment) {
+  return (v + alignment - 1) & ~(alignment - 1);
+}
+
+}  // namespace
+
+TextureCache::TextureCache(std::string directory, u_int64_t capacity)
+    : directory_(std::move(directory)), capacity_(capacity) {}
+
+bool TextureCache::computeKey(const std::string& source, bool mipmapped,
+                              bool srgb, u_int64_t& key) {
+  MappedFile file;
+  if (!file.open(source)) return false;
+  key = hashBytes(file.data(), file.size());
+  key = hashCombine(key, texture_cache_version);
+  key = hashCombine(key, (mipmapped ? 1 : 0) | (srgb ? 2 : 0));
+  return true;
+}
+
+std::string TextureCache::getEntryPath(u_int64_t key) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(key));
+  return directory_ + '/' + name + cache_suffix;
+}
+
+bool TextureCache::load(u_int64_t key, TextureCacheEntry& entry) {
+  auto path = getEntryPath(key);
+  auto& cache = entry.file;
+  if (!cache.open(path)) return false;
+
+  auto reject = [&] {
+    LogUtil::LogW("drop broken texture cache " + path + '\n');
+    cache.close();
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::remove(path.c_str());
+    return false;
+  };
+
+  if (cache.size() < sizeof(TextureCacheHeader)) return reject();
+  TextureCacheHeader header;
+  memcpy(&header, cache.data(), sizeof(header));
+  if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 ||
+      header.version != texture_cache_version || header.key != key ||
+      header.file_size != cache.size() || header.level_count == 0 ||
+      sizeof(TextureCacheHeader) +
+              header.level_count * sizeof(TextureCacheLevel) >
+          header.pixel_offset ||
+      header.pixel_offset + header.pixel_size > cache.size()) {
+    return reject();
+  }
+
+  entry.levels.resize(header.level_count);
+  for (u_int32_t i = 0; i < header.level_count; ++i) {
+    TextureCacheLevel level;
+    memcpy(&level,
+           cache.data() + sizeof(TextureCacheHeader) + i * sizeof(level),
+           sizeof(level));
+    if (level.offset + static_cast<u_int64_t>(level.width) * level.height * 4 >
+        header.pixel_size) {
+      return reject();
+    }
+    entry.levels[i] = {level.width, level.height, level.offset};
+  }
+  entry.pixels = cache.data() + header.pixel_offset;
+  entry.size = header.pixel_size;
+
+  // refresh lru order, failure only makes the entry older.
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  return true;
+}
+
+bool TextureCache::store(u_int64_t key, const MipChain& mips) {
+  TextureCacheHeader header{};
+  memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.version = texture_cache_version;
+  header.level_count = mips.levels.size();
+  header.key = key;
+  header.pixel_offset =
+      alignUp(sizeof(TextureCacheHeader) +
+                  header.level_count * sizeof(TextureCacheLevel),
+              64);
+  header.pixel_size = mips.pixels.size();
+  header.file_size = header.pixel_offset + header.pixel_size;
+
+  std::vector<TextureCacheLevel> levels(header.level_count);
+  for (size_t i = 0; i < levels.size(); ++i) {
+    levels[i] = {mips.levels[i].width, mips.levels[i].height,
+                 mips.levels[i].offset};
+  }
+
+  std::lock_guard<std::mutex> lock(write_mutex_);
+
+  std::error_code ec;
+  fs::create_directories(directory_, ec);
+
+  // write to temp file then rename, so a reader never see a half file.
+  auto path = getEntryPath(key);
+  auto temp_path = path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    const char padding[64] = {};
+    size_t table_end =
+        sizeof(TextureCacheHeader) + levels.size() * sizeof(TextureCacheLevel);
+    if (!out.is_open() ||
+        !out.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !out.write(reinterpret_cast<const char*>(levels.data()),
+                   levels.size() * sizeof(TextureCacheLevel)) ||
+        !out.write(padding, header.pixel_offset - table_end) ||
+        !out.write(reinterpret_cast<const char*>(mips.pixels.data()),
+                   mips.pixels.size())) {
+      LogUtil::LogW("failed to write texture cache " + temp_path + '\n');
+      out.close();
+      std::remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    LogUtil::LogW("failed to write texture cache " + path + '\n');
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  evictLocked();
+  return true;
+}
+
+void TextureCache::evict() {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  evictLocked();
+}
+
+void TextureCache::evictLocked() {
+  typedef struct {
+    fs::path path;
+    fs::file_time_type time;
+    u_int64_t size;
+  } CacheFile;
+
+  std::vector<CacheFile> files;
+  u_int64_t total = 0;
+  std::error_code ec;
+  for (const auto& item : fs::directory_iterator(directory_, ec)) {
+    if (!item.is_regular_file(ec) || item.path().extension() != cache_suffix)
+      continue;
+    CacheFile file{item.path(), item.last_write_time(ec), item.file_size(ec)};
+    if (ec) continue;
+    total += file.size;
+    files.push_back(std::move(file));
+  }
+  if (total <= capacity_) return;
+
+  std::sort(files.begin(), files.end(),
+            [](const CacheFile& a, const CacheFile& b) {
+              return a.time < b.time;
+            });
+  // a mapped entry stays readable after its file is removed.
+  for (const auto& file : files) {
+    if (total <= capacity_) break;
+    if (fs::remove(file.path, ec)) total -= file.size;
+  }
+}
+
+}  // namespace LLShader
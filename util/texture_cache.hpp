@@ -0,0 +1,102 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "util/mapped_file.hpp"
+#include "util/mipmap_generator.hpp"
+
+namespace LLShader {
+
+/// Decoded texture cache file, one per key, named <key in hex>.texcache.
+/// layout:
+///   TextureCacheHeader
+///   TextureCacheLevel[level_count]
+///   rgba 32 pixels of all levels (64 aligned), same packing as MipChain
+/// bump the version when layout or the mip filter changed.
+constexpr u_int32_t texture_cache_version = 1;
+
+typedef struct {
+  char magic[8];
+  u_int32_t version;
+  u_int32_t level_count;
+  u_int64_t key;
+  u_int64_t pixel_offset;
+  u_int64_t pixel_size;
+  // whole cache file size, reject truncated file.
+  u_int64_t file_size;
+} TextureCacheHeader;
+
+typedef struct {
+  u_int32_t width;
+  u_int32_t height;
+  // byte offset from pixel_offset.
+  u_int64_t offset;
+} TextureCacheLevel;
+
+/// a mapped cache file, pixels point into the mapping and can be copied
+/// into a staging buffer directly. valid while the entry lives.
+struct TextureCacheEntry {
+  MappedFile file;
+  const unsigned char* pixels{nullptr};
+  size_t size{0};
+  std::vector<MipLevel> levels;
+};
+
+/// Persistent cache of decoded textures, so repeat launches skip the png
+/// inflate and the mip generation.
+/// entries are keyed by the content hash of the source file plus the load
+/// options, so renamed or touched files still hit and edited files miss.
+/// least recently used entries are evicted once the directory grows over
+/// capacity, a hit refreshes the entry's modify time.
+/// thread safe, loads may run in parallel.
+class TextureCache final {
+ public:
+  static constexpr u_int64_t default_capacity = 512ull << 20;
+
+  explicit TextureCache(std::string directory,
+                        u_int64_t capacity = default_capacity);
+
+  TextureCache(const TextureCache&) = delete;
+
+  /// hash source content with the options which change the pixels.
+  /// return false if source can not be read.
+  static bool computeKey(const std::string& source, bool mipmapped,
+                         bool srgb, u_int64_t& key);
+
+  /// map the entry of key. return false on miss or broken entry, which is
+  /// removed.
+  bool load(u_int64_t key, TextureCacheEntry& entry);
+
+  /// write mips under key then evict down to capacity. failure only logs a
+  /// warning.
+  bool store(u_int64_t key, const MipChain& mips);
+
+  /// remove least recently used entries until total size fits capacity.
+  void evict();
+
+  inline const std::string& getDirectory() const { return directory_; }
+
+ private:
+  std::string getEntryPath(u_int64_t key) const;
+  // caller holds write_mutex_.
+  void evictLocked();
+
+  std::string directory_;
+  u_int64_t capacity_;
+
+  // store & evict touch the directory, loads only map single files.
+  std::mutex write_mutex_;
+};
+
+/// shared cache under cache/textures of the working directory.
+inline TextureCache& getGlobalTextureCache() {
+  static TextureCache cache("cache/textures");
+  return cache;
+}
+
+}  // namespace LLShader
+
+#endif
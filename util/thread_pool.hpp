@@ -0,0 +1,145 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LLShader {
+
+/// Fixed size worker pool.
+/// parallelFor() let the calling thread execute queued tasks while waiting,
+/// so a task running on the pool can use parallelFor() without deadlock.
+class ThreadPool final {
+ public:
+  explicit ThreadPool(size_t worker_count) {
+    worker_count = std::max<size_t>(worker_count, 1);
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+      workers_.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  inline size_t getWorkerCount() const { return workers_.size(); }
+
+  template <typename F>
+  auto submit(F&& func) -> std::future<decltype(func())> {
+    using R = decltype(func());
+    auto task =
+        std::make_shared<std::packaged_task<R()>>(std::forward<F>(func));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace_back([task] { (*task)(); });
+    }
+    cv_.notify_one();
+    return future;
+  }
+
+  /// call func(begin, end) over [0, count) splitted into at most
+  /// getWorkerCount() + 1 ranges, return after all ranges done. if ranges
+  /// throw, the first exception is rethrown here, still after all of them
+  /// finished since they reference this stack frame.
+  void parallelFor(size_t count,
+                   const std::function<void(size_t, size_t)>& func) {
+    if (count == 0) return;
+    size_t parts = std::min(count, getWorkerCount() + 1);
+    size_t step = (count + parts - 1) / parts;
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto run = [&func, &error, &error_mutex](size_t begin, size_t end) {
+      try {
+        func(begin, end);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) error = std::current_exception();
+      }
+    };
+
+    std::atomic<size_t> remaining{0};
+    for (size_t begin = step; begin < count; begin += step) {
+      size_t end = std::min(begin + step, count);
+      remaining.fetch_add(1, std::memory_order_relaxed);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace_back([&run, &remaining, begin, end] {
+          run(begin, end);
+          remaining.fetch_sub(1, std::memory_order_release);
+        });
+      }
+      cv_.notify_one();
+    }
+
+    run(0, std::min(step, count));
+
+    // help others instead of blocking.
+    while (remaining.load(std::memory_order_acquire) > 0) {
+      if (!runPendingTask()) std::this_thread::yield();
+    }
+    if (error) std::rethrow_exception(error);
+  }
+
+ private:
+  bool runPendingTask() {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tasks_.empty()) return false;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+    return true;
+  }
+
+  void workerLoop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_{false};
+};
+
+/// pool shared by asset loading code, keep one core for caller.
+inline ThreadPool& getGlobalThreadPool() {
+  static ThreadPool pool(
+      std::max(std::thread::hardware_concurrency(), 2u) - 1);
+  return pool;
+}
+
+}  // namespace LLShader
+
+#endif
@@ -0,0 +1,210 @@
+#include "tlsf_allocator.hpp"
+
+namespace LLShader {
+
+namespace {
+
+inline u_int32_t findMsb(u_int64_t v) { return 63 - __builtin_clzll(v); }
+
+inline u_int32_t findLsb(u_int64_t v) { return __builtin_ctzll(v); }
+
+}  // namespace
+
+TlsfAllocator::TlsfAllocator(u_int64_t size) : size_(size) {
+  for (auto& fl : heads_) {
+    for (auto& head : fl) head = invalid_node;
+  }
+  // the node at offset 0 is never merged away, validate() starts from it.
+  if (size_ > 0) insertFree(newNode(0, size_));
+}
+
+void TlsfAllocator::mapping(u_int64_t size, u_int32_t& fl, u_int32_t& sl) {
+  if (size < small_size) {
+    fl = 0;
+    sl = static_cast<u_int32_t>(size >> (small_log2 - sl_log2));
+    return;
+  }
+  u_int32_t msb = findMsb(size);
+  fl = msb - small_log2 + 1;
+  sl = static_cast<u_int32_t>(size >> (msb - sl_log2)) & (sl_count - 1);
+}
+
+u_int32_t TlsfAllocator::findFree(u_int64_t size) const {
+  // round up to the next class, so any range of the found list fits.
+  u_int64_t round = size < small_size
+                        ? (1ull << (small_log2 - sl_log2)) - 1
+                        : (1ull << (findMsb(size) - sl_log2)) - 1;
+  if (size > ~0ull - round) return invalid_node;
+  u_int32_t fl, sl;
+  mapping(size + round, fl, sl);
+
+  u_int32_t sl_map = sl_bitmap_[fl] & (~0u << sl);
+  if (sl_map == 0) {
+    if (fl + 1 >= fl_count) return invalid_node;
+    u_int64_t fl_map = fl_bitmap_ & (~0ull << (fl + 1));
+    if (fl_map == 0) return invalid_node;
+    fl = findLsb(fl_map);
+    sl_map = sl_bitmap_[fl];
+  }
+  return heads_[fl][findLsb(sl_map)];
+}
+
+u_int32_t TlsfAllocator::newNode(u_int64_t offset, u_int64_t size) {
+  u_int32_t index;
+  if (!recycled_nodes_.empty()) {
+    index = recycled_nodes_.back();
+    recycled_nodes_.pop_back();
+  } else {
+    index = static_cast<u_int32_t>(nodes_.size());
+    nodes_.emplace_back();
+  }
+  nodes_[index] = {offset,       size,         invalid_node, invalid_node,
+                   invalid_node, invalid_node, false};
+  return index;
+}
+
+void TlsfAllocator::insertFree(u_int32_t node) {
+  u_int32_t fl, sl;
+  mapping(nodes_[node].size, fl, sl);
+  u_int32_t head = heads_[fl][sl];
+  nodes_[node].prev_free = invalid_node;
+  nodes_[node].next_free = head;
+  if (head != invalid_node) nodes_[head].prev_free = node;
+  heads_[fl][sl] = node;
+  fl_bitmap_ |= 1ull << fl;
+  sl_bitmap_[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::removeFree(u_int32_t node) {
+  u_int32_t fl, sl;
+  mapping(nodes_[node].size, fl, sl);
+  const auto& n = nodes_[node];
+  if (n.prev_free != invalid_node) {
+    nodes_[n.prev_free].next_free = n.next_free;
+  } else {
+    heads_[fl][sl] = n.next_free;
+  }
+  if (n.next_free != invalid_node) nodes_[n.next_free].prev_free = n.prev_free;
+
+  if (heads_[fl][sl] == invalid_node) {
+    sl_bitmap_[fl] &= ~(1u << sl);
+    if (sl_bitmap_[fl] == 0) fl_bitmap_ &= ~(1ull << fl);
+  }
+}
+
+void TlsfAllocator::splitTail(u_int32_t node, u_int64_t size) {
+  u_int32_t tail =
+      newNode(nodes_[node].offset + size, nodes_[node].size - size);
+  auto& n = nodes_[node];
+  auto& t = nodes_[tail];
+  n.size = size;
+  t.prev_phys = node;
+  t.next_phys = n.next_phys;
+  if (n.next_phys != invalid_node) nodes_[n.next_phys].prev_phys = tail;
+  n.next_phys = tail;
+}
+
+void TlsfAllocator::mergeNext(u_int32_t node) {
+  u_int32_t next = nodes_[node].next_phys;
+  auto& n = nodes_[node];
+  const auto& m = nodes_[next];
+  n.size += m.size;
+  n.next_phys = m.next_phys;
+  if (m.next_phys != invalid_node) nodes_[m.next_phys].prev_phys = node;
+  recycled_nodes_.push_back(next);
+}
+
+bool TlsfAllocator::allocate(u_int64_t size, u_int64_t alignment,
+                             u_int64_t& offset, u_int32_t& node) {
+  if (size == 0) size = 1;
+  if (alignment == 0) alignment = 1;
+  u_int32_t found = findFree(size + alignment - 1);
+  if (found == invalid_node) return false;
+  removeFree(found);
+
+  // the front padding stays a free range. neighbours of a free range are
+  // always used, so it can not be merged here.
+  u_int64_t aligned =
+      (nodes_[found].offset + alignment - 1) & ~(alignment - 1);
+  u_int64_t padding = aligned - nodes_[found].offset;
+  if (padding > 0) {
+    splitTail(found, padding);
+    insertFree(found);
+    found = nodes_[found].next_phys;
+  }
+  if (nodes_[found].size > size) {
+    splitTail(found, size);
+    insertFree(nodes_[found].next_phys);
+  }
+
+  nodes_[found].used = true;
+  used_bytes_ += size;
+  ++allocation_count_;
+  offset = aligned;
+  node = found;
+  return true;
+}
+
+void TlsfAllocator::free(u_int32_t node) {
+  nodes_[node].used = false;
+  used_bytes_ -= nodes_[node].size;
+  --allocation_count_;
+
+  u_int32_t next = nodes_[node].next_phys;
+  if (next != invalid_node && !nodes_[next].used) {
+    removeFree(next);
+    mergeNext(node);
+  }
+  u_int32_t prev = nodes_[node].prev_phys;
+  if (prev != invalid_node && !nodes_[prev].used) {
+    removeFree(prev);
+    mergeNext(prev);
+    node = prev;
+  }
+  insertFree(node);
+}
+
+bool TlsfAllocator::validate() const {
+  if (size_ == 0) return nodes_.empty();
+
+  u_int64_t offset = 0, used = 0;
+  u_int32_t used_count = 0, free_count = 0;
+  u_int32_t prev = invalid_node;
+  for (u_int32_t i = 0; i != invalid_node; i = nodes_[i].next_phys) {
+    const auto& n = nodes_[i];
+    if (n.offset != offset || n.size == 0 || n.prev_phys != prev) return false;
+    if (n.used) {
+      used += n.size;
+      ++used_count;
+    } else {
+      ++free_count;
+      if (prev != invalid_node && !nodes_[prev].used) return false;
+    }
+    offset += n.size;
+    prev = i;
+  }
+  if (offset != size_ || used != used_bytes_ ||
+      used_count != allocation_count_) {
+    return false;
+  }
+
+  u_int32_t listed = 0;
+  for (u_int32_t fl = 0; fl < fl_count; ++fl) {
+    bool fl_set = fl_bitmap_ & (1ull << fl);
+    if (fl_set != (sl_bitmap_[fl] != 0)) return false;
+    for (u_int32_t sl = 0; sl < sl_count; ++sl) {
+      bool sl_set = sl_bitmap_[fl] & (1u << sl);
+      if (sl_set != (heads_[fl][sl] != invalid_node)) return false;
+      for (u_int32_t i = heads_[fl][sl]; i != invalid_node;
+           i = nodes_[i].next_free) {
+        u_int32_t node_fl, node_sl;
+        mapping(nodes_[i].size, node_fl, node_sl);
+        if (nodes_[i].used || node_fl != fl || node_sl != sl) return false;
+        ++listed;
+      }
+    }
+  }
+  return listed == free_count;
+}
+
+}  // namespace LLShader
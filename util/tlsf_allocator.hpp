@@ -0,0 +1,81 @@
+#ifndef TLSF_ALLOCATOR_HPP
+#define TLSF_ALLOCATOR_HPP
+
+#include <cstdlib>
+#include <vector>
+
+namespace LLShader {
+
+/// Two level segregated fit allocator over the offset range [0, size).
+/// only hands out offsets, the memory itself lives elsewhere (e.g. a
+/// VkDeviceMemory block). allocate and free are O(1): free ranges are kept
+/// in size class lists found by two bitmap scans, neighbours are merged on
+/// free so fragmentation stays low.
+class TlsfAllocator final {
+ public:
+  static constexpr u_int32_t invalid_node = ~0u;
+
+  explicit TlsfAllocator(u_int64_t size);
+
+  /// alignment must be a power of two. node identifies the range for free().
+  /// return false if no free range fits.
+  bool allocate(u_int64_t size, u_int64_t alignment, u_int64_t& offset,
+                u_int32_t& node);
+
+  void free(u_int32_t node);
+
+  inline u_int64_t getSize() const { return size_; }
+  inline u_int64_t getUsedBytes() const { return used_bytes_; }
+  inline u_int32_t getAllocationCount() const { return allocation_count_; }
+  inline bool isEmpty() const { return allocation_count_ == 0; }
+
+  /// walk all ranges and free lists, bench/gpu_allocator_stress runs it
+  /// after each step.
+  bool validate() const;
+
+ private:
+  // sizes below small_size share the first level, 16 byte classes.
+  static constexpr u_int32_t sl_log2 = 4;
+  static constexpr u_int32_t sl_count = 1 << sl_log2;
+  static constexpr u_int32_t small_log2 = 8;
+  static constexpr u_int64_t small_size = 1ull << small_log2;
+  static constexpr u_int32_t fl_count = 64 - small_log2 + 1;
+
+  typedef struct {
+    u_int64_t offset;
+    u_int64_t size;
+    // neighbours in address order.
+    u_int32_t prev_phys;
+    u_int32_t next_phys;
+    // links of the size class list, only for free ranges.
+    u_int32_t prev_free;
+    u_int32_t next_free;
+    bool used;
+  } Node;
+
+  static void mapping(u_int64_t size, u_int32_t& fl, u_int32_t& sl);
+
+  u_int32_t findFree(u_int64_t size) const;
+  u_int32_t newNode(u_int64_t offset, u_int64_t size);
+  void insertFree(u_int32_t node);
+  void removeFree(u_int32_t node);
+  // node becomes [offset, offset + size), the rest a free node after it.
+  void splitTail(u_int32_t node, u_int64_t size);
+  // absorb next_phys of node, which must be free.
+  void mergeNext(u_int32_t node);
+
+  u_int64_t size_;
+  u_int64_t used_bytes_{0};
+  u_int32_t allocation_count_{0};
+
+  std::vector<Node> nodes_;
+  std::vector<u_int32_t> recycled_nodes_;
+
+  u_int64_t fl_bitmap_{0};
+  u_int32_t sl_bitmap_[fl_count]{};
+  u_int32_t heads_[fl_count][sl_count];
+};
+
+}  // namespace LLShader
+
+#endif
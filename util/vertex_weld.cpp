@@ -0,0 +1,157 @@
+#include "vertex_weld.hpp"
+
+#include <cmath>
+
+namespace LLShader {
+
+namespace {
+
+constexpr u_int32_t empty_index = ~0u;
+
+// power of two, keep load factor <= 0.5.
+size_t tableCapacity(size_t count) {
+  size_t capacity = 16;
+  while (capacity < count * 2) capacity <<= 1;
+  return capacity;
+}
+
+inline u_int64_t hashCell(int32_t x, int32_t y, int32_t z) {
+  int32_t key[3] = {x, y, z};
+  return hashBytes(key, sizeof(key));
+}
+
+inline int32_t cellCoord(float v, float inv_cell_size) {
+  return static_cast<int32_t>(std::floor(v * inv_cell_size));
+}
+
+}  // namespace
+
+VertexWeldTable::VertexWeldTable(std::vector<VertexData>& vertices,
+                                 size_t expected_count, float epsilon)
+    : vertices_(vertices), epsilon_(epsilon) {
+  if (epsilon_ > 0.0f) {
+    // with cell size 2 * epsilon, the search box covers at most 2x2x2 cells.
+    inv_cell_size_ = 0.5f / epsilon_;
+    cells_.assign(tableCapacity(expected_count), {0, 0, 0, empty_index});
+    next_in_cell_.reserve(expected_count);
+  } else {
+    slots_.assign(tableCapacity(expected_count), {empty_index, 0});
+  }
+  vertices_.reserve(vertices_.size() + expected_count);
+}
+
+u_int32_t VertexWeldTable::insertOrGet(const VertexData& vertex) {
+  return epsilon_ > 0.0f ? insertNear(vertex) : insertExact(vertex);
+}
+
+u_int32_t VertexWeldTable::insertExact(const VertexData& vertex) {
+  if ((slot_count_ + 1) * 4 > slots_.size() * 3) growSlots();
+
+  u_int64_t hash = hashVertex(vertex);
+  u_int32_t tag = static_cast<u_int32_t>(hash >> 32);
+  size_t mask = slots_.size() - 1;
+  // single probe sequence, stop at match or first empty slot.
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    auto& slot = slots_[i];
+    if (slot.index == empty_index) {
+      slot.index = static_cast<u_int32_t>(vertices_.size());
+      slot.tag = tag;
+      ++slot_count_;
+      vertices_.push_back(vertex);
+      return slot.index;
+    }
+    if (slot.tag == tag && vertices_[slot.index] == vertex) return slot.index;
+  }
+}
+
+void VertexWeldTable::growSlots() {
+  std::vector<Slot> old;
+  old.swap(slots_);
+  slots_.assign(old.size() * 2, {empty_index, 0});
+  size_t mask = slots_.size() - 1;
+  for (const auto& slot : old) {
+    if (slot.index == empty_index) continue;
+    u_int64_t hash = hashVertex(vertices_[slot.index]);
+    size_t i = hash & mask;
+    while (slots_[i].index != empty_index) i = (i + 1) & mask;
+    slots_[i] = slot;
+  }
+}
+
+bool VertexWeldTable::isNear(const VertexData& a, const VertexData& b) const {
+  auto near = [this](float x, float y) {
+    return std::fabs(x - y) <= epsilon_;
+  };
+  for (int k = 0; k < 3; ++k) {
+    if (!near(a.position[k], b.position[k]) ||
+        !near(a.normal[k], b.normal[k])) {
+      return false;
+    }
+  }
+  return near(a.texcoords.x, b.texcoords.x) &&
+         near(a.texcoords.y, b.texcoords.y);
+}
+
+VertexWeldTable::Cell& VertexWeldTable::findCell(int32_t x, int32_t y,
+                                                 int32_t z) {
+  size_t mask = cells_.size() - 1;
+  for (size_t i = hashCell(x, y, z) & mask;; i = (i + 1) & mask) {
+    auto& cell = cells_[i];
+    if (cell.head == empty_index ||
+        (cell.x == x && cell.y == y && cell.z == z)) {
+      return cell;
+    }
+  }
+}
+
+u_int32_t VertexWeldTable::insertNear(const VertexData& vertex) {
+  if ((cell_count_ + 1) * 4 > cells_.size() * 3) growCells();
+
+  int32_t lo[3], hi[3];
+  for (int k = 0; k < 3; ++k) {
+    lo[k] = cellCoord(vertex.position[k] - epsilon_, inv_cell_size_);
+    hi[k] = cellCoord(vertex.position[k] + epsilon_, inv_cell_size_);
+  }
+
+  for (int32_t z = lo[2]; z <= hi[2]; ++z) {
+    for (int32_t y = lo[1]; y <= hi[1]; ++y) {
+      for (int32_t x = lo[0]; x <= hi[0]; ++x) {
+        const auto& cell = findCell(x, y, z);
+        for (u_int32_t i = cell.head; i != empty_index; i = next_in_cell_[i]) {
+          if (isNear(vertices_[i], vertex)) return i;
+        }
+      }
+    }
+  }
+
+  int32_t cx = cellCoord(vertex.position.x, inv_cell_size_);
+  int32_t cy = cellCoord(vertex.position.y, inv_cell_size_);
+  int32_t cz = cellCoord(vertex.position.z, inv_cell_size_);
+  auto index = static_cast<u_int32_t>(vertices_.size());
+  auto& cell = findCell(cx, cy, cz);
+  if (cell.head == empty_index) {
+    cell.x = cx;
+    cell.y = cy;
+    cell.z = cz;
+    ++cell_count_;
+  }
+  // next_in_cell_ is indexed by vertex index, pad for vertices that were in
+  // the array before this table.
+  next_in_cell_.resize(index + 1, empty_index);
+  next_in_cell_[index] = cell.head;
+  cell.head = index;
+  vertices_.push_back(vertex);
+  return index;
+}
+
+void VertexWeldTable::growCells() {
+  std::vector<Cell> old;
+  old.swap(cells_);
+  cells_.assign(old.size() * 2, {0, 0, 0, empty_index});
+  for (const auto& cell : old) {
+    if (cell.head == empty_index) continue;
+    findCell(cell.x, cell.y, cell.z) = cell;
+  }
+}
+
+}  // namespace LLShader
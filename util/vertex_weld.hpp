@@ -0,0 +1,64 @@
+#ifndef VERTEX_WELD_HPP
+#define VERTEX_WELD_HPP
+
+#include <vector>
+
+#include "demos/common/shader_type.hpp"
+
+namespace LLShader {
+
+/// Flat open addressing table used to dedup (weld) vertices while building
+/// index buffer. Slots keep the vertex index and the high hash bits, so most
+/// misses never touch the vertex array.
+///
+/// epsilon == 0: exact welding, vertices equal under VertexData::operator==.
+/// epsilon > 0: vertices whose position, normal and texcoords all differ less
+/// than epsilon per component are welded, candidates are found through a
+/// uniform grid on position. result depends on insertion order.
+class VertexWeldTable final {
+ public:
+  /// vertices: output vertex array, unique vertices are appended to it.
+  /// expected_count: upper bound of unique vertices, e.g. index count.
+  VertexWeldTable(std::vector<VertexData>& vertices, size_t expected_count,
+                  float epsilon = 0.0f);
+
+  VertexWeldTable(const VertexWeldTable&) = delete;
+
+  /// return index of the welded vertex, append it if not exist.
+  u_int32_t insertOrGet(const VertexData& vertex);
+
+ private:
+  typedef struct {
+    u_int32_t index;
+    u_int32_t tag;
+  } Slot;
+
+  typedef struct {
+    int32_t x, y, z;
+    u_int32_t head;
+  } Cell;
+
+  u_int32_t insertExact(const VertexData& vertex);
+  u_int32_t insertNear(const VertexData& vertex);
+
+  void growSlots();
+  void growCells();
+  Cell& findCell(int32_t x, int32_t y, int32_t z);
+  bool isNear(const VertexData& a, const VertexData& b) const;
+
+  std::vector<VertexData>& vertices_;
+
+  std::vector<Slot> slots_;
+  size_t slot_count_ = 0;
+
+  float epsilon_;
+  float inv_cell_size_ = 0.0f;
+  std::vector<Cell> cells_;
+  size_t cell_count_ = 0;
+  // next vertex in the same cell, linked list per cell.
+  std::vector<u_int32_t> next_in_cell_;
+};
+
+}  // namespace LLShader
+
+#endif